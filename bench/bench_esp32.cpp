@@ -0,0 +1,115 @@
+// ============================================================================
+// BENCHMARK EN EL EQUIPO (pio run -e esp32dev_bench -t upload)
+//
+// Reemplaza a main.cpp: monta la SD, pasa por bench_run() los primeros
+// BENCH_MAX_SAMPLES de cada session_*.bin de la raíz (o una señal sintética
+// si no hay archivos) e imprime el reporte por Serial. Corre en la tarea de
+// loop() sin la captura en paralelo: mide el costo propio de cada etapa.
+// ============================================================================
+
+#include <Arduino.h>
+#include <SD.h>
+#include <SPI.h>
+#include <esp_timer.h>
+#include "holter_config.h"
+#include "holter_bench.h"
+
+// Pines de la SD (los de holter_capture.cpp)
+#define SD_CS_PIN 5
+#define SD_MOSI 23
+#define SD_MISO 19
+#define SD_SCK 18
+
+// Muestras por archivo: 20000 x 6 bytes en el heap (80 s a 250 Hz)
+#ifndef BENCH_MAX_SAMPLES
+#define BENCH_MAX_SAMPLES 20000
+#endif
+
+static int16_t (*samples)[3] = nullptr;
+static uint8_t block[DATA_BLOCK_SIZE] __attribute__((aligned(4)));
+
+uint32_t bench_cycles() {
+  return ESP.getCycleCount();
+}
+
+uint64_t bench_nanos() {
+  return (uint64_t)esp_timer_get_time() * 1000;
+}
+
+static void printLine(const char* line) {
+  Serial.println(line);
+}
+
+// Decodifica hasta BENCH_MAX_SAMPLES muestras ECG de un archivo v7+
+static size_t loadRecording(File& file, uint16_t& sampleRate) {
+  FileHeader header;
+  if (file.read(block, FILE_HEADER_BLOCK_SIZE) != FILE_HEADER_BLOCK_SIZE) return 0;
+  memcpy(&header, block, sizeof(header));
+  if (header.magic != FILE_MAGIC || header.version < 7 || header.ecg_codec != ECG_CODEC_ID) {
+    Serial.printf("[WARNING] %s: se requiere formato v7+ con codec ECG\n", file.name());
+    return 0;
+  }
+  sampleRate = header.ecg_sample_rate;
+
+  size_t count = 0;
+  while (count + BENCH_MAX_BLOCK_SAMPLES <= BENCH_MAX_SAMPLES &&
+         file.read(block, DATA_BLOCK_SIZE) == DATA_BLOCK_SIZE) {
+    count += bench_decodeBlock(block, &samples[count][0], BENCH_MAX_BLOCK_SAMPLES);
+  }
+  return count;
+}
+
+static void runAndPrint(size_t count, uint16_t sampleRate) {
+  BenchReport report;
+  bench_run(&samples[0][0], count, sampleRate, report);
+  bench_print(report, printLine);
+  Serial.printf("[BENCH] CPU %lu MHz, heap libre %lu bytes\n",
+                (unsigned long)getCpuFrequencyMhz(), (unsigned long)ESP.getFreeHeap());
+}
+
+void setup() {
+  Serial.begin(115200);
+  delay(1000);
+  Serial.println("\n[INIT] Benchmark de captura/codec/filtros/QRS");
+
+  samples = (int16_t (*)[3])malloc(BENCH_MAX_SAMPLES * sizeof(*samples));
+  if (!samples) {
+    Serial.println("[ERROR] Sin memoria para las muestras");
+    return;
+  }
+
+  size_t files = 0;
+  SPI.begin(SD_SCK, SD_MISO, SD_MOSI, SD_CS_PIN);
+  if (SD.begin(SD_CS_PIN, SPI, 4000000)) {
+    File root = SD.open("/");
+    for (File file = root.openNextFile(); file; file = root.openNextFile()) {
+      const char* name = file.name();
+      size_t len = strlen(name);
+      if (!file.isDirectory() && strncmp(name, "session_", 8) == 0 && len > 4 &&
+          strcmp(name + len - 4, ".bin") == 0) {
+        uint16_t sampleRate = 0;
+        size_t count = loadRecording(file, sampleRate);
+        if (count > 0) {
+          Serial.printf("[BENCH] %s\n", name);
+          runAndPrint(count, sampleRate);
+          files++;
+        }
+      }
+      file.close();
+    }
+    root.close();
+  } else {
+    Serial.println("[WARNING] SD no disponible");
+  }
+
+  if (files == 0) {
+    Serial.println("[BENCH] Sin archivos: señal sintética");
+    bench_synthetic(&samples[0][0], BENCH_MAX_SAMPLES, HOLTER_ECG_SAMPLE_RATE_HZ);
+    runAndPrint(BENCH_MAX_SAMPLES, HOLTER_ECG_SAMPLE_RATE_HZ);
+  }
+  Serial.println("[BENCH] Fin");
+}
+
+void loop() {
+  delay(1000);
+}
@@ -0,0 +1,105 @@
+// ============================================================================
+// BENCHMARK EN EL HOST (pio run -e native)
+//
+// Uso: .pio/build/native/program [session_x.bin ...]
+// Cada archivo (formato v7+) se decodifica y se pasa por bench_run(); sin
+// argumentos se usan 10 minutos de señal sintética a 250 Hz. Termina con
+// código 1 si un archivo no se pudo leer o su decodificación no es sin pérdida.
+//
+// Los ciclos son del TSC (x86): frecuencia de referencia, no la del núcleo.
+// ============================================================================
+
+#include "holter_bench.h"
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+static const uint16_t SYNTHETIC_RATE_HZ = 250;
+static const size_t SYNTHETIC_SECONDS = 600;
+
+uint32_t bench_cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+  return (uint32_t)__rdtsc();
+#else
+  return 0;
+#endif
+}
+
+uint64_t bench_nanos() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void printLine(const char* line) {
+  printf("%s\n", line);
+}
+
+// Muestras ECG de un .bin; false si no es un archivo de bloques
+static bool loadRecording(const char* path, std::vector<int16_t>& samples, uint16_t& sampleRate) {
+  FILE* f = fopen(path, "rb");
+  if (!f) {
+    printf("[ERROR] No se pudo abrir %s\n", path);
+    return false;
+  }
+
+  uint8_t block[DATA_BLOCK_SIZE];
+  FileHeader header;
+  bool ok = fread(block, 1, FILE_HEADER_BLOCK_SIZE, f) == FILE_HEADER_BLOCK_SIZE;
+  memcpy(&header, block, sizeof(header));
+  if (!ok || header.magic != FILE_MAGIC || header.version < 7 || header.ecg_codec != ECG_CODEC_ID) {
+    printf("[ERROR] %s: se requiere formato v7+ con codec ECG\n", path);
+    fclose(f);
+    return false;
+  }
+  sampleRate = header.ecg_sample_rate;
+
+  samples.clear();
+  size_t badBlocks = 0;
+  std::vector<int16_t> frame(BENCH_MAX_BLOCK_SAMPLES * 3);
+  while (fread(block, 1, DATA_BLOCK_SIZE, f) == DATA_BLOCK_SIZE) {
+    const DataBlockHeader* blockHeader = (const DataBlockHeader*)block;
+    if (blockHeader->sync == DATA_BLOCK_SYNC && blockHeader->type != DATA_BLOCK_ECG) continue;
+    size_t n = bench_decodeBlock(block, frame.data(), BENCH_MAX_BLOCK_SAMPLES);
+    if (n == 0) {
+      badBlocks++;
+      continue;
+    }
+    samples.insert(samples.end(), frame.begin(), frame.begin() + n * 3);
+  }
+  fclose(f);
+
+  if (badBlocks) printf("[WARNING] %s: %zu bloques inválidos descartados\n", path, badBlocks);
+  return true;
+}
+
+int main(int argc, char** argv) {
+  bool ok = true;
+  BenchReport report;
+
+  if (argc < 2) {
+    std::vector<int16_t> samples(SYNTHETIC_RATE_HZ * SYNTHETIC_SECONDS * 3);
+    bench_synthetic(samples.data(), samples.size() / 3, SYNTHETIC_RATE_HZ);
+    printf("[BENCH] Señal sintética (%zu s)\n", SYNTHETIC_SECONDS);
+    bench_run(samples.data(), samples.size() / 3, SYNTHETIC_RATE_HZ, report);
+    bench_print(report, printLine);
+    return report.mismatches ? 1 : 0;
+  }
+
+  for (int i = 1; i < argc; i++) {
+    std::vector<int16_t> samples;
+    uint16_t sampleRate = 0;
+    if (!loadRecording(argv[i], samples, sampleRate)) {
+      ok = false;
+      continue;
+    }
+    printf("[BENCH] %s\n", argv[i]);
+    bench_run(samples.data(), samples.size() / 3, sampleRate, report);
+    bench_print(report, printLine);
+    if (report.mismatches) ok = false;
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,205 @@
+#include "holter_bench.h"
+#include "holter_config.h"
+#include "holter_crc.h"
+#include "ecg_filter.h"
+#include "holter_qrs.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+// ============================================================================
+// VARIABLES INTERNAS (PRIVADAS)
+// ============================================================================
+
+enum { STAGE_ENCODE, STAGE_DECODE, STAGE_FILTER, STAGE_QRS };
+static const char* const STAGE_NAMES[BENCH_NUM_STAGES] = {"encode+crc", "decode", "filter", "qrs"};
+
+static uint8_t dataBlock[DATA_BLOCK_SIZE] __attribute__((aligned(4)));
+static uint8_t* const dataBlockPayload = dataBlock + sizeof(DataBlockHeader);
+static int16_t decoded[BENCH_FRAME_SAMPLES][3];
+static int16_t filteredI[BENCH_FRAME_SAMPLES];
+static int16_t filteredII[BENCH_FRAME_SAMPLES];
+static QRSDetector qrsDetector;
+
+struct StageTimer {
+  uint32_t cycles;
+  uint64_t nanos;
+};
+
+// ============================================================================
+// FUNCIONES INTERNAS (PRIVADAS)
+// ============================================================================
+
+static inline void stageBegin(StageTimer& timer) {
+  timer.nanos = bench_nanos();
+  timer.cycles = bench_cycles();
+}
+
+static inline void stageEnd(BenchStage& stage, const StageTimer& timer, size_t samples) {
+  uint32_t cycles = bench_cycles() - timer.cycles;
+  uint32_t nanos = (uint32_t)(bench_nanos() - timer.nanos);
+
+  stage.samples += samples;
+  stage.calls++;
+  stage.cycles += cycles;
+  stage.nanos += nanos;
+  if (nanos > stage.maxNanos) stage.maxNanos = nanos;
+  if (cycles > stage.maxCycles) stage.maxCycles = cycles;
+}
+
+// Mismo armado que writeDataBlock() en la captura
+static void buildDataBlock(uint16_t type, size_t numSamples, uint32_t firstIndex,
+                           size_t payloadBytes) {
+  memset(dataBlockPayload + payloadBytes, 0, DATA_BLOCK_PAYLOAD - payloadBytes);
+
+  DataBlockHeader* header = (DataBlockHeader*)dataBlock;
+  header->sync = DATA_BLOCK_SYNC;
+  header->type = type;
+  header->num_samples = numSamples;
+  header->first_ecg_index = firstIndex;
+  header->payload_bytes = payloadBytes;
+  header->segment_tag = 0;
+  header->crc32 = 0;
+  header->crc32 = holter_crc32(0, dataBlock, DATA_BLOCK_SIZE);
+}
+
+// ============================================================================
+// IMPLEMENTACIÓN DE INTERFACE PÚBLICA
+// ============================================================================
+
+size_t bench_decodeBlock(const uint8_t* block, int16_t* samples, size_t maxSamples) {
+  DataBlockHeader header;
+  memcpy(&header, block, sizeof(header));
+  if (header.sync != DATA_BLOCK_SYNC || header.type != DATA_BLOCK_ECG ||
+      header.payload_bytes > DATA_BLOCK_PAYLOAD) {
+    return 0;
+  }
+
+  // CRC del bloque con el campo en 0
+  const size_t crcOffset = offsetof(DataBlockHeader, crc32);
+  static const uint8_t zeros[sizeof(header.crc32)] = {0};
+  uint32_t crc = holter_crc32(0, block, crcOffset);
+  crc = holter_crc32(crc, zeros, sizeof(zeros));
+  crc = holter_crc32(crc, block + crcOffset + sizeof(zeros),
+                     DATA_BLOCK_SIZE - crcOffset - sizeof(zeros));
+  if (crc != header.crc32) return 0;
+
+  size_t consumed = 0;
+  return ecg_codec_decodeFrame(block + sizeof(DataBlockHeader), header.payload_bytes,
+                               samples, maxSamples, &consumed);
+}
+
+void bench_run(const int16_t* samples, size_t count, uint16_t sampleRate, BenchReport& report) {
+  memset(&report, 0, sizeof(report));
+  report.sampleRate = sampleRate;
+  for (size_t i = 0; i < BENCH_NUM_STAGES; i++) {
+    report.stages[i].name = STAGE_NAMES[i];
+  }
+
+  ECGFilter filterI, filterII;
+  ecg_filter_init(filterI, sampleRate, HOLTER_ECG_HIGHPASS_HZ, HOLTER_ECG_LOWPASS_HZ,
+                  HOLTER_ECG_NOTCH_HZ);
+  ecg_filter_init(filterII, sampleRate, HOLTER_ECG_HIGHPASS_HZ, HOLTER_ECG_LOWPASS_HZ,
+                  HOLTER_ECG_NOTCH_HZ);
+  qrs_init(qrsDetector, sampleRate);
+
+  size_t pos = 0;
+  while (pos < count) {
+    const int16_t* in = samples + pos * 3;
+    size_t n = count - pos;
+    if (n > BENCH_FRAME_SAMPLES) n = BENCH_FRAME_SAMPLES;
+    StageTimer timer;
+
+    // Codec + bloque de 512 bytes (writeBlock() + writeDataBlock())
+    stageBegin(timer);
+    size_t bytes = ecg_codec_encodeFrameLimited(in, n, dataBlockPayload, DATA_BLOCK_PAYLOAD, &n);
+    buildDataBlock(DATA_BLOCK_ECG, n, pos, bytes);
+    stageEnd(report.stages[STAGE_ENCODE], timer, n);
+    report.blocks++;
+    report.encodedBytes += bytes;
+
+    // Decodificación del bloque (lo que hace el lector) y verificación sin pérdida
+    stageBegin(timer);
+    size_t got = bench_decodeBlock(dataBlock, &decoded[0][0], BENCH_FRAME_SAMPLES);
+    stageEnd(report.stages[STAGE_DECODE], timer, got);
+    if (got != n) {
+      report.mismatches += n;
+    } else {
+      for (size_t i = 0; i < n; i++) {
+        if (decoded[i][0] != in[i * 3] || decoded[i][1] != in[i * 3 + 1]) report.mismatches++;
+      }
+    }
+
+    // Filtros del equipo (HOLTER_ECG_FILTER) sobre I y II
+    stageBegin(timer);
+    for (size_t i = 0; i < n; i++) {
+      filteredI[i] = ecg_filter_process(filterI, in[i * 3]);
+      filteredII[i] = ecg_filter_process(filterII, in[i * 3 + 1]);
+    }
+    stageEnd(report.stages[STAGE_FILTER], timer, n);
+
+    // Detector QRS sobre la derivación II filtrada
+    stageBegin(timer);
+    QRSBeat beat;
+    for (size_t i = 0; i < n; i++) {
+      if (qrs_process(qrsDetector, filteredII[i], beat)) report.beats++;
+    }
+    stageEnd(report.stages[STAGE_QRS], timer, n);
+
+    pos += n;
+  }
+  report.samples = pos;
+}
+
+void bench_print(const BenchReport& report, void (*print)(const char* line)) {
+  char line[128];
+  double seconds = report.sampleRate ? (double)report.samples / report.sampleRate : 0;
+  double perSample = report.samples ? 1.0 / report.samples : 0;
+
+  snprintf(line, sizeof(line), "[BENCH] %llu muestras @ %u Hz (%.1f s), %lu bloques",
+           (unsigned long long)report.samples, report.sampleRate, seconds,
+           (unsigned long)report.blocks);
+  print(line);
+  snprintf(line, sizeof(line), "[BENCH] Codec: %.2f bytes/muestra, SD: %.2f bytes/muestra",
+           report.encodedBytes * perSample, (double)report.blocks * DATA_BLOCK_SIZE * perSample);
+  print(line);
+  snprintf(line, sizeof(line), "[BENCH] Sin pérdida: %s (%lu muestras distintas), %lu latidos",
+           report.mismatches ? "ERROR" : "OK", (unsigned long)report.mismatches,
+           (unsigned long)report.beats);
+  print(line);
+  print("[BENCH] etapa        muestras/s  x tiempo real  ciclos/muestra  max bloque (us)");
+
+  for (size_t i = 0; i < BENCH_NUM_STAGES; i++) {
+    const BenchStage& s = report.stages[i];
+    double rate = s.nanos ? s.samples * 1e9 / s.nanos : 0;
+    double realtime = report.sampleRate ? rate / report.sampleRate : 0;
+    double cycles = s.samples ? (double)s.cycles / s.samples : 0;
+    snprintf(line, sizeof(line), "[BENCH] %-11s %11.0f %14.1f %15.1f %16.1f",
+             s.name, rate, realtime, cycles, s.maxNanos / 1000.0);
+    print(line);
+  }
+}
+
+void bench_synthetic(int16_t* samples, size_t count, uint16_t sampleRate) {
+  // Escala del formato ECG_FORMAT_SCALED_MV (mV * 6553.6)
+  const double scale = 6553.6;
+  const double beatPeriod = 60.0 / 72.0;
+  uint32_t noise = 12345;
+
+  for (size_t n = 0; n < count; n++) {
+    double t = (double)n / sampleRate;
+    double phase = fmod(t, beatPeriod);
+    double qrs = 1.2 * exp(-pow((phase - 0.2) / 0.012, 2));
+    double twave = 0.3 * exp(-pow((phase - 0.45) / 0.04, 2));
+    double drift = 0.2 * sin(2 * M_PI * 0.3 * t);
+    noise = noise * 1103515245u + 12345u;
+    double hf = ((int32_t)(noise >> 16 & 0xFF) - 128) / 128.0 * 0.02;
+
+    double leadII = qrs + twave + drift + hf;
+    double leadI = 0.6 * (qrs + twave) + 0.5 * drift + hf;
+    samples[n * 3] = (int16_t)lround(leadI * scale);
+    samples[n * 3 + 1] = (int16_t)lround(leadII * scale);
+    // Como la captura: la III en enteros, igual a la que reconstruye el decodificador
+    samples[n * 3 + 2] = (int16_t)(samples[n * 3 + 1] - samples[n * 3]);
+  }
+}
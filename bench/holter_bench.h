@@ -0,0 +1,86 @@
+#ifndef HOLTER_BENCH_H
+#define HOLTER_BENCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "holter_format.h"
+#include "ecg_codec.h"
+
+// ============================================================================
+// BENCHMARK DE LOS CAMINOS CRÍTICOS (host y equipo)
+//
+// Reproduce una grabación (muestras ECG decodificadas de un .bin) por los
+// mismos módulos que usa la captura, bloque a bloque como writeBlock():
+//
+//   codec + bloque de 512 bytes con CRC -> decodificación (verifica que sea
+//   sin pérdida) -> filtros biquad de I y II -> detector QRS sobre II
+//
+// Cada etapa se mide por bloque (un frame, ~50-150 muestras): muestras/s,
+// ciclos/muestra y latencia máxima de un bloque. Las funciones de reloj las
+// provee cada plataforma (bench_native.cpp, bench_esp32.cpp).
+//
+// No depende de Arduino: se compila también en el entorno nativo.
+// ============================================================================
+
+static const size_t BENCH_NUM_STAGES = 4;
+// Muestras por frame al codificar (como un buffer de adquisición)
+static const size_t BENCH_FRAME_SAMPLES = 512;
+// Muestras máximas de un bloque ECG leído: al menos 1 bit por residuo (k = 0)
+static const size_t BENCH_MAX_BLOCK_SAMPLES =
+    (DATA_BLOCK_PAYLOAD - ECG_CODEC_FRAME_HEADER_SIZE) * 8 / ECG_CODEC_CHANNELS;
+
+struct BenchStage {
+  const char* name;
+  uint64_t samples;
+  uint64_t calls;
+  uint64_t cycles;
+  uint64_t nanos;
+  uint32_t maxNanos;           // Peor bloque
+  uint32_t maxCycles;
+};
+
+struct BenchReport {
+  uint16_t sampleRate;
+  uint64_t samples;
+  uint32_t blocks;
+  uint64_t encodedBytes;       // Payload de los frames (sin header de bloque ni relleno)
+  uint32_t mismatches;         // Muestras que no coinciden tras decodificar
+  uint32_t beats;
+  BenchStage stages[BENCH_NUM_STAGES];
+};
+
+// Reloj de la plataforma: contador de ciclos (puede desbordar en 32 bits,
+// solo se usan diferencias; 0 si no hay) y nanosegundos monotónicos
+uint32_t bench_cycles();
+uint64_t bench_nanos();
+
+/**
+ * Decodifica un bloque de datos de un .bin (v7+)
+ * @param block Bloque de DATA_BLOCK_SIZE bytes
+ * @param samples Salida como int16_t[maxSamples][3]
+ * @return Muestras ECG decodificadas; 0 si no es un bloque ECG, su sync o
+ *         CRC no coinciden, o no cabe en maxSamples
+ */
+size_t bench_decodeBlock(const uint8_t* block, int16_t* samples, size_t maxSamples);
+
+/**
+ * Pasa la grabación por todas las etapas
+ * @param samples Muestras como int16_t[count][3] (layout de ECGSample)
+ * @param count Número de muestras
+ * @param sampleRate Frecuencia de la grabación (del header)
+ */
+void bench_run(const int16_t* samples, size_t count, uint16_t sampleRate, BenchReport& report);
+
+/**
+ * Imprime el reporte línea por línea
+ * @param print Salida de la plataforma (printf / Serial)
+ */
+void bench_print(const BenchReport& report, void (*print)(const char* line));
+
+/**
+ * Señal sintética (latidos a 72 lpm sobre deriva de línea base) para
+ * correr el benchmark sin archivos
+ */
+void bench_synthetic(int16_t* samples, size_t count, uint16_t sampleRate);
+
+#endif // HOLTER_BENCH_H
@@ -18,6 +18,8 @@
 // Topics MQTT
 #define TOPIC_REQUEST "holter/upload-request"
 #define TOPIC_RESPONSE "holter/upload-url/esp32-holter-001"
+#define TOPIC_LIVE "holter/live/esp32-holter-001"
+#define TOPIC_STATS "holter/stats/esp32-holter-001"
 
 // ============================================================================
 // CERTIFICADO ROOT CA (Amazon Root CA 1)
@@ -11,7 +11,7 @@
 // ============================================================================
 
 enum DisplayMode {
-  DISP_IDLE,              // Pantalla normal: ECG en vivo, batería, hora
+  DISP_IDLE,              // Pantalla normal: forma de onda ECG, FC, batería, hora
   DISP_CONFIRM_CAPTURE,   // Confirmación: "Grabar 15s?"
   DISP_CAPTURING,         // Mostrando progreso de captura
   DISP_CONFIRM_UPLOAD,    // Confirmación: "Subir a AWS?"
@@ -34,14 +34,14 @@ struct BatteryInfo {
 // ============================================================================
 
 /**
- * Inicializa el módulo de display (OLED, botones, pines)
- * Debe ser llamado en setup()
+ * Inicializa el módulo de display (OLED, botones, pines) y lanza su tarea
+ * de baja prioridad en core 0. Debe ser llamado en setup()
  */
 void display_init(XSpaceBioV10Board* bioBoard);
 
 /**
- * Actualiza la pantalla según el modo actual
- * Debe ser llamado periódicamente en loop()
+ * Actualiza la pantalla según el modo actual y envía solo las páginas
+ * modificadas. La llama la tarea del display cada HOLTER_DISPLAY_FRAME_MS
  */
 void display_update();
 
@@ -72,13 +72,13 @@ void display_setProgress(float progress);
  * @param message Texto a mostrar
  * @param duration_ms Duración en milisegundos (0 = indefinido)
  */
-void display_showMessage(String message, unsigned long duration_ms = 2000);
+void display_showMessage(const char* message, unsigned long duration_ms = 2000);
 
 /**
  * Muestra un mensaje de error
  * @param error Texto del error
  */
-void display_showError(String error);
+void display_showError(const char* error);
 
 /**
  * Limpia la pantalla
@@ -91,23 +91,13 @@ void display_clear();
 void display_forceUpdate();
 
 /**
- * Obtiene la información actual de la batería
+ * Obtiene la información de la batería (última lectura, 1 Hz)
  */
 BatteryInfo display_getBattery();
 
 /**
- * Dibuja el icono de batería en la posición especificada
+ * Establece el texto adicional de la pantalla idle (hasta 17 caracteres)
  */
-void display_drawBatteryIcon(int x, int y, int percentage);
-
-/**
- * Establece el valor de ECG a mostrar en pantalla idle
- */
-void display_setECGValue(float derivation_I, float derivation_II, float derivation_III);
-
-/**
- * Establece el texto adicional a mostrar en la pantalla
- */
-void display_setText(String text);
+void display_setText(const char* text);
 
 #endif // DISPLAY_UI_H
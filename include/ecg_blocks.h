@@ -0,0 +1,59 @@
+#ifndef ECG_BLOCKS_H
+#define ECG_BLOCKS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include "holter_format.h"
+
+// ============================================================================
+// BLOQUES ECG PING-PONG (adquisición -> almacenamiento)
+//
+// La adquisición llena un bloque mientras el almacenamiento escribe el
+// otro. Cada bloque guarda el índice ECG de su primera muestra: si la SD
+// se atrasa y hay que descartar muestras, el bloque siguiente empieza en
+// el índice real y el salto queda como un hueco explícito. Así el índice
+// de cada muestra escrita es el mismo que usan IMU, picos R y eventos.
+//
+// Un productor (ecg_blocks_append) y un consumidor (ecg_blocks_release);
+// length[] publica cada bloque con release/acquire.
+//
+// No depende de Arduino: se compila también en el entorno nativo.
+// ============================================================================
+
+static const size_t ECG_BLOCK_SAMPLES = 1024;   // ~4 s a 250 Hz
+
+struct ECGBlocks {
+  ECGSample samples[2][ECG_BLOCK_SAMPLES] __attribute__((aligned(4)));
+  uint32_t firstIndex[2];             // Índice ECG de samples[b][0]
+  std::atomic<size_t> length[2];      // 0 = libre; >0 = lleno, pendiente de escribir
+  int active;                         // Solo lo usa el productor
+  size_t activeCount;                 // Muestras en el bloque activo
+  std::atomic<unsigned long> dropped; // Muestras descartadas (huecos)
+};
+
+/**
+ * Vacía los dos bloques y el contador de descartes
+ */
+void ecg_blocks_reset(ECGBlocks& blocks);
+
+/**
+ * Agrega la muestra de índice ECG index al bloque activo (productor)
+ * @return Bloque (0/1) que quedó listo para escribir, o -1. Si el bloque
+ *         activo está lleno y el otro no se liberó, la muestra se descarta
+ */
+int ecg_blocks_append(ECGBlocks& blocks, const ECGSample& sample, uint32_t index);
+
+/**
+ * Entrega el bloque activo aunque esté incompleto. Solo con el productor
+ * detenido y el otro bloque ya liberado
+ * @return Bloque entregado, o -1 si estaba vacío
+ */
+int ecg_blocks_flush(ECGBlocks& blocks);
+
+/**
+ * Libera un bloque ya escrito para que el productor lo vuelva a llenar
+ */
+void ecg_blocks_release(ECGBlocks& blocks, int block);
+
+#endif // ECG_BLOCKS_H
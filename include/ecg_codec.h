@@ -0,0 +1,74 @@
+#ifndef ECG_CODEC_H
+#define ECG_CODEC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// ============================================================================
+// CODEC ECG SIN PÉRDIDA (formato v4)
+//
+// Cada frame codifica un bloque de muestras de las derivaciones I y II
+// (la III se reconstruye como II - I al decodificar):
+//
+//   uint16_t num_samples
+//   uint16_t payload_bytes
+//   payload: por muestra, residuo de I y luego residuo de II
+//
+// El residuo es la diferencia contra una predicción de segundo orden
+// (2·x[n-1] - x[n-2]) en aritmética módulo 2^16, mapeado a sin signo
+// (zigzag) y codificado Rice con k adaptativo por derivación. Un cociente
+// >= ECG_CODEC_QMAX se escapa con el valor crudo de 16 bits. El estado del
+// predictor y de k se reinicia en cada frame: un frame se decodifica solo.
+//
+// No depende de Arduino: se compila también en el entorno nativo.
+// ============================================================================
+
+static const uint16_t ECG_CODEC_ID = 1;          // 0 = muestras crudas int16 x3
+static const uint16_t ECG_CODEC_CHANNELS = 2;    // I y II
+static const size_t ECG_CODEC_FRAME_HEADER_SIZE = 4;
+static const uint32_t ECG_CODEC_QMAX = 24;
+static const size_t ECG_CODEC_MAX_FRAME_SAMPLES = 4096;   // payload_bytes cabe en 16 bits
+
+// Peor caso de una muestra codificada: todos los residuos escapados
+static const size_t ECG_CODEC_MAX_SAMPLE_BITS = ECG_CODEC_CHANNELS * (ECG_CODEC_QMAX + 16);
+
+// Tamaño máximo de un frame de `count` muestras (todos los residuos escapados)
+static constexpr size_t ecg_codec_maxFrameSize(size_t count) {
+  return ECG_CODEC_FRAME_HEADER_SIZE + (count * ECG_CODEC_MAX_SAMPLE_BITS + 7) / 8;
+}
+
+/**
+ * Codifica un frame
+ * @param samples Muestras como int16_t[count][3] (layout de ECGSample)
+ * @param count Número de muestras (máximo ECG_CODEC_MAX_FRAME_SAMPLES)
+ * @param out Buffer de salida de al menos ecg_codec_maxFrameSize(count) bytes
+ * @return Bytes escritos en out (header incluido)
+ */
+size_t ecg_codec_encodeFrame(const int16_t* samples, size_t count, uint8_t* out);
+
+/**
+ * Codifica un frame de hasta `count` muestras que no exceda maxBytes: se
+ * detiene antes de la primera muestra que, en el peor caso, no cabría
+ * @param samples Muestras como int16_t[count][3] (layout de ECGSample)
+ * @param count Muestras disponibles
+ * @param out Buffer de salida de al menos maxBytes bytes
+ * @param maxBytes Tamaño máximo del frame (header incluido)
+ * @param encoded Recibe las muestras codificadas
+ * @return Bytes escritos en out (header incluido)
+ */
+size_t ecg_codec_encodeFrameLimited(const int16_t* samples, size_t count, uint8_t* out,
+                                    size_t maxBytes, size_t* encoded);
+
+/**
+ * Decodifica un frame generado por ecg_codec_encodeFrame
+ * @param in Datos del frame
+ * @param inLen Bytes disponibles en in
+ * @param samples Salida como int16_t[maxSamples][3]; la III = II - I
+ * @param maxSamples Capacidad de samples
+ * @param consumed Recibe los bytes del frame (header incluido)
+ * @return Muestras decodificadas, 0 si el frame está truncado o es inválido
+ */
+size_t ecg_codec_decodeFrame(const uint8_t* in, size_t inLen, int16_t* samples,
+                             size_t maxSamples, size_t* consumed);
+
+#endif // ECG_CODEC_H
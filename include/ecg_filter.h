@@ -0,0 +1,63 @@
+#ifndef ECG_FILTER_H
+#define ECG_FILTER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// ============================================================================
+// FILTROS ECG EN PUNTO FIJO (cascada de biquads)
+//
+// Pasaaltos Butterworth (deriva de línea base) + pasabajos Butterworth +
+// notch de red, aplicados muestra a muestra. Cada etapa es un biquad en
+// forma directa I con coeficientes Q30 y acumulador de 64 bits; el resto
+// del redondeo se realimenta a la muestra siguiente, así el pasaaltos de
+// 0.5 Hz no deja offset ni ciclos límite.
+//
+// Los coeficientes se calculan una vez en ecg_filter_init() (float); por
+// muestra solo hay aritmética entera. Memoria constante: 9 palabras por etapa.
+//
+// No depende de Arduino: se compila también en el entorno nativo.
+// ============================================================================
+
+static const size_t ECG_FILTER_MAX_STAGES = 3;
+
+// FileHeader.ecg_filter (máscara)
+static const uint16_t ECG_FILTER_NONE = 0;
+static const uint16_t ECG_FILTER_HIGHPASS = 1 << 0;
+static const uint16_t ECG_FILTER_LOWPASS = 1 << 1;
+static const uint16_t ECG_FILTER_NOTCH = 1 << 2;
+
+struct Biquad {
+  int32_t b0, b1, b2, a1, a2;          // Q30, a0 normalizado a 1
+  int32_t x1, x2, y1, y2;
+  int64_t err;                         // Resto del redondeo (Q30)
+};
+
+struct ECGFilter {
+  Biquad stages[ECG_FILTER_MAX_STAGES];
+  uint8_t numStages;
+  uint16_t mask;                       // ECG_FILTER_*
+  bool primed;
+};
+
+/**
+ * Calcula la cascada para una frecuencia de muestreo
+ * @param highpassHz Corte del pasaaltos (0 = sin etapa)
+ * @param lowpassHz Corte del pasabajos (0 o >= Nyquist = sin etapa)
+ * @param notchHz Frecuencia de red a eliminar (0 o >= Nyquist = sin etapa)
+ */
+void ecg_filter_init(ECGFilter& filter, uint16_t sampleRate, float highpassHz,
+                     float lowpassHz, float notchHz);
+
+/**
+ * Reinicia el estado; la primera muestra siguiente carga los filtros en
+ * régimen (sin transitorio por el offset DC de las cuentas crudas)
+ */
+void ecg_filter_reset(ECGFilter& filter);
+
+/**
+ * Filtra una muestra (saturada a int16)
+ */
+int16_t ecg_filter_process(ECGFilter& filter, int16_t sample);
+
+#endif // ECG_FILTER_H
@@ -3,61 +3,93 @@
 
 #include <Arduino.h>
 #include <XSpaceBioV10.h>
-#include <XSpaceV21.h>
-#include <SD.h>
+#include "holter_qrs.h"
+#include "holter_format.h"
 
 // ============================================================================
 // ESTRUCTURAS DE DATOS
 // ============================================================================
 
-struct FileHeader {
-  uint32_t magic;              // 0x45434744 = "ECGD"
-  uint16_t version;
-  uint16_t device_id;
-  uint32_t session_id;
-  uint32_t timestamp_start;
-  uint16_t ecg_sample_rate;
-  uint16_t imu_sample_rate;
-  uint32_t num_ecg_samples;
-  uint32_t num_imu_samples;
-} __attribute__((packed));
-
-struct ECGSample {
-  int16_t derivation_I;
-  int16_t derivation_II;
-  int16_t derivation_III;
-} __attribute__((packed));
-
-struct IMUSample {
-  int16_t accel_x;
-  int16_t accel_y;
-  int16_t accel_z;
-} __attribute__((packed));
+// Frecuencia cardíaca actual (holter_getHeartRate)
+struct HeartRateInfo {
+  uint16_t bpm;                // 0 = sin latidos en los últimos 3 s
+  uint16_t last_rr_ms;
+  uint16_t mean_rr_ms;         // Promedio de los últimos QRS_RR_HISTORY RR
+  uint16_t num_rr;             // RR válidos en rr_ms
+  uint16_t rr_ms[QRS_RR_HISTORY];   // Últimos RR, el más reciente al final
+  uint32_t beat_count;
+  uint32_t last_peak_index;    // Índice ECG global del último pico R
+};
+
+// Consumo de la grabación en curso (o la última), medido desde su inicio.
+// Las ocupaciones están en por mil del tiempo transcurrido
+struct PowerStats {
+  uint32_t window_ms;          // Tiempo medido
+  uint16_t cpu_freq_mhz;       // Frecuencia actual de la CPU
+  bool low_power;              // HOLTER_LOW_POWER activo
+  bool light_sleep;            // Light sleep automático configurado (fuera de la captura)
+  uint16_t acquisition_duty;   // Core 1: adquisición, filtros, QRS
+  uint16_t storage_duty;       // Core 0: compresión y armado de bloques
+  uint16_t sd_duty;            // SD escribiendo
+  uint32_t sd_bursts;          // Escrituras en la SD
+  uint32_t sd_burst_bytes;     // Promedio por escritura
+  uint16_t estimated_ma;       // Estimación con HOLTER_POWER_* (sin WiFi)
+};
+
+// Estadísticas de tiempo real (holter_getStats): las de la captura, que
+// también van al final de cada segmento, y el throughput de los uploads
+struct HolterStats {
+  CaptureStats capture;
+  uint32_t upload_bytes;       // Enviados a S3 desde el arranque
+  uint32_t upload_ms;          // Tiempo enviando (sin esperas de URL ni respuesta)
+  uint32_t upload_bytes_per_s; // De la última transferencia completa
+};
+
+// Columna de la forma de onda para el display: mínimo y máximo de la
+// derivación II en 1 / HOLTER_DISPLAY_WAVE_HZ s (conserva el pico R)
+struct WaveformPoint {
+  int16_t min;
+  int16_t max;
+};
+
+// Calibración de las muestras: los mismos campos v5 del header
+struct SampleCalibration {
+  uint32_t adc_coeff_a;
+  uint16_t adc_coeff_b;
+  uint16_t ecg_gain;
+  uint16_t ecg_offset_mv;
+  uint16_t sample_format;      // ECG_FORMAT_*
+  uint16_t ecg_filter;         // ECG_FILTER_*: con pasaaltos no hay offset DC
+};
 
 // ============================================================================
 // INTERFACE PÚBLICA
 // ============================================================================
 
 /**
- * Inicializa el módulo de captura (SD Card, IMU)
+ * Inicializa el módulo de captura (SD Card, IMU) y crea las tareas de
+ * adquisición y almacenamiento. El acelerómetro se maneja directo por
+ * I2C (holter_imu.h), sin la biblioteca XSpaceV21
  * Debe ser llamado en setup()
  */
-void holter_init(XSpaceBioV10Board* bioBoard, XSpaceV21Board* v21Board);
+void holter_init(XSpaceBioV10Board* bioBoard);
 
 /**
- * Inicia una sesión de captura de ECG + IMU
- * Crea archivo en SD y comienza a grabar
+ * Inicia una grabación continua de ECG + IMU
+ * Crea el primer segmento en SD y comienza a grabar. Cada
+ * HOLTER_SEGMENT_DURATION_SEC se cierra el segmento y se abre el siguiente
+ * sin interrumpir el muestreo, hasta HOLTER_RECORDING_DURATION_SEC.
  */
 bool holter_startCapture();
 
 /**
- * Loop de captura - debe ser llamado continuamente durante la captura
- * Maneja el muestreo de ECG (250Hz) e IMU (25Hz)
- */
-void holter_captureLoop();
-
-/**
- * Detiene la captura actual, cierra el archivo y actualiza header
+ * Detiene la captura actual. El cierre del archivo y la actualización del
+ * header los realiza la tarea de almacenamiento; holter_isCapturing()
+ * retorna false cuando terminó.
+ *
+ * El muestreo ECG (250Hz) corre en su propia tarea (core 1) disparada por un
+ * timer de hardware y la escritura en SD en otra (core 0); no hace falta
+ * llamar a ninguna función de captura desde loop().
  */
 void holter_stopCapture();
 
@@ -79,12 +111,27 @@ float holter_getProgress();
 unsigned long holter_getElapsedSeconds();
 
 /**
- * Obtiene el nombre del archivo actual
+ * Obtiene el nombre del segmento que se está escribiendo ("" si ninguno).
+ * Se publica antes de crear el archivo: un session_*.bin que no sea este
+ * ya está cerrado
+ * @param filename Buffer de HOLTER_MAX_FILENAME_LEN bytes
+ */
+void holter_getCurrentFile(char* filename);
+
+/**
+ * Obtiene el siguiente segmento cerrado y listo para subir
+ * @param filename Buffer de HOLTER_MAX_FILENAME_LEN bytes, recibe el nombre
+ * @return false si no hay segmentos pendientes
  */
-String holter_getCurrentFile();
+bool holter_getCompletedSegment(char* filename);
 
 /**
- * Obtiene el número de muestras ECG capturadas
+ * Obtiene el número del segmento actual (0 = primero)
+ */
+uint32_t holter_getSegmentSeq();
+
+/**
+ * Obtiene el número de muestras ECG escritas en toda la grabación
  */
 unsigned long holter_getECGSampleCount();
 
@@ -103,5 +150,87 @@ bool holter_isSDAvailable();
  */
 bool holter_isIMUAvailable();
 
+/**
+ * Lectura cruda (12 bits) del pin de batería durante la captura. Con
+ * HOLTER_ECG_ADC_DMA el ADC1 está en modo continuo y la batería es un
+ * canal más del patrón; analogRead() no se puede usar
+ * @return false sin captura en curso, sin lectura todavía o sin DMA
+ */
+bool holter_getBatteryRaw(uint16_t& raw);
+
+/**
+ * Obtiene la frecuencia cardíaca del detector QRS en el equipo
+ * @return false si no hay frecuencia válida (sin latidos recientes o
+ *         HOLTER_QRS_DETECT desactivado)
+ */
+bool holter_getHeartRate(HeartRateInfo& info);
+
+/**
+ * Dispara un evento (HOLTER_EVENT_MODE): se guardan en SD los
+ * HOLTER_EVENT_PRE_SEC s previos y los HOLTER_EVENT_POST_SEC siguientes.
+ * Un disparo durante un evento lo extiende. Se puede llamar desde cualquier tarea
+ */
+void holter_triggerEvent(EventSource source);
+
+/**
+ * Verifica si se está grabando un evento en SD
+ */
+bool holter_isEventRecording();
+
+/**
+ * Activa o desactiva la copia de cada muestra ECG para streaming en vivo
+ */
+void holter_setLiveTap(bool enabled);
+
+/**
+ * Lee muestras copiadas para streaming en vivo (sin bloquear). Si la
+ * copia se desbordó, la lectura se corta en el hueco
+ * @param samples Salida
+ * @param maxSamples Capacidad de samples
+ * @param firstIndex Recibe el índice global de la primera muestra
+ * @return Muestras consecutivas leídas (0 si no hay)
+ */
+size_t holter_readLiveSamples(ECGSample* samples, size_t maxSamples, uint32_t* firstIndex);
+
+/**
+ * Obtiene las estadísticas de consumo y ocupación de la grabación
+ */
+void holter_getPowerStats(PowerStats& stats);
+
+/**
+ * Obtiene las estadísticas de tiempo real de la grabación en curso (o la
+ * última): jitter del muestreo, latencia de la SD, ocupación y descartes
+ */
+void holter_getStats(HolterStats& stats);
+
+/**
+ * Registra una transferencia a S3 en las estadísticas (tarea de red)
+ * @param bytes Bytes enviados
+ * @param ms Duración del envío
+ */
+void holter_recordUpload(uint32_t bytes, uint32_t ms);
+
+/**
+ * Activa o desactiva la forma de onda decimada para el display
+ */
+void holter_setWaveformTap(bool enabled);
+
+/**
+ * Lee columnas de la forma de onda (sin bloquear). Si el display se
+ * atrasa, se descartan las nuevas
+ * @return Columnas leídas (0 si no hay)
+ */
+size_t holter_readWaveform(WaveformPoint* points, size_t maxPoints);
+
+/**
+ * Obtiene la calibración de las muestras de la grabación
+ */
+void holter_getCalibration(SampleCalibration& calibration);
+
+/**
+ * Obtiene el timestamp Unix de inicio de la grabación (session_id)
+ */
+uint32_t holter_getSessionTimestamp();
+
 #endif
 
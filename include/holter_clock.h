@@ -0,0 +1,44 @@
+#ifndef HOLTER_CLOCK_H
+#define HOLTER_CLOCK_H
+
+#include <Arduino.h>
+
+// ============================================================================
+// RELOJ DE PARED E IDENTIFICADORES DE SESIÓN
+//
+// La hora del sistema (RTC del ESP32) sigue corriendo en un reinicio por
+// software, watchdog o panic; solo un corte de energía la pierde. NTP se
+// consulta cuando el reloj no tiene hora o la última sincronización tiene
+// más de HOLTER_NTP_RESYNC_HOURS, no en cada arranque.
+// ============================================================================
+
+/**
+ * Configura la zona horaria y recupera el estado del reloj y la última
+ * sesión (NVS). Llamar en setup() antes de holter_init()
+ */
+void holter_clockInit();
+
+/**
+ * Verifica si time() es hora Unix real (NTP desde el último corte de energía)
+ */
+bool holter_clockIsSet();
+
+/**
+ * Verifica si hay que consultar NTP: reloj sin hora o sincronización vencida
+ */
+bool holter_clockNeedsSync();
+
+/**
+ * Arranca SNTP en segundo plano; al llegar la respuesta se registra la
+ * sincronización. Requiere WiFi conectado
+ */
+void holter_clockStartSync();
+
+/**
+ * Reserva el identificador de una grabación nueva: la hora Unix actual o,
+ * si no es mayor, la última sesión + 1 (persistida en NVS). Nunca se
+ * repite entre arranques aunque el reloj no tenga hora
+ */
+uint32_t holter_clockNewSession();
+
+#endif // HOLTER_CLOCK_H
@@ -0,0 +1,289 @@
+#ifndef HOLTER_CONFIG_H
+#define HOLTER_CONFIG_H
+
+// ============================================================================
+// CONFIGURACIÓN DE COMPILACIÓN
+// Cada valor puede sobreescribirse desde platformio.ini con build_flags,
+// por ejemplo: -DHOLTER_SEGMENT_DURATION_SEC=600
+// ============================================================================
+
+// Duración total de la grabación en segundos (0 = hasta holter_stopCapture())
+#ifndef HOLTER_RECORDING_DURATION_SEC
+#define HOLTER_RECORDING_DURATION_SEC (24UL * 3600UL)
+#endif
+
+// Duración de cada archivo de segmento en segundos
+#ifndef HOLTER_SEGMENT_DURATION_SEC
+#define HOLTER_SEGMENT_DURATION_SEC 300UL
+#endif
+
+// Longitud máxima de un nombre de archivo en SD (incluye '\0')
+#ifndef HOLTER_MAX_FILENAME_LEN
+#define HOLTER_MAX_FILENAME_LEN 64
+#endif
+
+// Frecuencia de muestreo ECG: 250, 500 o 1000 Hz
+#ifndef HOLTER_ECG_SAMPLE_RATE_HZ
+#define HOLTER_ECG_SAMPLE_RATE_HZ 250
+#endif
+
+// Muestreo con el ADC continuo (DMA vía I2S0) en lugar de un timer y
+// lecturas sueltas. Requiere HOLTER_ECG_RAW_ADC
+#ifndef HOLTER_ECG_ADC_DMA
+#define HOLTER_ECG_ADC_DMA 1
+#endif
+
+// Captura ECG en cuentas crudas del ADC (1) o en mV escalados con float (0).
+// En modo crudo el header guarda la calibración para reconstruir mV
+#ifndef HOLTER_ECG_RAW_ADC
+#define HOLTER_ECG_RAW_ADC 1
+#endif
+
+// Pines ADC1 de las salidas AD8232 de XS1 (derivación I) y XS2
+// (derivación II). La referencia es AD8232_GetVoltage(AD8232_XS1/XS2) de
+// XSpaceBioV10: al iniciar se compara con estos pines y se avisa si no
+// coinciden. No pueden ser el pin de batería
+#ifndef HOLTER_ECG_ADC_PIN_I
+#define HOLTER_ECG_ADC_PIN_I 34
+#endif
+#ifndef HOLTER_ECG_ADC_PIN_II
+#define HOLTER_ECG_ADC_PIN_II 35
+#endif
+
+// Divisor de la batería (ADC1) que lee el display
+#ifndef HOLTER_BATTERY_PIN
+#define HOLTER_BATTERY_PIN 36
+#endif
+
+// Filtros ECG en el equipo (ecg_filter.h): pasaaltos + pasabajos + notch
+// aplicados en la adquisición. El archivo, el streaming en vivo y el
+// detector QRS reciben la señal filtrada; el header lo indica (ecg_filter)
+#ifndef HOLTER_ECG_FILTER
+#define HOLTER_ECG_FILTER 0
+#endif
+
+// Cortes de los filtros en Hz (0 = sin esa etapa)
+#ifndef HOLTER_ECG_HIGHPASS_HZ
+#define HOLTER_ECG_HIGHPASS_HZ 0.5f
+#endif
+#ifndef HOLTER_ECG_LOWPASS_HZ
+#define HOLTER_ECG_LOWPASS_HZ 40
+#endif
+// Frecuencia de la red eléctrica: 60 Hz (América) o 50 Hz
+#ifndef HOLTER_ECG_NOTCH_HZ
+#define HOLTER_ECG_NOTCH_HZ 60
+#endif
+
+// Frecuencia del acelerómetro (25-100 Hz). Debe dividir exacto a la de ECG:
+// el IMU se dispara cada HOLTER_ECG_SAMPLE_RATE_HZ / HOLTER_IMU_SAMPLE_RATE_HZ
+// muestras ECG y comparte su reloj
+#ifndef HOLTER_IMU_SAMPLE_RATE_HZ
+#define HOLTER_IMU_SAMPLE_RATE_HZ 50
+#endif
+
+// Dirección I2C del acelerómetro (MPU6050: 0x68, 0x69 con AD0 en alto)
+#ifndef HOLTER_IMU_I2C_ADDR
+#define HOLTER_IMU_I2C_ADDR 0x68
+#endif
+
+// Detección de QRS en el equipo (derivación II): frecuencia cardíaca en
+// holter_getHeartRate() y anotaciones de picos R en cada segmento
+#ifndef HOLTER_QRS_DETECT
+#define HOLTER_QRS_DETECT 1
+#endif
+
+// Captura por eventos: en lugar de grabar continuo, el equipo guarda en RAM
+// (PSRAM si hay) los últimos HOLTER_EVENT_PRE_SEC s ya comprimidos y solo
+// escribe en SD pre + post evento cuando algo lo dispara (botón, frecuencia
+// cardíaca fuera de rango, caída detectada por el IMU)
+#ifndef HOLTER_EVENT_MODE
+#define HOLTER_EVENT_MODE 0
+#endif
+
+#ifndef HOLTER_EVENT_PRE_SEC
+#define HOLTER_EVENT_PRE_SEC 30
+#endif
+
+#ifndef HOLTER_EVENT_POST_SEC
+#define HOLTER_EVENT_POST_SEC 60
+#endif
+
+// Umbrales de frecuencia cardíaca que disparan un evento (0 = desactivado)
+#ifndef HOLTER_EVENT_HR_HIGH_BPM
+#define HOLTER_EVENT_HR_HIGH_BPM 150
+#endif
+#ifndef HOLTER_EVENT_HR_LOW_BPM
+#define HOLTER_EVENT_HR_LOW_BPM 40
+#endif
+
+// Caída (caída libre seguida de impacto en el acelerómetro) como evento
+#ifndef HOLTER_EVENT_FALL_DETECT
+#define HOLTER_EVENT_FALL_DETECT 1
+#endif
+
+// Columnas por segundo de la forma de onda del OLED (128 columnas: ~2.5 s
+// por barrido a 50 Hz). Cada columna es el min/max de la derivación II
+#ifndef HOLTER_DISPLAY_WAVE_HZ
+#define HOLTER_DISPLAY_WAVE_HZ 50
+#endif
+
+// Período de refresco del OLED; solo se envían las páginas modificadas
+#ifndef HOLTER_DISPLAY_FRAME_MS
+#define HOLTER_DISPLAY_FRAME_MS 40
+#endif
+
+// Bajo consumo: la CPU corre a 80 MHz (DFS con esp_pm si el framework lo
+// trae, si no frecuencia fija), el light sleep automático queda habilitado
+// fuera de la captura, la SD se escribe en ráfagas de HOLTER_SD_BURST_KB y
+// el WiFi se apaga entre uploads. El ADC continuo necesita el reloj APB:
+// durante la captura los cores duermen en WFI, no en light sleep
+#ifndef HOLTER_LOW_POWER
+#define HOLTER_LOW_POWER 0
+#endif
+
+// Bloques de datos acumulados en RAM por escritura en la SD. Con
+// HOLTER_LOW_POWER se escriben solo al llenarse o al cerrar el segmento:
+// un corte de energía pierde a lo sumo esta cantidad
+#ifndef HOLTER_SD_BURST_KB
+#define HOLTER_SD_BURST_KB (HOLTER_LOW_POWER ? 32 : 4)
+#endif
+
+// Bus de la tarjeta SD (holter_storage.h): 0 = SPI (pines de la placa), 1 o
+// 4 = host SDMMC nativo con 1 o 4 líneas de datos. SDMMC usa pines fijos y
+// pull-ups externos; en 4 bits GPIO12 (D2) necesita el eFuse de VDD_SDIO
+// en 3.3 V para no romper el arranque
+#ifndef HOLTER_SD_MODE
+#define HOLTER_SD_MODE 0
+#endif
+
+// Reloj máximo de la SD en Hz: al montar se prueba de este valor hacia
+// abajo hasta el primero que pasa la prueba de escritura y lectura
+#ifndef HOLTER_SD_MAX_HZ
+#define HOLTER_SD_MAX_HZ 40000000UL
+#endif
+
+// KB escritos y releídos al montar para validar el reloj y medir la
+// velocidad (0 = sin prueba: se queda el primer reloj que monta)
+#ifndef HOLTER_SD_SPEED_TEST_KB
+#define HOLTER_SD_SPEED_TEST_KB 64
+#endif
+
+// Reservar al abrir cada segmento su tamaño esperado (cota sin comprimir)
+// y recortarlo al cerrar: los clusters y la FAT se actualizan al rotar y no
+// en cada ráfaga de la captura
+#ifndef HOLTER_SD_PREALLOC
+#define HOLTER_SD_PREALLOC 1
+#endif
+
+// Segmentos ya subidos: 1 = se mueven a /uploaded y se borran, del más
+// antiguo al más nuevo, solo cuando falta espacio; 0 = se borran al subir
+#ifndef HOLTER_SD_KEEP_UPLOADED
+#define HOLTER_SD_KEEP_UPLOADED 1
+#endif
+
+// Espacio que siempre queda libre en la SD (journals, directorios)
+#ifndef HOLTER_SD_RESERVE_MB
+#define HOLTER_SD_RESERVE_MB 8
+#endif
+
+// Modelo de consumo para holter_getPowerStats() (mA típicos de hoja de
+// datos; calibrar con una medición real de la placa)
+#ifndef HOLTER_POWER_CPU_IDLE_MA
+#define HOLTER_POWER_CPU_IDLE_MA (HOLTER_LOW_POWER ? 20 : 30)
+#endif
+#ifndef HOLTER_POWER_CPU_ACTIVE_MA
+#define HOLTER_POWER_CPU_ACTIVE_MA (HOLTER_LOW_POWER ? 31 : 68)
+#endif
+#ifndef HOLTER_POWER_SD_WRITE_MA
+#define HOLTER_POWER_SD_WRITE_MA 60
+#endif
+// AD8232 x2, MPU6050 y SD en reposo
+#ifndef HOLTER_POWER_BASE_MA
+#define HOLTER_POWER_BASE_MA 5
+#endif
+
+// Mantener WiFi + sesión MQTT/TLS entre segmentos mientras se graba y pedir
+// por adelantado la URL prefirmada del segmento en curso (0 = conectar por
+// cada archivo y apagar la radio con la cola vacía)
+#ifndef HOLTER_NET_PERSISTENT
+#define HOLTER_NET_PERSISTENT (!HOLTER_LOW_POWER)
+#endif
+
+// Horas que se confía en la hora del RTC antes de volver a consultar NTP.
+// La hora sobrevive a los reinicios por software: no se sincroniza en cada
+// arranque (holter_clock.h)
+#ifndef HOLTER_NTP_RESYNC_HOURS
+#define HOLTER_NTP_RESYNC_HOURS 24
+#endif
+
+// Arranque rápido: sin esperas fijas para el monitor serie ni cuenta
+// regresiva antes de grabar (0 = 2 s + 3 s como antes)
+#ifndef HOLTER_FAST_BOOT
+#define HOLTER_FAST_BOOT 1
+#endif
+
+// Cola de upload persistente: los segmentos pendientes son los .bin que
+// quedan en la SD. Se suben del más antiguo al más nuevo en lotes de
+// HOLTER_UPLOAD_BATCH_SIZE archivos con un solo pedido de URLs
+#ifndef HOLTER_UPLOAD_BATCH_SIZE
+#define HOLTER_UPLOAD_BATCH_SIZE 4
+#endif
+
+// Espera máxima entre reintentos tras un fallo (backoff exponencial desde 5 s)
+#ifndef HOLTER_UPLOAD_BACKOFF_MAX_SEC
+#define HOLTER_UPLOAD_BACKOFF_MAX_SEC 600
+#endif
+
+// Intentos por archivo antes de dejarlo para el próximo arranque
+#ifndef HOLTER_UPLOAD_MAX_ATTEMPTS
+#define HOLTER_UPLOAD_MAX_ATTEMPTS 5
+#endif
+
+// Streaming en vivo por MQTT (TOPIC_LIVE): 1 = activo desde el arranque;
+// también se activa en tiempo de ejecución con holter_setLiveStream()
+#ifndef HOLTER_LIVE_STREAM
+#define HOLTER_LIVE_STREAM 0
+#endif
+
+// Duración de las muestras de cada mensaje en vivo (un frame del codec)
+#ifndef HOLTER_LIVE_FRAME_MS
+#define HOLTER_LIVE_FRAME_MS 250
+#endif
+
+// Telemetría: estadísticas de la captura (holter_getStats) por MQTT en
+// TOPIC_STATS cada N segundos mientras haya sesión abierta (0 = desactivada)
+#ifndef HOLTER_STATS_PERIOD_SEC
+#define HOLTER_STATS_PERIOD_SEC 60
+#endif
+
+// Tamaño de parte para upload multipart a S3 (mínimo de S3: 5 MiB).
+// Archivos más pequeños se suben con un solo PUT
+#ifndef HOLTER_MULTIPART_PART_SIZE
+#define HOLTER_MULTIPART_PART_SIZE (5UL * 1024UL * 1024UL)
+#endif
+
+// URLs de parte solicitadas por adelantado mientras se sube la actual
+#ifndef HOLTER_MULTIPART_URL_BATCH
+#define HOLTER_MULTIPART_URL_BATCH 2
+#endif
+
+// Largo máximo de una URL prefirmada de S3 (con el token de sesión de la
+// Lambda rondan 1.5 KB). Cada URL guardada (caché del lote, partes
+// multipart y la del upload actual) ocupa un buffer estático de este tamaño
+#ifndef HOLTER_UPLOAD_URL_MAX_LEN
+#define HOLTER_UPLOAD_URL_MAX_LEN 2048
+#endif
+
+// Nivel de logs por Serial (holter_log.h): 0 = ninguno, 1 = errores,
+// 2 = + advertencias, 3 = + información, 4 = + depuración. Lo que supera
+// el nivel no se compila; en producción usar 2
+#ifndef HOLTER_LOG_LEVEL
+#define HOLTER_LOG_LEVEL 3
+#endif
+
+// Buffer de los logs diferidos en bytes (0 = escribir directo por Serial)
+#ifndef HOLTER_LOG_BUFFER_SIZE
+#define HOLTER_LOG_BUFFER_SIZE 4096
+#endif
+
+#endif
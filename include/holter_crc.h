@@ -0,0 +1,23 @@
+#ifndef HOLTER_CRC_H
+#define HOLTER_CRC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// ============================================================================
+// CRC-32 (IEEE 802.3, polinomio reflejado 0xEDB88320)
+//
+// Mismo resultado que zlib.crc32() en Python: se encadena pasando el CRC
+// anterior (0 para empezar). No depende de Arduino.
+// ============================================================================
+
+/**
+ * Calcula el CRC-32 de un buffer
+ * @param crc CRC acumulado de los datos anteriores (0 al comenzar)
+ * @param data Datos
+ * @param len Bytes de data
+ * @return CRC acumulado
+ */
+uint32_t holter_crc32(uint32_t crc, const uint8_t* data, size_t len);
+
+#endif // HOLTER_CRC_H
@@ -0,0 +1,166 @@
+#ifndef HOLTER_FORMAT_H
+#define HOLTER_FORMAT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// ============================================================================
+// FORMATO DE ARCHIVO (session_<ts>_<seq>.bin)
+//
+// Estructuras que se escriben en la SD tal cual (packed, little-endian):
+// las comparten la captura, el benchmark y cualquier lector en C++.
+//
+// No depende de Arduino: se compila también en el entorno nativo.
+// ============================================================================
+
+// Versión 2: el header se rellena con ceros hasta ocupar el primer sector
+// (512 bytes) y las muestras ECG empiezan en el offset 512
+// Versión 3: una grabación se divide en segmentos session_<ts>_<seq>.bin;
+// el header agrega el número de segmento y el índice de su primera muestra
+// Versión 4: los datos ECG son frames comprimidos sin pérdida (ecg_codec.h)
+// con las derivaciones I y II; la III se reconstruye como II - I
+// Versión 5: las muestras pueden ser cuentas crudas del ADC; el header
+// guarda la calibración del ADC y del AD8232 para reconstruir mV
+// Versión 6: después del header los datos son chunks con marca de tiempo
+// (ChunkHeader + payload) de ECG e IMU intercalados; se leen hasta EOF sin
+// depender de los contadores del header
+// Versión 7: los datos son bloques de 512 bytes (DataBlockHeader + payload)
+// con su propio CRC32; el header ya no se reescribe al cerrar y sus
+// contadores quedan en 0. Un corte de energía pierde solo el último bloque
+// Versión 8: el header indica si las muestras pasaron por los filtros del
+// equipo (ecg_filter.h) y con qué cortes
+// Versión 9: el archivo se reserva completo al abrirlo y se recorta al
+// cerrarlo; cada bloque lleva la etiqueta de su segmento (segment_tag) para
+// distinguirlo de datos viejos de la tarjeta en un archivo sin recortar
+static const uint16_t FILE_FORMAT_VERSION = 9;
+
+static const uint32_t FILE_MAGIC = 0x45434744;    // "ECGD"
+
+// FileHeader.ecg_sample_format
+static const uint16_t ECG_FORMAT_SCALED_MV = 0;   // int16 = mV * 6553.6
+static const uint16_t ECG_FORMAT_ADC_COUNTS = 1;  // int16 = cuentas ADC (0..4095)
+static const size_t FILE_HEADER_BLOCK_SIZE = 512;
+
+struct FileHeader {
+  uint32_t magic;              // 0x45434744 = "ECGD"
+  uint16_t version;
+  uint16_t device_id;
+  uint32_t session_id;         // Unix time de inicio (contador si el reloj no tenía hora)
+  uint32_t timestamp_start;    // Unix time de la primera muestra del segmento
+  uint16_t ecg_sample_rate;
+  uint16_t imu_sample_rate;
+  uint32_t num_ecg_samples;
+  uint32_t num_imu_samples;
+  uint32_t segment_seq;        // v3: 0, 1, 2... dentro de la grabación
+  uint32_t first_sample_index; // v3: índice global de la primera muestra
+  uint16_t ecg_codec;          // v4: ECG_CODEC_ID (0 = crudo)
+  uint16_t ecg_channels;       // v4: derivaciones guardadas (I, II)
+  uint32_t adc_coeff_a;        // v5: mV en el pin por cuenta, Q16 (esp_adc_cal)
+  uint16_t adc_coeff_b;        // v5: offset del ADC en mV
+  uint16_t ecg_gain;           // v5: ganancia del AD8232
+  uint16_t ecg_offset_mv;      // v5: referencia de la salida del AD8232 en mV
+  uint16_t ecg_sample_format;  // v5: ECG_FORMAT_*
+  uint16_t ecg_filter;         // v8: ECG_FILTER_* (0 = señal cruda)
+  uint16_t ecg_highpass_chz;   // v8: corte del pasaaltos en centésimas de Hz
+  uint16_t ecg_lowpass_hz;     // v8: corte del pasabajos
+  uint16_t ecg_notch_hz;       // v8: frecuencia del notch
+} __attribute__((packed));
+
+// Bloques de datos (v7): un sector cada uno, alineados a 512 bytes
+static const size_t DATA_BLOCK_SIZE = 512;
+static const uint32_t DATA_BLOCK_SYNC = 0x4B4C4248;   // "HBLK"
+static const uint16_t DATA_BLOCK_ECG = 1;    // payload: un frame de ecg_codec
+static const uint16_t DATA_BLOCK_IMU = 2;    // payload: IMUSample[num_samples]
+static const uint16_t DATA_BLOCK_RPEAK = 3;  // payload: RPeakAnnotation[num_samples]
+static const uint16_t DATA_BLOCK_EVENT = 4;  // payload: EventAnnotation (first_ecg_index = disparo)
+static const uint16_t DATA_BLOCK_STATS = 5;  // payload: CaptureStats al cerrar el segmento
+
+struct DataBlockHeader {
+  uint32_t sync;               // DATA_BLOCK_SYNC
+  uint16_t type;               // DATA_BLOCK_*
+  uint16_t num_samples;
+  uint32_t first_ecg_index;    // Índice ECG global de la primera muestra (reloj común);
+                               // un salto entre bloques ECG = muestras descartadas
+  uint16_t payload_bytes;
+  uint16_t segment_tag;        // v9: data_block_tag() del segmento (antes 0)
+  uint32_t crc32;              // CRC32 del bloque completo con este campo en 0
+} __attribute__((packed));
+
+// Etiqueta de 16 bits de un segmento (header.session_id, header.segment_seq)
+static inline uint16_t data_block_tag(uint32_t session_id, uint32_t segment_seq) {
+  uint32_t h = (session_id ^ (segment_seq * 0x9E3779B1u)) * 0x85EBCA6Bu;
+  return (uint16_t)(h >> 16);
+}
+
+static const size_t DATA_BLOCK_PAYLOAD = DATA_BLOCK_SIZE - sizeof(DataBlockHeader);
+
+struct ECGSample {
+  int16_t derivation_I;
+  int16_t derivation_II;
+  int16_t derivation_III;
+} __attribute__((packed));
+
+struct IMUSample {
+  int16_t accel_x;
+  int16_t accel_y;
+  int16_t accel_z;
+} __attribute__((packed));
+
+// Pico R detectado en el equipo. La detección se confirma hasta ~2 s
+// después: un pico cerca del final de un segmento puede quedar anotado en
+// el siguiente
+struct RPeakAnnotation {
+  uint32_t ecg_index;          // Índice ECG global del pico R
+  uint16_t rr_ms;              // RR con el latido anterior (0 = primero o tras pérdida)
+} __attribute__((packed));
+
+// Origen de un evento (HOLTER_EVENT_MODE)
+enum EventSource : uint16_t {
+  EVENT_NONE = 0,
+  EVENT_BUTTON = 1,
+  EVENT_HEART_RATE = 2,        // Frecuencia fuera de HOLTER_EVENT_HR_LOW/HIGH_BPM
+  EVENT_FALL = 3
+};
+
+struct EventAnnotation {
+  uint16_t source;             // EventSource
+  uint16_t bpm;                // Frecuencia cardíaca al disparar (0 = sin dato)
+} __attribute__((packed));
+
+// Histogramas de tiempos en cubetas logarítmicas de base 4: la cubeta b
+// cuenta los valores en [4^b, 4^(b+1)) µs (la 0 incluye el 0 y la última
+// todo lo que supera 4^9 µs = 262 ms)
+static const size_t STATS_HIST_BINS = 10;
+
+// Estadísticas de la captura (holter_getStats y último bloque de cada
+// segmento). Acumuladas desde el inicio de la grabación: la diferencia
+// entre dos segmentos da las del intervalo
+struct CaptureStats {
+  uint32_t elapsed_ms;         // Desde el arranque del muestreo
+  uint32_t samples_produced;   // Muestras entregadas por el muestreo
+  uint32_t samples_expected;   // Las que corresponden a elapsed_ms a la frecuencia nominal
+  uint32_t samples_dropped;    // Bloque ping-pong lleno (SD lenta) o sin archivo
+  uint32_t imu_dropped;        // Ring IMU lleno, disparo perdido o lectura I2C fallida
+  uint32_t peaks_dropped;      // Ring de picos R lleno
+  // Intervalo entre ticks del timer (o entre frames del DMA): desvío del
+  // período nominal en µs
+  uint32_t interval_max_dev_us;
+  uint32_t interval_hist[STATS_HIST_BINS];
+  // Escrituras en la SD (write + flush de una ráfaga)
+  uint32_t sd_flushes;
+  uint32_t sd_flush_total_ms;
+  uint32_t sd_flush_max_us;
+  uint32_t sd_flush_hist[STATS_HIST_BINS];
+  // Máximos de ocupación. Un bloque lleno que espera más de lo que dura
+  // (SAMPLES_PER_BLOCK muestras) descarta muestras
+  uint32_t block_wait_max_ms;
+  uint16_t imu_ring_max;
+  uint16_t rpeak_ring_max;
+  uint16_t live_ring_max;
+  // Mínimo de stack libre de cada tarea de la captura, en bytes
+  uint16_t acquisition_stack_free;
+  uint16_t storage_stack_free;
+  uint16_t imu_stack_free;
+} __attribute__((packed));
+
+#endif // HOLTER_FORMAT_H
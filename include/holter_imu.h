@@ -0,0 +1,25 @@
+#ifndef HOLTER_IMU_H
+#define HOLTER_IMU_H
+
+#include <Arduino.h>
+#include "holter_capture.h"
+
+// ============================================================================
+// ACELERÓMETRO (MPU6050 por I2C)
+// Rango ±16 g: 2048 LSB/g, la misma escala que usa lambda2.py
+// (ACCEL_SCALE = 16 / 32768)
+// ============================================================================
+
+/**
+ * Inicializa el bus I2C y configura el acelerómetro
+ * @return true si el sensor respondió
+ */
+bool imu_init();
+
+/**
+ * Lee una muestra del acelerómetro (ejes X, Y, Z)
+ * @return false si falló la transacción I2C
+ */
+bool imu_read(IMUSample& sample);
+
+#endif // HOLTER_IMU_H
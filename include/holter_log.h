@@ -0,0 +1,77 @@
+#ifndef HOLTER_LOG_H
+#define HOLTER_LOG_H
+
+#include <stddef.h>
+#include "holter_config.h"
+
+// ============================================================================
+// LOGS DIFERIDOS CON NIVEL EN TIEMPO DE COMPILACIÓN
+//
+// HOLTER_LOGE/W/I/D formatean la línea en la tarea que llama y la copian a
+// un buffer circular; la tarea "log" (prioridad baja, core 0) la escribe
+// por Serial. Ninguna tarea espera al UART: si el buffer se llena la línea
+// se descarta y se cuenta. Las macros por encima de HOLTER_LOG_LEVEL no
+// generan código ni evalúan sus argumentos (el compilador igual verifica
+// el formato).
+//
+// Cada línea termina en '\n': el formato no lo incluye.
+// ============================================================================
+
+#define HOLTER_LOG_LEVEL_NONE 0
+#define HOLTER_LOG_LEVEL_ERROR 1
+#define HOLTER_LOG_LEVEL_WARNING 2
+#define HOLTER_LOG_LEVEL_INFO 3
+#define HOLTER_LOG_LEVEL_DEBUG 4
+
+#if HOLTER_LOG_LEVEL >= HOLTER_LOG_LEVEL_ERROR
+#define HOLTER_LOGE(...) holter_log(__VA_ARGS__)
+#else
+#define HOLTER_LOGE(...) do { if (0) holter_log(__VA_ARGS__); } while (0)
+#endif
+
+#if HOLTER_LOG_LEVEL >= HOLTER_LOG_LEVEL_WARNING
+#define HOLTER_LOGW(...) holter_log(__VA_ARGS__)
+#else
+#define HOLTER_LOGW(...) do { if (0) holter_log(__VA_ARGS__); } while (0)
+#endif
+
+#if HOLTER_LOG_LEVEL >= HOLTER_LOG_LEVEL_INFO
+#define HOLTER_LOGI(...) holter_log(__VA_ARGS__)
+#else
+#define HOLTER_LOGI(...) do { if (0) holter_log(__VA_ARGS__); } while (0)
+#endif
+
+#if HOLTER_LOG_LEVEL >= HOLTER_LOG_LEVEL_DEBUG
+#define HOLTER_LOGD(...) holter_log(__VA_ARGS__)
+#else
+#define HOLTER_LOGD(...) do { if (0) holter_log(__VA_ARGS__); } while (0)
+#endif
+
+// ============================================================================
+// INTERFACE PÚBLICA
+// ============================================================================
+
+/**
+ * Crea la tarea que vacía el buffer de logs. Hasta entonces (y con
+ * HOLTER_LOG_BUFFER_SIZE = 0) las líneas se escriben directo por Serial
+ * Llamar en setup() después de Serial.begin()
+ */
+void holter_logInit();
+
+/**
+ * Agrega una línea al buffer (usar las macros HOLTER_LOG*)
+ */
+void holter_log(const char* format, ...) __attribute__((format(printf, 1, 2)));
+
+/**
+ * Escribe por Serial todo lo pendiente y espera a que salga del UART.
+ * Para antes de un reinicio o de dormir, nunca desde la captura
+ */
+void holter_logFlush();
+
+/**
+ * Obtiene las líneas descartadas por buffer lleno desde el arranque
+ */
+unsigned long holter_getDroppedLogs();
+
+#endif // HOLTER_LOG_H
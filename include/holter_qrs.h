@@ -0,0 +1,95 @@
+#ifndef HOLTER_QRS_H
+#define HOLTER_QRS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// ============================================================================
+// DETECTOR QRS INCREMENTAL (Pan-Tompkins en enteros)
+//
+// Procesa una derivación muestra a muestra con memoria constante:
+//
+//   pasabanda (pasabajos + pasaaltos enteros) -> derivada -> cuadrado ->
+//   integración de ventana móvil (150 ms) -> umbrales adaptativos con
+//   período refractario, descarte de ondas T y búsqueda hacia atrás
+//
+// Los filtros son los del artículo original (diseñados para 200 Hz); el
+// detector corre a QRS_BASE_RATE_HZ promediando 2 o 4 muestras de entrada
+// a 500/1000 Hz, así el costo por segundo no depende de la frecuencia.
+//
+// No depende de Arduino: se compila también en el entorno nativo.
+// ============================================================================
+
+static const uint16_t QRS_BASE_RATE_HZ = 250;
+static const size_t QRS_LPF_LEN = 12;                              // x[n-12]
+static const size_t QRS_HPF_LEN = 32;                              // x[n-32]
+static const size_t QRS_MWI_LEN = QRS_BASE_RATE_HZ * 150 / 1000;   // 150 ms
+static const size_t QRS_RR_HISTORY = 8;
+
+struct QRSDetector {
+  // Entrada y decimación
+  uint16_t decimation;
+  uint16_t decimCount;
+  int32_t decimSum;
+  uint32_t n;                          // Muestras procesadas a QRS_BASE_RATE_HZ
+
+  // Pasabanda
+  int32_t lpfX[QRS_LPF_LEN];
+  int32_t lpfY1, lpfY2;
+  int32_t hpfX[QRS_HPF_LEN];
+  int32_t hpfSum;
+  int32_t derivX[4];
+
+  // Integración y |pasabanda| de la ventana (ubica el pico R)
+  uint32_t mwi[QRS_MWI_LEN];
+  uint32_t mwiSum;
+  uint32_t mwiPrev;
+  int32_t bandAbs[QRS_MWI_LEN];
+
+  // Pico en curso
+  uint32_t peakValue;
+  uint32_t peakR;                      // n del pico R del candidato
+  int32_t peakSlope;
+  int32_t windowSlope;                 // Máxima |derivada| desde la última decisión
+
+  // Umbrales (SPKI / NPKI del artículo) y aprendizaje inicial de 2 s
+  uint32_t signalLevel;
+  uint32_t noiseLevel;
+  uint32_t learnMax;
+  uint64_t learnSum;
+  bool learning;
+
+  // Latidos
+  uint32_t lastBeat;                   // n del último pico R (0 = ninguno)
+  int32_t lastSlope;
+  uint32_t backValue;                  // Mejor pico bajo umbral desde el último latido
+  uint32_t backR;
+  int32_t backSlope;
+  uint16_t rr[QRS_RR_HISTORY];         // Últimos RR en muestras base
+  uint8_t rrCount;
+  uint8_t rrPos;
+};
+
+struct QRSBeat {
+  uint32_t age;                        // Muestras de entrada desde el pico R
+  uint16_t rr_ms;                      // RR con el latido anterior (0 = primero)
+  uint16_t mean_rr_ms;                 // Promedio de los últimos QRS_RR_HISTORY RR
+};
+
+/**
+ * Inicializa el detector
+ * @param sampleRate Frecuencia de entrada: múltiplo de QRS_BASE_RATE_HZ (250, 500, 1000)
+ */
+void qrs_init(QRSDetector& detector, uint16_t sampleRate);
+
+/**
+ * Procesa una muestra de la derivación
+ * @param sample Muestra en cualquier escala (cuentas ADC o mV escalados)
+ * @param beat Recibe el latido confirmado; el pico R fue `beat.age`
+ *             muestras antes de la actual (la confirmación llega hasta
+ *             ~400 ms tarde)
+ * @return true si se confirmó un latido
+ */
+bool qrs_process(QRSDetector& detector, int16_t sample, QRSBeat& beat);
+
+#endif // HOLTER_QRS_H
@@ -0,0 +1,59 @@
+#ifndef HOLTER_RECOVERY_H
+#define HOLTER_RECOVERY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "holter_format.h"
+
+// ============================================================================
+// RECUPERACIÓN DE UN SEGMENTO SIN CERRAR
+//
+// Un segmento se crea con su tamaño reservado y los sectores reservados
+// conservan lo que hubiera antes en la tarjeta. Tras un corte de energía
+// el archivo puede quedar:
+//
+//   - vacío o sin header (corte antes de escribirlo): se borra
+//   - con un header ajeno en el sector 0 (magic distinto, o sesión/segmento
+//     que no coinciden con el nombre): se borra
+//   - con header y ningún bloque válido (corte antes del primer bloque): se borra
+//   - con un prefijo de bloques válidos (sync, etiqueta y CRC): se recorta
+//     tras el último
+//
+// Los bloques se escriben en orden: alcanza una búsqueda binaria.
+// La lectura de bloques la provee quien llama (SD en el equipo, memoria en
+// los tests).
+//
+// No depende de Arduino: se compila también en el entorno nativo.
+// ============================================================================
+
+enum SegmentRecovery {
+  SEGMENT_INTACT,    // Cerrado normalmente (o versión < 9, sin etiquetas)
+  SEGMENT_TRIM,      // Recortar a FILE_HEADER_BLOCK_SIZE + keepBlocks * DATA_BLOCK_SIZE
+  SEGMENT_REMOVE,    // Sin datos de este segmento
+};
+
+/**
+ * Lee el bloque index (0 = primero tras el header)
+ * @return false si no se pudo leer completo
+ */
+typedef bool (*RecoveryReadFn)(void* ctx, uint32_t index, uint8_t* block);
+
+/**
+ * Verifica sync, etiqueta y CRC de un bloque de datos
+ * @param block DATA_BLOCK_SIZE bytes; el campo crc32 queda en 0
+ */
+bool recovery_blockValid(uint8_t* block, uint16_t tag);
+
+/**
+ * Decide qué hacer con un segmento que pudo quedar sin cerrar
+ * @param name Nombre del archivo (/session_<ts>_<seq>.bin)
+ * @param header Primer sector del archivo, o nullptr si no se pudo leer
+ * @param fileSize Tamaño actual (con lo reservado)
+ * @param block Buffer de DATA_BLOCK_SIZE bytes para las lecturas
+ * @param keepBlocks Bloques a conservar (SEGMENT_TRIM)
+ */
+SegmentRecovery recovery_check(const char* name, const FileHeader* header, size_t fileSize,
+                               RecoveryReadFn read, void* ctx, uint8_t* block,
+                               uint32_t* keepBlocks);
+
+#endif // HOLTER_RECOVERY_H
@@ -0,0 +1,98 @@
+#ifndef HOLTER_STORAGE_H
+#define HOLTER_STORAGE_H
+
+#include <Arduino.h>
+#include "holter_config.h"
+
+// ============================================================================
+// TARJETA SD (SPI o host SDMMC nativo)
+//
+// HOLTER_SD_MODE elige el bus: 0 = SPI (pines de la placa XSpace), 1 o 4 =
+// host SDMMC del ESP32 con 1 o 4 líneas de datos (pines fijos: CLK 14,
+// CMD 15, D0 2, D1 4, D2 12, D3 13). Al montar se prueba una escalera de
+// relojes de mayor a menor y se queda el más alto con el que la tarjeta
+// escribe y relee HOLTER_SD_SPEED_TEST_KB sin errores.
+//
+// sdCard es el sistema de archivos del bus elegido: usarlo en lugar de SD
+//
+// Espacio: los segmentos subidos pasan a UPLOADED_DIR (HOLTER_SD_KEEP_UPLOADED)
+// y son lo único que se borra para hacer lugar; los pendientes nunca
+// ============================================================================
+
+#if HOLTER_SD_MODE == 0
+#include <SD.h>
+static fs::SDFS& sdCard = SD;
+#else
+#include <SD_MMC.h>
+static fs::SDMMCFS& sdCard = SD_MMC;
+#endif
+
+// Resultado del montaje (holter_getStorageInfo)
+struct StorageInfo {
+  bool mounted;
+  uint8_t mode;                // HOLTER_SD_MODE en uso
+  uint32_t clock_khz;          // Reloj negociado
+  uint32_t write_kbps;         // KB/s medidos al montar (0 = sin medir)
+  uint32_t read_kbps;
+  uint64_t total_bytes;
+  uint64_t used_bytes;         // Al montar
+  uint32_t uploaded_files;     // Segmentos subidos en UPLOADED_DIR (borrables)
+  uint64_t uploaded_bytes;
+};
+
+#define UPLOADED_DIR "/uploaded"
+
+// ============================================================================
+// INTERFACE PÚBLICA
+// ============================================================================
+
+/**
+ * Monta la tarjeta con el reloj más alto que pasa la prueba de escritura.
+ * Los reintentos (bus reiniciado, con esperas) son solo para fallos
+ * @return true si quedó montada
+ */
+bool holter_storageInit();
+
+/**
+ * Obtiene el bus, el reloj y las velocidades medidas al montar
+ */
+void holter_getStorageInfo(StorageInfo& info);
+
+/**
+ * Espacio libre en la tarjeta, descontada la reserva HOLTER_SD_RESERVE_MB
+ */
+uint64_t holter_storageFreeBytes();
+
+/**
+ * Borra segmentos subidos, del más antiguo al más nuevo, hasta que haya
+ * bytes libres
+ * @return true si hay espacio
+ */
+bool holter_storageEnsureFree(uint64_t bytes);
+
+/**
+ * Crea name para escritura (posición 0) con size bytes ya asignados; el
+ * archivo queda con ese tamaño hasta recortarlo.
+ * Con ESP-IDF >= 5.3 se crea con f_expand (esp_vfs_fat_create_contiguous_file):
+ * clusters contiguos. En versiones anteriores el VFS no expone el FIL de
+ * FatFs y se reserva posicionándose más allá del final: el espacio queda
+ * asignado pero NO necesariamente contiguo. Lo mismo si la tarjeta no
+ * tiene un tramo libre contiguo de size bytes
+ * @param size Bytes a reservar (0 = sin reserva)
+ * @param reserved true si quedaron reservados
+ * @return Archivo abierto (vacío si no se pudo crear)
+ */
+File holter_storageCreate(const char* name, uint32_t size, bool& reserved);
+
+/**
+ * Recorta un archivo cerrado a size bytes
+ */
+bool holter_storageTruncate(const char* name, uint32_t size);
+
+/**
+ * Saca de la cola un segmento ya subido: lo mueve a UPLOADED_DIR o lo
+ * borra (HOLTER_SD_KEEP_UPLOADED = 0)
+ */
+bool holter_storageRetire(const char* name);
+
+#endif // HOLTER_STORAGE_H
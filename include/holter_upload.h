@@ -5,7 +5,6 @@
 #include <WiFi.h>
 #include <WiFiClientSecure.h>
 #include <PubSubClient.h>
-#include <HTTPClient.h>
 
 // ============================================================================
 // ESTADOS DE UPLOAD
@@ -17,23 +16,46 @@ enum UploadState {
   UPLOAD_CONNECTING_MQTT,
   UPLOAD_REQUESTING_URL,
   UPLOAD_UPLOADING_S3,
+  UPLOAD_COMPLETING_MULTIPART,
   UPLOAD_COMPLETE,
   UPLOAD_ERROR
 };
 
+// ============================================================================
+// STREAMING EN VIVO
+// Cada mensaje binario en TOPIC_LIVE es un LiveFrameHeader seguido de un
+// frame de ecg_codec con HOLTER_LIVE_FRAME_MS de muestras consecutivas
+// ============================================================================
+
+static const uint8_t LIVE_FRAME_VERSION = 1;
+
+struct LiveFrameHeader {
+  uint8_t version;             // LIVE_FRAME_VERSION
+  uint8_t sample_format;       // ECG_FORMAT_*
+  uint16_t ecg_sample_rate;
+  uint32_t session_id;         // Unix time de inicio de la grabación
+  uint32_t first_sample_index; // Índice global: un salto indica muestras perdidas
+  uint32_t adc_coeff_a;        // Calibración, como en el header del archivo
+  uint16_t adc_coeff_b;
+  uint16_t ecg_gain;
+  uint16_t ecg_offset_mv;
+  uint16_t ecg_filter;         // ECG_FILTER_* (0 = señal cruda)
+} __attribute__((packed));
+
 // ============================================================================
 // INTERFACE PÚBLICA
 // ============================================================================
 
 /**
- * Inicializa el módulo de upload (WiFi, MQTT, certificados AWS)
+ * Inicializa el módulo de upload (WiFi, MQTT, certificados AWS) y crea la
+ * tarea de red en el core 0
  * Debe ser llamado en setup()
  */
 void holter_initUpload();
 
 /**
- * Conecta a WiFi
- * @return true si se conectó exitosamente
+ * Inicia la conexión WiFi sin bloquear (el avance llega por eventos)
+ * @return true si ya está conectado y con IP
  */
 bool holter_connectWiFi();
 
@@ -43,15 +65,21 @@ bool holter_connectWiFi();
 void holter_disconnectWiFi();
 
 /**
- * Inicia el proceso de upload de un archivo a AWS
+ * Encola un archivo para subirlo a AWS. La cola es la SD: todo segmento
+ * session_*.bin que siga en la tarjeta está pendiente, y la tarea de red
+ * los sube en segundo plano del más antiguo al más nuevo, en lotes, con
+ * reintentos y backoff si no hay conexión.
  * @param filename Nombre del archivo a subir (con path completo)
- * @return true si se inició correctamente
+ * @return true si se encoló correctamente
  */
-bool holter_startUpload(String filename);
+bool holter_startUpload(const char* filename);
 
 /**
- * Loop de upload - debe ser llamado continuamente durante el upload
- * Maneja la máquina de estados: WiFi → MQTT → S3
+ * Loop de upload - lo ejecuta la tarea de red; no llamar desde loop()
+ * Maneja la máquina de estados: WiFi → MQTT → S3. Cada llamada avanza un
+ * paso sin esperar: el PUT envía como máximo 4 KB por paso. Archivos
+ * mayores a HOLTER_MULTIPART_PART_SIZE se suben por partes (multipart) y
+ * pueden retomarse tras un corte o reinicio
  */
 void holter_uploadLoop();
 
@@ -61,26 +89,55 @@ void holter_uploadLoop();
 void holter_cancelUpload();
 
 /**
- * Verifica si hay un upload en progreso
+ * Verifica si hay un upload en progreso o archivos en cola
  * @return true si está subiendo
  */
 bool holter_isUploading();
 
 /**
- * Obtiene el progreso del upload actual
+ * Verifica si la máquina de estados está procesando un archivo
+ * (sin contar los que esperan en cola)
+ */
+bool holter_isUploadActive();
+
+/**
+ * Obtiene el número de segmentos pendientes en la SD (incluye el actual)
+ */
+int holter_getPendingUploads();
+
+/**
+ * Obtiene el progreso del upload actual (bytes enviados / tamaño)
  * @return Valor entre 0.0 y 1.0 (0% a 100%)
  */
 float holter_getUploadProgress();
 
+/**
+ * Obtiene los bytes del archivo actual ya enviados a S3 (en multipart,
+ * las partes confirmadas más lo enviado de la parte en curso)
+ */
+unsigned long holter_getUploadedBytes();
+
 /**
  * Obtiene el estado actual del upload
  */
 UploadState holter_getUploadState();
 
 /**
- * Obtiene un string descriptivo del estado actual
+ * Obtiene un texto descriptivo del estado actual (buffer estático, válido
+ * hasta la próxima llamada)
+ */
+const char* holter_getUploadStateString();
+
+/**
+ * Activa o desactiva el streaming en vivo. Mientras está activo la red se
+ * mantiene conectada y se publica un mensaje cada HOLTER_LIVE_FRAME_MS
+ */
+void holter_setLiveStream(bool enabled);
+
+/**
+ * Verifica si el streaming en vivo está activo
  */
-String holter_getUploadStateString();
+bool holter_isLiveStreaming();
 
 /**
  * Verifica si WiFi está conectado
@@ -93,8 +150,9 @@ bool holter_isWiFiConnected();
 bool holter_isMQTTConnected();
 
 /**
- * Obtiene el último error ocurrido
+ * Obtiene el último error ocurrido ("" si ninguno). Buffer estático que la
+ * tarea de red sobrescribe: copiarlo si se necesita conservarlo
  */
-String holter_getLastError();
+const char* holter_getLastError();
 
 #endif // HOLTER_UPLOAD_H
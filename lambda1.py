@@ -0,0 +1,153 @@
+"""
+Lambda Function: GenerateUploadURL
+Genera URLs prefirmadas de S3 para los archivos del ESP32 y las publica por MQTT.
+- Archivos pequeños: una URL PUT (put_object)
+- Archivos grandes (multipart=true): inicia/retoma el multipart upload, una
+  URL por parte (upload_part) y lo completa cuando el ESP32 lo pide
+"""
+
+import json
+import boto3
+import os
+
+# Clientes AWS
+s3_client = boto3.client('s3')
+iot_client = boto3.client('iot-data')
+
+# Configuración
+RAW_BUCKET = os.environ.get('RAW_BUCKET', 'holter-raw-data')
+URL_EXPIRATION_SEC = int(os.environ.get('URL_EXPIRATION_SEC', '3600'))
+
+
+def object_key(device_id, session_id):
+    return f'raw/{device_id}/{session_id}.bin'
+
+
+def publish(device_id, payload):
+    iot_client.publish(
+        topic=f'holter/upload-url/{device_id}',
+        qos=1,
+        payload=json.dumps(payload)
+    )
+
+
+def single_put_url(device_id, session_id):
+    """URL PUT para subir el archivo completo en una sola petición"""
+    url = s3_client.generate_presigned_url(
+        'put_object',
+        Params={
+            'Bucket': RAW_BUCKET,
+            'Key': object_key(device_id, session_id),
+            'ContentType': 'application/octet-stream'
+        },
+        ExpiresIn=URL_EXPIRATION_SEC
+    )
+    # session_id y expires_in permiten al ESP32 pedir la URL por adelantado
+    # (mientras graba el segmento) y guardarla hasta su vencimiento
+    publish(device_id, {
+        'status': 'success',
+        'session_id': session_id,
+        'expires_in': URL_EXPIRATION_SEC,
+        'upload_url': url
+    })
+
+
+def batch_put_urls(device_id, event):
+    """Varios archivos pendientes en un solo pedido: una URL PUT por archivo"""
+    batch = event['batch']
+    for entry in batch:
+        single_put_url(device_id, entry['session_id'])
+    print(f"[INFO] {len(batch)} URLs publicadas")
+
+
+def multipart_part_urls(device_id, session_id, event):
+    """Publica una URL por parte; un mensaje por parte para no exceder el buffer MQTT del ESP32"""
+    key = object_key(device_id, session_id)
+    upload_id = event.get('upload_id')
+
+    if not upload_id:
+        response = s3_client.create_multipart_upload(
+            Bucket=RAW_BUCKET, Key=key, ContentType='application/octet-stream'
+        )
+        upload_id = response['UploadId']
+        print(f"[INFO] Multipart iniciado: {key} ({upload_id})")
+    else:
+        print(f"[INFO] Multipart retomado: {key} ({upload_id})")
+
+    first_part = int(event.get('first_part', 1))
+    count = int(event.get('count', 1))
+
+    for part_number in range(first_part, first_part + count):
+        url = s3_client.generate_presigned_url(
+            'upload_part',
+            Params={
+                'Bucket': RAW_BUCKET,
+                'Key': key,
+                'UploadId': upload_id,
+                'PartNumber': part_number
+            },
+            ExpiresIn=URL_EXPIRATION_SEC
+        )
+        publish(device_id, {
+            'status': 'success',
+            'upload_id': upload_id,
+            'part_number': part_number,
+            'upload_url': url
+        })
+
+
+def complete_multipart(device_id, session_id, event):
+    """Completa el multipart con las partes que S3 tiene registradas"""
+    key = object_key(device_id, session_id)
+    upload_id = event['upload_id']
+    total_parts = int(event['total_parts'])
+
+    parts = []
+    paginator = s3_client.get_paginator('list_parts')
+    for page in paginator.paginate(Bucket=RAW_BUCKET, Key=key, UploadId=upload_id):
+        for part in page.get('Parts', []):
+            parts.append({'PartNumber': part['PartNumber'], 'ETag': part['ETag']})
+
+    if len(parts) != total_parts:
+        message = f"S3 tiene {len(parts)} de {total_parts} partes"
+        print(f"[ERROR] {message}")
+        publish(device_id, {'status': 'error', 'action': 'complete', 'message': message})
+        return
+
+    s3_client.complete_multipart_upload(
+        Bucket=RAW_BUCKET, Key=key, UploadId=upload_id,
+        MultipartUpload={'Parts': sorted(parts, key=lambda p: p['PartNumber'])}
+    )
+    print(f"[SUCCESS] Multipart completado: {key} ({total_parts} partes)")
+    publish(device_id, {'status': 'success', 'action': 'complete'})
+
+
+def lambda_handler(event, context):
+    """Handler principal (disparado por la IoT Rule de holter/upload-request)"""
+    print(f"[INFO] Event: {json.dumps(event)}")
+
+    device_id = event['device_id']
+    session_id = event['session_id']
+
+    try:
+        if event.get('action') == 'complete':
+            complete_multipart(device_id, session_id, event)
+        elif event.get('multipart'):
+            multipart_part_urls(device_id, session_id, event)
+        elif event.get('batch'):
+            batch_put_urls(device_id, event)
+        else:
+            single_put_url(device_id, session_id)
+
+        return {'statusCode': 200}
+
+    except Exception as e:
+        print(f"[ERROR] {str(e)}")
+        import traceback
+        traceback.print_exc()
+        # session_id: el ESP32 distingue el upload en curso de un pedido
+        # por adelantado; action 'part' si falló una URL de multipart
+        action = event.get('action') or ('part' if event.get('multipart') else 'url')
+        publish(device_id, {'status': 'error', 'action': action,
+                            'session_id': session_id, 'message': str(e)})
+        return {'statusCode': 500, 'body': json.dumps({'error': str(e)})}
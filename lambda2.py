@@ -7,15 +7,21 @@ import json
 import boto3
 import os
 import struct
+import zlib
 import numpy as np
 import pywt
 from datetime import datetime
 import matplotlib
 matplotlib.use('Agg')
 import matplotlib.pyplot as plt
-from io import BytesIO, StringIO
+from io import BytesIO
 from scipy import signal
-import csv
+from concurrent.futures import ThreadPoolExecutor
+try:
+    import pyarrow as pa
+    import pyarrow.parquet as pq
+except ImportError:
+    pa = None
 
 # Clientes AWS
 s3_client = boto3.client('s3')
@@ -24,11 +30,104 @@ s3_client = boto3.client('s3')
 OUTPUT_BUCKET = os.environ.get('OUTPUT_BUCKET', 'holter-processed-data')
 REGION = os.environ.get('AWS_REGION', 'us-east-1')
 
+# Procesamiento por ventanas: la memoria depende de la ventana, no de la duración
+CHUNK_SECONDS = int(os.environ.get('CHUNK_SECONDS', '60'))
+# Contexto a cada lado de la ventana (transitorio del pasaaltos de 0.5 Hz)
+CHUNK_OVERLAP_SECONDS = 10
+# Los gráficos muestran el primer minuto a resolución completa
+PLOT_WINDOW_SECONDS = 60
+# Lectura del objeto de S3 por partes
+S3_READ_SIZE = 1 << 20
+TMP_DIR = '/tmp'
+
+# Salida de señales: 'parquet', 'csv' o ambos ('parquet,csv')
+OUTPUT_FORMATS = [f.strip() for f in os.environ.get('OUTPUT_FORMATS', 'parquet').split(',') if f.strip()]
+PARQUET_COMPRESSION = os.environ.get('PARQUET_COMPRESSION', 'zstd')
+
+# Columnas de salida (nombre, tipo); una fila por muestra a la frecuencia de cada sensor
+ECG_COLUMNS = [
+    ('time_ecg_s', 'float64'),
+    ('ecg_I_raw_mV', 'float32'), ('ecg_II_raw_mV', 'float32'), ('ecg_III_raw_mV', 'float32'),
+    ('ecg_I_filt_mV', 'float32'), ('ecg_II_filt_mV', 'float32'), ('ecg_III_filt_mV', 'float32'),
+    ('motion_detected', 'bool')
+]
+IMU_COLUMNS = [
+    ('time_imu_s', 'float64'),
+    ('accel_x_g', 'float32'), ('accel_y_g', 'float32'), ('accel_z_g', 'float32'),
+    ('motion_detected', 'bool')
+]
+
+# Pirámide min/max del ECG filtrado (segundos por bucket, múltiplos de 1 s):
+# gráficos y visores dibujan cualquier zoom sin leer todas las muestras
+PYRAMID_LEVELS_SECONDS = [1, 10, 60]
+# Buckets máximos del gráfico de toda la grabación (nivel más fino que entra)
+OVERVIEW_MAX_BUCKETS = 2000
+PYRAMID_COLUMNS = [
+    ('level_s', 'int32'), ('time_s', 'float64'),
+    ('ecg_I_min_mV', 'float32'), ('ecg_II_min_mV', 'float32'), ('ecg_III_min_mV', 'float32'),
+    ('ecg_I_max_mV', 'float32'), ('ecg_II_max_mV', 'float32'), ('ecg_III_max_mV', 'float32'),
+    ('motion_fraction', 'float32')
+]
+
 # Escalas del ESP32
 ECG_SCALE_FACTOR = 6553.6
 ACCEL_SCALE = 16.0 / 32768.0  # Solo acelerómetro
 
-# FRECUENCIAS HARDCODED
+# Desde la versión 2 el header ocupa un sector completo (datos alineados a 512 bytes)
+HEADER_BLOCK_SIZE_V2 = 512
+# Versión 3: segment_seq(4) + first_sample_index(4) a continuación del header base
+HEADER_V3_EXTENSION = '<II'
+# Versión 4: ecg_codec(2) + ecg_channels(2); datos ECG en frames comprimidos
+HEADER_V4_EXTENSION = '<HH'
+# Versión 5: adc_coeff_a(4) + adc_coeff_b(2) + ecg_gain(2) + ecg_offset_mv(2) + ecg_sample_format(2)
+HEADER_V5_EXTENSION = '<IHHHH'
+# Versión 8: ecg_filter(2) + ecg_highpass_chz(2) + ecg_lowpass_hz(2) + ecg_notch_hz(2)
+HEADER_V8_EXTENSION = '<HHHH'
+ECG_FILTER_HIGHPASS = 1 << 0
+ECG_FILTER_LOWPASS = 1 << 1
+ECG_FILTER_NOTCH = 1 << 2
+ECG_FORMAT_SCALED_MV = 0
+ECG_FORMAT_ADC_COUNTS = 1
+# Versión 6: tras el header, chunks ECG/IMU intercalados hasta EOF
+# type(2) + num_samples(2) + first_ecg_index(4) + payload_bytes(4)
+CHUNK_HEADER_FORMAT = '<HHII'
+CHUNK_TYPE_ECG = 1
+CHUNK_TYPE_IMU = 2
+# Versión 7: bloques de 512 bytes con CRC32 propio; el header no se reescribe
+# sync(4) + type(2) + num_samples(2) + first_ecg_index(4) + payload_bytes(2) +
+# segment_tag(2) + crc32(4). Versión 9: segment_tag identifica el segmento
+# (antes 0) y descarta datos viejos de la tarjeta en un archivo sin recortar
+DATA_BLOCK_SIZE = 512
+DATA_BLOCK_SYNC = 0x4B4C4248  # "HBLK"
+DATA_BLOCK_HEADER_FORMAT = '<IHHIHHI'
+DATA_BLOCK_CRC_OFFSET = 16
+# Tipo 3: picos R detectados en el equipo, ecg_index(4) + rr_ms(2) cada uno
+DATA_BLOCK_RPEAK = 3
+RPEAK_DTYPE = np.dtype([('ecg_index', '<u4'), ('rr_ms', '<u2')])
+# Tipo 4: disparo de un evento (modo eventos), source(2) + bpm(2)
+DATA_BLOCK_EVENT = 4
+EVENT_SOURCES = {1: 'button', 2: 'heart_rate', 3: 'fall'}
+# Tipo 5: estadísticas de la captura al cerrar el segmento (CaptureStats en
+# include/holter_format.h), acumuladas desde el inicio de la grabación.
+# Histogramas en cubetas de base 4: la b cuenta [4^b, 4^(b+1)) µs
+DATA_BLOCK_STATS = 5
+STATS_HIST_BINS = 10
+STATS_FORMAT = '<7I10I3I10II6H'
+STATS_FIELDS = ['elapsed_ms', 'samples_produced', 'samples_expected', 'samples_dropped',
+                'imu_dropped', 'peaks_dropped', 'interval_max_dev_us', 'interval_hist',
+                'sd_flushes', 'sd_flush_total_ms', 'sd_flush_max_us', 'sd_flush_hist',
+                'block_wait_max_ms', 'imu_ring_max', 'rpeak_ring_max', 'live_ring_max',
+                'acquisition_stack_free', 'storage_stack_free', 'imu_stack_free']
+
+# Codec ECG sin pérdida (ver include/ecg_codec.h en el firmware)
+ECG_CODEC_RAW = 0
+ECG_CODEC_RICE2 = 1
+ECG_CODEC_QMAX = 24
+ECG_CODEC_K_INIT_A = 1024
+ECG_CODEC_K_RESET = 64
+ECG_CODEC_K_MAX = 15
+
+# Frecuencias por defecto: solo se usan si el header no trae la frecuencia
 ECG_SAMPLE_RATE_HZ = 250
 IMU_SAMPLE_RATE_HZ = 50  # Ajustado a 50Hz para reducir I2C
 
@@ -51,7 +150,7 @@ class SignalProcessor:
             return signal_data
         
         b, a = signal.iirnotch(f0, Q, fs)
-        filtered = signal.filtfilt(b, a, signal_data)
+        filtered = signal.filtfilt(b, a, signal_data, axis=0)
         return filtered
     
     def highpass_filter(self, signal_data, cutoff, fs, order=4):
@@ -63,8 +162,9 @@ class SignalProcessor:
             print(f"[WARNING] HPF cutoff inválido: {normalized_cutoff:.4f}, saltando")
             return signal_data
         
-        b, a = signal.butter(order, normalized_cutoff, btype='high')
-        filtered = signal.filtfilt(b, a, signal_data)
+        # Secciones de segundo orden: en forma b/a un orden 4 a 0.001*Nyquist pierde precisión
+        sos = signal.butter(order, normalized_cutoff, btype='high', output='sos')
+        filtered = signal.sosfiltfilt(sos, signal_data, axis=0)
         return filtered
     
     def lowpass_filter(self, signal_data, cutoff, fs, order=4):
@@ -76,36 +176,49 @@ class SignalProcessor:
             print(f"[WARNING] LPF cutoff inválido: {normalized_cutoff:.4f}, ajustando a 0.95")
             normalized_cutoff = 0.95
         
-        b, a = signal.butter(order, normalized_cutoff, btype='low')
-        filtered = signal.filtfilt(b, a, signal_data)
+        sos = signal.butter(order, normalized_cutoff, btype='low', output='sos')
+        filtered = signal.sosfiltfilt(sos, signal_data, axis=0)
         return filtered
     
-    def preprocess_ecg(self, ecg_signal):
+    def preprocess_ecg(self, ecg_signal, device_filter=0, verbose=True):
         """
         Preprocesamiento completo de ECG:
         1. Filtro pasa-altos 0.5Hz (elimina drift)
         2. Filtro pasa-bajos 100Hz (elimina ruido HF)
         3. Filtro notch 60Hz (elimina ruido eléctrico)
+        Se saltan las etapas que el equipo ya aplicó (máscara ecg_filter del header v8).
+        ecg_signal: (N,) o (N, 3); con (N, 3) las tres derivaciones se filtran juntas.
         """
         fs = self.ecg_sample_rate
         nyquist = fs / 2
         
-        print(f"[PREPROCESS] fs={fs}Hz, Nyquist={nyquist}Hz, señal length={len(ecg_signal)}")
+        if verbose:
+            print(f"[PREPROCESS] fs={fs}Hz, Nyquist={nyquist}Hz, señal length={len(ecg_signal)}")
         
         # Paso 1: HPF 0.5 Hz
-        ecg_hpf = self.highpass_filter(ecg_signal, cutoff=0.5, fs=fs)
+        if device_filter & ECG_FILTER_HIGHPASS:
+            ecg_hpf = ecg_signal
+        else:
+            ecg_hpf = self.highpass_filter(ecg_signal, cutoff=0.5, fs=fs)
         
         # Paso 2: LPF
-        lpf_cutoff = min(100, nyquist * 0.8)
-        print(f"[PREPROCESS] LPF cutoff ajustado a {lpf_cutoff}Hz")
-        ecg_lpf = self.lowpass_filter(ecg_hpf, cutoff=lpf_cutoff, fs=fs)
+        if device_filter & ECG_FILTER_LOWPASS:
+            ecg_lpf = ecg_hpf
+        else:
+            lpf_cutoff = min(100, nyquist * 0.8)
+            if verbose:
+                print(f"[PREPROCESS] LPF cutoff ajustado a {lpf_cutoff}Hz")
+            ecg_lpf = self.lowpass_filter(ecg_hpf, cutoff=lpf_cutoff, fs=fs)
         
         # Paso 3: Notch 60Hz
-        if fs > 120:
+        if device_filter & ECG_FILTER_NOTCH:
+            ecg_filtered = ecg_lpf
+        elif fs > 120:
             ecg_filtered = self.notch_filter_60hz(ecg_lpf, fs)
         else:
             ecg_filtered = ecg_lpf
-            print("[PREPROCESS] Saltando notch (fs muy bajo)")
+            if verbose:
+                print("[PREPROCESS] Saltando notch (fs muy bajo)")
         
         return ecg_filtered
     
@@ -132,14 +245,15 @@ class SignalProcessor:
         
         return filtered_signal
     
-    def detect_motion_segments(self, accel_data, window_size=50, threshold=0.3):
+    def detect_motion_segments(self, accel_data, window_size=50, threshold=0.3, verbose=True):
         """
         Detecta segmentos de movimiento usando SOLO acelerómetro
         accel_data: (N, 3) array con [ax, ay, az]
         """
         # Manejar caso sin datos IMU
         if len(accel_data) == 0:
-            print("[MOTION] No hay datos IMU - asumiendo sin movimiento")
+            if verbose:
+                print("[MOTION] No hay datos IMU - asumiendo sin movimiento")
             # Retornar array vacío que será manejado correctamente
             return np.array([], dtype=bool)
         
@@ -153,135 +267,432 @@ class SignalProcessor:
         accel_detrended = np.abs(accel_magnitude - accel_smooth)
         motion_indicator = accel_detrended > threshold
         
-        if len(motion_indicator) > 0:
-            motion_pct = (motion_indicator.sum() / len(motion_indicator)) * 100
-            print(f"[MOTION] {motion_pct:.1f}% del tiempo en movimiento")
-        else:
-            print("[MOTION] Sin datos de movimiento")
+        if verbose:
+            if len(motion_indicator) > 0:
+                motion_pct = (motion_indicator.sum() / len(motion_indicator)) * 100
+                print(f"[MOTION] {motion_pct:.1f}% del tiempo en movimiento")
+            else:
+                print("[MOTION] Sin datos de movimiento")
         
         return motion_indicator
     
-    def resample_motion_mask(self, motion_mask, target_length):
-        """Resamplea máscara de movimiento de IMU rate a ECG rate"""
-        # Manejar caso sin datos IMU
-        if len(motion_mask) == 0:
-            print(f"[RESAMPLE] Sin datos IMU - creando máscara vacía de {target_length} muestras")
-            return np.zeros(target_length, dtype=bool)
-        
-        original_length = len(motion_mask)
-        if original_length == target_length:
-            return motion_mask
-        
-        indices = np.linspace(0, original_length - 1, target_length).astype(int)
-        return motion_mask[indices]
-    
-    def detect_heart_rate(self, ecg_signal, lead_idx=1):
+    def find_r_peaks(self, ecg_signal):
+        """Picos R de una derivación filtrada (se prueba la señal normal e invertida)"""
         fs = self.ecg_sample_rate
         
-        # Recortar 1 segundo al inicio y 1 al final
-        margin = int(1 * fs)
-        if len(ecg_signal) > 2 * margin:
-            ecg_trimmed = ecg_signal[margin:-margin]
-        else:
-            ecg_trimmed = ecg_signal
-        
-        duration_sec = len(ecg_trimmed) / fs
-        
-        # Distancia mínima: 0.3s (200 BPM máx)
+        # Distancia mínima: 0.1s
         min_distance = int(0.1 * fs)
         
         # Normalizar señal
-        ecg_norm = ecg_trimmed - np.mean(ecg_trimmed)
+        ecg_norm = ecg_signal - np.mean(ecg_signal)
         signal_std = np.std(ecg_norm)
         min_height = signal_std * 3
         
-        # Detectar picos (probar normal e invertida)
         r_peaks_pos, _ = signal.find_peaks(ecg_norm, height=min_height, distance=min_distance)
         r_peaks_neg, _ = signal.find_peaks(-ecg_norm, height=min_height, distance=min_distance)
         
         if len(r_peaks_neg) > len(r_peaks_pos):
-            r_peaks = r_peaks_neg
-        else:
-            r_peaks = r_peaks_pos
-        
-        # Calcular BPM usando intervalos R-R
+            return r_peaks_neg
+        return r_peaks_pos
+    
+    def heart_rate_from_peaks(self, r_peaks, lead_idx=1):
+        """BPM usando los intervalos R-R de los picos detectados en el backend"""
         if len(r_peaks) >= 2:
-            rr_intervals = np.diff(r_peaks) / fs
-            rr_mean = np.mean(rr_intervals)
+            rr_mean = np.mean(np.diff(r_peaks)) / self.ecg_sample_rate
             bpm = 60 / rr_mean
         else:
             bpm = 0
         
         print(f"[HR] Lead {['I', 'II', 'III'][lead_idx]}: {len(r_peaks)} picos, BPM={bpm:.1f}")
-        
-        # Ajustar índices de picos al offset original
-        r_peaks_original = r_peaks + margin
-        
-        return bpm, r_peaks_original
+        return bpm, r_peaks
     
-    def process_ecg_with_motion(self, ecg_data, motion_mask_imu, wavelet_level=4):
-        """Procesa ECG con filtrado adaptativo según movimiento"""
-        n_samples, n_leads = ecg_data.shape
-        filtered = np.zeros_like(ecg_data)
-        preprocessed = np.zeros_like(ecg_data)
-        heart_rates = {}
+    def heart_rate_from_device(self, r_peaks, rr_ms, lead_idx=1):
+        """BPM con los picos R anotados por el equipo: no se re-detecta"""
+        # rr_ms = 0 marca el primer latido o uno tras pérdida de señal
+        valid_rr = rr_ms[rr_ms > 0]
+        bpm = 60000.0 / np.mean(valid_rr) if len(valid_rr) > 0 else 0
+        print(f"[HR] Lead {['I', 'II', 'III'][lead_idx]}: {len(r_peaks)} picos (equipo), BPM={bpm:.1f}")
+        return bpm, r_peaks
+    
+    def wavelet_by_motion(self, sig, motion_mask, wavelet_level=4):
+        """
+        Filtrado wavelet adaptativo de una derivación: los tramos con
+        movimiento y los quietos se filtran por separado con distinto umbral
+        """
+        motion_indices = np.where(motion_mask)[0]
+        quiet_indices = np.where(~motion_mask)[0]
         
-        # Resamplear máscara de movimiento a tasa ECG
-        motion_mask = self.resample_motion_mask(motion_mask_imu, n_samples)
+        # Inicializar con señal preprocesada
+        filtered = np.array(sig, dtype=np.float64)
         
-        print(f"[ECG] Procesando {n_leads} derivaciones, {n_samples} muestras @ {self.ecg_sample_rate}Hz")
+        if len(motion_indices) > 100:
+            filtered[motion_indices] = self.adaptive_wavelet_filter(
+                sig[motion_indices], level=wavelet_level, threshold_scale=2.0)
         
-        # PASO 1: Preprocesamiento (HPF + LPF + Notch)
-        for lead_idx in range(n_leads):
-            lead_name = ['I', 'II', 'III'][lead_idx]
-            signal_raw = ecg_data[:, lead_idx]
-            signal_preprocessed = self.preprocess_ecg(signal_raw)
-            preprocessed[:, lead_idx] = signal_preprocessed
-            print(f"[ECG] Lead {lead_name}: Filtros aplicados")
+        if len(quiet_indices) > 100:
+            filtered[quiet_indices] = self.adaptive_wavelet_filter(
+                sig[quiet_indices], level=wavelet_level, threshold_scale=1.0)
         
-        # PASO 2: Filtrado wavelet adaptativo
-        for lead_idx in range(n_leads):
-            lead_name = ['I', 'II', 'III'][lead_idx]
-            sig = preprocessed[:, lead_idx]
-            
-            # Verificar si hay datos de movimiento
-            if len(motion_mask) > 0:
-                motion_indices = np.where(motion_mask)[0]
-                quiet_indices = np.where(~motion_mask)[0]
-            else:
-                # Sin datos IMU: procesar todo como "quieto"
-                motion_indices = np.array([], dtype=int)
-                quiet_indices = np.arange(len(sig))
-                print(f"[ECG] Lead {lead_name}: Sin datos IMU - procesando sin detección de movimiento")
-            
-            # Inicializar con señal preprocesada
-            filtered[:, lead_idx] = sig
-            
-            if len(motion_indices) > 100:
-                motion_signal = sig[motion_indices]
-                filtered_motion = self.adaptive_wavelet_filter(motion_signal, level=wavelet_level, threshold_scale=2.0)
-                filtered[motion_indices, lead_idx] = filtered_motion
-            
-            if len(quiet_indices) > 100:
-                quiet_signal = sig[quiet_indices]
-                filtered_quiet = self.adaptive_wavelet_filter(quiet_signal, level=wavelet_level, threshold_scale=1.0)
-                filtered[quiet_indices, lead_idx] = filtered_quiet
-            
-            # Detectar BPM
-            bpm, r_peaks = self.detect_heart_rate(filtered[:, lead_idx], lead_idx)
-            heart_rates[lead_name] = {
-                'bpm': float(bpm),
-                'num_beats': len(r_peaks),
-                'r_peaks': r_peaks.tolist()
-            }
+        return filtered
+
+
+def decode_ecg_frames(file_data, offset, num_samples):
+    """
+    Decodifica los frames del codec v4 (predicción de 2º orden + Rice adaptativo).
+    Retorna int16 (N, 3) con III = II - I, y el offset donde terminan los frames.
+    Un frame truncado (archivo sin cerrar) corta la decodificación sin error.
+    """
+    out = np.zeros((num_samples, 3), dtype=np.int16)
+    decoded = 0
+    
+    while decoded < num_samples and offset + 4 <= len(file_data):
+        count, payload_len = struct.unpack('<HH', file_data[offset:offset + 4])
+        payload = file_data[offset + 4:offset + 4 + payload_len]
+        if count == 0 or len(payload) < payload_len:
+            print(f"[WARNING] Frame ECG truncado en offset {offset}")
+            break
+        
+        bits = ''.join(format(b, '08b') for b in payload)
+        pos = 0
+        state = [[ECG_CODEC_K_INIT_A, 1], [ECG_CODEC_K_INIT_A, 1]]
+        x1 = [0, 0]
+        x2 = [0, 0]
+        frame = np.zeros((count, 2), dtype=np.int32)
+        
+        for n in range(count):
+            for ch in range(2):
+                a, nn = state[ch]
+                k = 0
+                while (nn << k) < a and k < ECG_CODEC_K_MAX:
+                    k += 1
+                
+                zero = bits.find('0', pos, pos + ECG_CODEC_QMAX)
+                if zero >= 0:
+                    q = zero - pos
+                    pos = zero + 1
+                    u = (q << k) | (int(bits[pos:pos + k], 2) if k else 0)
+                    pos += k
+                else:
+                    pos += ECG_CODEC_QMAX
+                    u = int(bits[pos:pos + 16], 2)
+                    pos += 16
+                
+                a += u
+                nn += 1
+                if nn == ECG_CODEC_K_RESET:
+                    a >>= 1
+                    nn >>= 1
+                state[ch] = [a, nn]
+                
+                e = (u >> 1) ^ -(u & 1)
+                if n == 0:
+                    pred = 0
+                elif n == 1:
+                    pred = x1[ch]
+                else:
+                    pred = 2 * x1[ch] - x2[ch]
+                x = ((pred + e + 32768) & 0xFFFF) - 32768
+                frame[n, ch] = x
+                x2[ch] = x1[ch]
+                x1[ch] = x
+        
+        n_take = min(count, num_samples - decoded)
+        out[decoded:decoded + n_take, 0] = frame[:n_take, 0]
+        out[decoded:decoded + n_take, 1] = frame[:n_take, 1]
+        decoded += n_take
+        offset += 4 + payload_len
+    
+    out[:, 2] = (out[:, 1].astype(np.int32) - out[:, 0]).astype(np.int16)
+    return out[:decoded], offset
+
+
+def parse_chunks(file_data, offset, imu_decimation):
+    """
+    Recorre los chunks del formato v6 hasta EOF.
+    Retorna ECG int16 (N, 3), IMU int16 (M, 3) y el índice ECG global de cada
+    muestra IMU (reloj común; el IMU se toma cada imu_decimation muestras ECG).
+    Un chunk truncado (archivo sin cerrar) termina la lectura sin error.
+    """
+    chunk_size = struct.calcsize(CHUNK_HEADER_FORMAT)
+    ecg_parts = []
+    imu_parts = []
+    imu_index_parts = []
+    
+    while offset + chunk_size <= len(file_data):
+        ctype, count, first_index, payload_len = struct.unpack(
+            CHUNK_HEADER_FORMAT, file_data[offset:offset + chunk_size])
+        payload_start = offset + chunk_size
+        if payload_start + payload_len > len(file_data):
+            print(f"[WARNING] Chunk truncado en offset {offset}")
+            break
+        
+        if ctype == CHUNK_TYPE_ECG:
+            ecg, _ = decode_ecg_frames(file_data, payload_start, count)
+            ecg_parts.append(ecg)
+        elif ctype == CHUNK_TYPE_IMU:
+            imu = np.frombuffer(file_data[payload_start:payload_start + count * 6],
+                                dtype=np.int16).reshape(-1, 3)
+            imu_parts.append(imu)
+            imu_index_parts.append(first_index + np.arange(len(imu)) * imu_decimation)
+        else:
+            print(f"[WARNING] Chunk desconocido tipo {ctype} en offset {offset}")
         
-        return filtered, preprocessed, heart_rates, motion_mask
+        offset = payload_start + payload_len
+    
+    ecg = np.concatenate(ecg_parts) if ecg_parts else np.zeros((0, 3), dtype=np.int16)
+    imu = np.concatenate(imu_parts) if imu_parts else np.zeros((0, 3), dtype=np.int16)
+    imu_index = np.concatenate(imu_index_parts) if imu_index_parts else np.zeros(0, dtype=np.int64)
+    return ecg, imu, imu_index
 
 
-def parse_binary_file(file_data):
-    """Parsea archivo binario del ESP32 - VERSION SOLO ACELEROMETRO"""
-    print(f"[PARSE] Archivo de {len(file_data)} bytes")
+def data_block_tag(session_id, segment_seq):
+    """Igual que data_block_tag() en include/holter_format.h"""
+    h = (session_id ^ ((segment_seq * 0x9E3779B1) & 0xFFFFFFFF)) * 0x85EBCA6B
+    return (h & 0xFFFFFFFF) >> 16
+
+
+def header_block_tag(header):
+    """Etiqueta que deben llevar los bloques del archivo (None antes de v9)"""
+    if header['version'] < 9:
+        return None
+    return data_block_tag(header['session_id'], header['segment_seq'])
+
+
+def decode_data_block(block, imu_decimation, tag=None):
+    """
+    Valida y decodifica un bloque de 512 bytes del formato v7.
+    Retorna (tipo, first_index, datos) o None si el sync o el CRC no
+    coinciden (escritura cortada por un corte de energía) o si la etiqueta
+    es de otro segmento (v9).
+    """
+    header_size = struct.calcsize(DATA_BLOCK_HEADER_FORMAT)
+    sync, btype, count, first_index, payload_len, block_tag, crc = struct.unpack(
+        DATA_BLOCK_HEADER_FORMAT, block[:header_size])
+    check = zlib.crc32(block[:DATA_BLOCK_CRC_OFFSET] + b'\0\0\0\0' +
+                       block[DATA_BLOCK_CRC_OFFSET + 4:])
+    if sync != DATA_BLOCK_SYNC or crc != check or header_size + payload_len > DATA_BLOCK_SIZE:
+        return None
+    if tag is not None and block_tag != tag:
+        return None
+    
+    data = None
+    if btype == CHUNK_TYPE_ECG:
+        data, _ = decode_ecg_frames(block, header_size, count)
+    elif btype == CHUNK_TYPE_IMU:
+        imu = np.frombuffer(block[header_size:header_size + count * 6],
+                            dtype=np.int16).reshape(-1, 3)
+        data = (imu, first_index + np.arange(len(imu)) * imu_decimation)
+    elif btype == DATA_BLOCK_RPEAK:
+        data = np.frombuffer(block[header_size:header_size + count * RPEAK_DTYPE.itemsize],
+                             dtype=RPEAK_DTYPE)
+    elif btype == DATA_BLOCK_EVENT:
+        source, bpm = struct.unpack('<HH', block[header_size:header_size + 4])
+        data = {'ecg_index': first_index,
+                'source': EVENT_SOURCES.get(source, str(source)), 'bpm': bpm}
+    elif btype == DATA_BLOCK_STATS and payload_len >= struct.calcsize(STATS_FORMAT):
+        data = decode_stats(block[header_size:header_size + payload_len])
+    return btype, first_index, data
+
+
+def decode_stats(payload):
+    """Payload de un bloque DATA_BLOCK_STATS -> dict (histogramas como listas)"""
+    values = list(struct.unpack(STATS_FORMAT, payload[:struct.calcsize(STATS_FORMAT)]))
+    stats = {}
+    for name in STATS_FIELDS:
+        if name.endswith('_hist'):
+            stats[name] = values[:STATS_HIST_BINS]
+            del values[:STATS_HIST_BINS]
+        else:
+            stats[name] = values.pop(0)
+    # Muestras que el reloj esperaba y el muestreo no entregó
+    stats['samples_missed'] = max(0, stats['samples_expected'] - stats['samples_produced'])
+    return stats
+
+
+def fill_ecg_gap(previous, first, gap):
+    """
+    Relleno de un hueco ECG (muestras descartadas en el equipo: el bloque
+    siguiente empieza más adelante en first_ecg_index). Repite la última
+    muestra para que los índices de IMU, picos R y eventos sigan alineados
+    """
+    hold = previous[-1:] if previous is not None and len(previous) else first[:1]
+    return np.repeat(hold, gap, axis=0)
+
+
+def parse_data_blocks(file_data, offset, imu_decimation, tag=None):
+    """
+    Recorre los bloques de 512 bytes del formato v7 (escaneo lineal).
+    Un bloque con sync o CRC inválido (escritura cortada por un corte de
+    energía) se descarta y la lectura sigue con el siguiente.
+    Retorna lo mismo que parse_chunks() más las anotaciones de picos R
+    (RPEAK_DTYPE, índices globales) y los disparos de eventos.
+    """
+    ecg_parts = []
+    imu_parts = []
+    imu_index_parts = []
+    rpeak_parts = []
+    events = []
+    bad_blocks = 0
+    next_index = None
+    gap_samples = 0
+    
+    while offset + DATA_BLOCK_SIZE <= len(file_data):
+        block = decode_data_block(file_data[offset:offset + DATA_BLOCK_SIZE], imu_decimation, tag)
+        offset += DATA_BLOCK_SIZE
+        if block is None:
+            bad_blocks += 1
+            continue
+        
+        btype, first_index, data = block
+        if btype == CHUNK_TYPE_ECG:
+            if next_index is not None and first_index > next_index:
+                gap = first_index - next_index
+                ecg_parts.append(fill_ecg_gap(ecg_parts[-1] if ecg_parts else None, data, gap))
+                gap_samples += gap
+            ecg_parts.append(data)
+            next_index = first_index + len(data)
+        elif btype == CHUNK_TYPE_IMU:
+            imu_parts.append(data[0])
+            imu_index_parts.append(data[1])
+        elif btype == DATA_BLOCK_RPEAK:
+            rpeak_parts.append(data)
+        elif btype == DATA_BLOCK_EVENT:
+            events.append(data)
     
+    if bad_blocks:
+        print(f"[WARNING] {bad_blocks} bloques inválidos descartados")
+    if gap_samples:
+        print(f"[WARNING] {gap_samples} muestras ECG faltantes rellenadas (descartes del equipo)")
+    if offset < len(file_data):
+        print(f"[WARNING] Bloque final incompleto ({len(file_data) - offset} bytes)")
+    
+    ecg = np.concatenate(ecg_parts) if ecg_parts else np.zeros((0, 3), dtype=np.int16)
+    imu = np.concatenate(imu_parts) if imu_parts else np.zeros((0, 3), dtype=np.int16)
+    imu_index = np.concatenate(imu_index_parts) if imu_index_parts else np.zeros(0, dtype=np.int64)
+    rpeaks = np.concatenate(rpeak_parts) if rpeak_parts else np.zeros(0, dtype=RPEAK_DTYPE)
+    return ecg, imu, imu_index, rpeaks, events
+
+
+def iter_stream_blocks(body):
+    """
+    Bloques de DATA_BLOCK_SIZE de un stream (Body de get_object) leído de a
+    S3_READ_SIZE: el archivo no se carga completo en memoria
+    """
+    tail = b''
+    while True:
+        piece = body.read(S3_READ_SIZE)
+        if not piece:
+            break
+        data = tail + piece
+        usable = len(data) - len(data) % DATA_BLOCK_SIZE
+        for offset in range(0, usable, DATA_BLOCK_SIZE):
+            yield data[offset:offset + DATA_BLOCK_SIZE]
+        tail = data[usable:]
+    
+    if tail:
+        print(f"[WARNING] Bloque final incompleto ({len(tail)} bytes)")
+
+
+def stream_data_blocks(body, header, pipeline):
+    """
+    Lee los bloques v7 del stream y entrega ECG (mV) e IMU (g) al pipeline a
+    medida que llegan. Completa el header como parse_binary_file()
+    (contadores, eventos, picos R del equipo).
+    """
+    decimation = max(1, header['ecg_sample_rate'] // header['imu_sample_rate'])
+    first_sample = header['first_sample_index']
+    tag = header_block_tag(header)
+    rpeak_parts = []
+    events = []
+    bad_blocks = 0
+    num_blocks = 0
+    next_index = first_sample
+    last_mv = None
+    gap_samples = 0
+    
+    for raw_block in iter_stream_blocks(body):
+        num_blocks += 1
+        block = decode_data_block(raw_block, decimation, tag)
+        if block is None:
+            bad_blocks += 1
+            continue
+        
+        btype, first_index, data = block
+        if btype == CHUNK_TYPE_ECG:
+            ecg_mv = ecg_raw_to_mv(data, header)
+            if first_index > next_index:
+                gap = first_index - next_index
+                pipeline.add_ecg(fill_ecg_gap(last_mv, ecg_mv, gap))
+                gap_samples += gap
+            pipeline.add_ecg(ecg_mv)
+            next_index = first_index + len(ecg_mv)
+            last_mv = ecg_mv[-1:]
+        elif btype == CHUNK_TYPE_IMU:
+            pipeline.add_imu(data[0].astype(np.float32) * ACCEL_SCALE, data[1] - first_sample)
+        elif btype == DATA_BLOCK_RPEAK:
+            rpeak_parts.append(data)
+        elif btype == DATA_BLOCK_EVENT:
+            events.append(data)
+        elif btype == DATA_BLOCK_STATS and data is not None:
+            header['device_stats'] = data
+    
+    print(f"[PARSE] {num_blocks} bloques leídos")
+    stats = header.get('device_stats')
+    if stats and (stats['samples_missed'] or stats['samples_dropped']):
+        print(f"[WARNING] Equipo: {stats['samples_missed']} muestras faltantes, "
+              f"{stats['samples_dropped']} descartadas por SD lenta")
+    if bad_blocks:
+        print(f"[WARNING] {bad_blocks} bloques inválidos descartados")
+    if gap_samples:
+        print(f"[WARNING] {gap_samples} muestras ECG faltantes rellenadas (descartes del equipo)")
+    
+    header['num_ecg_samples'] = pipeline.received
+    header['num_imu_samples'] = pipeline.imu_received
+    rpeaks = np.concatenate(rpeak_parts) if rpeak_parts else np.zeros(0, dtype=RPEAK_DTYPE)
+    attach_annotations(header, rpeaks, events, pipeline.received)
+
+
+def attach_annotations(header, rpeaks, events, num_ecg):
+    """Eventos y picos R del equipo (índices globales) relativos al archivo"""
+    # Modo eventos: segundos del disparo desde el inicio del archivo
+    for event in events:
+        event['time_s'] = (event['ecg_index'] - header['first_sample_index']) / header['ecg_sample_rate']
+        print(f"[PARSE] Evento {event['source']} en {event['time_s']:.1f}s ({event['bpm']} lpm)")
+    header['events'] = events
+    # Un pico confirmado después del cierre del segmento queda en el
+    # siguiente: fuera de este archivo se descarta (a lo sumo un latido)
+    peak_index = rpeaks['ecg_index'].astype(np.int64) - header['first_sample_index']
+    in_file = (peak_index >= 0) & (peak_index < num_ecg)
+    if in_file.any():
+        header['device_peaks'] = (peak_index[in_file], rpeaks['rr_ms'][in_file])
+        print(f"[PARSE] Picos R del equipo: {in_file.sum()}")
+
+
+def adc_counts_to_mv(counts, header):
+    """Cuentas ADC (I, II) -> mV de ECG con la calibración del header; III = II - I"""
+    pin_mv = (counts[:, :2].astype(np.float64) * header['adc_coeff_a']) / 65536.0
+    ecg_mv = np.zeros((len(counts), 3), dtype=np.float32)
+    if header.get('ecg_filter', 0) & ECG_FILTER_HIGHPASS:
+        # El pasaaltos del equipo quitó la DC: ya no hay offset del ADC ni del AD8232
+        ecg_mv[:, :2] = pin_mv / header['ecg_gain']
+    else:
+        ecg_mv[:, :2] = (pin_mv + header['adc_coeff_b'] - header['ecg_offset_mv']) / header['ecg_gain']
+    ecg_mv[:, 2] = ecg_mv[:, 1] - ecg_mv[:, 0]
+    return ecg_mv
+
+
+def ecg_raw_to_mv(ecg_raw, header):
+    """Muestras ECG del archivo (cuentas ADC o mV escalados) -> mV"""
+    if header['ecg_sample_format'] == ECG_FORMAT_ADC_COUNTS:
+        return adc_counts_to_mv(ecg_raw, header)
+    return ecg_raw.astype(np.float32) / ECG_SCALE_FACTOR
+
+
+def parse_header(file_data):
+    """
+    Header del archivo (basta con los primeros HEADER_BLOCK_SIZE_V2 bytes).
+    Retorna (header, tamaño del header base).
+    """
     # Header: magic(4) + version(2) + device_id(2) + session_id(4) + timestamp(4) + 
     # ecg_rate(2) + imu_rate(2) + num_ecg(4) + num_imu(4) = 28 bytes
     header_format = '<IHHIIHHII'
@@ -306,8 +717,62 @@ def parse_binary_file(file_data):
         'num_imu_samples': header_data[8]
     }
     
-    header['ecg_sample_rate'] = ECG_SAMPLE_RATE_HZ
-    header['imu_sample_rate'] = IMU_SAMPLE_RATE_HZ
+    # La frecuencia real viene en el header (250/500/1000 Hz)
+    header['ecg_sample_rate'] = header['ecg_sample_rate_raw'] or ECG_SAMPLE_RATE_HZ
+    header['imu_sample_rate'] = header['imu_sample_rate_raw'] or IMU_SAMPLE_RATE_HZ
+    print(f"[PARSE] Frecuencias: ECG={header['ecg_sample_rate']}Hz, IMU={header['imu_sample_rate']}Hz")
+    
+    # Grabaciones largas: cada archivo es un segmento de la misma sesión
+    header['segment_seq'] = 0
+    header['first_sample_index'] = 0
+    if header['version'] >= 3:
+        ext_size = struct.calcsize(HEADER_V3_EXTENSION)
+        seq, first_idx = struct.unpack(HEADER_V3_EXTENSION,
+                                       file_data[header_size:header_size + ext_size])
+        header['segment_seq'] = seq
+        header['first_sample_index'] = first_idx
+        print(f"[PARSE] Segmento {seq} (primera muestra {first_idx})")
+    
+    header['ecg_codec'] = ECG_CODEC_RAW
+    if header['version'] >= 4:
+        v4_offset = header_size + struct.calcsize(HEADER_V3_EXTENSION)
+        codec, channels = struct.unpack(HEADER_V4_EXTENSION,
+                                        file_data[v4_offset:v4_offset + struct.calcsize(HEADER_V4_EXTENSION)])
+        header['ecg_codec'] = codec
+        header['ecg_channels'] = channels
+        print(f"[PARSE] Codec ECG: {codec} ({channels} derivaciones)")
+    
+    header['ecg_sample_format'] = ECG_FORMAT_SCALED_MV
+    if header['version'] >= 5:
+        v5_offset = (header_size + struct.calcsize(HEADER_V3_EXTENSION) +
+                     struct.calcsize(HEADER_V4_EXTENSION))
+        coeff_a, coeff_b, gain, offset_mv, sample_format = struct.unpack(
+            HEADER_V5_EXTENSION,
+            file_data[v5_offset:v5_offset + struct.calcsize(HEADER_V5_EXTENSION)])
+        header.update({
+            'adc_coeff_a': coeff_a,
+            'adc_coeff_b': coeff_b,
+            'ecg_gain': gain,
+            'ecg_offset_mv': offset_mv,
+            'ecg_sample_format': sample_format
+        })
+        print(f"[PARSE] Formato ECG: {sample_format} (ADC a={coeff_a} b={coeff_b} mV, ganancia {gain})")
+    
+    header['ecg_filter'] = 0
+    if header['version'] >= 8:
+        v8_offset = (header_size + struct.calcsize(HEADER_V3_EXTENSION) +
+                     struct.calcsize(HEADER_V4_EXTENSION) + struct.calcsize(HEADER_V5_EXTENSION))
+        ecg_filter, highpass_chz, lowpass_hz, notch_hz = struct.unpack(
+            HEADER_V8_EXTENSION,
+            file_data[v8_offset:v8_offset + struct.calcsize(HEADER_V8_EXTENSION)])
+        header.update({
+            'ecg_filter': ecg_filter,
+            'ecg_highpass_hz': highpass_chz / 100.0,
+            'ecg_lowpass_hz': lowpass_hz,
+            'ecg_notch_hz': notch_hz
+        })
+        print(f"[PARSE] Filtros del equipo: 0x{ecg_filter:X} (HPF {highpass_chz / 100.0} Hz, "
+              f"LPF {lowpass_hz} Hz, notch {notch_hz} Hz)")
     
     # Validar magic number con fallback
     expected_magic = 0x45434744  # "ECGD"
@@ -321,27 +786,62 @@ def parse_binary_file(file_data):
     print(f"[PARSE] ECG samples: {header['num_ecg_samples']}")
     print(f"[PARSE] IMU samples: {header['num_imu_samples']}")
     
+    return header, header_size
+
+
+def parse_binary_file(file_data):
+    """Parsea archivo binario del ESP32 - VERSION SOLO ACELEROMETRO"""
+    print(f"[PARSE] Archivo de {len(file_data)} bytes")
+    header, header_size = parse_header(file_data)
+    
     # Calcular tamaños
     ecg_sample_size = 6  # 3 x int16 (I, II, III)
     imu_sample_size = 6  # 3 x int16 (ax, ay, az)
     
-    ecg_size = header['num_ecg_samples'] * ecg_sample_size
-    ecg_start = header_size
-    ecg_end = ecg_start + ecg_size
+    ecg_start = HEADER_BLOCK_SIZE_V2 if header['version'] >= 2 else header_size
+    imu_raw = None
+    
+    if header['version'] >= 6:
+        decimation = max(1, header['ecg_sample_rate'] // header['imu_sample_rate'])
+        if header['version'] >= 7:
+            ecg_data_raw, imu_raw, imu_index, rpeaks, events = parse_data_blocks(
+                file_data, ecg_start, decimation, header_block_tag(header))
+            attach_annotations(header, rpeaks, events, len(ecg_data_raw))
+        else:
+            ecg_data_raw, imu_raw, imu_index = parse_chunks(file_data, ecg_start, decimation)
+        # Los contadores del header v7 quedan en 0: valen los bloques leídos
+        header['num_ecg_samples'] = len(ecg_data_raw)
+        header['num_imu_samples'] = len(imu_raw)
+        # Índice relativo al inicio del segmento -> segundos desde el inicio del archivo
+        header['imu_time_s'] = (imu_index - header['first_sample_index']) / header['ecg_sample_rate']
+        ecg_end = len(file_data)
+        ecg_size = ecg_end - ecg_start
+    elif header['ecg_codec'] == ECG_CODEC_RICE2:
+        ecg_data_raw, ecg_end = decode_ecg_frames(file_data, ecg_start, header['num_ecg_samples'])
+        ecg_size = ecg_end - ecg_start
+    else:
+        ecg_size = header['num_ecg_samples'] * ecg_sample_size
+        ecg_end = ecg_start + ecg_size
+        ecg_data_raw = np.frombuffer(file_data[ecg_start:ecg_end], dtype=np.int16).reshape(-1, 3)
     
     imu_start = ecg_end
     imu_size = header['num_imu_samples'] * imu_sample_size
     
-    print(f"[PARSE] ECG: offset {ecg_start}-{ecg_end} ({ecg_size} bytes)")
-    print(f"[PARSE] IMU: offset {imu_start}+ ({imu_size} bytes esperados)")
+    if imu_raw is None:
+        print(f"[PARSE] ECG: offset {ecg_start}-{ecg_end} ({ecg_size} bytes)")
+        print(f"[PARSE] IMU: offset {imu_start}+ ({imu_size} bytes esperados)")
+    else:
+        print(f"[PARSE] Chunks: offset {ecg_start}-{ecg_end} ({ecg_size} bytes)")
     
-    # Leer ECG
-    ecg_data_raw = np.frombuffer(file_data[ecg_start:ecg_end], dtype=np.int16).reshape(-1, 3)
-    ecg_data = ecg_data_raw.astype(np.float32) / ECG_SCALE_FACTOR
+    # Convertir ECG a mV
+    ecg_data = ecg_raw_to_mv(ecg_data_raw, header)
     print(f"[PARSE] ECG: shape={ecg_data.shape}, rango=[{ecg_data.min():.3f}, {ecg_data.max():.3f}] mV")
     
     # Leer IMU - SOLO ACELEROMETRO (3 valores)
-    if header['num_imu_samples'] > 0:
+    if imu_raw is not None:
+        imu_data = imu_raw.astype(np.float32) * ACCEL_SCALE
+        print(f"[PARSE] IMU (Accel): shape={imu_data.shape} (chunks)")
+    elif header['num_imu_samples'] > 0:
         imu_raw = np.frombuffer(file_data[imu_start:imu_start + imu_size], dtype=np.int16)
         n_imu = len(imu_raw) // 3  # 3 valores por muestra (ax, ay, az)
         imu_raw = imu_raw[:n_imu * 3].reshape(-1, 3)
@@ -356,67 +856,350 @@ def parse_binary_file(file_data):
         print(f"[PARSE] IMU: Sin datos (shape=(0, 3))")
     
     # Calcular duración
-    duration_ecg = len(ecg_data) / ECG_SAMPLE_RATE_HZ
-    duration_imu = len(imu_data) / IMU_SAMPLE_RATE_HZ if len(imu_data) > 0 else 0
+    duration_ecg = len(ecg_data) / header['ecg_sample_rate']
+    duration_imu = len(imu_data) / header['imu_sample_rate'] if len(imu_data) > 0 else 0
     print(f"[PARSE] Duración ECG: {duration_ecg:.2f}s, IMU: {duration_imu:.2f}s")
     
     return header, ecg_data, imu_data
 
 
-def generate_csv_data(ecg_raw, ecg_filtered, imu_data, motion_mask):
-    """Genera CSV con datos - VERSION SOLO ACELEROMETRO"""
-    output = StringIO()
-    writer = csv.writer(output)
-    
-    # Header
-    writer.writerow([
-        'time_ecg_s', 'ecg_I_raw_mV', 'ecg_II_raw_mV', 'ecg_III_raw_mV',
-        'ecg_I_filt_mV', 'ecg_II_filt_mV', 'ecg_III_filt_mV',
-        'time_imu_s', 'accel_x_g', 'accel_y_g', 'accel_z_g', 'motion_detected'
-    ])
-    
-    n_ecg = len(ecg_raw)
-    n_imu = len(imu_data)
-    max_rows = max(n_ecg, n_imu)
-    
-    for i in range(max_rows):
-        row = []
-        
-        # ECG data
-        if i < n_ecg:
-            t_ecg = i / ECG_SAMPLE_RATE_HZ
-            row.extend([
-                f"{t_ecg:.4f}",
-                f"{ecg_raw[i, 0]:.4f}", f"{ecg_raw[i, 1]:.4f}", f"{ecg_raw[i, 2]:.4f}",
-                f"{ecg_filtered[i, 0]:.4f}", f"{ecg_filtered[i, 1]:.4f}", f"{ecg_filtered[i, 2]:.4f}"
-            ])
-        else:
-            row.extend(['', '', '', '', '', '', ''])
-        
-        # IMU data 
-        if i < n_imu:
-            t_imu = i / IMU_SAMPLE_RATE_HZ
-            motion = 1 if i < len(motion_mask) and motion_mask[i] else 0
-            row.extend([
-                f"{t_imu:.4f}",
-                f"{imu_data[i, 0]:.4f}", f"{imu_data[i, 1]:.4f}", f"{imu_data[i, 2]:.4f}",
-                str(motion)
-            ])
-        else:
-            row.extend(['', '', '', '', ''])
-        
-        writer.writerow(row)
+def split_columns(columns):
+    """Argumentos de write(): columnas (N,) o grupos de columnas (N, k) -> lista de columnas"""
+    flat = []
+    for c in columns:
+        c = np.asarray(c)
+        flat.extend([c] if c.ndim == 1 else list(c.T))
+    return flat
+
+
+class CsvChunkWriter:
+    """CSV escrito por ventanas en /tmp; se sube al final con upload_file (multipart)"""
+    extension = 'csv'
+    content_type = 'text/csv'
+    
+    def __init__(self, path, columns):
+        self.path = path
+        self.fmt = ['%d' if np.dtype(dtype).kind in 'biu' else '%.4f' for _, dtype in columns]
+        self.rows = 0
+        self.file = open(path, 'w')
+        self.file.write(','.join(name for name, _ in columns) + '\n')
+    
+    def write(self, *columns):
+        """Agrega filas: cada argumento es una columna (N,) o un grupo de columnas (N, k)"""
+        table = np.column_stack([c.astype(np.float64) for c in split_columns(columns)])
+        if len(table):
+            np.savetxt(self.file, table, fmt=self.fmt, delimiter=',')
+        self.rows += len(table)
+    
+    def close(self):
+        self.file.close()
+
+
+class ParquetChunkWriter:
+    """
+    Parquet con un row group por ventana: las estadísticas min/max de cada
+    row group (tiempo incluido) permiten leer solo un rango de tiempo y las
+    columnas necesarias. Señales en float32, tiempo en float64.
+    """
+    extension = 'parquet'
+    content_type = 'application/vnd.apache.parquet'
+    
+    def __init__(self, path, columns):
+        self.path = path
+        self.rows = 0
+        self.dtypes = [np.dtype(dtype) for _, dtype in columns]
+        self.schema = pa.schema([(name, pa.from_numpy_dtype(dtype))
+                                 for (name, _), dtype in zip(columns, self.dtypes)])
+        self.writer = pq.ParquetWriter(path, self.schema, compression=PARQUET_COMPRESSION)
     
-    return output.getvalue()
+    def write(self, *columns):
+        """Agrega un row group: mismos argumentos que CsvChunkWriter.write()"""
+        flat = split_columns(columns)
+        if len(flat[0]) == 0:
+            return
+        arrays = [pa.array(c.astype(dtype, copy=False)) for c, dtype in zip(flat, self.dtypes)]
+        self.writer.write_table(pa.Table.from_arrays(arrays, schema=self.schema))
+        self.rows += len(flat[0])
+    
+    def close(self):
+        self.writer.close()
+
 
+def open_writers(base_name, table, columns):
+    """Un writer por formato de OUTPUT_FORMATS para la tabla `table` ('ecg' o 'imu')"""
+    formats = OUTPUT_FORMATS
+    if 'parquet' in formats and pa is None:
+        print("[WARNING] pyarrow no disponible: salida en CSV")
+        formats = [f for f in formats if f != 'parquet'] or ['csv']
+    
+    writers = []
+    for fmt in formats:
+        cls = {'csv': CsvChunkWriter, 'parquet': ParquetChunkWriter}.get(fmt)
+        if cls is None:
+            print(f"[WARNING] Formato de salida desconocido: {fmt}")
+            continue
+        writer = cls(os.path.join(TMP_DIR, f"{base_name}_{table}.{cls.extension}"), columns)
+        writer.suffix = f"{table}.{cls.extension}"
+        writers.append(writer)
+    return writers
 
-def generate_plots(ecg_filtered, ecg_raw, imu_accel, motion_mask, metadata, heart_rates):
+
+class ChunkedECGPipeline:
+    """
+    Procesamiento de grabaciones largas por ventanas (overlap-save): cada
+    ventana de CHUNK_SECONDS se filtra con CHUNK_OVERLAP_SECONDS de contexto
+    a cada lado y solo se conserva el centro, así los filtros de fase cero
+    y el wavelet no dejan costuras entre ventanas. La ventana se emite
+    cuando llega su contexto posterior (una ventana de retardo).
+    
+    La memoria depende de la ventana y no de la duración: solo se acumulan
+    los picos R y un minuto de vista previa para los gráficos.
+    """
+    
+    def __init__(self, processor, ecg_writers, imu_writers, device_filter=0):
+        self.processor = processor
+        self.fs = processor.ecg_sample_rate
+        self.chunk = CHUNK_SECONDS * self.fs
+        self.overlap = CHUNK_OVERLAP_SECONDS * self.fs
+        self.device_filter = device_filter
+        self.ecg_writers = ecg_writers
+        self.imu_writers = imu_writers
+        # Las tres derivaciones del wavelet en paralelo (pywt libera el GIL)
+        self.executor = ThreadPoolExecutor(max_workers=3)
+        
+        # ECG (mV) desde buffer_start; índices relativos al inicio del archivo
+        self.buffer = np.zeros((0, 3), dtype=np.float32)
+        self.parts = []
+        self.buffer_start = 0
+        self.received = 0
+        self.emitted = 0
+        
+        # IMU (g) pendiente con el índice ECG de cada muestra
+        self.imu = np.zeros((0, 3), dtype=np.float32)
+        self.imu_index = np.zeros(0, dtype=np.int64)
+        self.imu_parts = []
+        self.imu_received = 0
+        
+        # Resultados acumulados
+        self.num_chunks = 0
+        self.imu_motion = 0
+        self.peak_parts = [[], [], []]
+        self.preview_samples = PLOT_WINDOW_SECONDS * self.fs
+        self.preview = {'raw': [], 'filtered': [], 'imu': [], 'motion': []}
+        # Nivel de 1 s de la pirámide: min I/II/III, max I/II/III, muestras con movimiento, muestras
+        self.pyramid_parts = []
+    
+    def add_ecg(self, ecg_mv):
+        self.parts.append(ecg_mv)
+        self.received += len(ecg_mv)
+        self._process(final=False)
+    
+    def add_imu(self, accel_g, ecg_index):
+        self.imu_parts.append((accel_g, np.asarray(ecg_index, dtype=np.int64)))
+        self.imu_received += len(accel_g)
+    
+    def finish(self):
+        self._process(final=True)
+        self.executor.shutdown()
+        print(f"[CHUNKS] {self.num_chunks} ventanas de {CHUNK_SECONDS}s "
+              f"(contexto {CHUNK_OVERLAP_SECONDS}s), {self.received} muestras ECG")
+    
+    def _process(self, final):
+        while self.emitted < self.received:
+            # Falta el contexto posterior de la ventana: esperar más bloques
+            if not final and self.received - self.emitted < self.chunk + self.overlap:
+                return
+            
+            if self.parts:
+                self.buffer = np.concatenate([self.buffer] + self.parts)
+                self.parts = []
+            if self.imu_parts:
+                self.imu = np.concatenate([self.imu] + [p[0] for p in self.imu_parts])
+                self.imu_index = np.concatenate([self.imu_index] + [p[1] for p in self.imu_parts])
+                self.imu_parts = []
+            
+            end = min(self.emitted + self.chunk, self.received)
+            ctx_start = max(self.buffer_start, self.emitted - self.overlap)
+            ctx_end = min(self.received, end + self.overlap)
+            window = self.buffer[ctx_start - self.buffer_start:ctx_end - self.buffer_start]
+            self._process_window(window, ctx_start, self.emitted, end)
+            self.emitted = end
+            self.num_chunks += 1
+            
+            # Descartar lo que ya no hace falta como contexto
+            keep_from = self.emitted - self.overlap
+            if keep_from > self.buffer_start:
+                self.buffer = self.buffer[keep_from - self.buffer_start:]
+                self.buffer_start = keep_from
+            old = self.imu_index < keep_from
+            if old.any():
+                self.imu = self.imu[~old]
+                self.imu_index = self.imu_index[~old]
+    
+    def _process_window(self, window, ctx_start, start, end):
+        n = len(window)
+        keep = slice(start - ctx_start, end - ctx_start)
+        
+        # Movimiento con las muestras IMU de la ventana y su contexto
+        in_window = (self.imu_index >= ctx_start) & (self.imu_index < ctx_start + n)
+        imu_win = self.imu[in_window]
+        imu_idx = self.imu_index[in_window]
+        motion_imu = self.processor.detect_motion_segments(imu_win, verbose=False)
+        
+        # A tasa ECG: estado de la última muestra IMU tomada (sin IMU = quieto)
+        motion_ecg = np.zeros(n, dtype=bool)
+        if len(imu_idx):
+            pos = np.searchsorted(imu_idx, np.arange(ctx_start, ctx_start + n), side='right') - 1
+            motion_ecg[pos >= 0] = motion_imu[pos[pos >= 0]]
+        
+        # HPF + LPF + Notch de las tres derivaciones juntas, wavelet por derivación
+        preprocessed = self.processor.preprocess_ecg(window, self.device_filter, verbose=False)
+        filtered = np.column_stack(list(self.executor.map(
+            lambda lead: self.processor.wavelet_by_motion(preprocessed[:, lead], motion_ecg),
+            range(3))))
+        
+        for lead in range(3):
+            peaks = self.processor.find_r_peaks(filtered[:, lead])
+            peaks = peaks[(peaks >= keep.start) & (peaks < keep.stop)]
+            self.peak_parts[lead].append(peaks + ctx_start)
+        
+        raw = window[keep]
+        filtered = filtered[keep].astype(np.float32)
+        motion = motion_ecg[keep]
+        
+        # Las ventanas empiezan en un segundo entero: buckets de 1 s alineados
+        starts = np.arange(0, len(filtered), self.fs)
+        self.pyramid_parts.append(np.column_stack([
+            np.minimum.reduceat(filtered, starts, axis=0),
+            np.maximum.reduceat(filtered, starts, axis=0),
+            np.add.reduceat(motion.astype(np.float64), starts),
+            np.diff(np.append(starts, len(filtered)))]))
+        for writer in self.ecg_writers:
+            writer.write(np.arange(start, end) / self.fs, raw, filtered, motion)
+        
+        imu_keep = (imu_idx >= start) & (imu_idx < end)
+        for writer in self.imu_writers:
+            writer.write(imu_idx[imu_keep] / self.fs, imu_win[imu_keep], motion_imu[imu_keep])
+        self.imu_motion += int(motion_imu[imu_keep].sum())
+        
+        if start < self.preview_samples:
+            count = min(end, self.preview_samples) - start
+            imu_preview = imu_keep & (imu_idx < self.preview_samples)
+            self.preview['raw'].append(raw[:count])
+            self.preview['filtered'].append(filtered[:count])
+            self.preview['imu'].append(imu_win[imu_preview])
+            self.preview['motion'].append(motion_imu[imu_preview])
+    
+    def motion_percentage(self):
+        return self.imu_motion / self.imu_received * 100 if self.imu_received else 0
+    
+    def heart_rates(self, device_peaks=None):
+        """BPM y picos R por derivación sobre toda la grabación"""
+        heart_rates = {}
+        for lead_idx, lead_name in enumerate(['I', 'II', 'III']):
+            # Los picos R del equipo valen para las tres derivaciones
+            if device_peaks is not None:
+                bpm, r_peaks = self.processor.heart_rate_from_device(*device_peaks, lead_idx)
+            else:
+                r_peaks = np.concatenate(self.peak_parts[lead_idx])
+                # Recortar 1 segundo al inicio y 1 al final (transitorio de los filtros)
+                r_peaks = r_peaks[(r_peaks >= self.fs) & (r_peaks < self.received - self.fs)]
+                bpm, r_peaks = self.processor.heart_rate_from_peaks(r_peaks, lead_idx)
+            heart_rates[lead_name] = {
+                'bpm': float(bpm),
+                'num_beats': len(r_peaks),
+                'r_peaks': np.asarray(r_peaks).tolist()
+            }
+        return heart_rates
+    
+    def pyramid(self):
+        """Niveles PYRAMID_LEVELS_SECONDS a partir del nivel de 1 s: {nivel_s: array (N, 8)}"""
+        base = np.concatenate(self.pyramid_parts) if self.pyramid_parts else np.zeros((0, 8))
+        levels = {}
+        for level in PYRAMID_LEVELS_SECONDS:
+            starts = np.arange(0, len(base), level)
+            if len(starts) == 0:
+                levels[level] = base
+                continue
+            levels[level] = np.column_stack([
+                np.minimum.reduceat(base[:, 0:3], starts, axis=0),
+                np.maximum.reduceat(base[:, 3:6], starts, axis=0),
+                np.add.reduceat(base[:, 6:8], starts, axis=0)])
+        return levels
+    
+    def preview_data(self, heart_rates):
+        """Primer minuto (ECG crudo, filtrado, IMU, movimiento) y sus picos R para los gráficos"""
+        def joined(parts, shape, dtype):
+            return np.concatenate(parts) if parts else np.zeros(shape, dtype=dtype)
+        
+        raw = joined(self.preview['raw'], (0, 3), np.float32)
+        filtered = joined(self.preview['filtered'], (0, 3), np.float32)
+        imu = joined(self.preview['imu'], (0, 3), np.float32)
+        motion = joined(self.preview['motion'], 0, bool)
+        preview_rates = {}
+        for lead, hr in heart_rates.items():
+            peaks = np.asarray(hr['r_peaks'], dtype=np.int64)
+            preview_rates[lead] = dict(hr, r_peaks=peaks[peaks < len(filtered)])
+        return raw, filtered, imu, motion, preview_rates
+
+
+def write_pyramid(writers, levels):
+    """Una tabla con todos los niveles; un row group por nivel (filtro por level_s)"""
+    for level, buckets in levels.items():
+        n = len(buckets)
+        motion_fraction = buckets[:, 6] / np.maximum(buckets[:, 7], 1)
+        for writer in writers:
+            writer.write(np.full(n, level), np.arange(n) * float(level), buckets[:, :6], motion_fraction)
+
+
+def generate_overview_plot(levels, metadata):
+    """
+    Envolvente min/max de toda la grabación desde la pirámide: el costo no
+    depende de la duración (a lo sumo OVERVIEW_MAX_BUCKETS por derivación)
+    """
+    level = next((lv for lv in sorted(levels) if len(levels[lv]) <= OVERVIEW_MAX_BUCKETS),
+                 max(levels))
+    buckets = levels[level]
+    if len(buckets) == 0:
+        return None
+    time_s = np.arange(len(buckets)) * level
+    motion_fraction = buckets[:, 6] / np.maximum(buckets[:, 7], 1)
+    duration_sec = metadata['duration_seconds']
+    
+    fig, axes = plt.subplots(3, 1, figsize=(14, 10), sharex=True)
+    fig.suptitle(f'ECG Filtrado - Grabación completa ({duration_sec / 60:.1f} min, buckets de {level}s)',
+                 fontsize=14, fontweight='bold')
+    
+    for i, (ax, lead_name) in enumerate(zip(axes, ['I', 'II', 'III'])):
+        ax.fill_between(time_s, buckets[:, i], buckets[:, 3 + i], step='post',
+                        color='darkblue', linewidth=0)
+        # Tramos con movimiento (fracción del bucket)
+        ymin, ymax = ax.get_ylim()
+        ax.fill_between(time_s, ymin, ymin + (ymax - ymin) * motion_fraction, step='post',
+                        color='orange', alpha=0.3, linewidth=0)
+        ax.set_ylim(ymin, ymax)
+        ax.set_ylabel(f'{lead_name} (mV)', fontsize=10)
+        ax.grid(True, alpha=0.3)
+    
+    axes[-1].set_xlabel('Tiempo (s)', fontsize=11)
+    axes[-1].set_xlim(0, time_s[-1] + level)
+    plt.tight_layout()
+    
+    buf = BytesIO()
+    plt.savefig(buf, format='png', dpi=150)
+    buf.seek(0)
+    plt.close()
+    return buf.getvalue()
+
+
+def generate_plots(ecg_filtered, ecg_raw, imu_accel, motion_mask, metadata, heart_rates,
+                   ecg_fs=ECG_SAMPLE_RATE_HZ, imu_fs=IMU_SAMPLE_RATE_HZ):
     """Genera visualizaciones"""
     n_ecg = len(ecg_filtered)
     n_imu = len(imu_accel)
     
-    time_ecg = np.arange(n_ecg) / ECG_SAMPLE_RATE_HZ
-    time_imu = np.arange(n_imu) / IMU_SAMPLE_RATE_HZ if n_imu > 0 else np.array([])
+    time_ecg = np.arange(n_ecg) / ecg_fs
+    time_imu = np.arange(n_imu) / imu_fs if n_imu > 0 else np.array([])
     
     # Resamplear motion_mask para ECG
     if len(motion_mask) > 0 and len(motion_mask) != n_ecg:
@@ -427,7 +1210,7 @@ def generate_plots(ecg_filtered, ecg_raw, imu_accel, motion_mask, metadata, hear
     
     plots = {}
     
-    duration_sec = n_ecg / ECG_SAMPLE_RATE_HZ
+    duration_sec = n_ecg / ecg_fs
     print(f"[PLOTS] Duración: {duration_sec:.2f}s, ECG: {n_ecg}, IMU: {n_imu}")
     
     # ========== PLOT 1: ECG Filtrado ==========
@@ -594,50 +1377,91 @@ def lambda_handler(event, context):
         
         print(f"[INFO] Procesando: s3://{bucket_name}/{object_key}")
         
-        # Descargar
+        # Leer por bloques: el objeto no se descarga completo
         response = s3_client.get_object(Bucket=bucket_name, Key=object_key)
-        file_data = response['Body'].read()
-        print(f"[INFO] Descargado: {len(file_data) / 1024:.2f} KB")
+        body = response['Body']
+        print(f"[INFO] Objeto: {response.get('ContentLength', 0) / 1024:.2f} KB")
         
-        # Parsear
-        header, ecg_data, imu_data = parse_binary_file(file_data)
+        head = body.read(HEADER_BLOCK_SIZE_V2)
+        header, _ = parse_header(head)
         
         # Crear procesador
-        processor = SignalProcessor(ecg_fs=ECG_SAMPLE_RATE_HZ, imu_fs=IMU_SAMPLE_RATE_HZ)
+        ecg_fs = header['ecg_sample_rate']
+        imu_fs = header['imu_sample_rate']
+        processor = SignalProcessor(ecg_fs=ecg_fs, imu_fs=imu_fs)
         
-        # Detectar movimiento (solo si hay datos IMU)
-        if len(imu_data) > 0:
-            accel_data = imu_data  # Ya es solo acelerómetro (3 columnas)
-            motion_mask_imu = processor.detect_motion_segments(accel_data)
-            motion_percentage = (motion_mask_imu.sum() / len(motion_mask_imu)) * 100 if len(motion_mask_imu) > 0 else 0
-        else:
-            motion_mask_imu = np.array([], dtype=bool)
-            motion_percentage = 0
-            print("[INFO] Sin datos IMU")
+        # Salida por columnas, escrita ventana a ventana
+        base_key = object_key.replace('raw/', 'processed/').replace('.bin', '')
+        base_name = os.path.basename(base_key)
+        ecg_writers = open_writers(base_name, 'ecg', ECG_COLUMNS)
+        imu_writers = open_writers(base_name, 'imu', IMU_COLUMNS)
         
-        # Procesar ECG
         print("[INFO] Procesando ECG...")
-        ecg_filtered, ecg_preprocessed, heart_rates, motion_mask_ecg = processor.process_ecg_with_motion(
-            ecg_data, motion_mask_imu
-        )
+        pipeline = ChunkedECGPipeline(processor, ecg_writers, imu_writers,
+                                      device_filter=header['ecg_filter'])
+        if header['version'] >= 7:
+            stream_data_blocks(body, header, pipeline)
+        else:
+            # Formatos anteriores (segmentos cortos): parseo completo y el mismo pipeline
+            header, ecg_data, imu_data = parse_binary_file(head + body.read())
+            if 'imu_time_s' in header:
+                imu_index = np.round(header['imu_time_s'] * ecg_fs).astype(np.int64)
+            else:
+                imu_index = np.arange(len(imu_data), dtype=np.int64) * max(1, ecg_fs // imu_fs)
+            pipeline.add_imu(imu_data, imu_index)
+            pipeline.add_ecg(ecg_data)
+        pipeline.finish()
+        
+        # Pirámide min/max para gráficos y visores
+        pyramid = pipeline.pyramid()
+        pyramid_writers = open_writers(base_name, 'pyramid', PYRAMID_COLUMNS)
+        write_pyramid(pyramid_writers, pyramid)
+        
+        signal_writers = ecg_writers + imu_writers + pyramid_writers
+        for writer in signal_writers:
+            writer.close()
+        
+        if header['num_imu_samples'] == 0:
+            print("[INFO] Sin datos IMU")
+        motion_percentage = pipeline.motion_percentage()
+        heart_rates = pipeline.heart_rates(header.get('device_peaks'))
         
         # BPM promedio
         avg_bpm = np.mean([hr['bpm'] for hr in heart_rates.values()]) if heart_rates else 0
         
         # Metadata
-        duration_sec = len(ecg_data) / ECG_SAMPLE_RATE_HZ
+        duration_sec = pipeline.received / ecg_fs
         metadata = {
             'processing_timestamp': datetime.utcnow().isoformat(),
             'source_file': object_key,
             'duration_seconds': float(duration_sec),
             'motion_percentage': float(motion_percentage),
-            'ecg_samples': int(len(ecg_filtered)),
-            'imu_samples': int(len(imu_data)),
-            'ecg_sample_rate_hz': ECG_SAMPLE_RATE_HZ,
-            'imu_sample_rate_hz': IMU_SAMPLE_RATE_HZ,
+            'ecg_samples': int(pipeline.received),
+            'imu_samples': int(pipeline.imu_received),
+            'ecg_sample_rate_hz': ecg_fs,
+            'imu_sample_rate_hz': imu_fs,
             'header_ecg_rate': header['ecg_sample_rate_raw'],
             'header_imu_rate': header['imu_sample_rate_raw'],
+            'session_id': header['session_id'],
+            'segment_seq': header['segment_seq'],
+            'first_sample_index': header['first_sample_index'],
+            'segment_start_seconds': header['first_sample_index'] / ecg_fs,
             'imu_mode': 'accelerometer_only',
+            'r_peak_source': 'device' if 'device_peaks' in header else 'backend',
+            'device_filter': header['ecg_filter'],
+            'events': header.get('events', []),
+            'device_stats': header.get('device_stats'),
+            'processing': {
+                'chunk_seconds': CHUNK_SECONDS,
+                'overlap_seconds': CHUNK_OVERLAP_SECONDS,
+                'chunks': pipeline.num_chunks,
+                'output_formats': sorted({w.extension for w in ecg_writers}),
+                'plot_window_seconds': PLOT_WINDOW_SECONDS
+            },
+            'pyramid': {
+                'levels_seconds': PYRAMID_LEVELS_SECONDS,
+                'buckets': {str(level): len(buckets) for level, buckets in pyramid.items()}
+            },
             'heart_rate': {
                 'average_bpm': float(avg_bpm),
                 'lead_I': heart_rates.get('I', {}),
@@ -651,19 +1475,18 @@ def lambda_handler(event, context):
         for lead, hr in heart_rates.items():
             print(f"[RESULTS] Lead {lead}: {hr['bpm']:.1f} BPM ({hr['num_beats']} latidos)")
         
-        # Generar plots
+        # Generar plots (primer minuto a resolución completa)
         print("[INFO] Generando visualizaciones...")
+        preview_raw, preview_filtered, preview_imu, preview_motion, preview_rates = \
+            pipeline.preview_data(heart_rates)
         plots = generate_plots(
-            ecg_filtered, ecg_data, imu_data, 
-            motion_mask_imu, metadata, heart_rates
+            preview_filtered, preview_raw, preview_imu,
+            preview_motion, metadata, preview_rates,
+            ecg_fs=ecg_fs, imu_fs=imu_fs
         )
-        
-        # Generar CSV con datos
-        print("[INFO] Generando CSV...")
-        csv_data = generate_csv_data(ecg_data, ecg_filtered, imu_data, motion_mask_imu)
-        
-        # Base path
-        base_key = object_key.replace('raw/', 'processed/').replace('.bin', '')
+        overview = generate_overview_plot(pyramid, metadata)
+        if overview is not None:
+            plots['ecg_overview.png'] = overview
         
         uploaded_files = []
         
@@ -677,14 +1500,14 @@ def lambda_handler(event, context):
             uploaded_files.append(output_key)
             print(f"[SUCCESS] {output_key}")
         
-        # Subir CSV
-        csv_key = f"{base_key}_signals.csv"
-        s3_client.put_object(
-            Bucket=OUTPUT_BUCKET, Key=csv_key,
-            Body=csv_data.encode('utf-8'), ContentType='text/csv'
-        )
-        uploaded_files.append(csv_key)
-        print(f"[SUCCESS] {csv_key}")
+        # Subir tablas (ECG e IMU cada uno a su frecuencia, pirámide)
+        for writer in signal_writers:
+            output_key = f"{base_key}_{writer.suffix}"
+            s3_client.upload_file(writer.path, OUTPUT_BUCKET, output_key,
+                                  ExtraArgs={'ContentType': writer.content_type})
+            os.remove(writer.path)
+            uploaded_files.append(output_key)
+            print(f"[SUCCESS] {output_key} ({writer.rows} filas)")
         
         # Subir metadata JSON
         metadata_key = f"{base_key}_metadata.json"
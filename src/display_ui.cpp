@@ -1,4 +1,10 @@
 #include "display_ui.h"
+#include "holter_capture.h"
+#include "holter_config.h"
+#include "holter_log.h"
+#include <Wire.h>
+#include <time.h>
+#include <atomic>
 
 // ============================================================================
 // CONFIGURACIÓN HARDWARE
@@ -8,40 +14,169 @@
 #define SCREEN_HEIGHT 64
 #define OLED_RESET -1
 #define BUTTON_PIN 0
-#define BATTERY_PIN 36
+
+// El OLED comparte el bus con el IMU: la librería no debe dejarlo en
+// 100 kHz al terminar cada transferencia
+static const uint32_t OLED_I2C_CLOCK_HZ = 400000;
+static const uint8_t SCREEN_PAGES = SCREEN_HEIGHT / 8;
+
+// Tarea del display: core 0, debajo de SD y a la par de la red. La
+// adquisición (core 1) nunca la espera
+static const BaseType_t DISPLAY_CORE = 0;
+static const UBaseType_t DISPLAY_PRIORITY = 1;
+static const uint32_t DISPLAY_STACK = 4096;
+
+// Bytes de datos por transacción I2C (~0.8 ms a 400 kHz): el IMU no espera
+// el bus más que eso. El Wire del ESP32 serializa las transacciones entre tareas
+static const size_t I2C_CHUNK = 30;
 
 // ============================================================================
 // VARIABLES INTERNAS (PRIVADAS)
 // ============================================================================
 
-static Adafruit_SSD1306 display(SCREEN_WIDTH, SCREEN_HEIGHT, &Wire, OLED_RESET);
+static Adafruit_SSD1306 display(SCREEN_WIDTH, SCREEN_HEIGHT, &Wire, OLED_RESET,
+                                OLED_I2C_CLOCK_HZ, OLED_I2C_CLOCK_HZ);
 static XSpaceBioV10Board* g_bioBoard = nullptr;
-
-// Estado
-static DisplayMode currentMode = DISP_IDLE;
-static float currentProgress = 0.0;
-static String currentMessage = "";
-static String currentText = "";
-static unsigned long messageTimeout = 0;
+static TaskHandle_t displayTask = nullptr;
+static uint8_t oledAddress = 0;                // 0 = sin OLED
+
+// Estado (lo escriben loop() y otras tareas, lo dibuja la tarea del display)
+static volatile DisplayMode currentMode = DISP_IDLE;
+static volatile int currentProgress = 0;       // 0-100 %
+static char currentMessage[64] = "";
+static char currentText[18] = "";              // Una línea a la izquierda de la batería
+static portMUX_TYPE textMux = portMUX_INITIALIZER_UNLOCKED;
+static volatile unsigned long messageTimeout = 0;
+static std::atomic<bool> redrawRequested(true);
+static std::atomic<bool> textChanged(false);
+static std::atomic<bool> clearRequested(false);
+
+// Lo que hay en pantalla (solo la tarea del display)
+static DisplayMode drawnMode = DISP_IDLE;
+static int drawnProgress = -1;
+static unsigned long lastDrawTime = 0;
+static unsigned long splashUntil = 0;
+static bool waveTapEnabled = false;
 
 // Botón
 static byte lastButtonState = HIGH;
 static unsigned long lastDebounceTime = 0;
 static const unsigned long debounceDelay = 50;
 
-// ECG para display
-static float ecg_I = 0.0;
-static float ecg_II = 0.0;
-static float ecg_III = 0.0;
-
-// Timing
-static unsigned long lastUpdateTime = 0;
-static const unsigned long UPDATE_INTERVAL = 200; // 200ms = 5fps
+// Barra de estado: se recalcula a 1 Hz y solo se redibuja si cambió
+static const unsigned long STATUS_INTERVAL = 1000;
+static const unsigned long PROGRESS_INTERVAL = 200;
+static const unsigned long SPLASH_MS = 2000;
+static BatteryInfo battery = {0.0f, 0};
+static unsigned long lastStatusTime = 0;
+static char statusTime[9] = "";
+static char statusHeartRate[8] = "";
+static int statusBattery = -1;
+
+// Forma de onda: barrido de monitor en las páginas 2-7. El cursor borra
+// WAVE_GAP columnas por delante; cada columna nueva toca WAVE_GAP + 1
+// columnas de 6 páginas, el resto de la pantalla no se reenvía
+static const int16_t WAVE_TOP = 16;
+static const int16_t WAVE_HEIGHT = SCREEN_HEIGHT - WAVE_TOP;
+static const int16_t WAVE_GAP = 4;
+static const int32_t WAVE_MIN_SPAN = 32;       // Cuentas: el ruido no llena la altura
+static const size_t WAVE_READ_POINTS = 16;
+static int16_t sweepX = 0;
+static int16_t lastWaveY = -1;
+static int32_t scaleLo = 0;
+static int32_t scaleHi = 0;                    // scaleHi <= scaleLo: sin escala aún
+static int32_t sweepMin = INT32_MAX;
+static int32_t sweepMax = INT32_MIN;
+
+// Ventana modificada por página (columnas dirtyLo..dirtyHi)
+static bool pageDirty[SCREEN_PAGES];
+static uint8_t dirtyLo[SCREEN_PAGES];
+static uint8_t dirtyHi[SCREEN_PAGES];
 
 // ============================================================================
 // FUNCIONES INTERNAS (PRIVADAS)
 // ============================================================================
 
+static void markDirty(int16_t x, int16_t y, int16_t w, int16_t h) {
+  if (x < 0) { w += x; x = 0; }
+  if (y < 0) { h += y; y = 0; }
+  if (x + w > SCREEN_WIDTH) w = SCREEN_WIDTH - x;
+  if (y + h > SCREEN_HEIGHT) h = SCREEN_HEIGHT - y;
+  if (w <= 0 || h <= 0) return;
+  
+  uint8_t lo = (uint8_t)x;
+  uint8_t hi = (uint8_t)(x + w - 1);
+  for (int16_t page = y / 8; page <= (y + h - 1) / 8; page++) {
+    if (!pageDirty[page]) {
+      pageDirty[page] = true;
+      dirtyLo[page] = lo;
+      dirtyHi[page] = hi;
+    } else {
+      if (lo < dirtyLo[page]) dirtyLo[page] = lo;
+      if (hi > dirtyHi[page]) dirtyHi[page] = hi;
+    }
+  }
+}
+
+static void markAllDirty() {
+  markDirty(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
+}
+
+static void sendCommands(const uint8_t* commands, size_t len) {
+  Wire.beginTransmission(oledAddress);
+  Wire.write((uint8_t)0x00);   // Co = 0, D/C = 0: comandos
+  Wire.write(commands, len);
+  Wire.endTransmission();
+}
+
+// Envía solo las páginas modificadas. Las páginas consecutivas se agrupan
+// en una ventana de direcciones; en direccionamiento horizontal el
+// controlador la recorre página por página con un solo comando
+static void flushDirty() {
+  const uint8_t* buffer = display.getBuffer();
+  uint8_t page = 0;
+  
+  while (page < SCREEN_PAGES) {
+    if (!pageDirty[page]) {
+      page++;
+      continue;
+    }
+  
+    uint8_t first = page;
+    uint8_t lo = dirtyLo[page];
+    uint8_t hi = dirtyHi[page];
+    while (page + 1 < SCREEN_PAGES && pageDirty[page + 1]) {
+      page++;
+      if (dirtyLo[page] < lo) lo = dirtyLo[page];
+      if (dirtyHi[page] > hi) hi = dirtyHi[page];
+    }
+    uint8_t last = page;
+  
+    const uint8_t window[] = {SSD1306_COLUMNADDR, lo, hi, SSD1306_PAGEADDR, first, last};
+    sendCommands(window, sizeof(window));
+  
+    size_t chunk = 0;
+    for (uint8_t p = first; p <= last; p++) {
+      for (uint8_t x = lo; x <= hi; x++) {
+        if (chunk == 0) {
+          Wire.beginTransmission(oledAddress);
+          Wire.write((uint8_t)0x40);   // Co = 0, D/C = 1: datos
+        }
+        Wire.write(buffer[p * SCREEN_WIDTH + x]);
+        if (++chunk == I2C_CHUNK) {
+          Wire.endTransmission();
+          chunk = 0;
+        }
+      }
+      pageDirty[p] = false;
+    }
+    if (chunk > 0) {
+      Wire.endTransmission();
+    }
+    page++;
+  }
+}
+
 static void drawBatteryIconInternal(int x, int y, int percentage) {
   display.drawRect(x, y, 18, 9, SSD1306_WHITE);
   display.fillRect(x + 18, y + 2, 2, 5, SSD1306_WHITE);
@@ -49,58 +184,153 @@ static void drawBatteryIconInternal(int x, int y, int percentage) {
   display.fillRect(x + 2, y + 2, fillWidth, 5, SSD1306_WHITE);
 }
 
-static BatteryInfo getBatteryStatusInternal() {
-  BatteryInfo battery;
-  int rawValue = analogRead(BATTERY_PIN);
-  battery.voltage = (rawValue / 4095.0) * 2.0 * 3.3;
+static void readBatteryInternal() {
+  // Con el ADC continuo la captura lee la batería en su patrón: analogRead()
+  // sacaría al ADC1 del modo continuo
+  uint16_t captureRaw;
+  int rawValue;
+  if (holter_getBatteryRaw(captureRaw)) {
+    rawValue = captureRaw;
+  } else if (HOLTER_ECG_ADC_DMA && holter_isCapturing()) {
+    return;   // Primera lectura del DMA todavía en curso
+  } else {
+    rawValue = analogRead(HOLTER_BATTERY_PIN);
+  }
+  battery.voltage = (rawValue / 4095.0f) * 2.0f * 3.3f;
   
-  if (battery.voltage >= 4.1) battery.percentage = 100;
-  else if (battery.voltage >= 3.9) battery.percentage = 80;
-  else if (battery.voltage >= 3.7) battery.percentage = 60;
-  else if (battery.voltage >= 3.5) battery.percentage = 40;
-  else if (battery.voltage >= 3.3) battery.percentage = 20;
+  if (battery.voltage >= 4.1f) battery.percentage = 100;
+  else if (battery.voltage >= 3.9f) battery.percentage = 80;
+  else if (battery.voltage >= 3.7f) battery.percentage = 60;
+  else if (battery.voltage >= 3.5f) battery.percentage = 40;
+  else if (battery.voltage >= 3.3f) battery.percentage = 20;
   else battery.percentage = 10;
-  
-  return battery;
 }
 
-static String obtenerHoraActual() {
+// Sin NTP todavía: guiones (getLocalTime() esperaría hasta 5 s)
+static void formatTime(char* out, size_t len) {
+  time_t now = time(nullptr);
   struct tm timeinfo;
-  if (!getLocalTime(&timeinfo)) return "00:00:00";
-  
-  char buffer[10];
-  sprintf(buffer, "%02d:%02d:%02d", timeinfo.tm_hour, timeinfo.tm_min, timeinfo.tm_sec);
-  return String(buffer);
+  localtime_r(&now, &timeinfo);
+  if (timeinfo.tm_year < (2020 - 1900)) {
+    strncpy(out, "--:--:--", len);
+    return;
+  }
+  snprintf(out, len, "%02d:%02d:%02d", timeinfo.tm_hour, timeinfo.tm_min, timeinfo.tm_sec);
 }
 
-static void drawIdleScreen() {
-  display.clearDisplay();
+static void formatHeartRate(char* out, size_t len) {
+  HeartRateInfo heartRate;
+  if (holter_getHeartRate(heartRate)) {
+    snprintf(out, len, "%ulpm", (unsigned)heartRate.bpm);
+  } else {
+    strncpy(out, "--lpm", len);
+  }
+}
+
+// Hora, frecuencia cardíaca y batería en la página 0
+static void updateStatus(bool force) {
+  char timeText[sizeof(statusTime)];
+  char heartRateText[sizeof(statusHeartRate)];
+  formatTime(timeText, sizeof(timeText));
+  formatHeartRate(heartRateText, sizeof(heartRateText));
+  readBatteryInternal();
   
-  // Hora arriba a la izquierda
   display.setTextSize(1);
-  display.setCursor(0, 0);
-  display.print(obtenerHoraActual());
-  
-  // Batería arriba a la derecha
-  BatteryInfo battery = getBatteryStatusInternal();
-  drawBatteryIconInternal(105, 0, battery.percentage);
+  if (force || strcmp(timeText, statusTime) != 0) {
+    strcpy(statusTime, timeText);
+    display.fillRect(0, 0, 54, 8, SSD1306_BLACK);
+    display.setCursor(0, 0);
+    display.print(statusTime);
+    markDirty(0, 0, 54, 8);
+  }
+  if (force || strcmp(heartRateText, statusHeartRate) != 0) {
+    strcpy(statusHeartRate, heartRateText);
+    display.fillRect(60, 0, 42, 8, SSD1306_BLACK);
+    display.setCursor(60, 0);
+    display.print(statusHeartRate);
+    markDirty(60, 0, 42, 8);
+  }
+  if (force || battery.percentage != statusBattery) {
+    statusBattery = battery.percentage;
+    display.fillRect(105, 0, 20, 9, SSD1306_BLACK);
+    drawBatteryIconInternal(105, 0, statusBattery);
+    markDirty(105, 0, 20, 9);
+  }
+}
+
+static void drawTextLine() {
+  char text[sizeof(currentText)];
+  portENTER_CRITICAL(&textMux);
+  memcpy(text, currentText, sizeof(text));
+  portEXIT_CRITICAL(&textMux);
   
-  // ECG en el centro
+  display.fillRect(0, 8, 104, 8, SSD1306_BLACK);
   display.setTextSize(1);
-  display.setCursor(0, 20);
-  display.printf("I:  %.2f mV", ecg_I);
-  display.setCursor(0, 32);
-  display.printf("II: %.2f mV", ecg_II);
-  display.setCursor(0, 44);
-  display.printf("III:%.2f mV", ecg_III);
-  
-  // Texto adicional
-  if (currentText.length() > 0) {
-    display.setCursor(0, 56);
-    display.print(currentText);
+  display.setCursor(0, 8);
+  display.print(text);
+  markDirty(0, 8, 104, 8);
+}
+
+static int16_t waveY(int32_t value) {
+  int32_t y = WAVE_TOP + WAVE_HEIGHT - 1 - (value - scaleLo) * (WAVE_HEIGHT - 1) / (scaleHi - scaleLo);
+  if (y < WAVE_TOP) return WAVE_TOP;
+  if (y > SCREEN_HEIGHT - 1) return SCREEN_HEIGHT - 1;
+  return (int16_t)y;
+}
+
+// Autoescala: cada barrido usa los extremos del anterior
+static void setScale(int32_t lo, int32_t hi) {
+  if (hi - lo < WAVE_MIN_SPAN) {
+    lo = (lo + hi) / 2 - WAVE_MIN_SPAN / 2;
+    hi = lo + WAVE_MIN_SPAN;
+  }
+  scaleLo = lo;
+  scaleHi = hi;
+}
+
+static void resetSweep() {
+  sweepX = 0;
+  lastWaveY = -1;
+  scaleHi = scaleLo;
+  sweepMin = INT32_MAX;
+  sweepMax = INT32_MIN;
+}
+
+static void drawWavePoint(const WaveformPoint& point) {
+  if (scaleHi <= scaleLo) {
+    setScale(point.min, point.max);
   }
+  if (point.min < sweepMin) sweepMin = point.min;
+  if (point.max > sweepMax) sweepMax = point.max;
   
-  display.display();
+  // Trazo vertical min..max unido a la columna anterior
+  int16_t top = waveY(point.max);
+  int16_t bottom = waveY(point.min);
+  if (lastWaveY >= 0) {
+    if (lastWaveY < top) top = lastWaveY;
+    if (lastWaveY > bottom) bottom = lastWaveY;
+  }
+  lastWaveY = waveY(((int32_t)point.min + point.max) / 2);
+  
+  int16_t width = SCREEN_WIDTH - sweepX < WAVE_GAP + 1 ? SCREEN_WIDTH - sweepX : WAVE_GAP + 1;
+  display.fillRect(sweepX, WAVE_TOP, width, WAVE_HEIGHT, SSD1306_BLACK);
+  display.drawFastVLine(sweepX, top, bottom - top + 1, SSD1306_WHITE);
+  markDirty(sweepX, WAVE_TOP, width, WAVE_HEIGHT);
+  
+  if (++sweepX >= SCREEN_WIDTH) {
+    sweepX = 0;
+    lastWaveY = -1;
+    setScale(sweepMin, sweepMax);
+    sweepMin = INT32_MAX;
+    sweepMax = INT32_MIN;
+  }
+}
+
+static void drawIdleScreen() {
+  display.clearDisplay();
+  updateStatus(true);
+  drawTextLine();
+  resetSweep();
 }
 
 static void drawConfirmCaptureScreen() {
@@ -113,7 +343,6 @@ static void drawConfirmCaptureScreen() {
   display.print("Presiona boton");
   display.setCursor(10, 45);
   display.print("para confirmar");
-  display.display();
 }
 
 static void drawConfirmUploadScreen() {
@@ -126,75 +355,95 @@ static void drawConfirmUploadScreen() {
   display.print("Presiona boton");
   display.setCursor(10, 45);
   display.print("para confirmar");
-  display.display();
 }
 
-static void drawCapturingScreen() {
+static void drawProgressScreen(const char* title) {
   display.clearDisplay();
   display.setTextSize(2);
   display.setCursor(5, 10);
-  display.print("Grabando");
+  display.print(title);
   
   // Barra de progreso
   int barWidth = 100;
   int barX = 14;
   int barY = 35;
   display.drawRect(barX, barY, barWidth, 10, SSD1306_WHITE);
-  int fillWidth = (int)(currentProgress * (barWidth - 2));
+  int fillWidth = currentProgress * (barWidth - 2) / 100;
   display.fillRect(barX + 1, barY + 1, fillWidth, 8, SSD1306_WHITE);
   
   // Porcentaje
   display.setTextSize(1);
   display.setCursor(50, 50);
-  display.printf("%d%%", (int)(currentProgress * 100));
-  
-  display.display();
+  display.printf("%d%%", currentProgress);
 }
 
-static void drawUploadingScreen() {
-  display.clearDisplay();
-  display.setTextSize(2);
-  display.setCursor(10, 10);
-  display.print("Subiendo");
-  
-  // Barra de progreso
-  int barWidth = 100;
-  int barX = 14;
-  int barY = 35;
-  display.drawRect(barX, barY, barWidth, 10, SSD1306_WHITE);
-  int fillWidth = (int)(currentProgress * (barWidth - 2));
-  display.fillRect(barX + 1, barY + 1, fillWidth, 8, SSD1306_WHITE);
-  
-  // Porcentaje
-  display.setTextSize(1);
-  display.setCursor(50, 50);
-  display.printf("%d%%", (int)(currentProgress * 100));
-  
-  display.display();
+static void copyMessage(char* out, size_t len) {
+  portENTER_CRITICAL(&textMux);
+  strncpy(out, currentMessage, len - 1);
+  out[len - 1] = '\0';
+  portEXIT_CRITICAL(&textMux);
 }
 
 static void drawMessageScreen() {
+  char message[sizeof(currentMessage)];
+  copyMessage(message, sizeof(message));
+  
   display.clearDisplay();
   display.setTextSize(1);
   
   // Centrar texto
   int16_t x1, y1;
   uint16_t w, h;
-  display.getTextBounds(currentMessage, 0, 0, &x1, &y1, &w, &h);
+  display.getTextBounds(message, 0, 0, &x1, &y1, &w, &h);
   display.setCursor((SCREEN_WIDTH - w) / 2, (SCREEN_HEIGHT - h) / 2);
-  display.print(currentMessage);
-  
-  display.display();
+  display.print(message);
 }
 
 static void drawErrorScreen() {
+  char message[sizeof(currentMessage)];
+  copyMessage(message, sizeof(message));
+  
   display.clearDisplay();
   display.setTextSize(1);
   display.setCursor(0, 0);
   display.print("ERROR:");
   display.setCursor(0, 15);
-  display.print(currentMessage);
-  display.display();
+  display.print(message);
+}
+
+static void drawScreen(DisplayMode mode) {
+  switch (mode) {
+    case DISP_IDLE:
+      drawIdleScreen();
+      break;
+    case DISP_CONFIRM_CAPTURE:
+      drawConfirmCaptureScreen();
+      break;
+    case DISP_CAPTURING:
+      drawProgressScreen("Grabando");
+      break;
+    case DISP_CONFIRM_UPLOAD:
+      drawConfirmUploadScreen();
+      break;
+    case DISP_UPLOADING:
+      drawProgressScreen("Subiendo");
+      break;
+    case DISP_MESSAGE:
+      drawMessageScreen();
+      break;
+    case DISP_ERROR:
+      drawErrorScreen();
+      break;
+  }
+  markAllDirty();
+}
+
+static void displayTaskFn(void* param) {
+  TickType_t lastWake = xTaskGetTickCount();
+  for (;;) {
+    display_update();
+    vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(HOLTER_DISPLAY_FRAME_MS));
+  }
 }
 
 // ============================================================================
@@ -202,21 +451,25 @@ static void drawErrorScreen() {
 // ============================================================================
 
 void display_forceUpdate() {
-  lastUpdateTime = 0; // Forzar actualización inmediata
+  redrawRequested = true;
 }
 
 void display_init(XSpaceBioV10Board* bioBoard) {
   g_bioBoard = bioBoard;
   
   pinMode(BUTTON_PIN, INPUT_PULLUP);
+  readBatteryInternal();
   
-  Serial.println("[Display] Inicializando OLED...");
+  HOLTER_LOGI("[Display] Inicializando OLED...");
   
+  oledAddress = 0x3C;
   if (!display.begin(SSD1306_SWITCHCAPVCC, 0x3C)) {
-    Serial.println(F("[Display] ERROR: No se pudo inicializar OLED en 0x3C"));
-    Serial.println(F("[Display] Intentando con 0x3D..."));
+    HOLTER_LOGE("[Display] ERROR: No se pudo inicializar OLED en 0x3C");
+    HOLTER_LOGI("[Display] Intentando con 0x3D...");
+    oledAddress = 0x3D;
     if (!display.begin(SSD1306_SWITCHCAPVCC, 0x3D)) {
-      Serial.println(F("[Display] ERROR: No se pudo inicializar OLED"));
+      HOLTER_LOGE("[Display] ERROR: No se pudo inicializar OLED");
+      oledAddress = 0;
       return; // No bloquear, continuar sin display
     }
   }
@@ -224,7 +477,7 @@ void display_init(XSpaceBioV10Board* bioBoard) {
   display.clearDisplay();
   display.setTextColor(SSD1306_WHITE);
   
-  // Mensaje de bienvenida
+  // Mensaje de bienvenida (la tarea empieza a dibujar después de SPLASH_MS)
   display.setTextSize(2);
   display.setCursor(10, 10);
   display.println("HOLTER");
@@ -234,50 +487,73 @@ void display_init(XSpaceBioV10Board* bioBoard) {
   display.setCursor(10, 50);
   display.println("Listo!");
   display.display();
+  splashUntil = millis() + SPLASH_MS;
   
-  Serial.println("[Display] Inicializado correctamente");
-  
-  delay(2000); // Mostrar mensaje 2 segundos
   currentMode = DISP_IDLE;
+  xTaskCreatePinnedToCore(displayTaskFn, "display_ui", DISPLAY_STACK, nullptr,
+                          DISPLAY_PRIORITY, &displayTask, DISPLAY_CORE);
+  if (!displayTask) {
+    HOLTER_LOGE("[Display] ERROR: No se pudo crear la tarea del display");
+    return;
+  }
+  
+  HOLTER_LOGI("[Display] Inicializado correctamente");
 }
 
 void display_update() {
-  // Actualizar solo cada UPDATE_INTERVAL
+  if (oledAddress == 0) return;
+  
   unsigned long now = millis();
-  if (now - lastUpdateTime < UPDATE_INTERVAL) {
-    return;
-  }
-  lastUpdateTime = now;
+  if ((long)(now - splashUntil) < 0) return;
   
   // Verificar timeout de mensaje
-  if (currentMode == DISP_MESSAGE && messageTimeout > 0 && now > messageTimeout) {
+  if (currentMode == DISP_MESSAGE && messageTimeout > 0 && (long)(now - messageTimeout) >= 0) {
     currentMode = DISP_IDLE;
   }
   
-  // Dibujar según modo
-  switch(currentMode) {
-    case DISP_IDLE:
-      drawIdleScreen();
-      break;
-    case DISP_CONFIRM_CAPTURE:
-      drawConfirmCaptureScreen();
-      break;
-    case DISP_CAPTURING:
-      drawCapturingScreen();
-      break;
-    case DISP_CONFIRM_UPLOAD:
-      drawConfirmUploadScreen();
-      break;
-    case DISP_UPLOADING:
-      drawUploadingScreen();
-      break;
-    case DISP_MESSAGE:
-      drawMessageScreen();
-      break;
-    case DISP_ERROR:
-      drawErrorScreen();
-      break;
+  DisplayMode mode = currentMode;
+  bool redraw = redrawRequested.exchange(false) || mode != drawnMode;
+  if ((mode == DISP_CAPTURING || mode == DISP_UPLOADING) &&
+      currentProgress != drawnProgress && now - lastDrawTime >= PROGRESS_INTERVAL) {
+    redraw = true;
+  }
+  
+  // La forma de onda solo se decima mientras se ve
+  if ((mode == DISP_IDLE) != waveTapEnabled) {
+    waveTapEnabled = (mode == DISP_IDLE);
+    holter_setWaveformTap(waveTapEnabled);
   }
+  
+  if (clearRequested.exchange(false)) {
+    display.clearDisplay();
+    markAllDirty();
+  } else if (redraw) {
+    drawScreen(mode);
+    drawnMode = mode;
+    drawnProgress = currentProgress;
+    lastDrawTime = now;
+    lastStatusTime = now;
+  }
+  
+  if (mode == DISP_IDLE) {
+    if (now - lastStatusTime >= STATUS_INTERVAL) {
+      lastStatusTime = now;
+      updateStatus(false);
+    }
+    if (textChanged.exchange(false)) {
+      drawTextLine();
+    }
+  
+    WaveformPoint points[WAVE_READ_POINTS];
+    size_t n;
+    while ((n = holter_readWaveform(points, WAVE_READ_POINTS)) > 0) {
+      for (size_t i = 0; i < n; i++) {
+        drawWavePoint(points[i]);
+      }
+    }
+  }
+  
+  flushDirty();
 }
 
 void display_setMode(DisplayMode mode) {
@@ -307,41 +583,40 @@ bool display_checkButton() {
 }
 
 void display_setProgress(float progress) {
-  currentProgress = constrain(progress, 0.0, 1.0);
+  currentProgress = (int)(constrain(progress, 0.0f, 1.0f) * 100);
 }
 
-void display_showMessage(String message, unsigned long duration_ms) {
-  currentMessage = message;
-  currentMode = DISP_MESSAGE;
+void display_showMessage(const char* message, unsigned long duration_ms) {
+  portENTER_CRITICAL(&textMux);
+  strncpy(currentMessage, message, sizeof(currentMessage) - 1);
+  currentMessage[sizeof(currentMessage) - 1] = '\0';
+  portEXIT_CRITICAL(&textMux);
   messageTimeout = (duration_ms > 0) ? (millis() + duration_ms) : 0;
+  currentMode = DISP_MESSAGE;
   display_forceUpdate();
 }
 
-void display_showError(String error) {
-  currentMessage = error;
+void display_showError(const char* error) {
+  portENTER_CRITICAL(&textMux);
+  strncpy(currentMessage, error, sizeof(currentMessage) - 1);
+  currentMessage[sizeof(currentMessage) - 1] = '\0';
+  portEXIT_CRITICAL(&textMux);
   currentMode = DISP_ERROR;
   display_forceUpdate();
 }
 
 void display_clear() {
-  display.clearDisplay();
-  display.display();
+  clearRequested = true;
 }
 
 BatteryInfo display_getBattery() {
-  return getBatteryStatusInternal();
-}
-
-void display_drawBatteryIcon(int x, int y, int percentage) {
-  drawBatteryIconInternal(x, y, percentage);
-}
-
-void display_setECGValue(float derivation_I, float derivation_II, float derivation_III) {
-  ecg_I = derivation_I;
-  ecg_II = derivation_II;
-  ecg_III = derivation_III;
+  return battery;
 }
 
-void display_setText(String text) {
-  currentText = text;
+void display_setText(const char* text) {
+  portENTER_CRITICAL(&textMux);
+  strncpy(currentText, text, sizeof(currentText) - 1);
+  currentText[sizeof(currentText) - 1] = '\0';
+  portEXIT_CRITICAL(&textMux);
+  textChanged = true;
 }
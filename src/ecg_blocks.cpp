@@ -0,0 +1,59 @@
+#include "ecg_blocks.h"
+
+// ============================================================================
+// FUNCIONES INTERNAS (PRIVADAS)
+// ============================================================================
+
+// Publica el bloque activo y pasa al otro
+static int deliverActive(ECGBlocks& blocks) {
+  int block = blocks.active;
+  blocks.length[block].store(blocks.activeCount, std::memory_order_release);
+  blocks.active = block ^ 1;
+  blocks.activeCount = 0;
+  return block;
+}
+
+// ============================================================================
+// FUNCIONES PÚBLICAS
+// ============================================================================
+
+void ecg_blocks_reset(ECGBlocks& blocks) {
+  blocks.length[0].store(0);
+  blocks.length[1].store(0);
+  blocks.firstIndex[0] = 0;
+  blocks.firstIndex[1] = 0;
+  blocks.active = 0;
+  blocks.activeCount = 0;
+  blocks.dropped.store(0);
+}
+
+int ecg_blocks_append(ECGBlocks& blocks, const ECGSample& sample, uint32_t index) {
+  int ready = -1;
+  if (blocks.activeCount == ECG_BLOCK_SAMPLES) {
+    if (blocks.length[blocks.active ^ 1].load(std::memory_order_acquire) != 0) {
+      blocks.dropped.fetch_add(1, std::memory_order_relaxed);   // SD demasiado lenta
+      return -1;
+    }
+    ready = deliverActive(blocks);
+  }
+
+  if (blocks.activeCount == 0) {
+    blocks.firstIndex[blocks.active] = index;
+  }
+  blocks.samples[blocks.active][blocks.activeCount++] = sample;
+
+  if (blocks.activeCount == ECG_BLOCK_SAMPLES &&
+      blocks.length[blocks.active ^ 1].load(std::memory_order_acquire) == 0) {
+    ready = deliverActive(blocks);
+  }
+  return ready;
+}
+
+int ecg_blocks_flush(ECGBlocks& blocks) {
+  if (blocks.activeCount == 0) return -1;
+  return deliverActive(blocks);
+}
+
+void ecg_blocks_release(ECGBlocks& blocks, int block) {
+  blocks.length[block].store(0, std::memory_order_release);
+}
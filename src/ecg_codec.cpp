@@ -0,0 +1,184 @@
+#include "ecg_codec.h"
+
+// ============================================================================
+// PARÁMETROS DEL CODEC
+// ============================================================================
+
+// Adaptación de k (estilo JPEG-LS): A acumula los residuos mapeados, N cuenta
+// muestras; cada RESET muestras ambos se dividen a la mitad para seguir
+// cambios de amplitud (artefactos de movimiento, cambios de electrodo)
+static const uint32_t K_INIT_A = 1024;
+static const uint32_t K_RESET = 64;
+static const uint32_t K_MAX = 15;
+
+// ============================================================================
+// FUNCIONES INTERNAS (PRIVADAS)
+// ============================================================================
+
+struct BitWriter {
+  uint8_t* out;
+  size_t pos;
+  uint32_t acc;
+  int nbits;
+};
+
+struct BitReader {
+  const uint8_t* in;
+  size_t len;
+  size_t pos;
+  uint32_t acc;
+  int nbits;
+  bool overrun;
+};
+
+struct RiceState {
+  uint32_t A;
+  uint32_t N;
+};
+
+// Escribe los n bits bajos de value (n <= 24), el más significativo primero
+static inline void putBits(BitWriter& w, uint32_t value, int n) {
+  w.acc = (w.acc << n) | (value & ((1u << n) - 1));
+  w.nbits += n;
+  while (w.nbits >= 8) {
+    w.nbits -= 8;
+    w.out[w.pos++] = (uint8_t)(w.acc >> w.nbits);
+  }
+}
+
+static inline void flushBits(BitWriter& w) {
+  if (w.nbits > 0) {
+    w.out[w.pos++] = (uint8_t)(w.acc << (8 - w.nbits));
+    w.nbits = 0;
+  }
+}
+
+static inline uint32_t getBits(BitReader& r, int n) {
+  while (r.nbits < n) {
+    if (r.pos >= r.len) {
+      r.overrun = true;
+      return 0;
+    }
+    r.acc = (r.acc << 8) | r.in[r.pos++];
+    r.nbits += 8;
+  }
+  r.nbits -= n;
+  return (r.acc >> r.nbits) & ((1u << n) - 1);
+}
+
+static inline uint32_t riceK(const RiceState& s) {
+  uint32_t k = 0;
+  while ((s.N << k) < s.A && k < K_MAX) k++;
+  return k;
+}
+
+static inline void riceUpdate(RiceState& s, uint32_t u) {
+  s.A += u;
+  if (++s.N == K_RESET) {
+    s.A >>= 1;
+    s.N >>= 1;
+  }
+}
+
+static inline int16_t predict(int16_t x1, int16_t x2, size_t n) {
+  if (n == 0) return 0;
+  if (n == 1) return x1;
+  return (int16_t)(2 * (int32_t)x1 - x2);
+}
+
+static inline void encodeResidual(BitWriter& w, RiceState& s, int16_t e) {
+  uint32_t u = (uint16_t)(((int32_t)e << 1) ^ ((int32_t)e >> 15));   // zigzag
+  uint32_t k = riceK(s);
+  uint32_t q = u >> k;
+  
+  if (q < ECG_CODEC_QMAX) {
+    putBits(w, ((1u << q) - 1) << 1, q + 1);   // q unos y un cero
+    putBits(w, u, k);
+  } else {
+    putBits(w, (1u << ECG_CODEC_QMAX) - 1, ECG_CODEC_QMAX);   // escape
+    putBits(w, u, 16);
+  }
+  riceUpdate(s, u);
+}
+
+static inline int16_t decodeResidual(BitReader& r, RiceState& s) {
+  uint32_t k = riceK(s);
+  uint32_t q = 0;
+  while (q < ECG_CODEC_QMAX && getBits(r, 1)) q++;
+  
+  uint32_t u = (q < ECG_CODEC_QMAX) ? ((q << k) | getBits(r, k)) : getBits(r, 16);
+  riceUpdate(s, u);
+  return (int16_t)((u >> 1) ^ (0u - (u & 1)));
+}
+
+// ============================================================================
+// IMPLEMENTACIÓN DE INTERFACE PÚBLICA
+// ============================================================================
+
+size_t ecg_codec_encodeFrame(const int16_t* samples, size_t count, uint8_t* out) {
+  return ecg_codec_encodeFrameLimited(samples, count, out, ecg_codec_maxFrameSize(count), nullptr);
+}
+
+size_t ecg_codec_encodeFrameLimited(const int16_t* samples, size_t count, uint8_t* out,
+                                    size_t maxBytes, size_t* encoded) {
+  if (count > ECG_CODEC_MAX_FRAME_SAMPLES) count = ECG_CODEC_MAX_FRAME_SAMPLES;
+  size_t maxBits = (maxBytes > ECG_CODEC_FRAME_HEADER_SIZE)
+                       ? (maxBytes - ECG_CODEC_FRAME_HEADER_SIZE) * 8 : 0;
+  
+  BitWriter w = {out + ECG_CODEC_FRAME_HEADER_SIZE, 0, 0, 0};
+  RiceState state[ECG_CODEC_CHANNELS] = {{K_INIT_A, 1}, {K_INIT_A, 1}};
+  int16_t x1[ECG_CODEC_CHANNELS] = {0, 0};
+  int16_t x2[ECG_CODEC_CHANNELS] = {0, 0};
+  
+  size_t n = 0;
+  for (; n < count; n++) {
+    if (w.pos * 8 + w.nbits + ECG_CODEC_MAX_SAMPLE_BITS > maxBits) break;
+    const int16_t* sample = samples + n * 3;
+    for (size_t ch = 0; ch < ECG_CODEC_CHANNELS; ch++) {
+      int16_t x = sample[ch];
+      int16_t e = (int16_t)(x - predict(x1[ch], x2[ch], n));
+      encodeResidual(w, state[ch], e);
+      x2[ch] = x1[ch];
+      x1[ch] = x;
+    }
+  }
+  flushBits(w);
+  if (encoded) *encoded = n;
+  
+  out[0] = (uint8_t)(n & 0xFF);
+  out[1] = (uint8_t)(n >> 8);
+  out[2] = (uint8_t)(w.pos & 0xFF);
+  out[3] = (uint8_t)(w.pos >> 8);
+  return ECG_CODEC_FRAME_HEADER_SIZE + w.pos;
+}
+
+size_t ecg_codec_decodeFrame(const uint8_t* in, size_t inLen, int16_t* samples,
+                             size_t maxSamples, size_t* consumed) {
+  if (inLen < ECG_CODEC_FRAME_HEADER_SIZE) return 0;
+  
+  size_t count = in[0] | ((size_t)in[1] << 8);
+  size_t payload = in[2] | ((size_t)in[3] << 8);
+  if (count == 0 || count > maxSamples || ECG_CODEC_FRAME_HEADER_SIZE + payload > inLen) {
+    return 0;
+  }
+  
+  BitReader r = {in + ECG_CODEC_FRAME_HEADER_SIZE, payload, 0, 0, 0, false};
+  RiceState state[ECG_CODEC_CHANNELS] = {{K_INIT_A, 1}, {K_INIT_A, 1}};
+  int16_t x1[ECG_CODEC_CHANNELS] = {0, 0};
+  int16_t x2[ECG_CODEC_CHANNELS] = {0, 0};
+  
+  for (size_t n = 0; n < count; n++) {
+    int16_t* sample = samples + n * 3;
+    for (size_t ch = 0; ch < ECG_CODEC_CHANNELS; ch++) {
+      int16_t x = (int16_t)(predict(x1[ch], x2[ch], n) + decodeResidual(r, state[ch]));
+      sample[ch] = x;
+      x2[ch] = x1[ch];
+      x1[ch] = x;
+    }
+    sample[2] = (int16_t)(sample[1] - sample[0]);
+  }
+  
+  if (r.overrun) return 0;
+  if (consumed) *consumed = ECG_CODEC_FRAME_HEADER_SIZE + payload;
+  return count;
+}
@@ -0,0 +1,123 @@
+#include "ecg_filter.h"
+#include <math.h>
+#include <string.h>
+
+// ============================================================================
+// PARÁMETROS DE LOS FILTROS
+// ============================================================================
+
+static const int COEFF_SHIFT = 30;
+static const float BUTTERWORTH_Q = 0.70710678f;
+static const float NOTCH_Q = 30.0f;    // Ancho de banda ~2 Hz a 60 Hz
+
+enum StageType { STAGE_HIGHPASS, STAGE_LOWPASS, STAGE_NOTCH };
+
+// ============================================================================
+// FUNCIONES INTERNAS (PRIVADAS)
+// ============================================================================
+
+static int32_t toQ30(double value) {
+  double scaled = value * (double)(1L << COEFF_SHIFT);
+  if (scaled > 2147483647.0) return INT32_MAX;
+  if (scaled < -2147483648.0) return INT32_MIN;
+  return (int32_t)lround(scaled);
+}
+
+// Coeficientes del "Audio EQ Cookbook" (R. Bristow-Johnson)
+static void designStage(Biquad& stage, StageType type, uint16_t sampleRate, float hz) {
+  double w0 = 2.0 * M_PI * hz / sampleRate;
+  double cosw = cos(w0);
+  double alpha = sin(w0) / (2.0 * (type == STAGE_NOTCH ? NOTCH_Q : BUTTERWORTH_Q));
+  double b0, b1, b2;
+
+  switch (type) {
+    case STAGE_HIGHPASS:
+      b0 = (1.0 + cosw) / 2.0;
+      b1 = -(1.0 + cosw);
+      b2 = b0;
+      break;
+    case STAGE_LOWPASS:
+      b0 = (1.0 - cosw) / 2.0;
+      b1 = 1.0 - cosw;
+      b2 = b0;
+      break;
+    default:
+      b0 = 1.0;
+      b1 = -2.0 * cosw;
+      b2 = 1.0;
+      break;
+  }
+
+  double a0 = 1.0 + alpha;
+  memset(&stage, 0, sizeof(stage));
+  stage.b0 = toQ30(b0 / a0);
+  stage.b1 = toQ30(b1 / a0);
+  stage.b2 = toQ30(b2 / a0);
+  stage.a1 = toQ30(-2.0 * cosw / a0);
+  stage.a2 = toQ30((1.0 - alpha) / a0);
+}
+
+static inline int32_t stageProcess(Biquad& s, int32_t x) {
+  int64_t acc = (int64_t)s.b0 * x + (int64_t)s.b1 * s.x1 + (int64_t)s.b2 * s.x2 -
+                (int64_t)s.a1 * s.y1 - (int64_t)s.a2 * s.y2 + s.err;
+  int32_t y = (int32_t)(acc >> COEFF_SHIFT);
+  s.err = acc - ((int64_t)y << COEFF_SHIFT);
+
+  s.x2 = s.x1;
+  s.x1 = x;
+  s.y2 = s.y1;
+  s.y1 = y;
+  return y;
+}
+
+// ============================================================================
+// IMPLEMENTACIÓN DE INTERFACE PÚBLICA
+// ============================================================================
+
+void ecg_filter_init(ECGFilter& filter, uint16_t sampleRate, float highpassHz,
+                     float lowpassHz, float notchHz) {
+  memset(&filter, 0, sizeof(filter));
+  float nyquist = sampleRate / 2.0f;
+
+  if (highpassHz > 0 && highpassHz < nyquist) {
+    designStage(filter.stages[filter.numStages++], STAGE_HIGHPASS, sampleRate, highpassHz);
+    filter.mask |= ECG_FILTER_HIGHPASS;
+  }
+  if (lowpassHz > 0 && lowpassHz < nyquist) {
+    designStage(filter.stages[filter.numStages++], STAGE_LOWPASS, sampleRate, lowpassHz);
+    filter.mask |= ECG_FILTER_LOWPASS;
+  }
+  if (notchHz > 0 && notchHz < nyquist) {
+    designStage(filter.stages[filter.numStages++], STAGE_NOTCH, sampleRate, notchHz);
+    filter.mask |= ECG_FILTER_NOTCH;
+  }
+}
+
+void ecg_filter_reset(ECGFilter& filter) {
+  filter.primed = false;
+}
+
+int16_t ecg_filter_process(ECGFilter& filter, int16_t sample) {
+  int32_t x = sample;
+
+  if (!filter.primed) {
+    // Régimen para una entrada constante: el pasaaltos deja 0, el resto pasa la DC
+    int32_t level = x;
+    for (uint8_t i = 0; i < filter.numStages; i++) {
+      Biquad& s = filter.stages[i];
+      s.x1 = s.x2 = level;
+      if (filter.mask & ECG_FILTER_HIGHPASS && i == 0) level = 0;
+      s.y1 = s.y2 = level;
+      s.err = 0;
+    }
+    filter.primed = true;
+  }
+
+  for (uint8_t i = 0; i < filter.numStages; i++) {
+    x = stageProcess(filter.stages[i], x);
+  }
+
+  if (x > INT16_MAX) return INT16_MAX;
+  if (x < INT16_MIN) return INT16_MIN;
+  return (int16_t)x;
+}
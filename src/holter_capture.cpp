@@ -1,17 +1,22 @@
 #include "holter_capture.h"
+#include "holter_clock.h"
+#include "holter_config.h"
+#include "holter_log.h"
+#include "ecg_codec.h"
+#include "ecg_filter.h"
+#include "holter_imu.h"
+#include "holter_crc.h"
+#include "ecg_blocks.h"
+#include "holter_storage.h"
 #include <time.h>
-#include <SPI.h>
-
-// ============================================================================
-// CONFIGURACIÓN HARDWARE
-// ============================================================================
-
-#define SD_CS_PIN 5
-
-// Pines SPI del ESP32 (por defecto)
-#define SD_MOSI 23
-#define SD_MISO 19
-#define SD_SCK 18
+#include <atomic>
+#include <esp_timer.h>
+#include <esp_adc_cal.h>
+#include <esp_heap_caps.h>
+#include <esp_pm.h>
+#if HOLTER_ECG_ADC_DMA
+#include <driver/adc.h>
+#endif
 
 // ============================================================================
 // VARIABLES INTERNAS (PRIVADAS)
@@ -21,377 +26,1595 @@
 static XSpaceBioV10Board* g_bioBoard = nullptr;
 
 // Configuración
-static const int CAPTURE_DURATION_SEC = 15;
-static const int ECG_SAMPLE_RATE_HZ = 250;
+static const int ECG_SAMPLE_RATE_HZ = HOLTER_ECG_SAMPLE_RATE_HZ;
+static_assert(ECG_SAMPLE_RATE_HZ == 250 || ECG_SAMPLE_RATE_HZ == 500 || ECG_SAMPLE_RATE_HZ == 1000,
+              "HOLTER_ECG_SAMPLE_RATE_HZ debe ser 250, 500 o 1000");
 static const float ECG_SCALE_FACTOR = 6553.6;
-static const int BUFFER_SIZE = 8192;
+static const unsigned long RECORDING_DURATION_SEC = HOLTER_RECORDING_DURATION_SEC;
+static const unsigned long SEGMENT_DURATION_SEC = HOLTER_SEGMENT_DURATION_SEC;
+static const unsigned long SAMPLES_PER_SEGMENT = SEGMENT_DURATION_SEC * ECG_SAMPLE_RATE_HZ;
+// 0 = grabación indefinida hasta holter_stopCapture()
+static const unsigned long TOTAL_ECG_SAMPLES = RECORDING_DURATION_SEC * ECG_SAMPLE_RATE_HZ;
+
+// IMU: se dispara cada IMU_DECIMATION muestras ECG, así ambos flujos
+// comparten un solo reloj y el índice ECG sirve de marca de tiempo
+static const int IMU_SAMPLE_RATE_HZ = HOLTER_IMU_SAMPLE_RATE_HZ;
+static const unsigned long IMU_DECIMATION = ECG_SAMPLE_RATE_HZ / IMU_SAMPLE_RATE_HZ;
+static_assert(IMU_SAMPLE_RATE_HZ >= 25 && IMU_SAMPLE_RATE_HZ <= 100,
+              "HOLTER_IMU_SAMPLE_RATE_HZ debe estar entre 25 y 100");
+static_assert(ECG_SAMPLE_RATE_HZ % IMU_SAMPLE_RATE_HZ == 0,
+              "HOLTER_IMU_SAMPLE_RATE_HZ debe dividir a HOLTER_ECG_SAMPLE_RATE_HZ");
 
-// Estado
-static bool isCapturing = false;
+// Calibración ECG: mV_pin = (cuentas * coeff_a + 2^15) >> 16 + coeff_b y
+// mV_ecg = (mV_pin - OFFSET) / GAIN. La conversión la hace el back end con
+// las constantes del header; en el camino crítico no hay aritmética float.
+static const uint16_t AD8232_GAIN = 1100;
+static const uint16_t AD8232_OFFSET_MV = 1650;
+static const uint32_t ADC_MAX_COUNT = 4095;
+static const uint32_t ADC_VREF_EFUSE_DEFAULT_MV = 1100;
+static constexpr uint32_t ADC_IDEAL_COEFF_A = (3300UL * 65536UL + ADC_MAX_COUNT / 2) / ADC_MAX_COUNT;
+static uint32_t adcCoeffA = ADC_IDEAL_COEFF_A;
+static uint16_t adcCoeffB = 0;
+#if HOLTER_ECG_RAW_ADC
+static const uint16_t ECG_SAMPLE_FORMAT = ECG_FORMAT_ADC_COUNTS;
+#else
+static const uint16_t ECG_SAMPLE_FORMAT = ECG_FORMAT_SCALED_MV;
+#endif
+
+// Filtros por derivación (solo los usa la tarea de adquisición). La III se
+// calcula después de filtrar: sigue siendo exacta II - I
+static ECGFilter filterI;
+static ECGFilter filterII;
+#if HOLTER_ECG_FILTER
+static uint16_t ecgFilterMask = ECG_FILTER_NONE;   // Etapas activas (según Nyquist)
+#else
+static const uint16_t ecgFilterMask = ECG_FILTER_NONE;
+#endif
+
+// Estado (compartido entre loop(), tarea de adquisición y tarea de almacenamiento)
+static volatile bool isCapturing = false;
+static volatile bool stopRequested = false;
 static bool sdAvailable = false;
+static bool imuAvailable = false;
 
-// Archivo actual
+// Grabación y segmento actual (solo los modifica la tarea de almacenamiento)
 static File dataFile;
-static String currentSessionFile = "";
-static String currentSessionID = "";
+static unsigned long recordingTimestamp = 0;   // Unix time de la primera muestra
+static uint32_t segmentSeq = 0;
+static unsigned long segmentFirstSample = 0;
+static unsigned long segmentSampleCount = 0;
+static unsigned long segmentImuCount = 0;
+static unsigned long segmentPeakCount = 0;
+static unsigned long segmentDataBytes = 0;     // Bytes de bloques tras el header
+static unsigned long segmentEcgBytes = 0;
+static char currentSegmentFile[HOLTER_MAX_FILENAME_LEN] = "";
+static portMUX_TYPE fileNameMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Segmentos cerrados esperando ser tomados por main (holter_getCompletedSegment)
+static QueueHandle_t completedSegments = nullptr;
+static const int COMPLETED_QUEUE_DEPTH = 8;
 
 // Contadores
 static unsigned long captureStartTime = 0;
-static unsigned long sampleCount = 0;
+static unsigned long sampleCount = 0;         // Muestras escritas en SD (toda la grabación)
+static unsigned long imuSampleCount = 0;
+
+static_assert(HOLTER_BATTERY_PIN != HOLTER_ECG_ADC_PIN_I && HOLTER_BATTERY_PIN != HOLTER_ECG_ADC_PIN_II,
+              "HOLTER_BATTERY_PIN no puede ser un canal ECG del ADC");
+static_assert(HOLTER_ECG_ADC_PIN_I != HOLTER_ECG_ADC_PIN_II, "Las derivaciones I y II necesitan pines distintos");
+
+#if HOLTER_ECG_RAW_ADC
+// Diferencia máxima entre la lectura de la biblioteca y la del pin
+// configurado para darlo por correcto
+static const uint32_t ECG_PIN_CHECK_MV = 150;
+static const int ECG_PIN_CHECK_READS = 16;
+#endif
+
+#if HOLTER_ECG_ADC_DMA
+static_assert(HOLTER_ECG_RAW_ADC, "HOLTER_ECG_ADC_DMA requiere HOLTER_ECG_RAW_ADC");
 
-// Timing
-static unsigned long lastECGSample = 0;
+// ADC continuo: el controlador digital alterna I/II/batería a
+// DMA_CONV_FREQ_HZ (el mínimo del ESP32 es 20 kHz) y cada muestra es el
+// promedio de ADC_OVERSAMPLE conversiones por derivación. La batería va en
+// el patrón porque analogRead() sacaría al ADC1 del modo continuo
+static const uint32_t DMA_CHANNELS = 3;
+static const uint32_t DMA_CONV_FREQ_HZ = 30000;
+static const uint32_t ADC_OVERSAMPLE = DMA_CONV_FREQ_HZ / (DMA_CHANNELS * ECG_SAMPLE_RATE_HZ);
+static_assert(DMA_CONV_FREQ_HZ % (DMA_CHANNELS * ECG_SAMPLE_RATE_HZ) == 0, "Sobremuestreo no entero");
+static const uint32_t DMA_FRAME_BYTES = 1536;        // 768 conversiones (~25 ms)
+static const uint32_t DMA_STORE_BYTES = 4 * DMA_FRAME_BYTES;
+static const uint32_t DMA_READ_TIMEOUT_MS = 100;
+static const uint32_t BATTERY_AVERAGE = 1024;        // Conversiones por lectura (~0.1 s)
+static uint8_t adcChannelI = 0;
+static uint8_t adcChannelII = 0;
+static uint8_t adcChannelBattery = 0;
+static std::atomic<uint16_t> batteryRaw(0);          // Promedio de 12 bits; 0 = sin lectura
+#else
+// Timing (timer de hardware vía esp_timer)
 static const unsigned long ECG_INTERVAL_US = 1000000 / ECG_SAMPLE_RATE_HZ;
+static esp_timer_handle_t samplingTimer = nullptr;
+#endif
+static bool samplerReady = false;
+
+// Tareas FreeRTOS: adquisición en core 1 (máxima prioridad), SD en core 0
+static TaskHandle_t acquisitionTask = nullptr;
+static TaskHandle_t storageTask = nullptr;
+static const BaseType_t ACQUISITION_CORE = 1;
+static const BaseType_t STORAGE_CORE = 0;
+static const UBaseType_t ACQUISITION_PRIORITY = configMAX_PRIORITIES - 1;
+static const UBaseType_t STORAGE_PRIORITY = 3;
+static const uint32_t ACQUISITION_STACK = 4096;
+// IMU en core 1 por debajo de la adquisición ECG: una lectura I2C lenta
+// nunca retrasa una muestra ECG
+static TaskHandle_t imuTask = nullptr;
+static const UBaseType_t IMU_PRIORITY = configMAX_PRIORITIES - 2;
+static const uint32_t IMU_STACK = 3072;
+static const uint32_t STORAGE_STACK = 8192;
+
+// Buffers ping-pong alineados a sector: la tarea de adquisición llena uno
+// mientras la tarea de almacenamiento escribe el otro en la SD.
+// BLOCK_SIZE es múltiplo de 512 y de sizeof(ECGSample): ninguna muestra
+// queda partida entre dos escrituras y FatFS escribe sectores completos.
+static const size_t SD_SECTOR_SIZE = FILE_HEADER_BLOCK_SIZE;
+static const size_t BLOCK_SIZE = ECG_BLOCK_SAMPLES * sizeof(ECGSample);   // 12 sectores (~4 s)
+static_assert(BLOCK_SIZE % SD_SECTOR_SIZE == 0, "BLOCK_SIZE debe ser múltiplo de sector");
+
+// Cada bloque lleva el índice de su primera muestra: lo descartado por SD
+// lenta queda como hueco y no corre el resto de la línea de tiempo
+static ECGBlocks ecgBlocks;
+// Bloque de datos en armado: cada escritura en la SD es un sector completo
+// que se valida solo con su CRC
+static uint8_t dataBlock[DATA_BLOCK_SIZE] __attribute__((aligned(4)));
+static uint8_t* const dataBlockPayload = dataBlock + sizeof(DataBlockHeader);
+static_assert(DATA_BLOCK_SIZE == SD_SECTOR_SIZE, "Un bloque de datos por sector");
+static_assert(DATA_BLOCK_PAYLOAD >= ecg_codec_maxFrameSize(1), "Bloque sin espacio para una muestra");
+static const size_t IMU_SAMPLES_PER_DATA_BLOCK = DATA_BLOCK_PAYLOAD / sizeof(IMUSample);
+static const size_t RPEAKS_PER_DATA_BLOCK = DATA_BLOCK_PAYLOAD / sizeof(RPeakAnnotation);
+
+static std::atomic<unsigned long> samplesProduced(0);
+
+// Cola SPSC de muestras IMU (tarea IMU -> tarea de almacenamiento). Un
+// bloque ECG dura ~4 s a 250 Hz: a 100 Hz son ~410 muestras IMU por bloque,
+// más las que esperan a completar un bloque de datos
+struct TimedIMUSample {
+  uint32_t ecg_index;
+  IMUSample sample;
+};
+static const size_t IMU_RING_SIZE = 768;
+static TimedIMUSample imuRing[IMU_RING_SIZE];
+static std::atomic<size_t> imuHead(0);       // Escribe la tarea IMU
+static std::atomic<size_t> imuTail(0);       // Lee la tarea de almacenamiento
+static std::atomic<uint32_t> imuTriggerIndex(0);
+static volatile unsigned long droppedImuSamples = 0;
+
+// Detector QRS (solo lo usa la tarea de adquisición) y cola SPSC de picos R
+// hacia la tarea de almacenamiento: a 240 lpm caben ~30 s de latidos
+static QRSDetector qrsDetector;
+static const size_t RPEAK_RING_SIZE = 128;
+static RPeakAnnotation rpeakRing[RPEAK_RING_SIZE];
+static std::atomic<size_t> rpeakHead(0);     // Escribe la adquisición
+static std::atomic<size_t> rpeakTail(0);     // Lee la tarea de almacenamiento
+static volatile unsigned long droppedPeaks = 0;
+static HeartRateInfo heartRate = {0};        // Protegido por heartRateMux
+static portMUX_TYPE heartRateMux = portMUX_INITIALIZER_UNLOCKED;
+static const unsigned long HEART_RATE_STALE_SAMPLES = 3UL * ECG_SAMPLE_RATE_HZ;
+
+// Captura por eventos: ring de bloques de datos ya armados (con su CRC) que
+// guarda los últimos segundos mientras no hay evento. Solo lo usa la tarea
+// de almacenamiento. Se dimensiona para ~300 muestras ECG por bloque con
+// margen; con señal ruidosa comprime menos y el pre-evento es más corto
+static const bool EVENT_MODE = HOLTER_EVENT_MODE;
+static const unsigned long EVENT_PRE_SAMPLES = HOLTER_EVENT_PRE_SEC * ECG_SAMPLE_RATE_HZ;
+static const unsigned long EVENT_POST_SAMPLES = HOLTER_EVENT_POST_SEC * ECG_SAMPLE_RATE_HZ;
+static const size_t PRE_TRIGGER_BLOCKS =
+    (EVENT_PRE_SAMPLES / 300 + HOLTER_EVENT_PRE_SEC * IMU_SAMPLE_RATE_HZ / 82 + 2) * 3 / 2;
+static uint8_t (*preTriggerRing)[DATA_BLOCK_SIZE] = nullptr;
+static size_t preTriggerCapacity = 0;
+static size_t preTriggerHead = 0;
+static size_t preTriggerCount = 0;
+static volatile bool eventRecording = false;
+static unsigned long eventEndSample = 0;
+static std::atomic<uint16_t> pendingEventSource(EVENT_NONE);
+static std::atomic<uint32_t> pendingEventIndex(0);
+static unsigned long eventCount = 0;
+
+// Tamaño reservado al abrir un segmento (HOLTER_SD_PREALLOC): la tasa sin
+// comprimir (derivaciones I y II + IMU) en bloques llenos, con 1/8 de margen
+// para los picos R, los eventos y los bloques a medio llenar. Un evento
+// extendido o una señal que no comprime lo superan: el archivo crece
+static const uint32_t CAPTURE_RAW_BYTES_PER_SEC =
+    ECG_SAMPLE_RATE_HZ * ECG_CODEC_CHANNELS * sizeof(int16_t) + IMU_SAMPLE_RATE_HZ * sizeof(IMUSample);
+static const uint32_t SEGMENT_MAX_SEC =
+    EVENT_MODE ? HOLTER_EVENT_PRE_SEC + HOLTER_EVENT_POST_SEC : SEGMENT_DURATION_SEC;
+static const uint32_t SEGMENT_PREALLOC_BYTES = FILE_HEADER_BLOCK_SIZE +
+    ((uint64_t)SEGMENT_MAX_SEC * CAPTURE_RAW_BYTES_PER_SEC / DATA_BLOCK_PAYLOAD * 9 / 8 + 4) * DATA_BLOCK_SIZE;
+static bool segmentPreallocated = false;
+
+// Detección de caída a partir del IMU (2048 LSB/g): caída libre de al menos
+// FALL_FREE_MIN_SAMPLES y un impacto dentro de la ventana siguiente
+static const uint32_t FALL_FREE_G2 = (uint32_t)(0.4 * 2048) * (uint32_t)(0.4 * 2048);
+static const uint32_t FALL_IMPACT_G2 = (uint32_t)(2.5 * 2048) * (uint32_t)(2.5 * 2048);
+static const int FALL_FREE_MIN_SAMPLES = IMU_SAMPLE_RATE_HZ / 10;   // 100 ms
+static const int FALL_IMPACT_WINDOW = IMU_SAMPLE_RATE_HZ;           // 1 s
+
+// Copia para streaming en vivo (adquisición -> tarea de red). 1024 muestras
+// cubren 1 s a 1 kHz; si la red se atrasa más, se descartan las nuevas
+struct TimedECGSample {
+  uint32_t index;
+  ECGSample sample;
+};
+static const size_t LIVE_RING_SIZE = 1024;
+static TimedECGSample liveRing[LIVE_RING_SIZE];
+static std::atomic<size_t> liveHead(0);      // Escribe la adquisición
+static std::atomic<size_t> liveTail(0);      // Lee la tarea de red
+static volatile bool liveTap = false;
+
+// Forma de onda para el display (adquisición -> tarea del display): una
+// columna min/max cada WAVE_DECIMATION muestras, ~1.3 s a 50 Hz
+static const uint32_t WAVE_DECIMATION =
+    HOLTER_ECG_SAMPLE_RATE_HZ / HOLTER_DISPLAY_WAVE_HZ > 0 ? HOLTER_ECG_SAMPLE_RATE_HZ / HOLTER_DISPLAY_WAVE_HZ : 1;
+static const size_t WAVE_RING_SIZE = 64;
+static WaveformPoint waveRing[WAVE_RING_SIZE];
+static std::atomic<size_t> waveHead(0);      // Escribe la adquisición
+static std::atomic<size_t> waveTail(0);      // Lee la tarea del display
+static volatile bool waveTap = false;
+static WaveformPoint waveColumn;
+static uint32_t waveCount = 0;
+
+// Escritura en ráfagas: los bloques del archivo se juntan aquí y van a la
+// SD en un solo write + flush (la FAT se actualiza una vez por ráfaga)
+static const size_t SD_BURST_BLOCKS = (size_t)HOLTER_SD_BURST_KB * 1024 / DATA_BLOCK_SIZE;
+static_assert(SD_BURST_BLOCKS >= 1, "HOLTER_SD_BURST_KB debe contener al menos un bloque");
+static uint8_t sdBurst[SD_BURST_BLOCKS][DATA_BLOCK_SIZE] __attribute__((aligned(4)));
+static size_t sdBurstCount = 0;
 
-// Buffer de escritura
-static uint8_t writeBuffer[BUFFER_SIZE];
-static int bufferIndex = 0;
-static unsigned long lastFlush = 0;
+// Consumo: cada tarea acumula su tiempo ocupado en µs y lo publica en ms
+// para leerlo desde otras tareas
+struct BusyMeter {
+  uint32_t pendingUs;
+  std::atomic<uint32_t> totalMs;
+};
+static BusyMeter acquisitionBusy;            // Tarea de adquisición
+static BusyMeter storageBusy;                // Tarea de almacenamiento (incluye la SD)
+static BusyMeter sdBusy;                     // Escrituras en la SD
+static std::atomic<uint32_t> sdBursts(0);
+static std::atomic<uint32_t> sdBurstBytes(0);
+static unsigned long captureEndTime = 0;     // 0 = grabación en curso
+static bool lightSleepEnabled = false;
+// Sin light sleep mientras se muestrea: el ADC continuo y el timer corren
+// con el reloj APB
+static esp_pm_lock_handle_t samplingPmLock = nullptr;
+
+// Estadísticas de tiempo real (CaptureStats): cada contador lo escribe una
+// sola tarea y la estructura se arma al leerla. Los intervalos usan el
+// esp_timer que las tareas ya leen para el consumo: sin costo extra
+static_assert(sizeof(CaptureStats) <= DATA_BLOCK_PAYLOAD, "CaptureStats no cabe en un bloque");
+static int64_t samplingStartUs = 0;          // 0 = nunca se grabó
+static int64_t samplingEndUs = 0;            // 0 = grabación en curso
+static int64_t lastIntervalUs = 0;           // Adquisición: último tick o frame DMA
+static uint32_t intervalMaxDevUs = 0;
+static uint32_t intervalHist[STATS_HIST_BINS];
+static uint32_t sdFlushMaxUs = 0;            // Almacenamiento
+static uint32_t sdFlushHist[STATS_HIST_BINS];
+static int64_t blockReadyUs[2] = {0, 0};     // Entrega de cada bloque a almacenamiento
+static uint32_t blockWaitMaxMs = 0;
+static uint16_t imuRingMax = 0;
+static uint16_t rpeakRingMax = 0;
+static uint16_t liveRingMax = 0;
+static std::atomic<uint32_t> uploadBytes(0);   // Tarea de red (holter_recordUpload)
+static std::atomic<uint32_t> uploadMs(0);
+static std::atomic<uint32_t> uploadRate(0);
 
 // ============================================================================
 // FUNCIONES INTERNAS (PRIVADAS)
 // ============================================================================
 
-static void flushBuffer() {
-  if (!sdAvailable || bufferIndex == 0) {
-    bufferIndex = 0;
-    return;
+static bool recordingComplete(unsigned long samples) {
+  return TOTAL_ECG_SAMPLES > 0 && samples >= TOTAL_ECG_SAMPLES;
+}
+
+static inline void addBusy(BusyMeter& meter, int64_t us) {
+  meter.pendingUs += (uint32_t)us;
+  if (meter.pendingUs >= 1000) {
+    meter.totalMs.fetch_add(meter.pendingUs / 1000, std::memory_order_relaxed);
+    meter.pendingUs %= 1000;
+  }
+}
+
+static void resetBusy(BusyMeter& meter) {
+  meter.pendingUs = 0;
+  meter.totalMs.store(0, std::memory_order_relaxed);
+}
+
+// Cubeta de base 4 de un tiempo en µs (ver STATS_HIST_BINS)
+static inline size_t histBin(uint32_t us) {
+  if (us < 4) return 0;
+  size_t bin = (31 - __builtin_clz(us)) / 2;
+  return bin < STATS_HIST_BINS ? bin : STATS_HIST_BINS - 1;
+}
+
+// Desvío del intervalo desde el tick (o frame DMA) anterior respecto del
+// período nominal (solo la tarea de adquisición)
+static inline void recordInterval(int64_t now, uint32_t nominalUs) {
+  if (lastIntervalUs != 0) {
+    int32_t dev = (int32_t)(now - lastIntervalUs) - (int32_t)nominalUs;
+    uint32_t absDev = dev < 0 ? (uint32_t)-dev : (uint32_t)dev;
+    intervalHist[histBin(absDev)]++;
+    if (absDev > intervalMaxDevUs) intervalMaxDevUs = absDev;
   }
+  lastIntervalUs = now;
+}
+
+static inline void trackMax(uint16_t& max, size_t value) {
+  if (value > max) max = (uint16_t)value;
+}
+
+static uint16_t stackFree(TaskHandle_t task) {
+  // En ESP-IDF el high water mark está en bytes
+  return task ? (uint16_t)uxTaskGetStackHighWaterMark(task) : 0;
+}
+
+static void fillCaptureStats(CaptureStats& stats) {
+  memset(&stats, 0, sizeof(stats));
+  if (samplingStartUs == 0) return;   // Nunca se grabó
+  
+  int64_t end = samplingEndUs ? samplingEndUs : esp_timer_get_time();
+  uint64_t elapsedUs = (uint64_t)(end - samplingStartUs);
+  uint64_t expected = elapsedUs * ECG_SAMPLE_RATE_HZ / 1000000;
+  if (TOTAL_ECG_SAMPLES > 0 && expected > TOTAL_ECG_SAMPLES) expected = TOTAL_ECG_SAMPLES;
   
+  stats.elapsed_ms = (uint32_t)(elapsedUs / 1000);
+  stats.samples_produced = samplesProduced.load(std::memory_order_relaxed);
+  stats.samples_expected = (uint32_t)expected;
+  stats.samples_dropped = ecgBlocks.dropped.load(std::memory_order_relaxed);
+  stats.imu_dropped = droppedImuSamples;
+  stats.peaks_dropped = droppedPeaks;
+  stats.interval_max_dev_us = intervalMaxDevUs;
+  memcpy(stats.interval_hist, intervalHist, sizeof(intervalHist));
+  stats.sd_flushes = sdBursts.load(std::memory_order_relaxed);
+  stats.sd_flush_total_ms = sdBusy.totalMs.load(std::memory_order_relaxed);
+  stats.sd_flush_max_us = sdFlushMaxUs;
+  memcpy(stats.sd_flush_hist, sdFlushHist, sizeof(sdFlushHist));
+  stats.block_wait_max_ms = blockWaitMaxMs;
+  stats.imu_ring_max = imuRingMax;
+  stats.rpeak_ring_max = rpeakRingMax;
+  stats.live_ring_max = liveRingMax;
+  stats.acquisition_stack_free = stackFree(acquisitionTask);
+  stats.storage_stack_free = stackFree(storageTask);
+  stats.imu_stack_free = stackFree(imuTask);
+}
+
+static void resetCaptureStats() {
+  samplingEndUs = 0;
+  lastIntervalUs = 0;
+  intervalMaxDevUs = 0;
+  memset(intervalHist, 0, sizeof(intervalHist));
+  sdFlushMaxUs = 0;
+  memset(sdFlushHist, 0, sizeof(sdFlushHist));
+  blockWaitMaxMs = 0;
+  imuRingMax = 0;
+  rpeakRingMax = 0;
+  liveRingMax = 0;
+}
+
+static uint16_t perMille(uint32_t busyMs, uint32_t windowMs) {
+  if (windowMs == 0) return 0;
+  uint64_t value = (uint64_t)busyMs * 1000 / windowMs;
+  return value > 1000 ? 1000 : (uint16_t)value;
+}
+
+static void setCurrentSegmentFile(const char* name) {
+  portENTER_CRITICAL(&fileNameMux);
+  strncpy(currentSegmentFile, name, HOLTER_MAX_FILENAME_LEN - 1);
+  currentSegmentFile[HOLTER_MAX_FILENAME_LEN - 1] = '\0';
+  portEXIT_CRITICAL(&fileNameMux);
+}
+
+// Crea /session_<ts>_<seq>.bin y escribe su header (sector 0). En modo
+// eventos el segmento empieza antes de sampleCount: con el pre-evento.
+// <ts> va con 10 dígitos: sin hora el ID es un contador chico y los
+// nombres tienen que seguir ordenando como texto (SD, subida, espacio)
+static bool openSegment(unsigned long firstSample) {
+  char name[HOLTER_MAX_FILENAME_LEN];
+  snprintf(name, sizeof(name), "/session_%010lu_%04u.bin", recordingTimestamp, (unsigned)segmentSeq);
+  
+  if (sdCard.cardType() == CARD_NONE) {
+    HOLTER_LOGE("[ERROR] Tarjeta SD removida o no detectada");
+    return false;
+  }
+  
+  // Borra segmentos ya subidos si hace falta; sin lugar se graba igual
+  // hasta llenar la tarjeta, pero sin reservar
+  bool reserve = HOLTER_SD_PREALLOC && holter_storageEnsureFree(SEGMENT_PREALLOC_BYTES);
+  
+  // El nombre se publica antes de crear el archivo: la tarea de red que
+  // recorre la SD nunca ve este segmento sin saber que está abierto
+  setCurrentSegmentFile(name);
+  
+  // Clusters asignados ahora: las ráfagas escriben sobre espacio reservado
+  // y el flush solo actualiza la entrada del directorio, no la FAT
+  int64_t start = esp_timer_get_time();
+  dataFile = holter_storageCreate(name, reserve ? SEGMENT_PREALLOC_BYTES : 0, segmentPreallocated);
   if (!dataFile) {
-    Serial.println("[ERROR] Archivo no está abierto!");
-    bufferIndex = 0;
-    return;
+    HOLTER_LOGE("[ERROR] No se pudo crear segmento %s", name);
+    setCurrentSegmentFile("");
+    return false;
+  }
+  if (segmentPreallocated) {
+    HOLTER_LOGD("[SD] %lu KB reservados en %lu ms", (unsigned long)(SEGMENT_PREALLOC_BYTES / 1024),
+                (unsigned long)((esp_timer_get_time() - start) / 1000));
+  } else if (reserve) {
+    HOLTER_LOGW("[WARNING] No se pudo reservar el segmento: crece con cada ráfaga");
   }
   
-  size_t written = dataFile.write(writeBuffer, bufferIndex);
+  // Header con contadores en 0: nunca se reescribe, cada bloque de datos
+  // lleva su cantidad de muestras
+  FileHeader header = {0};
+  header.magic = FILE_MAGIC;
+  header.version = FILE_FORMAT_VERSION;
+  header.device_id = 1;
+  header.session_id = recordingTimestamp;
+  header.timestamp_start = recordingTimestamp + firstSample / ECG_SAMPLE_RATE_HZ;
+  header.ecg_sample_rate = ECG_SAMPLE_RATE_HZ;
+  header.imu_sample_rate = imuAvailable ? IMU_SAMPLE_RATE_HZ : 0;
+  header.num_ecg_samples = 0;
+  header.num_imu_samples = 0;
+  header.segment_seq = segmentSeq;
+  header.first_sample_index = firstSample;
+  header.ecg_codec = ECG_CODEC_ID;
+  header.ecg_channels = ECG_CODEC_CHANNELS;
+  header.adc_coeff_a = adcCoeffA;
+  header.adc_coeff_b = adcCoeffB;
+  header.ecg_gain = AD8232_GAIN;
+  header.ecg_offset_mv = AD8232_OFFSET_MV;
+  header.ecg_sample_format = ECG_SAMPLE_FORMAT;
+  header.ecg_filter = ecgFilterMask;
+  header.ecg_highpass_chz = (ecgFilterMask & ECG_FILTER_HIGHPASS) ? (uint16_t)(HOLTER_ECG_HIGHPASS_HZ * 100) : 0;
+  header.ecg_lowpass_hz = (ecgFilterMask & ECG_FILTER_LOWPASS) ? HOLTER_ECG_LOWPASS_HZ : 0;
+  header.ecg_notch_hz = (ecgFilterMask & ECG_FILTER_NOTCH) ? HOLTER_ECG_NOTCH_HZ : 0;
+  
+  // El header ocupa el primer sector completo: los bloques de datos quedan
+  // alineados a 512 bytes dentro del archivo
+  static uint8_t headerBlock[FILE_HEADER_BLOCK_SIZE] __attribute__((aligned(4)));
+  memset(headerBlock, 0, sizeof(headerBlock));
+  memcpy(headerBlock, &header, sizeof(FileHeader));
   
-  if (written == 0) {
-    Serial.println("[ERROR] Write failed - SD Card error!");
-  } else if (written != bufferIndex) {
-    Serial.printf("[WARNING] Escritura parcial: %d/%d bytes\n", written, bufferIndex);
+  size_t headerWritten = dataFile.write(headerBlock, FILE_HEADER_BLOCK_SIZE);
+  if (headerWritten != FILE_HEADER_BLOCK_SIZE) {
+    HOLTER_LOGE("[ERROR] Header incompleto (%u/%u bytes)",
+                (unsigned)headerWritten, (unsigned)FILE_HEADER_BLOCK_SIZE);
+    dataFile.close();
+    sdCard.remove(name);
+    segmentPreallocated = false;
+    setCurrentSegmentFile("");
+    return false;
   }
+  dataFile.flush();
+  
+  segmentFirstSample = firstSample;
+  segmentSampleCount = sampleCount - firstSample;
+  segmentImuCount = 0;
+  segmentPeakCount = 0;
+  segmentDataBytes = 0;
+  segmentEcgBytes = 0;
   
-  bufferIndex = 0;
+  HOLTER_LOGI("[SD] Segmento %u abierto: %s (primera muestra %lu)",
+              (unsigned)segmentSeq, name, segmentFirstSample);
+  return true;
 }
 
-static void writeToBuffer(uint8_t* data, size_t len) {
-  for (size_t i = 0; i < len; i++) {
-    writeBuffer[bufferIndex++] = data[i];
-    if (bufferIndex >= BUFFER_SIZE) {
-      flushBuffer();
+// Escribe la ráfaga acumulada: sectores completos y contiguos
+static bool flushBurst() {
+  if (sdBurstCount == 0) return true;
+  if (!dataFile) {
+    sdBurstCount = 0;
+    return false;
+  }
+  
+  size_t bytes = sdBurstCount * DATA_BLOCK_SIZE;
+  int64_t start = esp_timer_get_time();
+  bool ok = dataFile.write(sdBurst[0], bytes) == bytes;
+  dataFile.flush();
+  uint32_t us = (uint32_t)(esp_timer_get_time() - start);
+  addBusy(sdBusy, us);
+  sdFlushHist[histBin(us)]++;
+  if (us > sdFlushMaxUs) sdFlushMaxUs = us;
+  
+  sdBursts.fetch_add(1, std::memory_order_relaxed);
+  sdBurstBytes.fetch_add(bytes, std::memory_order_relaxed);
+  sdBurstCount = 0;
+  return ok;
+}
+
+static bool queueFileBlock(const uint8_t* block) {
+  memcpy(sdBurst[sdBurstCount++], block, DATA_BLOCK_SIZE);
+  if (sdBurstCount == SD_BURST_BLOCKS) {
+    return flushBurst();
+  }
+  return true;
+}
+
+// Completa el header del bloque en armado, calcula su CRC y lo agrega a la
+// ráfaga de la SD como un sector completo
+static bool writeDataBlock(uint16_t type, size_t numSamples, uint32_t firstIndex,
+                           size_t payloadBytes) {
+  memset(dataBlockPayload + payloadBytes, 0, DATA_BLOCK_PAYLOAD - payloadBytes);
+  
+  DataBlockHeader* header = (DataBlockHeader*)dataBlock;
+  header->sync = DATA_BLOCK_SYNC;
+  header->type = type;
+  header->num_samples = numSamples;
+  header->first_ecg_index = firstIndex;
+  header->payload_bytes = payloadBytes;
+  header->segment_tag = data_block_tag(recordingTimestamp, segmentSeq);
+  header->crc32 = 0;
+  header->crc32 = holter_crc32(0, dataBlock, DATA_BLOCK_SIZE);
+  
+  if (EVENT_MODE && !eventRecording) {
+    // Sin evento: al ring de pre-evento, pisando el bloque más antiguo
+    if (preTriggerCapacity == 0) return true;
+    memcpy(preTriggerRing[preTriggerHead], dataBlock, DATA_BLOCK_SIZE);
+    preTriggerHead = (preTriggerHead + 1) % preTriggerCapacity;
+    if (preTriggerCount < preTriggerCapacity) preTriggerCount++;
+    return true;
+  }
+  
+  segmentDataBytes += DATA_BLOCK_SIZE;
+  return queueFileBlock(dataBlock);
+}
+
+// Destino de los bloques de datos: el archivo o, sin evento, el ring
+static bool blockSinkReady() {
+  return dataFile || (EVENT_MODE && !eventRecording);
+}
+
+// Escribe en bloques las muestras IMU tomadas antes de la muestra ECG
+// `limitIndex`: el IMU queda en el mismo segmento que su ECG. Salvo al
+// cerrar el segmento (flush) solo se escriben bloques llenos
+static void writeImuBlocks(unsigned long limitIndex, bool flush) {
+  for (;;) {
+    size_t tail = imuTail.load(std::memory_order_relaxed);
+    size_t head = imuHead.load(std::memory_order_acquire);
+    
+    size_t available = 0;
+    for (size_t i = tail; i != head && available < IMU_SAMPLES_PER_DATA_BLOCK;
+         i = (i + 1) % IMU_RING_SIZE) {
+      if (imuRing[i].ecg_index >= limitIndex) break;
+      available++;
     }
+    if (available == 0 || (!flush && available < IMU_SAMPLES_PER_DATA_BLOCK)) return;
+    
+    uint32_t firstIndex = imuRing[tail].ecg_index;
+    IMUSample* payload = (IMUSample*)dataBlockPayload;
+    for (size_t n = 0; n < available; n++) {
+      payload[n] = imuRing[tail].sample;
+      tail = (tail + 1) % IMU_RING_SIZE;
+    }
+    imuTail.store(tail, std::memory_order_release);
+    
+    if (!blockSinkReady()) return;
+    if (!writeDataBlock(DATA_BLOCK_IMU, available, firstIndex, available * sizeof(IMUSample))) {
+      HOLTER_LOGE("[ERROR] Write failed - SD Card error!");
+    }
+    segmentImuCount += available;
+    imuSampleCount += available;
   }
 }
 
-// ============================================================================
-// IMPLEMENTACIÓN DE INTERFACE PÚBLICA
-// ============================================================================
+// Igual que writeImuBlocks() para las anotaciones de picos R
+static void writePeakBlocks(unsigned long limitIndex, bool flush) {
+  for (;;) {
+    size_t tail = rpeakTail.load(std::memory_order_relaxed);
+    size_t head = rpeakHead.load(std::memory_order_acquire);
+    
+    size_t available = 0;
+    for (size_t i = tail; i != head && available < RPEAKS_PER_DATA_BLOCK;
+         i = (i + 1) % RPEAK_RING_SIZE) {
+      if (rpeakRing[i].ecg_index >= limitIndex) break;
+      available++;
+    }
+    if (available == 0 || (!flush && available < RPEAKS_PER_DATA_BLOCK)) return;
+    
+    uint32_t firstIndex = rpeakRing[tail].ecg_index;
+    RPeakAnnotation* payload = (RPeakAnnotation*)dataBlockPayload;
+    for (size_t n = 0; n < available; n++) {
+      payload[n] = rpeakRing[tail];
+      tail = (tail + 1) % RPEAK_RING_SIZE;
+    }
+    rpeakTail.store(tail, std::memory_order_release);
+    
+    if (!blockSinkReady()) return;
+    if (!writeDataBlock(DATA_BLOCK_RPEAK, available, firstIndex,
+                        available * sizeof(RPeakAnnotation))) {
+      HOLTER_LOGE("[ERROR] Write failed - SD Card error!");
+    }
+    segmentPeakCount += available;
+  }
+}
 
-void holter_init(XSpaceBioV10Board* bioBoard, XSpaceV21Board* v21Board) {
-  g_bioBoard = bioBoard;
+// Registra un latido confirmado (tarea de adquisición)
+static void recordBeat(unsigned long produced, const QRSBeat& beat) {
+  RPeakAnnotation peak;
+  peak.ecg_index = produced - beat.age;
+  peak.rr_ms = beat.rr_ms;
+  
+  size_t head = rpeakHead.load(std::memory_order_relaxed);
+  size_t next = (head + 1) % RPEAK_RING_SIZE;
+  size_t tail = rpeakTail.load(std::memory_order_acquire);
+  if (next != tail) {
+    rpeakRing[head] = peak;
+    rpeakHead.store(next, std::memory_order_release);
+    trackMax(rpeakRingMax, (next + RPEAK_RING_SIZE - tail) % RPEAK_RING_SIZE);
+  } else {
+    droppedPeaks++;
+  }
+  
+  portENTER_CRITICAL(&heartRateMux);
+  if (beat.rr_ms != 0) {
+    if (heartRate.num_rr < QRS_RR_HISTORY) heartRate.num_rr++;
+    memmove(heartRate.rr_ms, heartRate.rr_ms + 1, (QRS_RR_HISTORY - 1) * sizeof(uint16_t));
+    heartRate.rr_ms[QRS_RR_HISTORY - 1] = beat.rr_ms;
+  }
+  heartRate.last_rr_ms = beat.rr_ms;
+  heartRate.mean_rr_ms = beat.mean_rr_ms;
+  heartRate.bpm = beat.mean_rr_ms ? 60000 / beat.mean_rr_ms : 0;
+  heartRate.beat_count++;
+  heartRate.last_peak_index = peak.ecg_index;
+  portEXIT_CRITICAL(&heartRateMux);
+}
+
+// Recorta lo reservado que no se usó
+static void closeDataFile(const char* name) {
+  dataFile.close();
+  if (segmentPreallocated) {
+    holter_storageTruncate(name, FILE_HEADER_BLOCK_SIZE + segmentDataBytes);
+    segmentPreallocated = false;
+  }
+}
+
+// Cierra el archivo y lo entrega a main. Los bloques ya están completos en
+// la SD: no hay header que reescribir ni que verificar
+static void closeSegment() {
+  if (!dataFile) return;
   
-  Serial.println("[INIT] Inicializando módulo de captura...");
+  char name[HOLTER_MAX_FILENAME_LEN];
+  portENTER_CRITICAL(&fileNameMux);
+  memcpy(name, currentSegmentFile, sizeof(name));
+  portEXIT_CRITICAL(&fileNameMux);
+  
+  if (segmentSampleCount == 0) {
+    // Segmento recién rotado sin datos: no se sube
+    sdBurstCount = 0;
+    dataFile.close();
+    sdCard.remove(name);
+    segmentPreallocated = false;
+    return;
+  }
   
-  // Configurar pines SPI explícitamente
-  pinMode(SD_CS_PIN, OUTPUT);
-  digitalWrite(SD_CS_PIN, HIGH);
+  writeImuBlocks(segmentFirstSample + segmentSampleCount, true);
+  writePeakBlocks(segmentFirstSample + segmentSampleCount, true);
   
-  delay(100);
+  // Último bloque: las estadísticas acumuladas hasta el cierre
+  CaptureStats trailer;
+  fillCaptureStats(trailer);
+  memcpy(dataBlockPayload, &trailer, sizeof(trailer));
+  if (!writeDataBlock(DATA_BLOCK_STATS, 1, segmentFirstSample + segmentSampleCount,
+                      sizeof(trailer)) ||
+      !flushBurst()) {
+    HOLTER_LOGE("[ERROR] Write failed - SD Card error!");
+  }
+  closeDataFile(name);
   
-  // Inicializar SPI con pines específicos
-  SPI.begin(SD_SCK, SD_MISO, SD_MOSI, SD_CS_PIN);
+  HOLTER_LOGI("[SD] Segmento %u cerrado: %s | %lu ECG + %lu IMU + %lu R | %lu bytes (compresión ECG %.1fx)",
+              (unsigned)segmentSeq, name, segmentSampleCount, segmentImuCount, segmentPeakCount,
+              FILE_HEADER_BLOCK_SIZE + segmentDataBytes,
+              (float)(segmentSampleCount * sizeof(ECGSample)) /
+                  (segmentEcgBytes ? segmentEcgBytes : 1));
   
-  Serial.println("[INIT] SPI inicializado");
-  Serial.printf("[INIT] Pines - CS:%d, MOSI:%d, MISO:%d, SCK:%d\n", 
-                SD_CS_PIN, SD_MOSI, SD_MISO, SD_SCK);
+  if (xQueueSend(completedSegments, name, 0) != pdTRUE) {
+    HOLTER_LOGW("[WARNING] Cola de segmentos llena, %s queda en SD", name);
+  }
+  segmentSeq++;
+}
+
+// Termina el evento en curso: el segmento se cierra y los bloques vuelven
+// al ring de pre-evento
+static void endEvent() {
+  closeSegment();
+  eventRecording = false;
+  setCurrentSegmentFile("");   // Sin segmento abierto: nada que pedir por adelantado
+  HOLTER_LOGI("[EVENT] Evento terminado en la muestra %lu", sampleCount);
+}
+
+// Muestras que todavía entran en el segmento abierto
+static size_t segmentRoom() {
+  size_t room = SAMPLES_PER_SEGMENT - segmentSampleCount;
+  if (EVENT_MODE && eventEndSample - sampleCount < room) {
+    room = eventEndSample - sampleCount;   // El archivo termina con el post-evento
+  }
+  return room;
+}
+
+// Avanza la línea de tiempo n muestras (escritas o descartadas) y rota el
+// segmento al llegar a su final
+static void advanceSamples(size_t n, bool toFile) {
+  sampleCount += n;
+  if (!toFile) return;
   
-  // Intentar montar SD Card
-  Serial.print("[SD] Inicializando tarjeta SD...");
+  segmentSampleCount += n;
+  if (EVENT_MODE && sampleCount >= eventEndSample) {
+    endEvent();
+  } else if (segmentSampleCount >= SAMPLES_PER_SEGMENT) {
+    closeSegment();
+    if (!recordingComplete(sampleCount)) {
+      openSegment(sampleCount);
+    }
+  }
+}
+
+// Hueco por muestras descartadas: no se escribe nada, pero los segmentos
+// siguen cubriendo la misma duración y el siguiente bloque ECG lleva su
+// índice real (el lector ve el salto en first_ecg_index)
+static void skipSamples(unsigned long gap) {
+  while (gap > 0) {
+    bool toFile = (!EVENT_MODE || eventRecording) && dataFile;
+    size_t n = gap;
+    if (toFile) {
+      size_t room = segmentRoom();
+      if (room < n) n = room;
+    }
+    advanceSamples(n, toFile);
+    gap -= n;
+  }
+}
+
+// Comprime un bloque, lo escribe en la SD y lo libera para la adquisición.
+// Si el bloque cruza el final de un segmento, se parte y se rota el
+// archivo: la adquisición sigue llenando el otro bloque.
+// En modo eventos, sin evento en curso, los bloques van al ring.
+static void writeBlock(int block) {
+  size_t count = ecgBlocks.length[block].load(std::memory_order_acquire);
+  if (count == 0) return;
   
-  SD.end();
-  delay(500);
+  const ECGSample* samples = ecgBlocks.samples[block];
+  uint32_t firstIndex = ecgBlocks.firstIndex[block];
+  if (firstIndex > sampleCount) {
+    skipSamples(firstIndex - sampleCount);
+  }
   
-  bool sdMounted = false;
-  for (int i = 0; i < 5 && !sdMounted; i++) {
-    if (i > 0) {
-      Serial.printf(" reintento %d...", i);
-      delay(1000);
+  while (count > 0) {
+    bool toFile = !EVENT_MODE || eventRecording;
+    if (toFile && !dataFile && (!sdAvailable || !openSegment(sampleCount))) {
+      HOLTER_LOGE("[ERROR] Archivo no está abierto!");
+      ecgBlocks.dropped.fetch_add(count, std::memory_order_relaxed);
+      sampleCount += count;   // Hueco: el resto de la línea de tiempo no se corre
+      break;
     }
     
-    sdMounted = SD.begin(SD_CS_PIN, SPI, 4000000);
+    size_t n = count;
+    if (toFile) {
+      size_t room = segmentRoom();
+      n = (count < room) ? count : room;
+    }
     
-    if (!sdMounted) {
-      SPI.end();
-      delay(200);
-      SPI.begin(SD_SCK, SD_MISO, SD_MOSI, SD_CS_PIN);
-      delay(200);
+    // Un frame por bloque de datos, con las muestras que quepan en él;
+    // ningún frame cruza el límite de un segmento
+    size_t bytes = ecg_codec_encodeFrameLimited((const int16_t*)samples, n, dataBlockPayload,
+                                                DATA_BLOCK_PAYLOAD, &n);
+    if (!writeDataBlock(DATA_BLOCK_ECG, n, sampleCount, bytes)) {
+      HOLTER_LOGE("[ERROR] Write failed - SD Card error!");
     }
+    if (toFile) segmentEcgBytes += DATA_BLOCK_SIZE;
+    
+    samples += n;
+    count -= n;
+    advanceSamples(n, toFile);
   }
   
-  if (!sdMounted) {
-    Serial.println(" [FAIL]");
-    Serial.println("[ERROR] SD Card no disponible");
-    sdAvailable = false;
-  } else {
-    Serial.println(" [OK]");
-    
-    uint8_t cardType = SD.cardType();
-    if (cardType == CARD_NONE) {
-      Serial.println("[WARNING] No se detectó tarjeta SD");
-      sdAvailable = false;
-    } else {
-      Serial.print("[SD] Tipo: ");
-      if (cardType == CARD_MMC) Serial.println("MMC");
-      else if (cardType == CARD_SD) Serial.println("SDSC");
-      else if (cardType == CARD_SDHC) Serial.println("SDHC");
-      else Serial.println("UNKNOWN");
-      
-      uint64_t cardSize = SD.cardSize() / (1024 * 1024);
-      Serial.printf("[SD] Tamaño: %lluMB\n", cardSize);
-      
-      uint64_t usedBytes = SD.usedBytes() / (1024 * 1024);
-      uint64_t totalBytes = SD.totalBytes() / (1024 * 1024);
-      Serial.printf("[SD] Usado: %lluMB / %lluMB\n", usedBytes, totalBytes);
-      
-      sdAvailable = true;
+  writeImuBlocks(sampleCount, false);
+  writePeakBlocks(sampleCount, false);
+  // Sin bajo consumo la ráfaga es lo de este bloque (~2 s de datos); con
+  // bajo consumo se escribe al llenarse o al cerrar el segmento
+  if (!HOLTER_LOW_POWER && !flushBurst()) {
+    HOLTER_LOGE("[ERROR] Write failed - SD Card error!");
+  }
+  uint32_t waitMs = (uint32_t)((esp_timer_get_time() - blockReadyUs[block]) / 1000);
+  if (waitMs > blockWaitMaxMs) blockWaitMaxMs = waitMs;
+  ecg_blocks_release(ecgBlocks, block);
+}
+
+// Anotación del disparo: un bloque con el índice y el origen del evento
+static void writeEventBlock(uint16_t source, uint32_t triggerIndex, uint16_t bpm) {
+  EventAnnotation* event = (EventAnnotation*)dataBlockPayload;
+  event->source = source;
+  event->bpm = bpm;
+  if (!writeDataBlock(DATA_BLOCK_EVENT, 1, triggerIndex, sizeof(EventAnnotation))) {
+    HOLTER_LOGE("[ERROR] Write failed - SD Card error!");
+  }
+}
+
+// Abre el segmento del evento con el pre-evento del ring. Un disparo con
+// un evento en curso solo extiende su final
+static void startEvent(uint16_t source, uint32_t triggerIndex) {
+  HeartRateInfo hr;
+  holter_getHeartRate(hr);
+  unsigned long endSample = triggerIndex + EVENT_POST_SAMPLES;
+  
+  if (eventRecording) {
+    if (endSample > eventEndSample) eventEndSample = endSample;
+    writeEventBlock(source, triggerIndex, hr.bpm);
+    HOLTER_LOGI("[EVENT] Evento %u extendido hasta la muestra %lu", source, eventEndSample);
+    return;
+  }
+  if (!sdAvailable) return;
+  
+  // Primer bloque ECG con muestras dentro de la ventana de pre-evento: ahí
+  // empieza el archivo (los bloques IMU previos a él se descartan)
+  unsigned long preStart = triggerIndex > EVENT_PRE_SAMPLES ? triggerIndex - EVENT_PRE_SAMPLES : 0;
+  size_t index = (preTriggerHead + preTriggerCapacity - preTriggerCount) % (preTriggerCapacity ? preTriggerCapacity : 1);
+  size_t remaining = preTriggerCount;
+  while (remaining > 0) {
+    const DataBlockHeader* header = (const DataBlockHeader*)preTriggerRing[index];
+    if (header->type == DATA_BLOCK_ECG && header->first_ecg_index + header->num_samples > preStart) break;
+    index = (index + 1) % preTriggerCapacity;
+    remaining--;
+  }
+  unsigned long firstSample = remaining > 0
+      ? ((const DataBlockHeader*)preTriggerRing[index])->first_ecg_index
+      : sampleCount;
+  
+  eventRecording = true;
+  if (!openSegment(firstSample)) {
+    eventRecording = false;
+    return;
+  }
+  
+  for (; remaining > 0; remaining--) {
+    const DataBlockHeader* header = (const DataBlockHeader*)preTriggerRing[index];
+    if (!queueFileBlock(preTriggerRing[index])) {
+      HOLTER_LOGE("[ERROR] Write failed - SD Card error!");
     }
+    segmentDataBytes += DATA_BLOCK_SIZE;
+    if (header->type == DATA_BLOCK_ECG) segmentEcgBytes += DATA_BLOCK_SIZE;
+    if (header->type == DATA_BLOCK_IMU) segmentImuCount += header->num_samples;
+    if (header->type == DATA_BLOCK_RPEAK) segmentPeakCount += header->num_samples;
+    index = (index + 1) % preTriggerCapacity;
   }
+  preTriggerCount = 0;
   
-  Serial.println("[INIT] Módulo de captura listo");
+  eventEndSample = endSample > sampleCount ? endSample : sampleCount + 1;
+  writeEventBlock(source, triggerIndex, hr.bpm);
+  if (!HOLTER_LOW_POWER && !flushBurst()) {
+    HOLTER_LOGE("[ERROR] Write failed - SD Card error!");
+  }
+  eventCount++;
+  
+  HOLTER_LOGI("[EVENT] Evento %u (origen %u, %u lpm) en la muestra %lu: %.1f s de pre-evento",
+              (unsigned)eventCount, source, hr.bpm, (unsigned long)triggerIndex,
+              (float)(triggerIndex > firstSample ? triggerIndex - firstSample : 0) / ECG_SAMPLE_RATE_HZ);
 }
 
-bool holter_startCapture() {
-  Serial.println("\n========================================");
-  Serial.println("INICIANDO CAPTURA");
-  Serial.println("========================================");
+// Dispara un evento por frecuencia cardíaca al salir del rango (con 5 lpm
+// de histéresis para no redisparar en el borde)
+static void checkHeartRateEvent() {
+  static bool alarm = false;
+  HeartRateInfo hr;
+  if (!holter_getHeartRate(hr)) return;
   
-  captureStartTime = millis();
+  const int HYSTERESIS = alarm ? 5 : 0;
+  bool high = HOLTER_EVENT_HR_HIGH_BPM > 0 && hr.bpm > HOLTER_EVENT_HR_HIGH_BPM - HYSTERESIS;
+  bool low = HOLTER_EVENT_HR_LOW_BPM > 0 && hr.bpm < HOLTER_EVENT_HR_LOW_BPM + HYSTERESIS;
+  if ((high || low) && !alarm) {
+    holter_triggerEvent(EVENT_HEART_RATE);
+  }
+  alarm = high || low;
+}
+
+// Agrega la muestra al bloque activo; si se completa un bloque se entrega
+// a la tarea de almacenamiento. Con la SD atrasada la muestra se descarta
+// (no se bloquea) y queda un hueco en su índice
+static void appendSample(const ECGSample& sample, unsigned long index) {
+  int64_t now = esp_timer_get_time();
+  int ready = ecg_blocks_append(ecgBlocks, sample, (uint32_t)index);
+  if (ready >= 0) {
+    blockReadyUs[ready] = now;
+    xTaskNotifyGive(storageTask);
+  }
+}
+
+#if HOLTER_ECG_ADC_DMA
+// (las muestras salen del ADC continuo, ver acquisitionTaskFn)
+#elif HOLTER_ECG_RAW_ADC
+// Cuentas crudas del ADC: solo enteros en el camino crítico
+static ECGSample readECGSample() {
+  ECGSample sample;
+  sample.derivation_I = (int16_t)analogRead(HOLTER_ECG_ADC_PIN_I);
+  sample.derivation_II = (int16_t)analogRead(HOLTER_ECG_ADC_PIN_II);
+  // La III en cuentas es exacta: offset y referencia se cancelan en II - I
+  sample.derivation_III = (int16_t)(sample.derivation_II - sample.derivation_I);
+  return sample;
+}
+#else
+static ECGSample readECGSample() {
+  float derivationI = g_bioBoard->AD8232_GetVoltage(AD8232_XS1);
+  float derivationII = g_bioBoard->AD8232_GetVoltage(AD8232_XS2);
   
-  // Obtener timestamp Unix real
-  time_t now;
-  time(&now);
-  unsigned long timestamp = (unsigned long)now;
+  const float OFFSET = AD8232_OFFSET_MV / 1000.0;
   
-  currentSessionID = "session_" + String(timestamp);
-  currentSessionFile = "/" + currentSessionID + ".bin";
+  float ecgI_mV = ((derivationI - OFFSET) * 1000.0) / AD8232_GAIN;
+  float ecgII_mV = ((derivationII - OFFSET) * 1000.0) / AD8232_GAIN;
   
-  Serial.println("[INFO] Sesión: " + currentSessionID);
-  Serial.println("[INFO] Archivo: " + currentSessionFile);
-  Serial.println("[INFO] Timestamp Unix: " + String(timestamp));
-  Serial.printf("[INFO] Duración configurada: %d segundos\n", CAPTURE_DURATION_SEC);
+  ECGSample sample;
+  sample.derivation_I = (int16_t)(ecgI_mV * ECG_SCALE_FACTOR);
+  sample.derivation_II = (int16_t)(ecgII_mV * ECG_SCALE_FACTOR);
+  // Se calcula en enteros para que coincida exacto con la III que
+  // reconstruye el decodificador (el archivo solo guarda I y II)
+  sample.derivation_III = (int16_t)(sample.derivation_II - sample.derivation_I);
+  return sample;
+}
+#endif
+
+#if HOLTER_ECG_RAW_ADC
+// El modo crudo lee los pines directamente; la biblioteca es la que conoce
+// el cableado de XS1/XS2, así que se compara su lectura con la del pin
+static void checkECGPin(int lead, uint8_t pin, const char* name) {
+  uint32_t libraryMv = 0;
+  uint32_t pinMv = 0;
+  for (int i = 0; i < ECG_PIN_CHECK_READS; i++) {
+    libraryMv += (uint32_t)(g_bioBoard->AD8232_GetVoltage(lead) * 1000.0);
+    pinMv += analogReadMilliVolts(pin);
+  }
+  libraryMv /= ECG_PIN_CHECK_READS;
+  pinMv /= ECG_PIN_CHECK_READS;
   
-  if (!sdAvailable) {
-    Serial.println("[ERROR] SD Card no disponible - no se puede capturar");
-    sampleCount = 100;
-    isCapturing = false;
-    return false;
+  uint32_t diff = libraryMv > pinMv ? libraryMv - pinMv : pinMv - libraryMv;
+  if (diff > ECG_PIN_CHECK_MV) {
+    HOLTER_LOGW("[WARNING] %s: GPIO%u lee %lu mV y la biblioteca %lu mV, revisar el pin",
+                name, pin, (unsigned long)pinMv, (unsigned long)libraryMv);
   }
+}
+#endif
+
+// Configura los pines ECG del ADC1 y lee la calibración de fábrica (eFuse)
+// una sola vez; los coeficientes van en el header de cada segmento
+static void initECGAdc() {
+#if HOLTER_ECG_RAW_ADC
+  analogReadResolution(12);
+  analogSetPinAttenuation(HOLTER_ECG_ADC_PIN_I, ADC_11db);
+  analogSetPinAttenuation(HOLTER_ECG_ADC_PIN_II, ADC_11db);
+  checkECGPin(AD8232_XS1, HOLTER_ECG_ADC_PIN_I, "XS1");
+  checkECGPin(AD8232_XS2, HOLTER_ECG_ADC_PIN_II, "XS2");
   
-  if (SD.cardType() == CARD_NONE) {
-    Serial.println("[ERROR] Tarjeta SD removida o no detectada");
-    sdAvailable = false;
-    return false;
+  esp_adc_cal_characteristics_t adcChars;
+  esp_adc_cal_value_t calSource = esp_adc_cal_characterize(
+      ADC_UNIT_1, ADC_ATTEN_DB_11, ADC_WIDTH_BIT_12, ADC_VREF_EFUSE_DEFAULT_MV, &adcChars);
+  adcCoeffA = adcChars.coeff_a;
+  adcCoeffB = (uint16_t)adcChars.coeff_b;
+  
+  HOLTER_LOGI("[INIT] ADC ECG en cuentas crudas (pines %d/%d), calibración %s: a=%lu b=%u mV",
+              HOLTER_ECG_ADC_PIN_I, HOLTER_ECG_ADC_PIN_II,
+              calSource == ESP_ADC_CAL_VAL_DEFAULT_VREF ? "por defecto" : "eFuse",
+              (unsigned long)adcCoeffA, adcCoeffB);
+#endif
+}
+
+// Entrega una muestra al bloque activo (solo desde la tarea de adquisición)
+static void produceSample(const ECGSample& input) {
+  unsigned long produced = samplesProduced.load(std::memory_order_relaxed);
+  if (!isCapturing || stopRequested || recordingComplete(produced)) return;
+  
+#if HOLTER_ECG_FILTER
+  ECGSample sample;
+  sample.derivation_I = ecg_filter_process(filterI, input.derivation_I);
+  sample.derivation_II = ecg_filter_process(filterII, input.derivation_II);
+  sample.derivation_III = (int16_t)(sample.derivation_II - sample.derivation_I);
+#else
+  const ECGSample& sample = input;
+#endif
+  
+  appendSample(sample, produced);
+  samplesProduced.store(produced + 1, std::memory_order_release);
+  
+  if (liveTap) {
+    size_t head = liveHead.load(std::memory_order_relaxed);
+    size_t next = (head + 1) % LIVE_RING_SIZE;
+    size_t tail = liveTail.load(std::memory_order_acquire);
+    if (next != tail) {
+      liveRing[head].index = produced;
+      liveRing[head].sample = sample;
+      liveHead.store(next, std::memory_order_release);
+      trackMax(liveRingMax, (next + LIVE_RING_SIZE - tail) % LIVE_RING_SIZE);
+    }
   }
   
-  Serial.println("[SD] Creando archivo...");
-  dataFile = SD.open(currentSessionFile.c_str(), FILE_WRITE);
+  if (waveTap) {
+    int16_t v = sample.derivation_II;
+    if (waveCount == 0 || v < waveColumn.min) waveColumn.min = v;
+    if (waveCount == 0 || v > waveColumn.max) waveColumn.max = v;
+    if (++waveCount >= WAVE_DECIMATION) {
+      waveCount = 0;
+      size_t head = waveHead.load(std::memory_order_relaxed);
+      size_t next = (head + 1) % WAVE_RING_SIZE;
+      if (next != waveTail.load(std::memory_order_acquire)) {
+        waveRing[head] = waveColumn;
+        waveHead.store(next, std::memory_order_release);
+      }
+    }
+  }
   
-  if(!dataFile) {
-    Serial.println("[ERROR] No se pudo crear archivo en SD");
-    return false;
+#if HOLTER_QRS_DETECT
+  QRSBeat beat;
+  if (qrs_process(qrsDetector, sample.derivation_II, beat)) {
+    recordBeat(produced, beat);
   }
+#endif
   
-  Serial.println("[SD] Archivo abierto correctamente");
+  if (imuAvailable && produced % IMU_DECIMATION == 0) {
+    imuTriggerIndex.store(produced, std::memory_order_relaxed);
+    xTaskNotifyGive(imuTask);
+  }
   
-  // Escribir header INICIAL con contadores en 0
-  FileHeader header = {0};
-  header.magic = 0x45434744; // "ECGD"
-  header.version = 1;
-  header.device_id = 1;
-  header.session_id = timestamp;
-  header.timestamp_start = timestamp;
-  header.ecg_sample_rate = ECG_SAMPLE_RATE_HZ;
-  header.imu_sample_rate = 0;
-  header.num_ecg_samples = 0;  // Se actualizará al final
-  header.num_imu_samples = 0;
+  if (recordingComplete(produced + 1)) {
+    xTaskNotifyGive(storageTask);
+  }
+}
+
+#if HOLTER_ECG_ADC_DMA
+
+static bool initSampler() {
+  adcChannelI = (uint8_t)digitalPinToAnalogChannel(HOLTER_ECG_ADC_PIN_I);
+  adcChannelII = (uint8_t)digitalPinToAnalogChannel(HOLTER_ECG_ADC_PIN_II);
+  adcChannelBattery = (uint8_t)digitalPinToAnalogChannel(HOLTER_BATTERY_PIN);
   
-  size_t headerWritten = dataFile.write((uint8_t*)&header, sizeof(FileHeader));
-  if (headerWritten != sizeof(FileHeader)) {
-    Serial.printf("[ERROR] Header incompleto (%d/%d bytes)\n", 
-                  headerWritten, sizeof(FileHeader));
-    dataFile.close();
+  adc_digi_init_config_t initConfig = {
+    .max_store_buf_size = DMA_STORE_BYTES,
+    .conv_num_each_intr = DMA_FRAME_BYTES / ADC_RESULT_BYTE,
+    .adc1_chan_mask = (uint32_t)((1 << adcChannelI) | (1 << adcChannelII) | (1 << adcChannelBattery)),
+    .adc2_chan_mask = 0,
+  };
+  if (adc_digi_initialize(&initConfig) != ESP_OK) {
     return false;
   }
   
-  dataFile.flush();
-  Serial.printf("[SD] Header inicial escrito: %d bytes\n", headerWritten);
+  static adc_digi_pattern_config_t pattern[DMA_CHANNELS];
+  const uint8_t channels[DMA_CHANNELS] = {adcChannelI, adcChannelII, adcChannelBattery};
+  for (uint32_t i = 0; i < DMA_CHANNELS; i++) {
+    pattern[i].atten = ADC_ATTEN_DB_11;
+    pattern[i].channel = channels[i];
+    pattern[i].unit = 0;   // ADC1
+    pattern[i].bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+  }
   
-  sampleCount = 0;
-  bufferIndex = 0;
-  lastFlush = millis();
-  isCapturing = true;
-  lastECGSample = micros();
+  adc_digi_configuration_t digiConfig = {
+    .conv_limit_en = true,
+    .conv_limit_num = 250,
+    .pattern_num = DMA_CHANNELS,
+    .adc_pattern = pattern,
+    .sample_freq_hz = DMA_CONV_FREQ_HZ,
+    .conv_mode = ADC_CONV_SINGLE_UNIT_1,
+    .format = ADC_DIGI_OUTPUT_FORMAT_TYPE1,
+  };
+  if (adc_digi_controller_configure(&digiConfig) != ESP_OK) {
+    adc_digi_deinitialize();
+    return false;
+  }
   
-  Serial.println("[CAPTURE] Capturando...\n");
+  HOLTER_LOGI("[INIT] ADC continuo (DMA): %lu Hz, promedio de %lu conversiones por muestra",
+              (unsigned long)ECG_SAMPLE_RATE_HZ, (unsigned long)ADC_OVERSAMPLE);
   return true;
 }
 
-void holter_captureLoop() {
-  if (!isCapturing) return;
+static void startSampler() {
+  adc_digi_start();
+}
+
+static void stopSampler() {
+  adc_digi_stop();
+}
+
+// Tarea de adquisición (core 1): recibe las conversiones del DMA en
+// bloques y las promedia por derivación (y la batería). Nunca toca la SD,
+// la red ni Serial.
+static void acquisitionTaskFn(void* arg) {
+  static uint8_t dmaBuffer[DMA_FRAME_BYTES] __attribute__((aligned(4)));
+  uint32_t sum[2] = {0, 0};
+  uint32_t count[2] = {0, 0};
+  uint32_t batterySum = 0;
+  uint32_t batteryCount = 0;
   
-  unsigned long currentTime = micros();
-  unsigned long elapsed = (millis() - captureStartTime) / 1000;
+  for (;;) {
+    if (!isCapturing || stopRequested) {
+      sum[0] = sum[1] = count[0] = count[1] = 0;
+      batterySum = batteryCount = 0;
+      vTaskDelay(pdMS_TO_TICKS(10));
+      continue;
+    }
+    
+    uint32_t length = 0;
+    if (adc_digi_read_bytes(dmaBuffer, sizeof(dmaBuffer), &length, DMA_READ_TIMEOUT_MS) != ESP_OK) {
+      continue;
+    }
+    
+    int64_t start = esp_timer_get_time();
+    recordInterval(start, (length / ADC_RESULT_BYTE) * 1000000ULL / DMA_CONV_FREQ_HZ);
+    for (uint32_t i = 0; i + ADC_RESULT_BYTE <= length; i += ADC_RESULT_BYTE) {
+      const adc_digi_output_data_t* conv = (const adc_digi_output_data_t*)&dmaBuffer[i];
+      if (conv->type1.channel == adcChannelBattery) {
+        batterySum += conv->type1.data;
+        if (++batteryCount == BATTERY_AVERAGE) {
+          batteryRaw.store((uint16_t)(batterySum / BATTERY_AVERAGE), std::memory_order_relaxed);
+          batterySum = batteryCount = 0;
+        }
+        continue;
+      }
+      
+      int lead = (conv->type1.channel == adcChannelI) ? 0 :
+                 (conv->type1.channel == adcChannelII) ? 1 : -1;
+      
+      // Si una derivación se adelanta (conversión perdida) se descarta el exceso
+      if (lead < 0 || count[lead] == ADC_OVERSAMPLE) continue;
+      sum[lead] += conv->type1.data;
+      count[lead]++;
+      
+      if (count[0] == ADC_OVERSAMPLE && count[1] == ADC_OVERSAMPLE) {
+        ECGSample sample;
+        sample.derivation_I = (int16_t)((sum[0] + ADC_OVERSAMPLE / 2) / ADC_OVERSAMPLE);
+        sample.derivation_II = (int16_t)((sum[1] + ADC_OVERSAMPLE / 2) / ADC_OVERSAMPLE);
+        sample.derivation_III = (int16_t)(sample.derivation_II - sample.derivation_I);
+        produceSample(sample);
+        sum[0] = sum[1] = count[0] = count[1] = 0;
+      }
+    }
+    addBusy(acquisitionBusy, esp_timer_get_time() - start);
+  }
+}
+
+#else
+
+// Callback del timer periódico: solo despierta a la tarea de adquisición
+static void onSampleTimer(void* arg) {
+  if (acquisitionTask) {
+    xTaskNotifyGive(acquisitionTask);
+  }
+}
+
+static bool initSampler() {
+  const esp_timer_create_args_t timerArgs = {
+    .callback = &onSampleTimer,
+    .arg = nullptr,
+    .dispatch_method = ESP_TIMER_TASK,
+    .name = "ecg_sampler"
+  };
+  return esp_timer_create(&timerArgs, &samplingTimer) == ESP_OK;
+}
+
+static void startSampler() {
+  esp_timer_start_periodic(samplingTimer, ECG_INTERVAL_US);
+}
+
+static void stopSampler() {
+  esp_timer_stop(samplingTimer);
+}
+
+// Tarea de adquisición (core 1): una lectura AD8232 por tick del timer.
+// Nunca toca la SD, la red ni Serial.
+static void acquisitionTaskFn(void* arg) {
+  for (;;) {
+    ulTaskNotifyTake(pdFALSE, portMAX_DELAY);
+    int64_t start = esp_timer_get_time();
+    recordInterval(start, ECG_INTERVAL_US);
+    produceSample(readECGSample());
+    addBusy(acquisitionBusy, esp_timer_get_time() - start);
+  }
+}
+
+#endif
+
+// Bajo consumo: DFS con light sleep automático si el framework trae esp_pm
+// (CONFIG_PM_ENABLE y tickless idle), si no CPU fija a 80 MHz. El mínimo
+// es 80 MHz: el ADC continuo, la SPI de la SD y el I2C usan el APB de 80 MHz
+static void initPowerManagement() {
+#if HOLTER_LOW_POWER
+  esp_pm_config_esp32_t pmConfig = {};
+  pmConfig.max_freq_mhz = 160;
+  pmConfig.min_freq_mhz = 80;
+  pmConfig.light_sleep_enable = true;
   
-  if (elapsed >= CAPTURE_DURATION_SEC) {
-    holter_stopCapture();
-    return;
+  esp_err_t err = esp_pm_configure(&pmConfig);
+  if (err != ESP_OK) {
+    pmConfig.light_sleep_enable = false;   // Sin tickless idle: solo DFS
+    err = esp_pm_configure(&pmConfig);
   }
   
-  // Muestreo ECG a 250Hz
-  while (currentTime - lastECGSample >= ECG_INTERVAL_US) {
-    lastECGSample += ECG_INTERVAL_US;
-    
-    float derivationI = g_bioBoard->AD8232_GetVoltage(AD8232_XS1);
-    float derivationII = g_bioBoard->AD8232_GetVoltage(AD8232_XS2);
-    
-    const float OFFSET = 1.65;
-    const float AD8232_GAIN = 1100.0;
-    
-    float ecgI_mV = ((derivationI - OFFSET) * 1000.0) / AD8232_GAIN;
-    float ecgII_mV = ((derivationII - OFFSET) * 1000.0) / AD8232_GAIN;
-    float derivationIII = ecgII_mV - ecgI_mV;
+  if (err == ESP_OK) {
+    lightSleepEnabled = pmConfig.light_sleep_enable;
+    esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "holter_sampling", &samplingPmLock);
+    HOLTER_LOGI("[INIT] Bajo consumo: DFS %d-%d MHz, light sleep automático %s",
+                pmConfig.min_freq_mhz, pmConfig.max_freq_mhz,
+                lightSleepEnabled ? "fuera de la captura" : "no disponible");
+  } else {
+    setCpuFrequencyMhz(80);
+    HOLTER_LOGI("[INIT] Bajo consumo: CPU fija a 80 MHz (esp_pm no disponible)");
+  }
+  HOLTER_LOGI("[INIT] SD en ráfagas de %u KB", (unsigned)HOLTER_SD_BURST_KB);
+#endif
+}
+
+// Tarea IMU (core 1): una lectura I2C por disparo de produceSample()
+// Caída: caída libre sostenida y luego un impacto (solo la tarea IMU)
+static void detectFall(const IMUSample& s) {
+  static int freeFallRun = 0;
+  static int impactWindow = 0;
+  
+  uint32_t g2 = (uint32_t)((int32_t)s.accel_x * s.accel_x) +
+                (uint32_t)((int32_t)s.accel_y * s.accel_y) +
+                (uint32_t)((int32_t)s.accel_z * s.accel_z);
+  
+  if (impactWindow > 0) {
+    if (g2 > FALL_IMPACT_G2) {
+      holter_triggerEvent(EVENT_FALL);
+      impactWindow = 0;
+      freeFallRun = 0;
+      return;
+    }
+    impactWindow--;
+  }
+  
+  if (g2 < FALL_FREE_G2) {
+    if (++freeFallRun >= FALL_FREE_MIN_SAMPLES) impactWindow = FALL_IMPACT_WINDOW;
+  } else {
+    freeFallRun = 0;
+  }
+}
+
+static void imuTaskFn(void* arg) {
+  for (;;) {
+    // Disparos acumulados mientras una lectura esperaba el bus (el display
+    // lo comparte): solo se lee el último, los demás son descartes
+    uint32_t triggers = ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    if (triggers > 1) droppedImuSamples += triggers - 1;
+    uint32_t index = imuTriggerIndex.load(std::memory_order_relaxed);
     
-    ECGSample sample;
-    sample.derivation_I = (int16_t)(ecgI_mV * ECG_SCALE_FACTOR);
-    sample.derivation_II = (int16_t)(ecgII_mV * ECG_SCALE_FACTOR);
-    sample.derivation_III = (int16_t)(derivationIII * ECG_SCALE_FACTOR);
+    TimedIMUSample entry;
+    entry.ecg_index = index;
+    if (!imu_read(entry.sample)) {
+      droppedImuSamples++;   // Transacción I2C fallida
+      continue;
+    }
     
-    writeToBuffer((uint8_t*)&sample, sizeof(ECGSample));
-    sampleCount++;
+    if (EVENT_MODE && HOLTER_EVENT_FALL_DETECT) {
+      detectFall(entry.sample);
+    }
     
-    currentTime = micros();
+    size_t head = imuHead.load(std::memory_order_relaxed);
+    size_t next = (head + 1) % IMU_RING_SIZE;
+    size_t tail = imuTail.load(std::memory_order_acquire);
+    if (next == tail) {
+      droppedImuSamples++;
+      continue;
+    }
+    imuRing[head] = entry;
+    imuHead.store(next, std::memory_order_release);
+    trackMax(imuRingMax, (next + IMU_RING_SIZE - tail) % IMU_RING_SIZE);
   }
+}
+
+static void storageStep() {
+  unsigned long elapsed = (millis() - captureStartTime) / 1000;
   
-  // Flush periódico (cada 2 segundos)
-  if (millis() - lastFlush >= 2000) {
-    flushBuffer();
-    if (dataFile) {
-      dataFile.flush();
+  if (EVENT_MODE) {
+    if (HOLTER_QRS_DETECT) checkHeartRateEvent();
+    uint16_t source = pendingEventSource.exchange(EVENT_NONE, std::memory_order_acquire);
+    if (source != EVENT_NONE) {
+      startEvent(source, pendingEventIndex.load(std::memory_order_relaxed));
     }
-    lastFlush = millis();
   }
   
-  // Progreso cada 3 segundos
+  // Como máximo un bloque está pendiente a la vez
+  writeBlock(0);
+  writeBlock(1);
+  
+  // Progreso cada 30 segundos
   static unsigned long lastReport = 0;
-  if (elapsed > 0 && elapsed % 3 == 0 && elapsed != lastReport) {
+  if (elapsed > 0 && elapsed % 30 == 0 && elapsed != lastReport) {
     lastReport = elapsed;
-    Serial.printf("[PROGRESS] %lus/%ds | ECG: %lu muestras (%.1f Hz)\n", 
-                  elapsed, CAPTURE_DURATION_SEC, sampleCount,
-                  (float)sampleCount / elapsed);
+    HeartRateInfo hr;
+    holter_getHeartRate(hr);
+    HOLTER_LOGI("[PROGRESS] %lus/%lus | Segmento %u | ECG: %lu muestras (%.1f Hz) | FC: %u lpm", 
+                elapsed, RECORDING_DURATION_SEC, (unsigned)segmentSeq, sampleCount,
+                (float)samplesProduced.load() / elapsed, hr.bpm);
+#if HOLTER_LOW_POWER
+    PowerStats power;
+    holter_getPowerStats(power);
+    HOLTER_LOGI("[POWER] CPU %u MHz | Adquisición %u.%u%% | Almacenamiento %u.%u%% | SD %u.%u%% | ~%u mA",
+                power.cpu_freq_mhz, power.acquisition_duty / 10, power.acquisition_duty % 10,
+                power.storage_duty / 10, power.storage_duty % 10,
+                power.sd_duty / 10, power.sd_duty % 10, power.estimated_ma);
+#endif
+    CaptureStats stats;
+    fillCaptureStats(stats);
+    HOLTER_LOGI("[STATS] Muestras %lu/%lu esperadas | Descartadas %lu | Jitter máx %lu us | SD máx %lu us | Espera bloque máx %lu ms",
+                (unsigned long)stats.samples_produced, (unsigned long)stats.samples_expected,
+                (unsigned long)stats.samples_dropped, (unsigned long)stats.interval_max_dev_us,
+                (unsigned long)stats.sd_flush_max_us, (unsigned long)stats.block_wait_max_ms);
   }
-  
-  yield();
 }
 
-void holter_stopCapture() {
-  if (!isCapturing) return;
+static void finalizeCapture() {
+  HOLTER_LOGI("\n[CAPTURE] Finalizando grabación...");
   
-  Serial.println("\n[CAPTURE] Finalizando captura...");
-  isCapturing = false;
+  if (samplerReady) {
+    stopSampler();
+  }
+  samplingEndUs = esp_timer_get_time();
+  if (samplingPmLock) {
+    esp_pm_lock_release(samplingPmLock);
+  }
+  stopRequested = true;
+  vTaskDelay(pdMS_TO_TICKS(10));  // Dejar terminar una lectura en curso en el core 1
   
-  if (!sdAvailable || !dataFile) {
-    Serial.println("[WARNING] Captura sin archivo abierto");
-    return;
+  // Bloque pendiente + bloque activo parcial (la adquisición ya no lo toca)
+  writeBlock(ecgBlocks.active ^ 1);
+  int partial = ecg_blocks_flush(ecgBlocks);
+  if (partial >= 0) {
+    blockReadyUs[partial] = esp_timer_get_time();
+    writeBlock(partial);
   }
   
-  // Flush final de datos
-  Serial.printf("[DEBUG] Flush final del buffer (%d bytes pendientes)\n", bufferIndex);
-  flushBuffer();
-  dataFile.flush();
+  closeSegment();
+  setCurrentSegmentFile("");
+  eventRecording = false;
+  preTriggerCount = 0;
+  captureEndTime = millis();
   
-  unsigned long fileSize = dataFile.size();
-  Serial.printf("[DEBUG] Tamaño antes de cerrar: %lu bytes\n", fileSize);
-  Serial.printf("[DEBUG] Muestras capturadas: %lu\n", sampleCount);
+  HOLTER_LOGI("\n========================================");
+  HOLTER_LOGI("GRABACIÓN COMPLETADA");
+  HOLTER_LOGI("========================================");
+  HOLTER_LOGI("[INFO] Segmentos: %u", (unsigned)segmentSeq);
+  HOLTER_LOGI("[INFO] ECG muestras: %lu", sampleCount);
+  HOLTER_LOGI("[INFO] IMU muestras: %lu", imuSampleCount);
+  if (EVENT_MODE) {
+    HOLTER_LOGI("[INFO] Eventos grabados: %lu", eventCount);
+  }
+  HOLTER_LOGI("[INFO] Frecuencia real: %.1f Hz", 
+              (float)sampleCount * 1000.0 / (millis() - captureStartTime));
+  PowerStats power;
+  holter_getPowerStats(power);
+  HOLTER_LOGI("[INFO] Ocupación: adquisición %u.%u%%, almacenamiento %u.%u%%, SD %u.%u%% (%lu ráfagas de %lu bytes)",
+              power.acquisition_duty / 10, power.acquisition_duty % 10,
+              power.storage_duty / 10, power.storage_duty % 10,
+              power.sd_duty / 10, power.sd_duty % 10,
+              (unsigned long)power.sd_bursts, (unsigned long)power.sd_burst_bytes);
+  HOLTER_LOGI("[INFO] Consumo estimado: ~%u mA sin WiFi (CPU %u MHz)",
+              power.estimated_ma, power.cpu_freq_mhz);
+  CaptureStats stats;
+  fillCaptureStats(stats);
+  HOLTER_LOGI("[INFO] Muestreo: %lu muestras de %lu según el reloj, jitter máx %lu us",
+              (unsigned long)stats.samples_produced, (unsigned long)stats.samples_expected,
+              (unsigned long)stats.interval_max_dev_us);
+  HOLTER_LOGI("[INFO] SD: escritura máx %lu us, espera máx de un bloque %lu ms",
+              (unsigned long)stats.sd_flush_max_us, (unsigned long)stats.block_wait_max_ms);
+  if (stats.samples_dropped > 0) {
+    HOLTER_LOGW("[WARNING] Muestras descartadas por SD lenta: %lu (huecos en el archivo)",
+                (unsigned long)stats.samples_dropped);
+  }
+  if (droppedImuSamples > 0) {
+    HOLTER_LOGW("[WARNING] Muestras IMU descartadas: %lu", droppedImuSamples);
+  }
+#if HOLTER_QRS_DETECT
+  HOLTER_LOGI("[INFO] Latidos detectados: %lu", (unsigned long)heartRate.beat_count);
+  if (droppedPeaks > 0) {
+    HOLTER_LOGW("[WARNING] Anotaciones R descartadas: %lu", droppedPeaks);
+  }
+#endif
+  HOLTER_LOGI("========================================\n");
   
-  // NO cerrar el archivo, solo hacer seek para actualizar header
-  Serial.println("[DEBUG] Actualizando header sin cerrar archivo...");
-  delay(100);
+  isCapturing = false;
+}
+
+// Tarea de almacenamiento (core 0): escribe los bloques llenos en la SD y
+// rota los segmentos. Un bloqueo aquí nunca retrasa una muestra.
+static void storageTaskFn(void* arg) {
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100));
+    if (!isCapturing) continue;
+    
+    int64_t start = esp_timer_get_time();
+    storageStep();
+    addBusy(storageBusy, esp_timer_get_time() - start);
+    
+    bool allProduced = recordingComplete(samplesProduced.load(std::memory_order_acquire));
+    if (stopRequested || allProduced) {
+      finalizeCapture();
+    }
+  }
+}
+
+// ============================================================================
+// IMPLEMENTACIÓN DE INTERFACE PÚBLICA
+// ============================================================================
 
-  const size_t OFFSET_NUM_ECG = 20;
-  const size_t OFFSET_NUM_IMU = 24;
+void holter_init(XSpaceBioV10Board* bioBoard) {
+  g_bioBoard = bioBoard;
+  
+  HOLTER_LOGI("[INIT] Inicializando módulo de captura...");
+  initPowerManagement();
   
-  // Escribir num_ecg_samples
-  dataFile.seek(OFFSET_NUM_ECG);
-  uint32_t ecg_count = (uint32_t)sampleCount;
-  size_t written1 = dataFile.write((uint8_t*)&ecg_count, sizeof(uint32_t));
+  sdAvailable = holter_storageInit();
+  if (sdAvailable) {
+    // Margen del bus frente a la captura sin comprimir (cota superior)
+    StorageInfo storage;
+    holter_getStorageInfo(storage);
+    if (storage.write_kbps) {
+      HOLTER_LOGI("[SD] Captura: %lu B/s (margen x%lu)", (unsigned long)CAPTURE_RAW_BYTES_PER_SEC,
+                  (unsigned long)(storage.write_kbps * 1024 / CAPTURE_RAW_BYTES_PER_SEC));
+    }
+  }
   
-  // Escribir num_imu_samples (0)
-  dataFile.seek(OFFSET_NUM_IMU);
-  uint32_t imu_count = 0;
-  size_t written2 = dataFile.write((uint8_t*)&imu_count, sizeof(uint32_t));
+  initECGAdc();
   
-  if (written1 != sizeof(uint32_t) || written2 != sizeof(uint32_t)) {
-    Serial.println("[ERROR] No se pudo actualizar contadores en header");
-  } else {
-    Serial.println("[DEBUG] Contadores actualizados en header:");
-    Serial.printf("  - num_ecg_samples: %lu\n", sampleCount);
-    Serial.printf("  - num_imu_samples: 0\n");
+#if HOLTER_ECG_FILTER
+  ecg_filter_init(filterI, ECG_SAMPLE_RATE_HZ, HOLTER_ECG_HIGHPASS_HZ,
+                  HOLTER_ECG_LOWPASS_HZ, HOLTER_ECG_NOTCH_HZ);
+  ecg_filter_init(filterII, ECG_SAMPLE_RATE_HZ, HOLTER_ECG_HIGHPASS_HZ,
+                  HOLTER_ECG_LOWPASS_HZ, HOLTER_ECG_NOTCH_HZ);
+  ecgFilterMask = filterI.mask;
+  HOLTER_LOGI("[INIT] Filtros ECG: %u etapas (pasaaltos %.2f Hz, pasabajos %d Hz, notch %d Hz)",
+              filterI.numStages, (float)HOLTER_ECG_HIGHPASS_HZ, HOLTER_ECG_LOWPASS_HZ,
+              HOLTER_ECG_NOTCH_HZ);
+#endif
+  
+  if (EVENT_MODE) {
+    // PSRAM si la placa la tiene; si no, RAM interna y se achica hasta caber
+    uint32_t caps = psramFound() ? MALLOC_CAP_SPIRAM : MALLOC_CAP_8BIT;
+    for (size_t blocks = PRE_TRIGGER_BLOCKS; blocks >= 8 && !preTriggerRing; blocks /= 2) {
+      preTriggerRing = (uint8_t(*)[DATA_BLOCK_SIZE])heap_caps_malloc(blocks * DATA_BLOCK_SIZE, caps);
+      if (preTriggerRing) preTriggerCapacity = blocks;
+    }
+    if (preTriggerRing) {
+      HOLTER_LOGI("[INIT] Modo eventos: pre-evento de %u bloques (%u KB en %s), %d s + %d s",
+                  (unsigned)preTriggerCapacity, (unsigned)(preTriggerCapacity * DATA_BLOCK_SIZE / 1024),
+                  psramFound() ? "PSRAM" : "RAM interna", HOLTER_EVENT_PRE_SEC, HOLTER_EVENT_POST_SEC);
+    } else {
+      HOLTER_LOGW("[WARNING] Sin memoria para el pre-evento: los eventos empiezan en el disparo");
+    }
   }
   
-  dataFile.flush();
+  imuAvailable = imu_init();
+  if (!imuAvailable) {
+    HOLTER_LOGW("[WARNING] IMU no disponible, se graba solo ECG");
+  }
   
-  // Verificación final
-  delay(100);
+  samplerReady = initSampler();
+  if (!samplerReady) {
+    HOLTER_LOGE("[ERROR] No se pudo configurar el muestreo ECG");
+  }
   
-  File checkFile = SD.open(currentSessionFile.c_str(), FILE_READ);
-  if (!checkFile) {
-    Serial.println("[ERROR] No se pudo reabrir para verificación");
-    return;
+  completedSegments = xQueueCreate(COMPLETED_QUEUE_DEPTH, HOLTER_MAX_FILENAME_LEN);
+  
+  xTaskCreatePinnedToCore(acquisitionTaskFn, "ecg_acq", ACQUISITION_STACK, nullptr,
+                          ACQUISITION_PRIORITY, &acquisitionTask, ACQUISITION_CORE);
+  xTaskCreatePinnedToCore(storageTaskFn, "sd_writer", STORAGE_STACK, nullptr,
+                          STORAGE_PRIORITY, &storageTask, STORAGE_CORE);
+  if (imuAvailable) {
+    xTaskCreatePinnedToCore(imuTaskFn, "imu_acq", IMU_STACK, nullptr,
+                            IMU_PRIORITY, &imuTask, ACQUISITION_CORE);
+    imuAvailable = (imuTask != nullptr);
   }
   
-  unsigned long finalSize = checkFile.size();
+  if (!completedSegments || !acquisitionTask || !storageTask) {
+    HOLTER_LOGE("[ERROR] No se pudieron crear las tareas de captura");
+  }
   
-  // Leer y verificar header
-  FileHeader verifyHeader;
-  size_t headerRead = checkFile.read((uint8_t*)&verifyHeader, sizeof(FileHeader));
-  checkFile.close();
+  HOLTER_LOGI("[INIT] Módulo de captura listo");
+}
+
+bool holter_startCapture() {
+  if (isCapturing) {
+    HOLTER_LOGW("[WARNING] Ya hay una captura en progreso");
+    return false;
+  }
   
-  unsigned long expectedSize = sizeof(FileHeader) + (sampleCount * sizeof(ECGSample));
+  HOLTER_LOGI("\n========================================");
+  HOLTER_LOGI("INICIANDO GRABACIÓN");
+  HOLTER_LOGI("========================================");
   
-  Serial.println("\n========================================");
-  Serial.println("CAPTURA COMPLETADA");
-  Serial.println("========================================");
-  Serial.printf("[INFO] Archivo: %s\n", currentSessionFile.c_str());
-  Serial.printf("[INFO] Tamaño: %lu bytes (%.2f KB)\n", finalSize, finalSize/1024.0);
-  Serial.printf("[INFO] ECG muestras: %lu\n", sampleCount);
-  Serial.printf("[INFO] Frecuencia real: %.1f Hz\n", 
-                (float)sampleCount / CAPTURE_DURATION_SEC);
+  captureStartTime = millis();
   
-  if (headerRead == sizeof(FileHeader)) {
-    Serial.printf("[VERIFY] Header magic: 0x%08X\n", verifyHeader.magic);
-    Serial.printf("[VERIFY] Header num_ecg: %u\n", verifyHeader.num_ecg_samples);
-    Serial.printf("[VERIFY] Header num_imu: %u\n", verifyHeader.num_imu_samples);
-    
-    if (verifyHeader.num_ecg_samples == sampleCount) {
-      Serial.println("[OK] Header actualizado correctamente ✓");
-    } else {
-      Serial.printf("[WARNING] Header no coincide: esperado %lu, leído %u\n", 
-                    sampleCount, verifyHeader.num_ecg_samples);
-    }
+  // Hora Unix del RTC, o un ID que no se repite si aún no tiene hora
+  recordingTimestamp = holter_clockNewSession();
+  
+  HOLTER_LOGI("[INFO] Grabación: session_%010lu", recordingTimestamp);
+  if (holter_clockIsSet()) {
+    HOLTER_LOGI("[INFO] Timestamp Unix: %lu", recordingTimestamp);
   } else {
-    Serial.println("[ERROR] No se pudo leer header para verificar");
+    HOLTER_LOGW("[WARNING] Reloj sin hora (sin NTP desde el último corte de energía): "
+                "el ID de sesión no es hora Unix");
+  }
+  HOLTER_LOGI("[INFO] Duración configurada: %lu segundos (0 = indefinida)", RECORDING_DURATION_SEC);
+  HOLTER_LOGI("[INFO] Segmentos de %lu segundos", SEGMENT_DURATION_SEC);
+  
+  if (!sdAvailable) {
+    HOLTER_LOGE("[ERROR] SD Card no disponible - no se puede capturar");
+    isCapturing = false;
+    return false;
   }
   
-  Serial.printf("[VERIFY] Esperado: %lu bytes | Real: %lu bytes\n", expectedSize, finalSize);
+  // Lugar para toda la grabación a la tasa sin comprimir (indefinida o por
+  // eventos: al menos un segmento), borrando segmentos ya subidos si hace falta
+  uint64_t needed = (RECORDING_DURATION_SEC && !EVENT_MODE)
+      ? (uint64_t)RECORDING_DURATION_SEC * CAPTURE_RAW_BYTES_PER_SEC * 9 / 8
+      : SEGMENT_PREALLOC_BYTES;
+  if (!holter_storageEnsureFree(needed)) {
+    HOLTER_LOGE("[ERROR] Espacio insuficiente en la SD: la grabación necesita %lluMB",
+                needed / (1024 * 1024));
+    return false;
+  }
+  HOLTER_LOGI("[SD] Libre: %lluMB (la grabación necesita hasta %lluMB)",
+              holter_storageFreeBytes() / (1024 * 1024), needed / (1024 * 1024));
   
-  if (finalSize == expectedSize) {
-    Serial.println("[OK] Archivo completo y válido ✓");
-  } else {
-    long diff = (long)(finalSize - expectedSize);
-    Serial.printf("[INFO] Diferencia: %ld bytes\n", diff);
+  if (!samplerReady || !acquisitionTask || !storageTask) {
+    HOLTER_LOGE("[ERROR] Timer o tareas de muestreo no disponibles");
+    return false;
+  }
+  
+  sampleCount = 0;
+  imuSampleCount = 0;
+  segmentSeq = 0;
+  imuHead.store(0);
+  imuTail.store(0);
+  droppedImuSamples = 0;
+  qrs_init(qrsDetector, ECG_SAMPLE_RATE_HZ);
+  ecg_filter_reset(filterI);
+  ecg_filter_reset(filterII);
+  rpeakHead.store(0);
+  rpeakTail.store(0);
+  droppedPeaks = 0;
+  preTriggerHead = 0;
+  preTriggerCount = 0;
+  eventRecording = false;
+  eventCount = 0;
+  pendingEventSource.store(EVENT_NONE);
+  portENTER_CRITICAL(&heartRateMux);
+  memset(&heartRate, 0, sizeof(heartRate));
+  portEXIT_CRITICAL(&heartRateMux);
+  // En modo eventos el primer segmento se abre con el primer disparo
+  if (!EVENT_MODE && !openSegment(0)) {
+    return false;
+  }
+  
+  samplesProduced.store(0);
+  sdBurstCount = 0;
+  resetBusy(acquisitionBusy);
+  resetBusy(storageBusy);
+  resetBusy(sdBusy);
+  sdBursts.store(0);
+  sdBurstBytes.store(0);
+  resetCaptureStats();
+  captureEndTime = 0;
+  ecg_blocks_reset(ecgBlocks);
+#if HOLTER_ECG_ADC_DMA
+  batteryRaw.store(0);
+#endif
+  stopRequested = false;
+  isCapturing = true;
+  
+  if (samplingPmLock) {
+    esp_pm_lock_acquire(samplingPmLock);
   }
-  Serial.println("========================================\n");
+  samplingStartUs = esp_timer_get_time();
+  startSampler();
+  
+  HOLTER_LOGI("[CAPTURE] Capturando...\n");
+  return true;
+}
+
+void holter_stopCapture() {
+  if (!isCapturing) return;
+  
+  // El cierre lo ejecuta la tarea de almacenamiento, dueña del archivo
+  stopRequested = true;
+  xTaskNotifyGive(storageTask);
 }
 
 bool holter_isCapturing() {
@@ -399,9 +1622,8 @@ bool holter_isCapturing() {
 }
 
 float holter_getProgress() {
-  if (!isCapturing) return 0.0;
-  unsigned long elapsed = (millis() - captureStartTime) / 1000;
-  float progress = (float)elapsed / (float)CAPTURE_DURATION_SEC;
+  if (!isCapturing || TOTAL_ECG_SAMPLES == 0) return 0.0;
+  float progress = (float)samplesProduced.load() / (float)TOTAL_ECG_SAMPLES;
   return constrain(progress, 0.0, 1.0);
 }
 
@@ -410,8 +1632,18 @@ unsigned long holter_getElapsedSeconds() {
   return (millis() - captureStartTime) / 1000;
 }
 
-String holter_getCurrentFile() {
-  return currentSessionFile;
+void holter_getCurrentFile(char* filename) {
+  portENTER_CRITICAL(&fileNameMux);
+  memcpy(filename, currentSegmentFile, HOLTER_MAX_FILENAME_LEN);
+  portEXIT_CRITICAL(&fileNameMux);
+}
+
+bool holter_getCompletedSegment(char* filename) {
+  return completedSegments && xQueueReceive(completedSegments, filename, 0) == pdTRUE;
+}
+
+uint32_t holter_getSegmentSeq() {
+  return segmentSeq;
 }
 
 unsigned long holter_getECGSampleCount() {
@@ -419,7 +1651,7 @@ unsigned long holter_getECGSampleCount() {
 }
 
 unsigned long holter_getIMUSampleCount() {
-  return 0;
+  return imuSampleCount;
 }
 
 bool holter_isSDAvailable() {
@@ -427,5 +1659,137 @@ bool holter_isSDAvailable() {
 }
 
 bool holter_isIMUAvailable() {
+  return imuAvailable;
+}
+
+bool holter_getBatteryRaw(uint16_t& raw) {
+#if HOLTER_ECG_ADC_DMA
+  if (!isCapturing) return false;
+  raw = batteryRaw.load(std::memory_order_relaxed);
+  return raw != 0;
+#else
   return false;
-}
\ No newline at end of file
+#endif
+}
+
+bool holter_getHeartRate(HeartRateInfo& info) {
+  portENTER_CRITICAL(&heartRateMux);
+  info = heartRate;
+  portEXIT_CRITICAL(&heartRateMux);
+  
+  unsigned long produced = samplesProduced.load(std::memory_order_acquire);
+  if (info.beat_count == 0 || produced - info.last_peak_index > HEART_RATE_STALE_SAMPLES) {
+    info.bpm = 0;   // Asistolia, electrodo suelto o ruido: no reportar el último valor
+  }
+  return info.bpm != 0;
+}
+
+void holter_triggerEvent(EventSource source) {
+  if (!EVENT_MODE || !isCapturing || source == EVENT_NONE) return;
+  pendingEventIndex.store(samplesProduced.load(std::memory_order_acquire), std::memory_order_relaxed);
+  pendingEventSource.store(source, std::memory_order_release);
+  xTaskNotifyGive(storageTask);
+}
+
+bool holter_isEventRecording() {
+  return eventRecording;
+}
+
+void holter_setLiveTap(bool enabled) {
+  if (enabled && !liveTap) {
+    liveTail.store(liveHead.load(std::memory_order_acquire), std::memory_order_release);
+  }
+  liveTap = enabled;
+}
+
+size_t holter_readLiveSamples(ECGSample* samples, size_t maxSamples, uint32_t* firstIndex) {
+  size_t tail = liveTail.load(std::memory_order_relaxed);
+  size_t head = liveHead.load(std::memory_order_acquire);
+  size_t n = 0;
+  
+  while (tail != head && n < maxSamples) {
+    if (n == 0) {
+      *firstIndex = liveRing[tail].index;
+    } else if (liveRing[tail].index != *firstIndex + n) {
+      break;   // Hueco: el resto va en la próxima lectura
+    }
+    samples[n++] = liveRing[tail].sample;
+    tail = (tail + 1) % LIVE_RING_SIZE;
+  }
+  liveTail.store(tail, std::memory_order_release);
+  return n;
+}
+
+void holter_getPowerStats(PowerStats& stats) {
+  memset(&stats, 0, sizeof(stats));
+  stats.cpu_freq_mhz = (uint16_t)getCpuFrequencyMhz();
+  stats.low_power = HOLTER_LOW_POWER;
+  stats.light_sleep = lightSleepEnabled;
+  if (!isCapturing && captureEndTime == 0) return;   // Nunca se grabó
+  
+  unsigned long end = captureEndTime ? captureEndTime : millis();
+  stats.window_ms = end - captureStartTime;
+  
+  uint32_t sdMs = sdBusy.totalMs.load(std::memory_order_relaxed);
+  uint32_t storageMs = storageBusy.totalMs.load(std::memory_order_relaxed);
+  stats.acquisition_duty = perMille(acquisitionBusy.totalMs.load(std::memory_order_relaxed),
+                                    stats.window_ms);
+  stats.storage_duty = perMille(storageMs > sdMs ? storageMs - sdMs : 0, stats.window_ms);
+  stats.sd_duty = perMille(sdMs, stats.window_ms);
+  stats.sd_bursts = sdBursts.load(std::memory_order_relaxed);
+  stats.sd_burst_bytes = stats.sd_bursts ? sdBurstBytes.load(std::memory_order_relaxed) / stats.sd_bursts : 0;
+  
+  // Un core ocupado por tarea: la CPU cuenta el promedio de los dos
+  uint32_t cpuDuty = ((uint32_t)stats.acquisition_duty + stats.storage_duty) / 2;
+  stats.estimated_ma = (uint16_t)(HOLTER_POWER_BASE_MA + HOLTER_POWER_CPU_IDLE_MA +
+                                  (HOLTER_POWER_CPU_ACTIVE_MA - HOLTER_POWER_CPU_IDLE_MA) * cpuDuty / 1000 +
+                                  HOLTER_POWER_SD_WRITE_MA * stats.sd_duty / 1000);
+}
+
+void holter_getStats(HolterStats& stats) {
+  fillCaptureStats(stats.capture);
+  stats.upload_bytes = uploadBytes.load(std::memory_order_relaxed);
+  stats.upload_ms = uploadMs.load(std::memory_order_relaxed);
+  stats.upload_bytes_per_s = uploadRate.load(std::memory_order_relaxed);
+}
+
+void holter_recordUpload(uint32_t bytes, uint32_t ms) {
+  uploadBytes.fetch_add(bytes, std::memory_order_relaxed);
+  uploadMs.fetch_add(ms, std::memory_order_relaxed);
+  if (ms > 0) {
+    uploadRate.store((uint32_t)((uint64_t)bytes * 1000 / ms), std::memory_order_relaxed);
+  }
+}
+
+void holter_setWaveformTap(bool enabled) {
+  if (enabled && !waveTap) {
+    waveTail.store(waveHead.load(std::memory_order_acquire), std::memory_order_release);
+  }
+  waveTap = enabled;
+}
+
+size_t holter_readWaveform(WaveformPoint* points, size_t maxPoints) {
+  size_t tail = waveTail.load(std::memory_order_relaxed);
+  size_t head = waveHead.load(std::memory_order_acquire);
+  size_t n = 0;
+  
+  while (tail != head && n < maxPoints) {
+    points[n++] = waveRing[tail];
+    tail = (tail + 1) % WAVE_RING_SIZE;
+  }
+  waveTail.store(tail, std::memory_order_release);
+  return n;
+}
+
+void holter_getCalibration(SampleCalibration& calibration) {
+  calibration.adc_coeff_a = adcCoeffA;
+  calibration.adc_coeff_b = adcCoeffB;
+  calibration.ecg_gain = AD8232_GAIN;
+  calibration.ecg_offset_mv = AD8232_OFFSET_MV;
+  calibration.sample_format = ECG_SAMPLE_FORMAT;
+  calibration.ecg_filter = ecgFilterMask;
+}
+
+uint32_t holter_getSessionTimestamp() {
+  return recordingTimestamp;
+}
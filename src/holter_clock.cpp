@@ -0,0 +1,93 @@
+#include "holter_clock.h"
+#include "holter_config.h"
+#include "holter_log.h"
+#include <Preferences.h>
+#include <esp_sntp.h>
+#include <time.h>
+
+// ============================================================================
+// VARIABLES INTERNAS (PRIVADAS)
+// ============================================================================
+
+static const char* NTP_SERVER = "pool.ntp.org";
+static const char* TIMEZONE = "<-05>5";             // UTC-5 sin horario de verano (POSIX)
+static const time_t VALID_EPOCH = 1704067200;       // 2024-01-01: antes, el reloj no tiene hora
+static const uint32_t RESYNC_SEC = HOLTER_NTP_RESYNC_HOURS * 3600UL;
+static const char* PREFS_NAMESPACE = "holter_clock";
+static const uint32_t RECORD_MAGIC = 0x434C4B31;    // "CLK1"
+
+// Última sincronización NTP en memoria RTC sin inicializar: sobrevive a los
+// mismos reinicios que la hora. Tras un corte de energía el magic no coincide
+struct ClockRecord {
+  uint32_t magic;
+  uint32_t syncedAt;      // time() de la última respuesta NTP
+};
+RTC_NOINIT_ATTR static ClockRecord clockRecord;
+
+static uint32_t lastSession = 0;
+
+// ============================================================================
+// FUNCIONES INTERNAS (PRIVADAS)
+// ============================================================================
+
+// Respuesta NTP (tarea de lwIP): solo actualiza el registro en RTC
+static void onTimeSync(struct timeval* tv) {
+  clockRecord.syncedAt = (uint32_t)tv->tv_sec;
+  clockRecord.magic = RECORD_MAGIC;
+  HOLTER_LOGI("[NTP] Hora sincronizada: %lu", (unsigned long)tv->tv_sec);
+}
+
+// ============================================================================
+// IMPLEMENTACIÓN DE INTERFACE PÚBLICA
+// ============================================================================
+
+void holter_clockInit() {
+  // La zona horaria no depende de NTP: el display usa la hora local del RTC
+  setenv("TZ", TIMEZONE, 1);
+  tzset();
+  
+  Preferences prefs;
+  if (prefs.begin(PREFS_NAMESPACE, true)) {
+    lastSession = prefs.getUInt("session", 0);
+    prefs.end();
+  }
+  
+  if (!holter_clockIsSet()) {
+    clockRecord.magic = 0;
+    HOLTER_LOGI("[INIT] Reloj sin hora (corte de energía): NTP al conectar WiFi");
+  } else if (clockRecord.magic == RECORD_MAGIC) {
+    HOLTER_LOGI("[INIT] Hora conservada en el RTC (NTP hace %lu min)",
+                (unsigned long)((uint32_t)time(nullptr) - clockRecord.syncedAt) / 60);
+  }
+}
+
+bool holter_clockIsSet() {
+  return time(nullptr) >= VALID_EPOCH;
+}
+
+bool holter_clockNeedsSync() {
+  if (!holter_clockIsSet() || clockRecord.magic != RECORD_MAGIC) return true;
+  return (uint32_t)time(nullptr) - clockRecord.syncedAt >= RESYNC_SEC;
+}
+
+void holter_clockStartSync() {
+  HOLTER_LOGI("[NTP] Sincronizando hora (en segundo plano)...");
+  sntp_set_time_sync_notification_cb(onTimeSync);
+  configTzTime(TIMEZONE, NTP_SERVER);
+}
+
+uint32_t holter_clockNewSession() {
+  uint32_t now = (uint32_t)time(nullptr);
+  uint32_t session = (now > lastSession) ? now : lastSession + 1;
+  lastSession = session;
+  
+  // Una escritura en flash por grabación
+  Preferences prefs;
+  if (prefs.begin(PREFS_NAMESPACE, false)) {
+    prefs.putUInt("session", session);
+    prefs.end();
+  } else {
+    HOLTER_LOGW("[WARNING] No se pudo guardar el ID de sesión en NVS");
+  }
+  return session;
+}
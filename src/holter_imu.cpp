@@ -0,0 +1,80 @@
+#include "holter_imu.h"
+#include "holter_config.h"
+#include "holter_log.h"
+#include <Wire.h>
+
+// ============================================================================
+// CONFIGURACIÓN HARDWARE
+// ============================================================================
+
+static const uint32_t IMU_I2C_CLOCK_HZ = 400000;
+
+// Registros MPU6050
+static const uint8_t REG_SMPLRT_DIV = 0x19;
+static const uint8_t REG_CONFIG = 0x1A;
+static const uint8_t REG_ACCEL_CONFIG = 0x1C;
+static const uint8_t REG_ACCEL_XOUT_H = 0x3B;
+static const uint8_t REG_PWR_MGMT_1 = 0x6B;
+static const uint8_t REG_PWR_MGMT_2 = 0x6C;
+static const uint8_t REG_WHO_AM_I = 0x75;
+
+static const uint8_t ACCEL_FS_16G = 0x18;
+static const uint8_t DLPF_44HZ = 0x03;        // Antialias para 25-100 Hz
+static const uint8_t CLOCK_PLL_XGYRO = 0x01;
+static const uint8_t GYRO_STANDBY = 0x07;     // Solo acelerómetro
+
+// ============================================================================
+// FUNCIONES INTERNAS (PRIVADAS)
+// ============================================================================
+
+static bool writeRegister(uint8_t reg, uint8_t value) {
+  Wire.beginTransmission(HOLTER_IMU_I2C_ADDR);
+  Wire.write(reg);
+  Wire.write(value);
+  return Wire.endTransmission() == 0;
+}
+
+static bool readRegisters(uint8_t reg, uint8_t* out, uint8_t len) {
+  Wire.beginTransmission(HOLTER_IMU_I2C_ADDR);
+  Wire.write(reg);
+  if (Wire.endTransmission(false) != 0) return false;
+  if (Wire.requestFrom((uint8_t)HOLTER_IMU_I2C_ADDR, len) != len) return false;
+  for (uint8_t i = 0; i < len; i++) {
+    out[i] = Wire.read();
+  }
+  return true;
+}
+
+// ============================================================================
+// IMPLEMENTACIÓN DE INTERFACE PÚBLICA
+// ============================================================================
+
+bool imu_init() {
+  Wire.begin();
+  Wire.setClock(IMU_I2C_CLOCK_HZ);
+  
+  uint8_t whoAmI = 0;
+  if (!readRegisters(REG_WHO_AM_I, &whoAmI, 1)) {
+    HOLTER_LOGI("[IMU] No responde en el bus I2C");
+    return false;
+  }
+  
+  bool ok = writeRegister(REG_PWR_MGMT_1, CLOCK_PLL_XGYRO) &&
+            writeRegister(REG_PWR_MGMT_2, GYRO_STANDBY) &&
+            writeRegister(REG_CONFIG, DLPF_44HZ) &&
+            writeRegister(REG_SMPLRT_DIV, 0) &&
+            writeRegister(REG_ACCEL_CONFIG, ACCEL_FS_16G);
+  
+  HOLTER_LOGI("[IMU] WHO_AM_I=0x%02X, acelerómetro ±16g %s", whoAmI, ok ? "[OK]" : "[FAIL]");
+  return ok;
+}
+
+bool imu_read(IMUSample& sample) {
+  uint8_t raw[6];
+  if (!readRegisters(REG_ACCEL_XOUT_H, raw, sizeof(raw))) return false;
+  
+  sample.accel_x = (int16_t)((raw[0] << 8) | raw[1]);
+  sample.accel_y = (int16_t)((raw[2] << 8) | raw[3]);
+  sample.accel_z = (int16_t)((raw[4] << 8) | raw[5]);
+  return true;
+}
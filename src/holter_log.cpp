@@ -0,0 +1,133 @@
+#include "holter_log.h"
+#include <Arduino.h>
+#include <stdarg.h>
+
+// ============================================================================
+// VARIABLES INTERNAS (PRIVADAS)
+// ============================================================================
+
+static const size_t LOG_LINE_MAX = 192;          // Las más largas se truncan
+static const size_t LOG_BUFFER_SIZE = HOLTER_LOG_BUFFER_SIZE;
+static const size_t LOG_WRITE_CHUNK = 128;       // Bytes por Serial.write()
+static const BaseType_t LOG_CORE = 0;
+static const UBaseType_t LOG_PRIORITY = tskIDLE_PRIORITY + 1;
+static const uint32_t LOG_STACK = 3072;
+static const int LOG_FLUSH_TIMEOUT_MS = 1000;
+
+// Buffer circular de bytes: las líneas se copian enteras o no se copian
+static char logBuffer[LOG_BUFFER_SIZE > 0 ? LOG_BUFFER_SIZE : 1];
+static size_t logHead = 0;                       // Protegidos por logMux
+static size_t logTail = 0;
+static unsigned long droppedLogs = 0;
+static portMUX_TYPE logMux = portMUX_INITIALIZER_UNLOCKED;
+static unsigned long reportedDrops = 0;          // Solo la tarea de logs
+static TaskHandle_t logTask = nullptr;
+
+// ============================================================================
+// FUNCIONES INTERNAS (PRIVADAS)
+// ============================================================================
+
+static size_t pendingBytes() {
+  portENTER_CRITICAL(&logMux);
+  size_t used = (logHead + LOG_BUFFER_SIZE - logTail) % LOG_BUFFER_SIZE;
+  portEXIT_CRITICAL(&logMux);
+  return used;
+}
+
+// Escribe lo pendiente por tramos: el lock se toma solo para copiar, el
+// UART bloquea únicamente a esta tarea
+static void drainLogs() {
+  char chunk[LOG_WRITE_CHUNK];
+  
+  for (;;) {
+    portENTER_CRITICAL(&logMux);
+    size_t used = (logHead + LOG_BUFFER_SIZE - logTail) % LOG_BUFFER_SIZE;
+    size_t n = min(used, min(LOG_WRITE_CHUNK, LOG_BUFFER_SIZE - logTail));
+    memcpy(chunk, logBuffer + logTail, n);
+    logTail = (logTail + n) % LOG_BUFFER_SIZE;
+    unsigned long dropped = droppedLogs;
+    portEXIT_CRITICAL(&logMux);
+    
+    if (n == 0) {
+      if (dropped != reportedDrops) {
+        Serial.printf("[WARNING] Log: %lu líneas descartadas (buffer lleno)\n",
+                      dropped - reportedDrops);
+        reportedDrops = dropped;
+      }
+      return;
+    }
+    Serial.write((const uint8_t*)chunk, n);
+  }
+}
+
+// Tarea de logs (core 0, prioridad mínima): despierta con cada línea nueva
+static void logTaskFn(void* arg) {
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    drainLogs();
+  }
+}
+
+// ============================================================================
+// IMPLEMENTACIÓN DE INTERFACE PÚBLICA
+// ============================================================================
+
+void holter_logInit() {
+  if (LOG_BUFFER_SIZE == 0 || logTask) return;
+  
+  xTaskCreatePinnedToCore(logTaskFn, "log", LOG_STACK, nullptr, LOG_PRIORITY, &logTask, LOG_CORE);
+  if (!logTask) {
+    Serial.println("[ERROR] No se pudo crear la tarea de logs, se escribe directo");
+  }
+}
+
+void holter_log(const char* format, ...) {
+  char line[LOG_LINE_MAX];
+  va_list args;
+  va_start(args, format);
+  int len = vsnprintf(line, sizeof(line) - 1, format, args);
+  va_end(args);
+  if (len < 0) return;
+  if ((size_t)len > sizeof(line) - 2) len = sizeof(line) - 2;
+  line[len++] = '\n';
+  
+  if (!logTask) {
+    Serial.write((const uint8_t*)line, len);
+    return;
+  }
+  
+  bool stored = false;
+  portENTER_CRITICAL(&logMux);
+  size_t used = (logHead + LOG_BUFFER_SIZE - logTail) % LOG_BUFFER_SIZE;
+  if (used + len < LOG_BUFFER_SIZE) {
+    size_t first = min((size_t)len, LOG_BUFFER_SIZE - logHead);
+    memcpy(logBuffer + logHead, line, first);
+    memcpy(logBuffer, line + first, len - first);
+    logHead = (logHead + len) % LOG_BUFFER_SIZE;
+    stored = true;
+  } else {
+    droppedLogs++;
+  }
+  portEXIT_CRITICAL(&logMux);
+  
+  if (stored) {
+    xTaskNotifyGive(logTask);
+  }
+}
+
+void holter_logFlush() {
+  if (logTask) {
+    xTaskNotifyGive(logTask);
+    for (int waited = 0; pendingBytes() > 0 && waited < LOG_FLUSH_TIMEOUT_MS; waited += 10) {
+      vTaskDelay(pdMS_TO_TICKS(10));
+    }
+  }
+  Serial.flush();
+}
+
+unsigned long holter_getDroppedLogs() {
+  portENTER_CRITICAL(&logMux);
+  unsigned long dropped = droppedLogs;
+  portEXIT_CRITICAL(&logMux);
+  return dropped;
+}
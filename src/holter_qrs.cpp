@@ -0,0 +1,209 @@
+#include "holter_qrs.h"
+#include <string.h>
+
+// ============================================================================
+// PARÁMETROS DEL DETECTOR (en muestras a QRS_BASE_RATE_HZ)
+// ============================================================================
+
+static const uint32_t LEARN_SAMPLES = 2 * QRS_BASE_RATE_HZ;        // Umbrales iniciales
+static const uint32_t REFRACTORY = QRS_BASE_RATE_HZ * 200 / 1000;  // 200 ms
+static const uint32_t T_WAVE_WINDOW = QRS_BASE_RATE_HZ * 360 / 1000;
+static const uint32_t MAX_RR = 3 * QRS_BASE_RATE_HZ;               // Más: pérdida de señal
+// Retardo del pasabanda: pasabajos 5 muestras + pasaaltos 16
+static const uint32_t FILTER_DELAY = 21;
+// |derivada| máxima: QRS_MWI_LEN cuadrados caben en uint32
+static const int32_t SLOPE_MAX = 10000;
+static_assert((uint64_t)SLOPE_MAX * SLOPE_MAX * QRS_MWI_LEN <= 0xFFFFFFFFULL,
+              "La integración desborda uint32");
+
+// ============================================================================
+// FUNCIONES INTERNAS (PRIVADAS)
+// ============================================================================
+
+static inline uint16_t rrToMs(uint32_t rr) {
+  return (uint16_t)(rr * 1000 / QRS_BASE_RATE_HZ);
+}
+
+// Umbral primario del artículo: NPKI + 0.25 (SPKI - NPKI)
+static inline uint32_t threshold(const QRSDetector& d) {
+  uint32_t range = d.signalLevel > d.noiseLevel ? d.signalLevel - d.noiseLevel : 0;
+  return d.noiseLevel + range / 4;
+}
+
+// Carga los filtros con la primera muestra en régimen: sin transitorio
+// por el offset DC (en cuentas crudas el ECG está centrado en ~2000)
+static void prime(QRSDetector& d, int32_t x) {
+  for (size_t i = 0; i < QRS_LPF_LEN; i++) d.lpfX[i] = x;
+  d.lpfY1 = d.lpfY2 = 36 * x;          // Ganancia DC del pasabajos
+  int32_t lp = d.lpfY1 >> 5;
+  for (size_t i = 0; i < QRS_HPF_LEN; i++) d.hpfX[i] = lp;
+  d.hpfSum = (int32_t)QRS_HPF_LEN * lp;
+}
+
+// Índice n del pico R: máximo |pasabanda| de la ventana de integración,
+// corrido por el retardo del filtro
+static uint32_t locateR(const QRSDetector& d) {
+  size_t pos = d.n % QRS_MWI_LEN;
+  size_t best = 0;
+  int32_t bestValue = -1;
+  for (size_t age = 0; age < QRS_MWI_LEN; age++) {
+    int32_t v = d.bandAbs[(pos + QRS_MWI_LEN - age) % QRS_MWI_LEN];
+    if (v > bestValue) {
+      bestValue = v;
+      best = age;
+    }
+  }
+  return d.n - best - FILTER_DELAY;
+}
+
+static void acceptBeat(QRSDetector& d, uint32_t r, int32_t slope, QRSBeat& beat) {
+  beat.rr_ms = 0;
+  if (d.lastBeat != 0 && r - d.lastBeat <= MAX_RR) {
+    uint32_t rr = r - d.lastBeat;
+    d.rr[d.rrPos] = (uint16_t)rr;
+    d.rrPos = (d.rrPos + 1) % QRS_RR_HISTORY;
+    if (d.rrCount < QRS_RR_HISTORY) d.rrCount++;
+    beat.rr_ms = rrToMs(rr);
+  }
+
+  uint32_t sum = 0;
+  for (uint8_t i = 0; i < d.rrCount; i++) sum += d.rr[i];
+  beat.mean_rr_ms = d.rrCount ? rrToMs(sum / d.rrCount) : 0;
+  beat.age = (d.n - r) * d.decimation;
+
+  d.lastBeat = r;
+  d.lastSlope = slope;
+  d.backValue = 0;
+}
+
+// Clasifica un pico de la integración como QRS o ruido
+static bool classifyPeak(QRSDetector& d, QRSBeat& beat) {
+  uint32_t v = d.peakValue;
+  uint32_t r = d.peakR;
+  uint32_t sinceBeat = d.lastBeat ? r - d.lastBeat : MAX_RR;
+
+  bool isQRS = v > threshold(d) && sinceBeat >= REFRACTORY;
+  // Onda T: cerca del latido anterior y con menos de la mitad de su pendiente
+  if (isQRS && sinceBeat < T_WAVE_WINDOW && d.peakSlope < d.lastSlope / 2) {
+    isQRS = false;
+  }
+
+  if (isQRS) {
+    d.signalLevel = d.signalLevel - d.signalLevel / 8 + v / 8;
+    acceptBeat(d, r, d.peakSlope, beat);
+    return true;
+  }
+
+  d.noiseLevel = d.noiseLevel - d.noiseLevel / 8 + v / 8;
+  // Candidato de la búsqueda hacia atrás: sobre el umbral secundario (la mitad)
+  if (sinceBeat >= REFRACTORY && v > threshold(d) / 2 && v > d.backValue) {
+    d.backValue = v;
+    d.backR = r;
+    d.backSlope = d.peakSlope;
+  }
+  return false;
+}
+
+// Búsqueda hacia atrás: sin latido en 1.66 RR promedio, el mejor pico bajo
+// umbral era un QRS
+static bool searchBack(QRSDetector& d, QRSBeat& beat) {
+  if (d.backValue == 0 || d.rrCount == 0) return false;
+
+  uint32_t sum = 0;
+  for (uint8_t i = 0; i < d.rrCount; i++) sum += d.rr[i];
+  uint32_t limit = sum / d.rrCount * 166 / 100;
+  if (d.n - d.lastBeat <= limit) return false;
+
+  d.signalLevel = d.signalLevel - d.signalLevel / 4 + d.backValue / 4;
+  acceptBeat(d, d.backR, d.backSlope, beat);
+  return true;
+}
+
+// Una muestra a QRS_BASE_RATE_HZ
+static bool processBase(QRSDetector& d, int32_t x, QRSBeat& beat) {
+  if (d.n == 0) prime(d, x);
+  d.n++;
+
+  // Pasabajos: y[n] = 2y[n-1] - y[n-2] + x[n] - 2x[n-6] + x[n-12] (ganancia 36)
+  size_t lpos = d.n % QRS_LPF_LEN;
+  int32_t y = 2 * d.lpfY1 - d.lpfY2 + x - 2 * d.lpfX[(lpos + 6) % QRS_LPF_LEN] + d.lpfX[lpos];
+  d.lpfX[lpos] = x;
+  d.lpfY2 = d.lpfY1;
+  d.lpfY1 = y;
+  int32_t lp = y >> 5;
+
+  // Pasaaltos: x[n-16] menos el promedio de las últimas 32 muestras
+  size_t hpos = d.n % QRS_HPF_LEN;
+  d.hpfSum += lp - d.hpfX[hpos];
+  int32_t band = d.hpfX[(hpos + 16) % QRS_HPF_LEN] - d.hpfSum / (int32_t)QRS_HPF_LEN;
+  d.hpfX[hpos] = lp;
+
+  // Derivada de 5 puntos
+  int32_t slope = (2 * band + d.derivX[0] - d.derivX[2] - 2 * d.derivX[3]) / 8;
+  d.derivX[3] = d.derivX[2];
+  d.derivX[2] = d.derivX[1];
+  d.derivX[1] = d.derivX[0];
+  d.derivX[0] = band;
+  if (slope < 0) slope = -slope;
+  if (slope > SLOPE_MAX) slope = SLOPE_MAX;
+  if (slope > d.windowSlope) d.windowSlope = slope;
+
+  // Cuadrado e integración de ventana móvil
+  size_t mpos = d.n % QRS_MWI_LEN;
+  uint32_t sq = (uint32_t)(slope * slope);
+  d.mwiSum += sq - d.mwi[mpos];
+  d.mwi[mpos] = sq;
+  d.bandAbs[mpos] = band < 0 ? -band : band;
+  uint32_t integrated = d.mwiSum;
+
+  if (d.learning) {
+    if (integrated > d.learnMax) d.learnMax = integrated;
+    d.learnSum += integrated;
+    if (d.n >= LEARN_SAMPLES) {
+      d.signalLevel = d.learnMax / 3;
+      d.noiseLevel = (uint32_t)(d.learnSum / LEARN_SAMPLES / 2);
+      d.learning = false;
+    }
+    return false;
+  }
+
+  // Picos de la integración: máximo local que luego cae a la mitad
+  bool detected = false;
+  if (integrated > d.mwiPrev) {
+    if (integrated > d.peakValue) {
+      d.peakValue = integrated;
+      d.peakR = locateR(d);
+      d.peakSlope = d.windowSlope;
+    }
+  } else if (d.peakValue > 0 && integrated < d.peakValue / 2) {
+    detected = classifyPeak(d, beat);
+    d.peakValue = 0;
+    d.windowSlope = 0;
+  }
+  d.mwiPrev = integrated;
+
+  if (!detected) {
+    detected = searchBack(d, beat);
+  }
+  return detected;
+}
+
+// ============================================================================
+// IMPLEMENTACIÓN DE INTERFACE PÚBLICA
+// ============================================================================
+
+void qrs_init(QRSDetector& detector, uint16_t sampleRate) {
+  memset(&detector, 0, sizeof(detector));
+  detector.decimation = sampleRate > QRS_BASE_RATE_HZ ? sampleRate / QRS_BASE_RATE_HZ : 1;
+  detector.learning = true;
+}
+
+bool qrs_process(QRSDetector& detector, int16_t sample, QRSBeat& beat) {
+  detector.decimSum += sample;
+  if (++detector.decimCount < detector.decimation) return false;
+
+  int32_t x = detector.decimSum / detector.decimation;
+  detector.decimSum = 0;
+  detector.decimCount = 0;
+  return processBase(detector, x, beat);
+}
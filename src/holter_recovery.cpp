@@ -0,0 +1,72 @@
+#include "holter_recovery.h"
+#include "holter_crc.h"
+#include <stdio.h>
+#include <string.h>
+
+// ============================================================================
+// FUNCIONES INTERNAS (PRIVADAS)
+// ============================================================================
+
+static bool readValid(RecoveryReadFn read, void* ctx, uint32_t index, uint16_t tag,
+                      uint8_t* block) {
+  return read(ctx, index, block) && recovery_blockValid(block, tag);
+}
+
+// El header tiene que ser el de este archivo: un sector reservado puede
+// traer el header de un segmento viejo. Acepta <ts> con o sin ceros
+static bool headerMatchesName(const char* name, const FileHeader& header) {
+  const char* base = strrchr(name, '/');
+  base = base ? base + 1 : name;
+  unsigned long session = 0;
+  unsigned seq = 0;
+  if (sscanf(base, "session_%lu_%u.bin", &session, &seq) != 2) return true;
+  return session == header.session_id && seq == header.segment_seq;
+}
+
+// ============================================================================
+// FUNCIONES PÚBLICAS
+// ============================================================================
+
+bool recovery_blockValid(uint8_t* block, uint16_t tag) {
+  DataBlockHeader header;
+  memcpy(&header, block, sizeof(header));
+  if (header.sync != DATA_BLOCK_SYNC || header.segment_tag != tag) return false;
+  memset(block + offsetof(DataBlockHeader, crc32), 0, sizeof(header.crc32));
+  return holter_crc32(0, block, DATA_BLOCK_SIZE) == header.crc32;
+}
+
+SegmentRecovery recovery_check(const char* name, const FileHeader* header, size_t fileSize,
+                               RecoveryReadFn read, void* ctx, uint8_t* block,
+                               uint32_t* keepBlocks) {
+  *keepBlocks = 0;
+  if (!header || fileSize < FILE_HEADER_BLOCK_SIZE || header->magic != FILE_MAGIC) {
+    return SEGMENT_REMOVE;
+  }
+  if (header->version < 9) return SEGMENT_INTACT;
+  if (!headerMatchesName(name, *header)) return SEGMENT_REMOVE;
+
+  uint32_t blocks = (fileSize - FILE_HEADER_BLOCK_SIZE) / DATA_BLOCK_SIZE;
+  if (blocks == 0) return SEGMENT_REMOVE;
+
+  uint16_t tag = data_block_tag(header->session_id, header->segment_seq);
+  if (readValid(read, ctx, blocks - 1, tag, block)) {
+    // Cerrado y recortado normalmente (salvo una cola de menos de un bloque)
+    *keepBlocks = blocks;
+    bool exact = fileSize == FILE_HEADER_BLOCK_SIZE + (size_t)blocks * DATA_BLOCK_SIZE;
+    return exact ? SEGMENT_INTACT : SEGMENT_TRIM;
+  }
+
+  int32_t valid = -1;                            // Último bloque válido
+  int32_t invalid = blocks - 1;                  // Primer bloque inválido conocido
+  while (invalid - valid > 1) {
+    int32_t mid = valid + (invalid - valid) / 2;
+    if (readValid(read, ctx, mid, tag, block)) {
+      valid = mid;
+    } else {
+      invalid = mid;
+    }
+  }
+  if (valid < 0) return SEGMENT_REMOVE;
+  *keepBlocks = valid + 1;
+  return SEGMENT_TRIM;
+}
@@ -0,0 +1,450 @@
+#include "holter_storage.h"
+#include "holter_format.h"
+#include "holter_recovery.h"
+#include "holter_log.h"
+#include <SPI.h>
+#include <esp_timer.h>
+#include <esp_idf_version.h>
+#include <unistd.h>
+
+// f_expand llega al VFS recién en ESP-IDF 5.3
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 3, 0)
+#include <esp_vfs_fat.h>
+#define SD_CONTIGUOUS_FILES 1
+#else
+#define SD_CONTIGUOUS_FILES 0
+#endif
+
+// ============================================================================
+// CONFIGURACIÓN HARDWARE
+// ============================================================================
+
+#define SD_CS_PIN 5
+
+// Pines SPI del ESP32 (por defecto)
+#define SD_MOSI 23
+#define SD_MISO 19
+#define SD_SCK 18
+
+// Punto de montaje en el VFS (rutas POSIX como truncate())
+#if HOLTER_SD_MODE == 0
+#define SD_MOUNT_POINT "/sd"
+#else
+#define SD_MOUNT_POINT "/sdcard"
+#endif
+
+// ============================================================================
+// VARIABLES INTERNAS (PRIVADAS)
+// ============================================================================
+
+static const int MOUNT_ATTEMPTS = 5;
+static const char* TEST_FILE = "/.sdtest.bin";
+
+// La prueba escribe en ráfagas del mismo tamaño que la captura
+static const size_t TEST_CHUNK = (size_t)HOLTER_SD_BURST_KB * 1024;
+static const uint32_t TEST_CHUNKS = (uint32_t)HOLTER_SD_SPEED_TEST_KB / HOLTER_SD_BURST_KB;
+static_assert(HOLTER_SD_SPEED_TEST_KB == 0 || HOLTER_SD_SPEED_TEST_KB >= HOLTER_SD_BURST_KB,
+              "HOLTER_SD_SPEED_TEST_KB debe contener al menos una ráfaga");
+
+// Relojes a probar, de mayor a menor. En SPI son divisores exactos de los
+// 80 MHz del APB; en SDMMC, alta velocidad, velocidad por defecto y uno
+// conservador para cableados largos
+#if HOLTER_SD_MODE == 0
+static const uint32_t CLOCK_LADDER_KHZ[] = {40000, 26667, 20000, 10000, 4000};
+#else
+static const uint32_t CLOCK_LADDER_KHZ[] = {40000, 20000, 10000};
+#endif
+static const int CLOCK_STEPS = sizeof(CLOCK_LADDER_KHZ) / sizeof(CLOCK_LADDER_KHZ[0]);
+
+static const char* SEGMENT_PREFIX = "/session_";
+static const char* SEGMENT_EXT = ".bin";
+static const size_t UPLOADED_PATH_LEN = sizeof(UPLOADED_DIR) + HOLTER_MAX_FILENAME_LEN;
+static const uint64_t RESERVE_BYTES = (uint64_t)HOLTER_SD_RESERVE_MB * 1024 * 1024;
+
+static StorageInfo storageInfo = {};
+
+// Segmentos en UPLOADED_DIR: los mueve la tarea de upload y los borra la
+// de almacenamiento
+static portMUX_TYPE uploadedMux = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t uploadedFiles = 0;
+static uint64_t uploadedBytes = 0;
+
+// ============================================================================
+// FUNCIONES INTERNAS (PRIVADAS)
+// ============================================================================
+
+static bool mountAt(uint32_t khz) {
+#if HOLTER_SD_MODE == 0
+  return SD.begin(SD_CS_PIN, SPI, khz * 1000, SD_MOUNT_POINT);
+#else
+  return SD_MMC.begin(SD_MOUNT_POINT, HOLTER_SD_MODE == 1, false, (int)khz);
+#endif
+}
+
+// Libera la tarjeta y, en SPI, reinicia el bus antes de un reintento
+static void resetBus() {
+  sdCard.end();
+#if HOLTER_SD_MODE == 0
+  SPI.end();
+  delay(200);
+  SPI.begin(SD_SCK, SD_MISO, SD_MOSI, SD_CS_PIN);
+#endif
+  delay(200);
+}
+
+static uint8_t testPattern(size_t i) {
+  return (uint8_t)(i * 7 + 1);
+}
+
+// Escribe y relee TEST_CHUNKS ráfagas. Con un reloj que el cableado no
+// soporta fallan las escrituras, el CRC de lectura o la comparación: el
+// montaje en sí usa 400 kHz y no lo detecta. Deja las velocidades en
+// storageInfo. @return false si algo falló
+static bool speedTest(uint8_t* buffer) {
+  for (size_t i = 0; i < TEST_CHUNK; i++) buffer[i] = testPattern(i);
+  
+  File file = sdCard.open(TEST_FILE, FILE_WRITE);
+  if (!file) return false;
+  
+  bool ok = true;
+  int64_t start = esp_timer_get_time();
+  for (uint32_t chunk = 0; chunk < TEST_CHUNKS && ok; chunk++) {
+    memcpy(buffer, &chunk, sizeof(chunk));       // Cada ráfaga distinta
+    ok = file.write(buffer, TEST_CHUNK) == TEST_CHUNK;
+  }
+  file.close();                                  // Incluye la actualización de la FAT
+  int64_t writeUs = esp_timer_get_time() - start;
+  
+  int64_t readUs = 0;
+  if (ok) {
+    file = sdCard.open(TEST_FILE, FILE_READ);
+    ok = (bool)file;
+    for (uint32_t chunk = 0; chunk < TEST_CHUNKS && ok; chunk++) {
+      start = esp_timer_get_time();
+      ok = file.read(buffer, TEST_CHUNK) == TEST_CHUNK;
+      readUs += esp_timer_get_time() - start;
+  
+      uint32_t tag;
+      memcpy(&tag, buffer, sizeof(tag));
+      ok = ok && tag == chunk;
+      for (size_t i = sizeof(tag); i < TEST_CHUNK && ok; i++) {
+        ok = buffer[i] == testPattern(i);
+      }
+    }
+    if (file) file.close();
+  }
+  sdCard.remove(TEST_FILE);
+  
+  if (!ok) return false;
+  
+  uint64_t kb = (uint64_t)TEST_CHUNKS * HOLTER_SD_BURST_KB;
+  storageInfo.write_kbps = writeUs > 0 ? (uint32_t)(kb * 1000000 / writeUs) : 0;
+  storageInfo.read_kbps = readUs > 0 ? (uint32_t)(kb * 1000000 / readUs) : 0;
+  return true;
+}
+
+// Monta con el reloj más alto de la escalera que pasa la prueba
+static bool mountLadder(uint8_t* buffer) {
+  for (int step = 0; step < CLOCK_STEPS; step++) {
+    uint32_t khz = CLOCK_LADDER_KHZ[step];
+    if (khz * 1000 > HOLTER_SD_MAX_HZ && step < CLOCK_STEPS - 1) continue;
+  
+    if (!mountAt(khz)) {
+      sdCard.end();
+      continue;
+    }
+    if (sdCard.cardType() == CARD_NONE) {
+      sdCard.end();
+      return false;                              // Sin tarjeta: bajar el reloj no sirve
+    }
+    if (buffer && !speedTest(buffer)) {
+      HOLTER_LOGW("[WARNING] SD inestable a %lu kHz, se baja el reloj", (unsigned long)khz);
+      sdCard.end();
+      continue;
+    }
+  
+    storageInfo.clock_khz = khz;
+    return true;
+  }
+  return false;
+}
+
+static bool isSegmentFile(const char* name) {
+  size_t len = strlen(name);
+  size_t extLen = strlen(SEGMENT_EXT);
+  return strncmp(name, SEGMENT_PREFIX, strlen(SEGMENT_PREFIX)) == 0 &&
+         len > extLen && strcmp(name + len - extLen, SEGMENT_EXT) == 0;
+}
+
+static void addUploaded(int32_t files, int64_t bytes) {
+  portENTER_CRITICAL(&uploadedMux);
+  uploadedFiles += files;
+  uploadedBytes += bytes;
+  portEXIT_CRITICAL(&uploadedMux);
+}
+
+// Lectura de un bloque para recovery_check(): ctx es el File abierto
+static bool readSegmentBlock(void* ctx, uint32_t index, uint8_t* block) {
+  File& file = *(File*)ctx;
+  if (!file.seek(FILE_HEADER_BLOCK_SIZE + index * DATA_BLOCK_SIZE)) return false;
+  return file.read(block, DATA_BLOCK_SIZE) == DATA_BLOCK_SIZE;
+}
+
+// Un corte de energía deja el último segmento con su tamaño reservado y,
+// tras los datos, lo que hubiera antes en esos sectores (holter_recovery.h)
+static void recoverSegment(const char* name) {
+  static uint8_t block[DATA_BLOCK_SIZE] __attribute__((aligned(4)));
+  
+  File file = sdCard.open(name, FILE_READ);
+  if (!file) return;
+  
+  size_t size = file.size();
+  FileHeader header;
+  bool headerRead = file.read(block, FILE_HEADER_BLOCK_SIZE) == FILE_HEADER_BLOCK_SIZE;
+  memcpy(&header, block, sizeof(header));
+  uint32_t keep = 0;
+  SegmentRecovery action = recovery_check(name, headerRead ? &header : nullptr, size,
+                                          readSegmentBlock, &file, block, &keep);
+  file.close();
+  
+  if (action == SEGMENT_REMOVE) {
+    HOLTER_LOGW("[WARNING] Segmento sin cerrar y sin datos: %s eliminado", name);
+    sdCard.remove(name);
+  } else if (action == SEGMENT_TRIM) {
+    HOLTER_LOGW("[WARNING] Segmento sin cerrar (corte de energía): %s recortado a %lu bloques",
+                name, (unsigned long)keep);
+    holter_storageTruncate(name, FILE_HEADER_BLOCK_SIZE + keep * DATA_BLOCK_SIZE);
+  }
+}
+
+// Recupera el segmento más nuevo y cuenta los ya subidos
+static void scanSegments() {
+  char newest[HOLTER_MAX_FILENAME_LEN] = "";
+  
+  File root = sdCard.open("/");
+  if (root) {
+    File entry = root.openNextFile();
+    while (entry) {
+      const char* name = entry.path();           // path() muere con close()
+      if (!entry.isDirectory() && strlen(name) < sizeof(newest) && isSegmentFile(name) &&
+          strcmp(name, newest) > 0) {
+        strcpy(newest, name);
+      }
+      entry.close();
+      entry = root.openNextFile();
+    }
+    root.close();
+  }
+  if (newest[0]) recoverSegment(newest);
+  
+#if HOLTER_SD_KEEP_UPLOADED
+  if (!sdCard.exists(UPLOADED_DIR) && !sdCard.mkdir(UPLOADED_DIR)) {
+    HOLTER_LOGW("[WARNING] No se pudo crear " UPLOADED_DIR ": los segmentos subidos se borran");
+    return;
+  }
+#endif
+  File dir = sdCard.open(UPLOADED_DIR);
+  if (!dir) return;
+  File entry = dir.openNextFile();
+  while (entry) {
+    if (!entry.isDirectory()) addUploaded(1, entry.size());
+    entry.close();
+    entry = dir.openNextFile();
+  }
+  dir.close();
+  
+  if (uploadedFiles) {
+    HOLTER_LOGI("[SD] Segmentos ya subidos: %lu (%lluMB), se borran si falta espacio",
+                (unsigned long)uploadedFiles, uploadedBytes / (1024 * 1024));
+  }
+}
+
+// Segmento subido más antiguo: los nombres (ancho fijo) ordenan cronológicamente
+static bool oldestUploaded(char* path, uint64_t& size) {
+  File dir = sdCard.open(UPLOADED_DIR);
+  if (!dir) return false;
+  
+  path[0] = '\0';
+  File entry = dir.openNextFile();
+  while (entry) {
+    const char* name = entry.path();
+    if (!entry.isDirectory() && strlen(name) < UPLOADED_PATH_LEN &&
+        (path[0] == '\0' || strcmp(name, path) < 0)) {
+      strcpy(path, name);
+      size = entry.size();
+    }
+    entry.close();
+    entry = dir.openNextFile();
+  }
+  dir.close();
+  return path[0] != '\0';
+}
+
+// ============================================================================
+// IMPLEMENTACIÓN DE INTERFACE PÚBLICA
+// ============================================================================
+
+bool holter_storageInit() {
+  memset(&storageInfo, 0, sizeof(storageInfo));
+  storageInfo.mode = HOLTER_SD_MODE;
+  
+#if HOLTER_SD_MODE == 0
+  // Configurar pines SPI explícitamente
+  pinMode(SD_CS_PIN, OUTPUT);
+  digitalWrite(SD_CS_PIN, HIGH);
+  
+  // Inicializar SPI con pines específicos
+  SPI.begin(SD_SCK, SD_MISO, SD_MOSI, SD_CS_PIN);
+  
+  HOLTER_LOGI("[INIT] SPI inicializado");
+  HOLTER_LOGI("[INIT] Pines - CS:%d, MOSI:%d, MISO:%d, SCK:%d",
+              SD_CS_PIN, SD_MOSI, SD_MISO, SD_SCK);
+#else
+  HOLTER_LOGI("[INIT] Host SDMMC de %d bit(s)", HOLTER_SD_MODE);
+#endif
+  
+  // Intentar montar SD Card: las esperas y el reinicio del bus son solo
+  // para los reintentos, una tarjeta sana monta en el primer intento
+  HOLTER_LOGI("[SD] Inicializando tarjeta SD...");
+  
+  // Buffer de la prueba solo durante el montaje
+  uint8_t* buffer = TEST_CHUNKS ? (uint8_t*)malloc(TEST_CHUNK) : nullptr;
+  if (TEST_CHUNKS && !buffer) {
+    HOLTER_LOGW("[WARNING] Sin memoria para la prueba de velocidad de la SD");
+  }
+  
+  bool sdMounted = false;
+  for (int i = 0; i < MOUNT_ATTEMPTS && !sdMounted; i++) {
+    if (i > 0) {
+      HOLTER_LOGI("[SD] Reintento %d...", i);
+      resetBus();
+      delay(1000);
+    }
+  
+    sdMounted = mountLadder(buffer);
+  }
+  free(buffer);
+  
+  if (!sdMounted) {
+    HOLTER_LOGE("[ERROR] SD Card no disponible");
+    return false;
+  }
+  
+  uint8_t cardType = sdCard.cardType();
+  HOLTER_LOGI("[SD] Montada [OK] a %lu kHz", (unsigned long)storageInfo.clock_khz);
+  HOLTER_LOGI("[SD] Tipo: %s", cardType == CARD_MMC ? "MMC" :
+                               cardType == CARD_SD ? "SDSC" :
+                               cardType == CARD_SDHC ? "SDHC" : "UNKNOWN");
+  
+  uint64_t cardSize = sdCard.cardSize() / (1024 * 1024);
+  HOLTER_LOGI("[SD] Tamaño: %lluMB", cardSize);
+  
+  storageInfo.total_bytes = sdCard.totalBytes();
+  storageInfo.used_bytes = sdCard.usedBytes();
+  HOLTER_LOGI("[SD] Usado: %lluMB / %lluMB", storageInfo.used_bytes / (1024 * 1024),
+              storageInfo.total_bytes / (1024 * 1024));
+  
+  if (storageInfo.write_kbps) {
+    HOLTER_LOGI("[SD] Velocidad: escritura %lu KB/s, lectura %lu KB/s (ráfagas de %u KB)",
+                (unsigned long)storageInfo.write_kbps, (unsigned long)storageInfo.read_kbps,
+                (unsigned)HOLTER_SD_BURST_KB);
+  }
+  
+  storageInfo.mounted = true;
+  scanSegments();
+  return true;
+}
+
+void holter_getStorageInfo(StorageInfo& info) {
+  info = storageInfo;
+  portENTER_CRITICAL(&uploadedMux);
+  info.uploaded_files = uploadedFiles;
+  info.uploaded_bytes = uploadedBytes;
+  portEXIT_CRITICAL(&uploadedMux);
+}
+
+uint64_t holter_storageFreeBytes() {
+  if (!storageInfo.mounted) return 0;
+  
+  // f_getfree usa la cuenta de clusters libres en caché: no recorre la FAT
+  uint64_t total = sdCard.totalBytes();
+  uint64_t used = sdCard.usedBytes();
+  return total > used + RESERVE_BYTES ? total - used - RESERVE_BYTES : 0;
+}
+
+bool holter_storageEnsureFree(uint64_t bytes) {
+  uint64_t available = holter_storageFreeBytes();
+  while (available < bytes) {
+    char path[UPLOADED_PATH_LEN];
+    uint64_t size = 0;
+    if (!storageInfo.mounted || !oldestUploaded(path, size) || !sdCard.remove(path)) {
+      HOLTER_LOGW("[WARNING] SD sin espacio: %lluKB libres, se necesitan %lluKB",
+                  available / 1024, bytes / 1024);
+      return false;
+    }
+    addUploaded(-1, -(int64_t)size);
+    HOLTER_LOGI("[SD] Espacio liberado: %s (ya subido)", path);
+    available = holter_storageFreeBytes();
+  }
+  return true;
+}
+
+File holter_storageCreate(const char* name, uint32_t size, bool& reserved) {
+  reserved = false;
+  
+#if SD_CONTIGUOUS_FILES
+  if (size > 0) {
+    // f_expand solo acepta un archivo vacío
+    char path[sizeof(SD_MOUNT_POINT) + HOLTER_MAX_FILENAME_LEN];
+    snprintf(path, sizeof(path), SD_MOUNT_POINT "%s", name);
+    sdCard.remove(name);
+    if (esp_vfs_fat_create_contiguous_file(SD_MOUNT_POINT, path, size, true) == ESP_OK) {
+      File file = sdCard.open(name, "r+");
+      if (file) {
+        reserved = true;
+        return file;
+      }
+    }
+    HOLTER_LOGD("[SD] Sin tramo contiguo de %lu KB para %s", (unsigned long)(size / 1024), name);
+    sdCard.remove(name);
+  }
+#endif
+  
+  File file = sdCard.open(name, FILE_WRITE);
+  if (file && size > 0) {
+    // En escritura, posicionarse más allá del final agranda el archivo
+    // (f_lseek de FatFs): la cadena de clusters se asigna sin escribir
+    // datos, pero donde FatFs encuentre lugar (no necesariamente contigua)
+    reserved = file.seek(size) && file.seek(0);
+  }
+  return file;
+}
+
+bool holter_storageTruncate(const char* name, uint32_t size) {
+  char path[sizeof(SD_MOUNT_POINT) + HOLTER_MAX_FILENAME_LEN];
+  snprintf(path, sizeof(path), SD_MOUNT_POINT "%s", name);
+  if (truncate(path, size) != 0) {
+    HOLTER_LOGE("[ERROR] No se pudo recortar %s a %lu bytes", name, (unsigned long)size);
+    return false;
+  }
+  return true;
+}
+
+bool holter_storageRetire(const char* name) {
+#if HOLTER_SD_KEEP_UPLOADED
+  const char* base = strrchr(name, '/');
+  char path[UPLOADED_PATH_LEN];
+  snprintf(path, sizeof(path), UPLOADED_DIR "%s", base ? base : name);
+  
+  File file = sdCard.open(name, FILE_READ);
+  size_t size = file ? file.size() : 0;
+  if (file) file.close();
+  
+  if (sdCard.rename(name, path)) {
+    addUploaded(1, size);
+    return true;
+  }
+  HOLTER_LOGW("[WARNING] No se pudo mover %s a " UPLOADED_DIR ", se borra", name);
+#endif
+  return sdCard.remove(name);
+}
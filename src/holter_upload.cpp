@@ -1,8 +1,23 @@
 #include "holter_upload.h"
 #include "aws_config.h"
 #include "holter_capture.h"
+#include "holter_clock.h"
+#include "holter_config.h"
+#include "holter_log.h"
+#include "holter_storage.h"
+#include "ecg_codec.h"
 #include <ArduinoJson.h>
-#include <time.h>
+#include <Preferences.h>
+#include <stdarg.h>
+#include <strings.h>
+
+// aws_config.h anteriores al streaming en vivo no definen el topic
+#ifndef TOPIC_LIVE
+#define TOPIC_LIVE "holter/live/" DEVICE_ID
+#endif
+#ifndef TOPIC_STATS
+#define TOPIC_STATS "holter/stats/" DEVICE_ID
+#endif
 
 // ============================================================================
 // VARIABLES INTERNAS (PRIVADAS)
@@ -10,151 +25,692 @@
 
 static WiFiClientSecure wifiClient;
 static PubSubClient mqttClient(wifiClient);
+static const uint16_t MQTT_BUFFER_SIZE = 4096;
+
+// Conexión HTTPS a S3 reutilizable (keep-alive): las URLs prefirmadas van
+// todas al mismo host del bucket. Sin CA, igual que HTTPClient::begin(url)
+static WiFiClientSecure s3Client;
+static const size_t HOST_MAX_LEN = 128;
+static char s3Host[HOST_MAX_LEN] = "";
+
+// Tarea de red (core 0)
+static TaskHandle_t networkTask = nullptr;
+static const BaseType_t NETWORK_CORE = 0;
+static const UBaseType_t NETWORK_PRIORITY = 1;
+static const uint32_t NETWORK_STACK = 10240;
+static const int MAX_FILENAME_LEN = HOLTER_MAX_FILENAME_LEN;
+
+// Cola persistente: la SD es la cola (un segmento se borra solo al subirse).
+// La tarea de red la relee y toma un lote con los más antiguos; sobrevive
+// a cortes de WiFi y a reinicios sin guardar nada aparte
+static const int UPLOAD_BATCH = HOLTER_UPLOAD_BATCH_SIZE;
+static const unsigned long BACKOFF_MIN_MS = 5000;
+static const unsigned long BACKOFF_MAX_MS = HOLTER_UPLOAD_BACKOFF_MAX_SEC * 1000UL;
+static const int MAX_FILE_ATTEMPTS = HOLTER_UPLOAD_MAX_ATTEMPTS;
+static const int ATTEMPT_SLOTS = 8;
+static const char* SEGMENT_PREFIX = "/session_";
+static const char* SEGMENT_EXT = ".bin";
+static const char* RETIRED_TEXT = HOLTER_SD_KEEP_UPLOADED ? "movido a " UPLOADED_DIR : "eliminado";
 
-// Estado
-static UploadState currentState = UPLOAD_IDLE;
-static String currentFilename = "";
-static String uploadURL = "";
+struct FileAttempts {
+  char name[MAX_FILENAME_LEN];
+  int failures;
+};
+static char batchFiles[UPLOAD_BATCH][MAX_FILENAME_LEN];
+static unsigned long batchSizes[UPLOAD_BATCH];
+static int batchCount = 0;
+static int batchIndex = 0;
+static volatile bool backlogDirty = true;      // Hay que releer la SD
+static volatile int pendingCount = 0;          // Segmentos pendientes en la SD
+static FileAttempts fileAttempts[ATTEMPT_SLOTS];
+static unsigned long backoffMs = 0;
+static unsigned long retryAt = 0;
+static bool resultHandled = true;
+static bool reachedServer = false;             // El fallo no fue de conectividad
+
+// Estado. Todos los textos van en buffers estáticos de tamaño fijo: sin
+// String ni heap después del arranque, que queda entero para TLS
+static const size_t URL_MAX_LEN = HOLTER_UPLOAD_URL_MAX_LEN;
+static const size_t ERROR_MAX_LEN = 96;
+static volatile UploadState currentState = UPLOAD_IDLE;
+static char currentFilename[MAX_FILENAME_LEN] = "";
+static char uploadURL[URL_MAX_LEN] = "";
 static bool urlReceived = false;
-static String lastError = "";
-static String currentSessionID = "";
+static bool lambdaFailed = false;              // Lambda respondió error para este upload
+static char lastError[ERROR_MAX_LEN] = "";
+static char stateString[ERROR_MAX_LEN + 8] = "";   // holter_getUploadStateString()
+static char currentSessionID[MAX_FILENAME_LEN] = "";
+static unsigned long currentFileSize = 0;
+static bool ntpStarted = false;
+
+// WiFi por eventos: la conexión avanza en segundo plano y la máquina de
+// estados solo consulta wifiUp en cada paso
+static volatile bool wifiUp = false;
+static bool wifiStarted = false;
+static bool wifiReported = false;              // IP y RSSI ya informados en esta conexión
+static const unsigned long WIFI_CONNECT_TIMEOUT_MS = 10000;
+
+// Fast connect: BSSID y canal del último AP en NVS. Con ellos la asociación
+// no escanea canales; si no conecta en FAST_CONNECT_TIMEOUT_MS se vuelve al
+// escaneo completo (el AP cambió de canal o el equipo de lugar)
+static const char* NET_PREFS_NAMESPACE = "holter_net";
+static const unsigned long FAST_CONNECT_TIMEOUT_MS = 3000;
+static uint8_t savedBSSID[6];
+static uint8_t savedChannel = 0;               // 0 = sin AP guardado
+static bool fastConnecting = false;
+static unsigned long wifiStartedAt = 0;
+
+// MQTT: un intento por paso como máximo cada MQTT_RETRY_MS
+static unsigned long mqttAttemptAt = 0;
+static int mqttFailures = 0;
+static const unsigned long MQTT_RETRY_MS = 2000;
+static const int MQTT_MAX_ATTEMPTS = 3;
+
+// PUT incremental: cada paso envía como máximo TRANSFER_CHUNK bytes del
+// archivo y luego se lee la respuesta sin esperar
+enum TransferPhase {
+  TRANSFER_IDLE,
+  TRANSFER_SENDING,
+  TRANSFER_RESPONSE
+};
+static const int TRANSFER_RUNNING = 0;
+static const int TRANSFER_FAILED = -1;
+static const size_t TRANSFER_CHUNK = 4096;
+static TransferPhase transferPhase = TRANSFER_IDLE;
+static File transferFile;
+static unsigned long transferLength = 0;
+static unsigned long transferSent = 0;
+static unsigned long transferActivity = 0;
+static unsigned long transferStart = 0;
+static uint8_t transferBuffer[TRANSFER_CHUNK];
+static size_t transferBufferLen = 0;
+static size_t transferBufferPos = 0;
+static char requestHeader[URL_MAX_LEN + 256];     // Línea PUT con la ruta firmada
+
+// Respuesta HTTP del PUT en curso. Las líneas más largas se truncan: solo
+// interesan el estado, ETag, Content-Length y Connection
+static const size_t RESPONSE_LINE_MAX = 256;
+static const size_t ETAG_MAX_LEN = 72;
+static const size_t RESPONSE_BODY_LOG = 256;
+static char responseLine[RESPONSE_LINE_MAX];
+static size_t responseLineLen = 0;
+static int responseCode = 0;
+static bool responseHeadersDone = false;
+static long responseBodyLeft = 0;      // -1 = largo desconocido
+static bool responseKeepAlive = true;
+static char responseETag[ETAG_MAX_LEN] = "";
+static char responseBody[RESPONSE_BODY_LOG + 1] = "";
+static size_t responseBodyLen = 0;
+
+// Streaming en vivo: un frame del codec por mensaje. Si la red se atrasó
+// (handshake TLS, PUT), se envían varios frames seguidos para alcanzar
+static const unsigned long LIVE_FRAME_MS = HOLTER_LIVE_FRAME_MS;
+static const size_t LIVE_FRAME_SAMPLES = HOLTER_ECG_SAMPLE_RATE_HZ * HOLTER_LIVE_FRAME_MS / 1000;
+static const size_t LIVE_MESSAGE_SIZE = sizeof(LiveFrameHeader) + ecg_codec_maxFrameSize(LIVE_FRAME_SAMPLES);
+static const int LIVE_MAX_FRAMES_PER_STEP = 4;
+static_assert(LIVE_FRAME_SAMPLES > 0, "HOLTER_LIVE_FRAME_MS demasiado corto");
+static_assert(LIVE_MESSAGE_SIZE + sizeof(TOPIC_LIVE) + 8 <= MQTT_BUFFER_SIZE,
+              "HOLTER_LIVE_FRAME_MS no cabe en el buffer MQTT");
+static volatile bool liveEnabled = HOLTER_LIVE_STREAM;
+static unsigned long lastLiveFrame = 0;
+static unsigned long liveFramesSent = 0;
+static ECGSample liveSamples[LIVE_FRAME_SAMPLES];
+static uint8_t liveMessage[LIVE_MESSAGE_SIZE];
+
+// Telemetría por MQTT (TOPIC_STATS)
+static const unsigned long STATS_PERIOD_MS = HOLTER_STATS_PERIOD_SEC * 1000UL;
+static unsigned long lastStatsPublish = 0;
+
+// Documentos JSON estáticos. Solo los usa la tarea de red (el callback MQTT
+// corre dentro de mqttClient.loop()): uno para lo que se publica y otro
+// para las respuestas de Lambda, que traen una URL prefirmada entera
+static const size_t JSON_REQUEST_SIZE = 1536;
+static const size_t JSON_RESPONSE_SIZE = URL_MAX_LEN + 512;
+static StaticJsonDocument<JSON_REQUEST_SIZE> requestDoc;
+static StaticJsonDocument<JSON_RESPONSE_SIZE> responseDoc;
+static char jsonBuffer[JSON_REQUEST_SIZE];
+
+// URLs PUT pedidas antes de cerrar el segmento, con su vencimiento. Con
+// HOLTER_NET_PERSISTENT el segmento cerrado se sube sin esperar a Lambda
+struct CachedURL {
+  char sessionID[MAX_FILENAME_LEN];
+  char url[URL_MAX_LEN];
+  unsigned long receivedAt;
+  unsigned long validMs;
+};
+static const bool NET_PERSISTENT = HOLTER_NET_PERSISTENT;
+static const int URL_CACHE_SLOTS = HOLTER_UPLOAD_BATCH_SIZE + 1;   // Lote + segmento en curso
+static const unsigned long URL_EXPIRY_MARGIN_SEC = 60;   // No usar URLs a punto de vencer
+static const unsigned long PREFETCH_RETRY_MS = 60000;
+static CachedURL urlCache[URL_CACHE_SLOTS];
+static char prefetchSessionID[MAX_FILENAME_LEN] = "";
+static unsigned long prefetchRequestedAt = 0;
+
+// Multipart: una URL prefirmada por parte y un journal en SD
+// (<archivo>.mpu) con el upload_id y el ETag de cada parte confirmada,
+// para retomar desde la última parte buena tras un corte o reinicio
+static const unsigned long PART_SIZE = HOLTER_MULTIPART_PART_SIZE;
+static const int URL_SLOTS = HOLTER_MULTIPART_URL_BATCH;
+static const int MAX_PART_RETRIES = 3;
+static const char* JOURNAL_EXT = ".mpu";
+static const size_t JOURNAL_PATH_LEN = MAX_FILENAME_LEN + 4;
+static const size_t UPLOAD_ID_MAX_LEN = 256;
+static bool multipart = false;
+static char multipartUploadId[UPLOAD_ID_MAX_LEN] = "";
+static char journalFile[JOURNAL_PATH_LEN] = "";
+static uint32_t totalParts = 0;
+static uint32_t nextPart = 1;
+static char partURLs[URL_SLOTS][URL_MAX_LEN];
+static uint32_t partURLNumber[URL_SLOTS];
+static int partRetries = 0;
+static bool multipartCompleted = false;
 
 // Timing
 static unsigned long uploadStartTime = 0;
 static const unsigned long UPLOAD_TIMEOUT_MS = 60000;
-
-// NTP
-static const char* ntpServer = "pool.ntp.org";
-static const long gmtOffset_sec = -5 * 3600;
-static const int daylightOffset_sec = 0;
+static const unsigned long PART_TIMEOUT_MS = 30000;
 
 // ============================================================================
 // FUNCIONES INTERNAS (PRIVADAS)
 // ============================================================================
 
+// Arranca SNTP en segundo plano solo si el reloj no tiene hora o la última
+// sincronización venció: tras un reinicio la hora sigue en el RTC. Una vez
+// arrancado, SNTP se resincroniza solo
 static void syncTime() {
-  Serial.println("[NTP] Sincronizando hora...");
-  configTime(gmtOffset_sec, daylightOffset_sec, ntpServer);
+  if (ntpStarted || !holter_clockNeedsSync()) return;
+  
+  holter_clockStartSync();
+  ntpStarted = true;
+}
+
+static void loadAccessPoint() {
+  Preferences prefs;
+  if (!prefs.begin(NET_PREFS_NAMESPACE, true)) return;
+  if (prefs.getBytes("bssid", savedBSSID, sizeof(savedBSSID)) == sizeof(savedBSSID)) {
+    savedChannel = prefs.getUChar("channel", 0);
+  }
+  prefs.end();
+}
+
+// Guarda el AP de la conexión actual si cambió: una escritura en flash por
+// cambio de AP, no por conexión
+static void saveAccessPoint() {
+  const uint8_t* bssid = WiFi.BSSID();
+  uint8_t channel = (uint8_t)WiFi.channel();
+  if (!bssid || channel == 0) return;
+  if (channel == savedChannel && memcmp(bssid, savedBSSID, sizeof(savedBSSID)) == 0) return;
+  
+  memcpy(savedBSSID, bssid, sizeof(savedBSSID));
+  savedChannel = channel;
+  Preferences prefs;
+  if (!prefs.begin(NET_PREFS_NAMESPACE, false)) return;
+  prefs.putBytes("bssid", savedBSSID, sizeof(savedBSSID));
+  prefs.putUChar("channel", savedChannel);
+  prefs.end();
+  HOLTER_LOGI("[WiFi] AP guardado para fast connect: %02X:%02X:%02X:%02X:%02X:%02X, canal %u",
+              savedBSSID[0], savedBSSID[1], savedBSSID[2], savedBSSID[3], savedBSSID[4],
+              savedBSSID[5], savedChannel);
+}
+
+// Eventos WiFi (tarea de eventos de Arduino): solo actualizan banderas
+static void onWiFiEvent(arduino_event_id_t event, arduino_event_info_t info) {
+  if (event == ARDUINO_EVENT_WIFI_STA_GOT_IP) {
+    wifiUp = true;
+  } else if (event == ARDUINO_EVENT_WIFI_STA_DISCONNECTED) {
+    wifiUp = false;
+  }
+}
+
+// Inicia la asociación una sola vez; la reconexión la maneja el driver
+static void startWiFi() {
+  if (wifiStarted) return;
   
-  struct tm timeinfo;
-  if(!getLocalTime(&timeinfo)){
-    Serial.println("[WARNING] No se pudo obtener hora NTP");
+  WiFi.persistent(false);   // El AP se guarda aparte: sin escribir flash en cada begin()
+  WiFi.mode(WIFI_STA);
+#if HOLTER_LOW_POWER
+  // Modem sleep máximo: la radio despierta solo en los beacons DTIM
+  WiFi.setSleep(WIFI_PS_MAX_MODEM);
+#endif
+  WiFi.setAutoReconnect(true);
+  fastConnecting = (savedChannel != 0);
+  if (fastConnecting) {
+    HOLTER_LOGI("\n[WiFi] Conectando a: %s (fast connect, canal %u)", WIFI_SSID, savedChannel);
+    WiFi.begin(WIFI_SSID, WIFI_PASSWORD, savedChannel, savedBSSID);
+  } else {
+    HOLTER_LOGI("\n[WiFi] Conectando a: %s", WIFI_SSID);
+    WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+  }
+  wifiStartedAt = millis();
+  wifiStarted = true;
+}
+
+// El AP guardado no respondió: asociarse escaneando todos los canales. El
+// nuevo AP reemplaza al guardado al conectar
+static void fallbackToScan() {
+  HOLTER_LOGW("[WARNING] Fast connect sin respuesta, escaneando canales...");
+  fastConnecting = false;
+  savedChannel = 0;
+  WiFi.disconnect();
+  WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+  wifiStartedAt = millis();
+}
+
+// Guarda el motivo del fallo para holter_getLastError()
+static void setError(const char* format, ...) __attribute__((format(printf, 1, 2)));
+static void setError(const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  vsnprintf(lastError, sizeof(lastError), format, args);
+  va_end(args);
+}
+
+// Copia src en dst (size bytes). Lo que no cabe no se trunca: deja dst
+// vacío y devuelve false (una URL cortada no sirve)
+static bool copyText(char* dst, size_t size, const char* src) {
+  size_t len = strlen(src);
+  if (len >= size) {
+    dst[0] = '\0';
+    return false;
+  }
+  memcpy(dst, src, len + 1);
+  return true;
+}
+
+static bool endsWith(const char* text, const char* suffix) {
+  size_t len = strlen(text);
+  size_t suffixLen = strlen(suffix);
+  return len >= suffixLen && strcmp(text + len - suffixLen, suffix) == 0;
+}
+
+// session_<ts>_<seq> a partir de /session_<ts>_<seq>.bin
+// @param sessionID Buffer de MAX_FILENAME_LEN bytes
+static void sessionIDFromFilename(const char* filename, char* sessionID) {
+  const char* start = strrchr(filename, '/');
+  start = start ? start + 1 : filename;
+  const char* dot = strrchr(start, '.');
+  size_t len = dot ? (size_t)(dot - start) : strlen(start);
+  len = min(len, (size_t)MAX_FILENAME_LEN - 1);
+  memcpy(sessionID, start, len);
+  sessionID[len] = '\0';
+}
+
+static void cacheURL(const char* sessionID, const char* url, unsigned long expiresSec) {
+  if (expiresSec <= URL_EXPIRY_MARGIN_SEC) return;
+  if (strlen(sessionID) >= MAX_FILENAME_LEN || strlen(url) >= URL_MAX_LEN) {
+    HOLTER_LOGW("[WARNING] URL prefirmada demasiado larga, no se guarda");
     return;
   }
   
-  Serial.printf("[NTP] Hora sincronizada: %02d/%02d/%04d %02d:%02d:%02d\n",
-                timeinfo.tm_mday, timeinfo.tm_mon + 1, timeinfo.tm_year + 1900,
-                timeinfo.tm_hour, timeinfo.tm_min, timeinfo.tm_sec);
+  // Reemplaza la entrada de la misma sesión o la más antigua
+  int slot = 0;
+  for (int i = 0; i < URL_CACHE_SLOTS; i++) {
+    if (strcmp(urlCache[i].sessionID, sessionID) == 0) {
+      slot = i;
+      break;
+    }
+    if (urlCache[i].receivedAt < urlCache[slot].receivedAt) slot = i;
+  }
+  copyText(urlCache[slot].sessionID, sizeof(urlCache[slot].sessionID), sessionID);
+  copyText(urlCache[slot].url, sizeof(urlCache[slot].url), url);
+  urlCache[slot].receivedAt = millis();
+  urlCache[slot].validMs = (expiresSec - URL_EXPIRY_MARGIN_SEC) * 1000UL;
+  HOLTER_LOGI("[MQTT] URL prefirmada en caché para %s (%lus)", sessionID, expiresSec);
 }
 
-static void mqttCallback(char* topic, byte* payload, unsigned int length) {
-  Serial.println("\n[MQTT] ========== MENSAJE RECIBIDO ==========");
-  Serial.println("[MQTT] Topic: " + String(topic));
-  Serial.print("[MQTT] Payload: ");
-  for (unsigned int i = 0; i < length; i++) {
-    Serial.print((char)payload[i]);
+// @param url Buffer de URL_MAX_LEN bytes
+static bool takeCachedURL(const char* sessionID, char* url) {
+  for (int i = 0; i < URL_CACHE_SLOTS; i++) {
+    CachedURL& entry = urlCache[i];
+    if (entry.url[0] == '\0' || strcmp(entry.sessionID, sessionID) != 0) continue;
+    
+    bool valid = millis() - entry.receivedAt < entry.validMs;
+    if (valid) memcpy(url, entry.url, URL_MAX_LEN);
+    entry.url[0] = '\0';
+    entry.sessionID[0] = '\0';
+    return valid;
+  }
+  return false;
+}
+
+static bool hasCachedURL(const char* sessionID) {
+  for (int i = 0; i < URL_CACHE_SLOTS; i++) {
+    if (urlCache[i].url[0] != '\0' && strcmp(urlCache[i].sessionID, sessionID) == 0 &&
+        millis() - urlCache[i].receivedAt < urlCache[i].validMs) {
+      return true;
+    }
   }
-  Serial.println();
+  return false;
+}
+
+static const char* journalPath() {
+  snprintf(journalFile, sizeof(journalFile), "%s%s", currentFilename, JOURNAL_EXT);
+  return journalFile;
+}
+
+// Lee una línea del journal sin el '\n'. @return false al final del archivo
+static bool readJournalLine(File& journal, char* line, size_t size) {
+  if (!journal.available()) return false;
+  size_t len = journal.readBytesUntil('\n', line, size - 1);
+  line[len] = '\0';
+  return true;
+}
+
+// Carga el journal del archivo actual. Formato de texto:
+//   <upload_id> <part_size>
+//   <parte> <etag>      (una línea por parte confirmada, en orden)
+static void loadJournal() {
+  multipartUploadId[0] = '\0';
+  nextPart = 1;
+  
+  File journal = sdCard.open(journalPath(), FILE_READ);
+  if (!journal) return;
+  
+  char line[UPLOAD_ID_MAX_LEN + 16];
+  char* sep = readJournalLine(journal, line, sizeof(line)) ? strchr(line, ' ') : nullptr;
+  if (!sep || sep == line || strtoul(sep + 1, nullptr, 10) != PART_SIZE) {
+    journal.close();
+    HOLTER_LOGI("[S3] Journal inválido o de otro tamaño de parte, se descarta");
+    sdCard.remove(journalPath());
+    return;
+  }
+  *sep = '\0';
+  copyText(multipartUploadId, sizeof(multipartUploadId), line);
   
-  DynamicJsonDocument doc(1024);
+  while (readJournalLine(journal, line, sizeof(line))) {
+    uint32_t part = (uint32_t)strtoul(line, nullptr, 10);
+    if (part != nextPart) break;   // Solo cuentan partes consecutivas
+    nextPart++;
+  }
+  journal.close();
+  
+  HOLTER_LOGI("[S3] Journal encontrado: retomando desde parte %u", (unsigned)nextPart);
+}
+
+// Print::printf() usa el heap para líneas de más de 64 bytes
+static void journalWrite(File& journal, const char* format, ...) __attribute__((format(printf, 2, 3)));
+static void journalWrite(File& journal, const char* format, ...) {
+  char line[UPLOAD_ID_MAX_LEN + 16];
+  va_list args;
+  va_start(args, format);
+  int len = vsnprintf(line, sizeof(line), format, args);
+  va_end(args);
+  if (len > 0) journal.write((const uint8_t*)line, min((size_t)len, sizeof(line) - 1));
+}
+
+static void journalStart() {
+  File journal = sdCard.open(journalPath(), FILE_WRITE);
+  if (!journal) {
+    HOLTER_LOGW("[WARNING] No se pudo crear journal de upload");
+    return;
+  }
+  journalWrite(journal, "%s %lu\n", multipartUploadId, PART_SIZE);
+  journal.close();
+}
+
+static void journalAppendPart(uint32_t part, const char* etag) {
+  File journal = sdCard.open(journalPath(), FILE_APPEND);
+  if (!journal) {
+    HOLTER_LOGW("[WARNING] No se pudo actualizar journal de upload");
+    return;
+  }
+  journalWrite(journal, "%u %s\n", (unsigned)part, etag);
+  journal.close();
+}
+
+static void discardJournal() {
+  sdCard.remove(journalPath());
+  multipartUploadId[0] = '\0';
+  nextPart = 1;
+}
+
+static bool partURLReady(uint32_t part) {
+  int slot = (part - 1) % URL_SLOTS;
+  return partURLNumber[slot] == part && partURLs[slot][0] != '\0';
+}
+
+static void mqttCallback(char* topic, byte* payload, unsigned int length) {
+  HOLTER_LOGD("[MQTT] Mensaje en %s: %.*s", topic, (int)length, (const char*)payload);
+  
+  JsonDocument& doc = responseDoc;
   DeserializationError error = deserializeJson(doc, payload, length);
   
   if (error) {
-    Serial.println("[ERROR] JSON parsing failed: " + String(error.c_str()));
-    lastError = "JSON parse error";
+    HOLTER_LOGE("[ERROR] JSON parsing failed: %s", error.c_str());
+    setError("JSON parse error");
     return;
   }
   
-  Serial.println("[DEBUG] JSON parseado correctamente");
+  HOLTER_LOGD("[DEBUG] JSON parseado correctamente");
   
-  if (String(topic) == TOPIC_RESPONSE) {
-    Serial.println("[DEBUG] Topic coincide con TOPIC_RESPONSE");
-    if (doc.containsKey("upload_url")) {
-      uploadURL = doc["upload_url"].as<String>();
-      urlReceived = true;
-      Serial.println("[MQTT] URL recibida: " + uploadURL.substring(0, 50) + "...");
+  if (strcmp(topic, TOPIC_RESPONSE) == 0) {
+    HOLTER_LOGD("[DEBUG] Topic coincide con TOPIC_RESPONSE");
+    const char* action = doc["action"] | "";
+    if (strcmp(action, "complete") == 0) {
+      const char* status = doc["status"] | "";
+      multipartCompleted = (strcmp(status, "success") == 0);
+      if (!multipartCompleted) {
+        const char* message = doc["message"] | "";
+        setError("Multipart complete failed: %s", message);
+      }
+    } else if (strcmp(doc["status"] | "", "error") == 0) {
+      // Lambda no pudo generar la URL (action "url" o "part"). Un error de
+      // un pedido por adelantado no corta el upload en curso
+      const char* sessionID = doc["session_id"] | "";
+      const char* message = doc["message"] | "";
+      bool active = currentState == UPLOAD_REQUESTING_URL || currentState == UPLOAD_UPLOADING_S3;
+      if (!active || (sessionID[0] != '\0' && strcmp(sessionID, currentSessionID) != 0)) {
+        HOLTER_LOGW("[WARNING] Lambda falló para %s (pedido por adelantado): %s", sessionID, message);
+      } else {
+        HOLTER_LOGE("[ERROR] Lambda: %s", message);
+        setError("Lambda error: %s", message);
+        lambdaFailed = true;
+      }
+    } else if (doc.containsKey("part_number")) {
+      uint32_t part = doc["part_number"];
+      const char* uploadId = doc["upload_id"] | "";
+      if (multipartUploadId[0] == '\0' &&
+          copyText(multipartUploadId, sizeof(multipartUploadId), uploadId)) {
+        journalStart();   // Upload nuevo: iniciar journal
+      }
+      if (strcmp(uploadId, multipartUploadId) == 0 && part >= nextPart && part < nextPart + URL_SLOTS) {
+        int slot = (part - 1) % URL_SLOTS;
+        if (copyText(partURLs[slot], sizeof(partURLs[slot]), doc["upload_url"] | "")) {
+          partURLNumber[slot] = part;
+          HOLTER_LOGI("[MQTT] URL recibida para parte %u", (unsigned)part);
+        } else {
+          HOLTER_LOGW("[WARNING] URL de parte %u demasiado larga", (unsigned)part);
+        }
+      }
+    } else if (doc.containsKey("upload_url")) {
+      const char* sessionID = doc["session_id"];
+      const char* url = doc["upload_url"] | "";
+      bool waiting = currentState == UPLOAD_REQUESTING_URL && !multipart;
+      if (sessionID && (!waiting || strcmp(currentSessionID, sessionID) != 0)) {
+        // Pedida por adelantado para un segmento que aún se está grabando
+        cacheURL(sessionID, url, doc["expires_in"] | 0UL);
+      } else if (copyText(uploadURL, sizeof(uploadURL), url)) {
+        urlReceived = true;
+        HOLTER_LOGI("[MQTT] URL recibida: %.50s...", uploadURL);
+      } else {
+        HOLTER_LOGW("[WARNING] URL recibida demasiado larga (máx. %u)", (unsigned)URL_MAX_LEN - 1);
+        setError("Upload URL too long");
+      }
     } else {
-      Serial.println("[WARNING] JSON no contiene 'upload_url'");
-      serializeJsonPretty(doc, Serial);
-      Serial.println();
-      lastError = "No upload_url in response";
+      HOLTER_LOGW("[WARNING] JSON no contiene 'upload_url'");
+      setError("No upload_url in response");
     }
   } else {
-    Serial.println("[WARNING] Topic no coincide. Esperado: " + String(TOPIC_RESPONSE));
+    HOLTER_LOGW("[WARNING] Topic no coincide. Esperado: %s", TOPIC_RESPONSE);
   }
-  Serial.println("[MQTT] ==========================================\n");
 }
 
+// Un intento de conexión a AWS IoT, como máximo uno cada MQTT_RETRY_MS.
+// El handshake TLS es lo único que bloquea, y solo a la tarea de red
 static bool connectMQTT() {
-  Serial.println("[MQTT] Configurando AWS IoT...");
-  
-  mqttClient.setBufferSize(4096);
-  Serial.println("[DEBUG] Buffer MQTT configurado: 4096 bytes");
+  if (mqttClient.connected()) {
+    return true;  // Sesión reutilizada de un upload anterior en cola
+  }
+  if (!wifiUp || (mqttAttemptAt != 0 && millis() - mqttAttemptAt < MQTT_RETRY_MS)) {
+    return false;
+  }
+  mqttAttemptAt = millis();
   
+  mqttClient.setBufferSize(MQTT_BUFFER_SIZE);
   mqttClient.setServer(AWS_IOT_ENDPOINT, AWS_IOT_PORT);
   mqttClient.setCallback(mqttCallback);
   mqttClient.setKeepAlive(60);
   
-  Serial.println("[MQTT] Conectando a AWS IoT Core...");
+  HOLTER_LOGI("[MQTT] Conectando a AWS IoT Core...");
   
-  int attempts = 0;
-  while (!mqttClient.connected() && attempts < 3) {
-    if (mqttClient.connect(DEVICE_ID, NULL, NULL, NULL, 0, false, NULL, true)) {
-      Serial.println("[MQTT] Conectado a AWS IoT Core");
-      
-      delay(100);
-      if (!mqttClient.connected()) {
-        Serial.println("[ERROR] Conexión perdida inmediatamente");
-        attempts++;
-        continue;
-      }
-      
-      if (mqttClient.subscribe(TOPIC_RESPONSE, 1)) {
-        Serial.println("[MQTT] Suscrito a: " + String(TOPIC_RESPONSE) + " (QoS 1)");
-      } else {
-        Serial.println("[ERROR] No se pudo suscribir a: " + String(TOPIC_RESPONSE));
-        attempts++;
-        continue;
-      }
-      
-      Serial.println("[MQTT] Esperando confirmación de suscripción...");
-      for (int i = 0; i < 20; i++) {
-        mqttClient.loop();
-        if (!mqttClient.connected()) {
-          Serial.println("[ERROR] Conexión perdida durante suscripción");
-          attempts++;
-          break;
-        }
-        delay(50);
-      }
-      
-      if (mqttClient.connected()) {
-        Serial.println("[MQTT] Listo para recibir mensajes");
-        return true;
-      }
-    } else {
-      Serial.println("[MQTT] Error conectando: " + String(mqttClient.state()));
-      lastError = "MQTT connect failed: " + String(mqttClient.state());
-      attempts++;
-      delay(2000);
+  if (!mqttClient.connect(DEVICE_ID, NULL, NULL, NULL, 0, false, NULL, true)) {
+    HOLTER_LOGE("[MQTT] Error conectando: %d", mqttClient.state());
+    setError("MQTT connect failed: %d", mqttClient.state());
+    mqttFailures++;
+    return false;
+  }
+  
+  // El broker procesa SUBSCRIBE antes que los PUBLISH siguientes de la
+  // misma conexión: no hace falta esperar el SUBACK
+  if (!mqttClient.subscribe(TOPIC_RESPONSE, 1)) {
+    HOLTER_LOGE("[ERROR] No se pudo suscribir a: %s", TOPIC_RESPONSE);
+    mqttClient.disconnect();
+    mqttFailures++;
+    return false;
+  }
+  
+  HOLTER_LOGI("[MQTT] Conectado y suscrito a: %s", TOPIC_RESPONSE);
+  mqttFailures = 0;
+  return true;
+}
+
+// Documento vacío para un mensaje saliente; se serializa en jsonBuffer
+static JsonDocument& newRequest() {
+  requestDoc.clear();
+  return requestDoc;
+}
+
+// Pide a Lambda las URLs prefirmadas de las partes [first, first + count).
+// Si aún no hay upload_id, Lambda inicia el multipart upload.
+static bool requestPartURLs(uint32_t first, uint32_t count) {
+  if (!connectMQTT()) return false;
+  
+  JsonDocument& doc = newRequest();
+  doc["device_id"] = DEVICE_ID;
+  doc["session_id"] = currentSessionID;
+  doc["file_size"] = currentFileSize;
+  doc["multipart"] = true;
+  doc["part_size"] = PART_SIZE;
+  doc["first_part"] = first;
+  doc["count"] = count;
+  if (multipartUploadId[0] != '\0') {
+    doc["upload_id"] = multipartUploadId;
+  }
+  
+  size_t jsonSize = serializeJson(doc, jsonBuffer);
+  return mqttClient.publish(TOPIC_REQUEST, (uint8_t*)jsonBuffer, jsonSize);
+}
+
+// Pide a Lambda una URL PUT para la sesión; Lambda la devuelve con el
+// session_id y su vencimiento (expires_in)
+static bool publishURLRequest(const char* sessionID, unsigned long fileSize) {
+  char timestamp[12];
+  snprintf(timestamp, sizeof(timestamp), "%lu", millis() / 1000);
+  
+  JsonDocument& doc = newRequest();
+  doc["device_id"] = DEVICE_ID;
+  doc["session_id"] = sessionID;
+  doc["timestamp"] = timestamp;
+  doc["file_size"] = fileSize;
+  doc["ready_for_upload"] = true;
+  
+  size_t jsonSize = serializeJson(doc, jsonBuffer);
+  HOLTER_LOGD("[DEBUG] Payload: %s", jsonBuffer);
+  return mqttClient.publish(TOPIC_REQUEST, (uint8_t*)jsonBuffer, jsonSize);
+}
+
+// Pide en un solo mensaje las URLs del archivo actual y de los siguientes
+// del lote que aún no tienen una; Lambda responde un mensaje por archivo
+static bool publishBatchURLRequest() {
+  char timestamp[12];
+  snprintf(timestamp, sizeof(timestamp), "%lu", millis() / 1000);
+  
+  JsonDocument& doc = newRequest();
+  doc["device_id"] = DEVICE_ID;
+  doc["session_id"] = currentSessionID;
+  doc["timestamp"] = timestamp;
+  JsonArray batch = doc.createNestedArray("batch");
+  
+  JsonObject current = batch.createNestedObject();
+  current["session_id"] = currentSessionID;
+  current["file_size"] = currentFileSize;
+  
+  char sessionID[MAX_FILENAME_LEN];
+  for (int i = batchIndex; i < batchCount; i++) {
+    sessionIDFromFilename(batchFiles[i], sessionID);
+    if (strcmp(sessionID, currentSessionID) == 0 || batchSizes[i] > PART_SIZE ||
+        hasCachedURL(sessionID)) {
+      continue;
     }
+    JsonObject entry = batch.createNestedObject();
+    entry["session_id"] = sessionID;   // char[]: el documento guarda una copia
+    entry["file_size"] = batchSizes[i];
   }
   
-  Serial.println("[MQTT] Falló después de 3 intentos");
-  lastError = "MQTT connection failed after 3 attempts";
-  return false;
+  size_t jsonSize = serializeJson(doc, jsonBuffer);
+  HOLTER_LOGI("[MQTT] Pidiendo %u URLs en un mensaje", (unsigned)batch.size());
+  return mqttClient.publish(TOPIC_REQUEST, (uint8_t*)jsonBuffer, jsonSize);
+}
+
+// Con la red libre y una grabación en curso, pide la URL del segmento que
+// se está escribiendo: al cerrarse se sube sin esperar respuesta de Lambda
+static void prefetchNextURL() {
+  if (!NET_PERSISTENT || !holter_isCapturing()) return;
+  
+  char filename[MAX_FILENAME_LEN];
+  holter_getCurrentFile(filename);
+  if (filename[0] == '\0') return;
+  
+  char sessionID[MAX_FILENAME_LEN];
+  sessionIDFromFilename(filename, sessionID);
+  if (hasCachedURL(sessionID)) return;
+  if (strcmp(sessionID, prefetchSessionID) == 0 &&
+      millis() - prefetchRequestedAt < PREFETCH_RETRY_MS) return;
+  
+  if (!holter_connectWiFi() || !connectMQTT()) return;   // Se reintenta en el próximo paso
+  
+  memcpy(prefetchSessionID, sessionID, sizeof(prefetchSessionID));
+  prefetchRequestedAt = millis();
+  HOLTER_LOGI("[MQTT] Pidiendo URL por adelantado para %s", sessionID);
+  publishURLRequest(sessionID, 0);
+}
+
+// Pide a Lambda cerrar el multipart upload con las partes ya subidas
+static bool requestCompleteMultipart() {
+  if (!connectMQTT()) return false;
+  
+  JsonDocument& doc = newRequest();
+  doc["device_id"] = DEVICE_ID;
+  doc["session_id"] = currentSessionID;
+  doc["action"] = "complete";
+  doc["upload_id"] = multipartUploadId;
+  doc["total_parts"] = totalParts;
+  
+  size_t jsonSize = serializeJson(doc, jsonBuffer);
+  return mqttClient.publish(TOPIC_REQUEST, (uint8_t*)jsonBuffer, jsonSize);
 }
 
 static void requestUploadURL() {
-  Serial.println("\n[UPLOAD] Solicitando URL de AWS...");
+  HOLTER_LOGI("\n[UPLOAD] Solicitando URL de AWS...");
+  reachedServer = true;
   
   unsigned long fileSize = 0;
   
   if (holter_isSDAvailable()) {
-    File file = SD.open(currentFilename.c_str(), FILE_READ);
+    File file = sdCard.open(currentFilename, FILE_READ);
     if (!file) {
-      Serial.println("[ERROR] No se pudo abrir archivo");
-      lastError = "Cannot open file";
+      HOLTER_LOGE("[ERROR] No se pudo abrir archivo");
+      setError("Cannot open file");
       currentState = UPLOAD_ERROR;
       return;
     }
@@ -162,165 +718,748 @@ static void requestUploadURL() {
     file.close();
   } else {
     fileSize = 1024; // Simulado
-    Serial.printf("[INFO] Tamaño simulado: %lu bytes\n", fileSize);
+    HOLTER_LOGI("[INFO] Tamaño simulado: %lu bytes", fileSize);
   }
   
-  // Extraer session ID del filename
-  int lastSlash = currentFilename.lastIndexOf('/');
-  int lastDot = currentFilename.lastIndexOf('.');
-  currentSessionID = currentFilename.substring(lastSlash + 1, lastDot);
+  sessionIDFromFilename(currentFilename, currentSessionID);
+  currentFileSize = fileSize;
+  multipart = fileSize > PART_SIZE;
   
-  DynamicJsonDocument doc(512);
-  doc["device_id"] = DEVICE_ID;
-  doc["session_id"] = currentSessionID;
-  doc["timestamp"] = String(millis() / 1000);
-  doc["file_size"] = fileSize;
-  doc["ready_for_upload"] = true;
-  
-  char jsonBuffer[512];
-  size_t jsonSize = serializeJson(doc, jsonBuffer);
+  if (multipart) {
+    totalParts = (fileSize + PART_SIZE - 1) / PART_SIZE;
+    for (int i = 0; i < URL_SLOTS; i++) {
+      partURLs[i][0] = '\0';
+      partURLNumber[i] = 0;
+    }
+    partRetries = 0;
+    multipartCompleted = false;
+    loadJournal();
+    HOLTER_LOGI("[S3] Multipart: %u partes de %lu KB", 
+                (unsigned)totalParts, PART_SIZE / 1024);
+    
+    uploadStartTime = millis();
+    currentState = UPLOAD_REQUESTING_URL;
+    if (nextPart <= totalParts) {
+      uint32_t count = min((uint32_t)URL_SLOTS, totalParts - nextPart + 1);
+      if (!requestPartURLs(nextPart, count)) {
+        setError("MQTT publish failed");
+        currentState = UPLOAD_ERROR;
+      }
+    }
+    return;
+  }
   
-  Serial.println("[MQTT] Publicando solicitud...");
-  Serial.println("[DEBUG] Topic: " + String(TOPIC_REQUEST));
-  Serial.println("[DEBUG] Payload: " + String(jsonBuffer));
+  if (takeCachedURL(currentSessionID, uploadURL)) {
+    HOLTER_LOGI("[UPLOAD] URL prefirmada en caché, subida inmediata");
+    urlReceived = true;
+    currentState = UPLOAD_UPLOADING_S3;
+    return;
+  }
   
+  HOLTER_LOGD("[MQTT] Publicando solicitud...");
   mqttClient.loop();
   
-  bool publishResult = mqttClient.publish(TOPIC_REQUEST, (uint8_t*)jsonBuffer, jsonSize);
-  
-  if (publishResult) {
-    Serial.println("[MQTT] Solicitud enviada");
-    Serial.println("[INFO] Esperando respuesta (60s timeout)...");
+  if (publishBatchURLRequest()) {
+    HOLTER_LOGD("[MQTT] Solicitud enviada, esperando respuesta (60s timeout)...");
     
     uploadStartTime = millis();
     urlReceived = false;
     currentState = UPLOAD_REQUESTING_URL;
   } else {
-    Serial.println("[ERROR] No se pudo publicar - Estado: " + String(mqttClient.state()));
-    lastError = "MQTT publish failed";
+    HOLTER_LOGE("[ERROR] No se pudo publicar - Estado: %d", mqttClient.state());
+    setError("MQTT publish failed");
     currentState = UPLOAD_ERROR;
   }
 }
 
-static bool uploadToS3() {
-  Serial.println("\n[S3] Iniciando upload...");
+// Separa https://host[:puerto]/ruta?query en host, puerto y ruta (que
+// apunta dentro de url)
+// @param host Buffer de HOST_MAX_LEN bytes
+static bool parseURL(const char* url, char* host, uint16_t& port, const char*& path) {
+  const char* schemeEnd = strstr(url, "://");
+  if (!schemeEnd) return false;
+  const char* hostStart = schemeEnd + 3;
+  path = strchr(hostStart, '/');
+  if (!path) return false;
   
-  File file = SD.open(currentFilename.c_str(), FILE_READ);
-  if (!file) {
-    Serial.println("[ERROR] No se pudo abrir archivo");
-    lastError = "Cannot open file for upload";
+  size_t hostLen = path - hostStart;
+  if (hostLen >= HOST_MAX_LEN) return false;
+  memcpy(host, hostStart, hostLen);
+  host[hostLen] = '\0';
+  port = 443;
+  char* colon = strchr(host, ':');
+  if (colon) {
+    port = (uint16_t)atoi(colon + 1);
+    *colon = '\0';
+  }
+  return host[0] != '\0';
+}
+
+static void transferClose(bool keepConnection) {
+  if (transferFile) transferFile.close();
+  transferPhase = TRANSFER_IDLE;
+  if (!keepConnection) {
+    s3Client.stop();
+    s3Host[0] = '\0';
+  }
+}
+
+// Abre el rango [offset, offset + length) del archivo actual y envía la
+// cabecera del PUT. Reutiliza la conexión si sigue abierta al mismo host
+static bool transferBegin(const char* url, unsigned long offset, unsigned long length) {
+  char host[HOST_MAX_LEN];
+  const char* path;
+  uint16_t port;
+  if (!parseURL(url, host, port, path)) {
+    setError("Invalid upload URL");
     return false;
   }
   
-  unsigned long fileSize = file.size();
-  Serial.println("[S3] Archivo: " + currentFilename);
-  Serial.println("[S3] Tamaño: " + String(fileSize / 1024) + " KB");
+  // La ruta firmada cabe siempre: la URL entera mide menos de URL_MAX_LEN
+  int headerLen = snprintf(requestHeader, sizeof(requestHeader),
+                           "PUT %s HTTP/1.1\r\n"
+                           "Host: %s\r\n"
+                           "Content-Type: application/octet-stream\r\n"
+                           "Content-Length: %lu\r\n"
+                           "Connection: keep-alive\r\n\r\n",
+                           path, host, length);
   
-  uint8_t* fileData = (uint8_t*)malloc(fileSize);
-  if (!fileData) {
-    Serial.println("[ERROR] No hay memoria suficiente");
-    file.close();
-    lastError = "Out of memory";
+  transferFile = sdCard.open(currentFilename, FILE_READ);
+  if (!transferFile || !transferFile.seek(offset)) {
+    HOLTER_LOGE("[ERROR] No se pudo abrir archivo");
+    setError("Cannot open file for upload");
+    transferClose(true);
     return false;
   }
   
-  Serial.println("[S3] Leyendo archivo...");
-  size_t bytesRead = file.read(fileData, fileSize);
-  file.close();
+  if (!s3Client.connected() || strcmp(host, s3Host) != 0) {
+    s3Client.stop();
+    HOLTER_LOGI("[S3] Conectando a %s...", host);
+    if (!s3Client.connect(host, port)) {
+      setError("S3 connect failed");
+      transferClose(false);
+      return false;
+    }
+    memcpy(s3Host, host, sizeof(s3Host));
+  }
+  
+  s3Client.write((const uint8_t*)requestHeader, headerLen);
   
-  if (bytesRead != fileSize) {
-    Serial.println("[ERROR] Lectura incompleta");
-    free(fileData);
-    lastError = "Incomplete file read";
-    return false;
+  transferLength = length;
+  transferSent = 0;
+  transferBufferLen = 0;
+  transferBufferPos = 0;
+  transferActivity = millis();
+  transferStart = transferActivity;
+  responseLineLen = 0;
+  responseCode = 0;
+  responseHeadersDone = false;
+  responseBodyLeft = -1;
+  responseKeepAlive = true;
+  responseETag[0] = '\0';
+  responseBody[0] = '\0';
+  responseBodyLen = 0;
+  transferPhase = TRANSFER_SENDING;
+  return true;
+}
+
+// Procesa "Nombre: valor" (modifica la línea)
+static void parseResponseHeader(char* line) {
+  char* colon = strchr(line, ':');
+  if (!colon || colon == line) return;
+  
+  *colon = '\0';
+  const char* name = line;
+  char* value = colon + 1;
+  while (*value == ' ' || *value == '\t') value++;
+  char* end = value + strlen(value);
+  while (end > value && (end[-1] == ' ' || end[-1] == '\t')) *--end = '\0';
+  
+  if (strcasecmp(name, "etag") == 0) {
+    copyText(responseETag, sizeof(responseETag), value);
+  } else if (strcasecmp(name, "content-length") == 0) {
+    responseBodyLeft = atol(value);
+  } else if (strcasecmp(name, "connection") == 0) {
+    responseKeepAlive = (strcasecmp(value, "close") != 0);
+  } else if (strcasecmp(name, "transfer-encoding") == 0) {
+    responseBodyLeft = -1;   // chunked: se descarta cerrando la conexión
+  }
+}
+
+// Lee lo disponible de la respuesta. @return true cuando está completa
+static bool readResponse() {
+  while (s3Client.available() > 0) {
+    int c = s3Client.read();
+    if (c < 0) break;
+    transferActivity = millis();
+    
+    if (responseHeadersDone) {
+      if (responseBodyLen < RESPONSE_BODY_LOG) {
+        responseBody[responseBodyLen++] = (char)c;
+        responseBody[responseBodyLen] = '\0';
+      }
+      if (responseBodyLeft > 0 && --responseBodyLeft == 0) return true;
+      continue;
+    }
+    
+    if (c != '\n') {
+      if (c != '\r' && responseLineLen < RESPONSE_LINE_MAX - 1) {
+        responseLine[responseLineLen++] = (char)c;
+      }
+      continue;
+    }
+    responseLine[responseLineLen] = '\0';
+    
+    if (responseCode == 0) {
+      // Línea de estado: HTTP/1.1 200 OK
+      const char* sp = strchr(responseLine, ' ');
+      responseCode = (sp && sp > responseLine) ? atoi(sp + 1) : TRANSFER_FAILED;
+    } else if (responseLineLen == 0) {
+      responseHeadersDone = true;
+      if (responseBodyLeft == 0) return true;
+    } else {
+      parseResponseHeader(responseLine);
+    }
+    responseLineLen = 0;
   }
   
-  Serial.println("[S3] Conectando a S3...");
-  HTTPClient http;
-  http.begin(uploadURL);
-  http.addHeader("Content-Type", "application/octet-stream");
-  http.addHeader("Content-Length", String(fileSize));
-  http.setTimeout(30000);
+  // Cuerpo de largo desconocido: termina cuando S3 cierra la conexión
+  if (responseHeadersDone && responseBodyLeft < 0 && !s3Client.connected()) {
+    responseKeepAlive = false;
+    return true;
+  }
+  return false;
+}
+
+// Un paso del PUT en curso
+// @return TRANSFER_RUNNING, el código HTTP final o TRANSFER_FAILED
+static int transferStep(unsigned long timeoutMs) {
+  if (transferPhase == TRANSFER_IDLE) return TRANSFER_FAILED;
+  
+  if (millis() - transferActivity > timeoutMs) {
+    setError("S3 upload timeout");
+    transferClose(false);
+    return TRANSFER_FAILED;
+  }
+  
+  if (transferPhase == TRANSFER_SENDING) {
+    if (!s3Client.connected()) {
+      setError("S3 connection lost");
+      transferClose(false);
+      return TRANSFER_FAILED;
+    }
+    
+    if (transferBufferPos == transferBufferLen) {
+      size_t want = min((unsigned long)TRANSFER_CHUNK, transferLength - transferSent);
+      transferBufferLen = transferFile.read(transferBuffer, want);
+      transferBufferPos = 0;
+      if (transferBufferLen == 0) {
+        setError("SD read failed during upload");
+        transferClose(false);
+        return TRANSFER_FAILED;
+      }
+    }
+    
+    size_t written = s3Client.write(transferBuffer + transferBufferPos,
+                                    transferBufferLen - transferBufferPos);
+    if (written > 0) {
+      transferBufferPos += written;
+      transferSent += written;
+      transferActivity = millis();
+    }
+    
+    if (transferSent >= transferLength) {
+      holter_recordUpload(transferSent, millis() - transferStart);
+      transferFile.close();
+      transferPhase = TRANSFER_RESPONSE;
+    }
+    return TRANSFER_RUNNING;
+  }
   
-  Serial.println("[S3] Enviando datos...");
-  int httpCode = http.PUT(fileData, fileSize);
+  if (!readResponse()) {
+    if (!s3Client.connected() && s3Client.available() == 0) {
+      setError("S3 connection lost");
+      transferClose(false);
+      return TRANSFER_FAILED;
+    }
+    return TRANSFER_RUNNING;
+  }
   
-  free(fileData);
+  int code = responseCode;
+  transferClose(responseKeepAlive && responseBodyLeft == 0);
+  return code;
+}
+
+static void startSinglePut() {
+  HOLTER_LOGI("\n[S3] Iniciando upload...");
+  HOLTER_LOGI("[S3] Archivo: %s", currentFilename);
+  HOLTER_LOGI("[S3] Tamaño: %lu KB", currentFileSize / 1024);
   
-  Serial.println("[S3] HTTP Code: " + String(httpCode));
+  if (!transferBegin(uploadURL, 0, currentFileSize)) {
+    currentState = UPLOAD_ERROR;
+  }
+}
+
+static void finishSinglePut(int httpCode) {
+  HOLTER_LOGI("[S3] HTTP Code: %d", httpCode);
   
   if (httpCode == 200 || httpCode == 204) {
-    Serial.println("[S3] Upload exitoso!");
-    http.end();
+    HOLTER_LOGI("[S3] Upload exitoso!");
+    if (holter_storageRetire(currentFilename)) {
+      HOLTER_LOGI("[SD] Archivo fuera de la cola (%s)", RETIRED_TEXT);
+    }
+    HOLTER_LOGI("\n========================================");
+    HOLTER_LOGI("UPLOAD COMPLETADO EXITOSAMENTE");
+    HOLTER_LOGI("========================================\n");
+    currentState = UPLOAD_COMPLETE;
+    return;
+  }
+  
+  if (httpCode > 0) {
+    HOLTER_LOGI("[S3] Response: %s", responseBody);
+    setError("S3 upload failed: %d", httpCode);
+  }
+  HOLTER_LOGE("[S3] Error: %s", lastError);
+  currentState = UPLOAD_ERROR;
+}
+
+static void startPart(uint32_t part) {
+  int slot = (part - 1) % URL_SLOTS;
+  unsigned long offset = (unsigned long)(part - 1) * PART_SIZE;
+  unsigned long length = min(PART_SIZE, currentFileSize - offset);
+  
+  HOLTER_LOGI("[S3] Parte %u/%u (%lu KB)...", 
+              (unsigned)part, (unsigned)totalParts, length / 1024);
+  
+  if (!transferBegin(partURLs[slot], offset, length) && ++partRetries >= MAX_PART_RETRIES) {
+    currentState = UPLOAD_ERROR;
+  }
+}
+
+static void finishPart(int httpCode) {
+  uint32_t part = nextPart;
+  
+  if (httpCode == 200) {
+    journalAppendPart(part, responseETag);
+    partURLs[(part - 1) % URL_SLOTS][0] = '\0';
+    HOLTER_LOGI("[S3] Parte confirmada, ETag: %s", responseETag);
     
-    if (SD.remove(currentFilename.c_str())) {
-      Serial.println("[SD] Archivo eliminado (espacio liberado)");
+    // Pedir por adelantado la URL de la parte URL_SLOTS posiciones más
+    // adelante, que llega por MQTT mientras se sube la intermedia
+    partRetries = 0;
+    uint32_t ahead = part + URL_SLOTS;
+    nextPart++;
+    if (ahead <= totalParts) {
+      requestPartURLs(ahead, 1);
     }
+    return;
+  }
+  
+  if (httpCode > 0) {
+    HOLTER_LOGE("[S3] Error HTTP en parte: %d", httpCode);
+    setError("S3 part upload failed: %d", httpCode);
+  }
+  
+  if (httpCode == 404) {
+    // NoSuchUpload: el multipart fue abortado o expiró, empezar de cero
+    discardJournal();
+    partRetries = MAX_PART_RETRIES;
+  }
+  if (++partRetries >= MAX_PART_RETRIES) {
+    currentState = UPLOAD_ERROR;
+  }
+}
+
+// Un paso del upload multipart: completa cuando no quedan partes, espera
+// la URL de la siguiente o arranca su PUT
+static void multipartStep() {
+  if (nextPart > totalParts) {
+    HOLTER_LOGI("[S3] Todas las partes subidas, completando multipart...");
+    lastError[0] = '\0';
+    if (requestCompleteMultipart()) {
+      uploadStartTime = millis();
+      multipartCompleted = false;
+      currentState = UPLOAD_COMPLETING_MULTIPART;
+    } else {
+      setError("MQTT publish failed");
+      currentState = UPLOAD_ERROR;
+    }
+    return;
+  }
+  
+  if (!partURLReady(nextPart)) {
+    uploadStartTime = millis();
+    currentState = UPLOAD_REQUESTING_URL;
+    return;
+  }
+  
+  startPart(nextPart);
+}
+
+static void beginUpload(const char* filename) {
+  copyText(currentFilename, sizeof(currentFilename), filename);
+  resultHandled = false;
+  reachedServer = false;
+  currentState = UPLOAD_CONNECTING_WIFI;
+  uploadStartTime = millis();
+  currentFileSize = 0;
+  multipart = false;
+  mqttFailures = 0;
+  urlReceived = false;
+  lambdaFailed = false;
+  lastError[0] = '\0';
+  uploadURL[0] = '\0';
+  
+  HOLTER_LOGI("[Upload] Iniciando proceso de upload para: %s", currentFilename);
+}
+
+static FileAttempts* findAttempts(const char* name, bool create) {
+  FileAttempts* oldest = &fileAttempts[0];
+  for (int i = 0; i < ATTEMPT_SLOTS; i++) {
+    if (strcmp(fileAttempts[i].name, name) == 0) return &fileAttempts[i];
+    if (fileAttempts[i].failures < oldest->failures) oldest = &fileAttempts[i];
+  }
+  if (!create) return nullptr;
+  
+  strncpy(oldest->name, name, MAX_FILENAME_LEN);
+  oldest->name[MAX_FILENAME_LEN - 1] = '\0';
+  oldest->failures = 0;
+  return oldest;
+}
+
+// Archivos que agotaron sus intentos quedan en la SD hasta el próximo arranque
+static bool retriesExhausted(const char* name) {
+  FileAttempts* attempts = findAttempts(name, false);
+  return attempts && attempts->failures >= MAX_FILE_ATTEMPTS;
+}
+
+// Relee la SD y arma el lote con los segmentos pendientes más antiguos.
+// Los nombres session_<ts>_<seq> (ancho fijo) ordenan cronológicamente como texto.
+// El segmento en grabación se vuelve a consultar por cada entrada: la
+// captura publica el nombre antes de crear el archivo, así que uno recién
+// rotado durante el recorrido nunca se toma por cerrado
+static void scanBacklog() {
+  backlogDirty = false;
+  batchCount = 0;
+  batchIndex = 0;
+  
+  File root = sdCard.open("/");
+  if (!root) return;
+  
+  char recording[MAX_FILENAME_LEN];
+  int pending = 0;
+  
+  File entry = root.openNextFile();
+  while (entry) {
+    char name[MAX_FILENAME_LEN];
+    bool fits = copyText(name, sizeof(name), entry.path());   // path() muere con close()
+    unsigned long size = entry.size();
+    bool isDir = entry.isDirectory();
+    entry.close();
+    entry = root.openNextFile();
+    holter_getCurrentFile(recording);
     
-    return true;
-  } else {
-    Serial.println("[S3] Error HTTP: " + String(httpCode));
-    String response = http.getString();
-    Serial.println("[S3] Response: " + response);
-    http.end();
-    lastError = "S3 upload failed: " + String(httpCode);
-    return false;
+    if (isDir || !fits || strncmp(name, SEGMENT_PREFIX, strlen(SEGMENT_PREFIX)) != 0 ||
+        !endsWith(name, SEGMENT_EXT) || strcmp(name, recording) == 0 ||
+        retriesExhausted(name)) {
+      continue;
+    }
+    pending++;
+    
+    // Inserción ordenada, quedan solo los UPLOAD_BATCH más antiguos
+    int pos = batchCount;
+    while (pos > 0 && strcmp(name, batchFiles[pos - 1]) < 0) pos--;
+    if (pos >= UPLOAD_BATCH) continue;
+    
+    int last = (batchCount < UPLOAD_BATCH) ? batchCount++ : UPLOAD_BATCH - 1;
+    for (int i = last; i > pos; i--) {
+      memcpy(batchFiles[i], batchFiles[i - 1], MAX_FILENAME_LEN);
+      batchSizes[i] = batchSizes[i - 1];
+    }
+    memcpy(batchFiles[pos], name, MAX_FILENAME_LEN);
+    batchSizes[pos] = size;
+  }
+  root.close();
+  
+  pendingCount = pending;
+  if (pending > 0) {
+    HOLTER_LOGI("[Upload] %d segmentos pendientes en SD, lote de %d", pending, batchCount);
   }
 }
 
+// Registra el resultado del último upload: éxito reinicia el backoff; un
+// fallo lo duplica (5 s .. HOLTER_UPLOAD_BACKOFF_MAX_SEC). Solo los fallos
+// con la red disponible cuentan como intento del archivo: un corte largo
+// de WiFi no agota los intentos
+static void handleUploadResult() {
+  if (resultHandled) return;
+  resultHandled = true;
+  
+  if (currentState == UPLOAD_COMPLETE) {
+    backoffMs = 0;
+    if (pendingCount > 0) pendingCount--;
+    return;
+  }
+  if (currentState != UPLOAD_ERROR) return;
+  
+  if (reachedServer) {
+    FileAttempts* attempts = findAttempts(currentFilename, true);
+    attempts->failures++;
+    if (attempts->failures >= MAX_FILE_ATTEMPTS) {
+      HOLTER_LOGW("[WARNING] %s falló %d veces, queda en SD hasta el próximo arranque",
+                  currentFilename, attempts->failures);
+      if (pendingCount > 0) pendingCount--;
+    }
+  }
+  
+  backoffMs = backoffMs ? min(backoffMs * 2, BACKOFF_MAX_MS) : BACKOFF_MIN_MS;
+  retryAt = millis() + backoffMs;
+  backlogDirty = true;   // El archivo sigue en la SD: vuelve a ser el más antiguo
+  HOLTER_LOGI("[Upload] Reintento en %lus", backoffMs / 1000);
+}
+
+// Siguiente archivo de la cola, del más antiguo al más nuevo
+static bool nextQueuedFile(char* name) {
+  if (backoffMs > 0 && (long)(millis() - retryAt) < 0) return false;
+  
+  if (batchIndex >= batchCount || backlogDirty) {
+    if (!holter_isSDAvailable()) return false;
+    scanBacklog();
+  }
+  if (batchIndex >= batchCount) return false;
+  
+  memcpy(name, batchFiles[batchIndex++], MAX_FILENAME_LEN);
+  if (batchIndex >= batchCount) backlogDirty = true;   // Fin del lote: releer
+  return true;
+}
+
+// Publica las muestras en vivo acumuladas, un frame cada LIVE_FRAME_MS
+static void liveStreamStep() {
+  if (!liveEnabled || !holter_isCapturing()) return;
+  if (millis() - lastLiveFrame < LIVE_FRAME_MS) return;
+  if (!holter_connectWiFi() || !connectMQTT()) return;   // Se reintenta en el próximo paso
+  lastLiveFrame = millis();
+  
+  SampleCalibration calibration;
+  holter_getCalibration(calibration);
+  
+  for (int frame = 0; frame < LIVE_MAX_FRAMES_PER_STEP; frame++) {
+    uint32_t firstIndex = 0;
+    size_t count = holter_readLiveSamples(liveSamples, LIVE_FRAME_SAMPLES, &firstIndex);
+    if (count == 0) break;
+    
+    LiveFrameHeader* header = (LiveFrameHeader*)liveMessage;
+    header->version = LIVE_FRAME_VERSION;
+    header->sample_format = calibration.sample_format;
+    header->ecg_sample_rate = HOLTER_ECG_SAMPLE_RATE_HZ;
+    header->session_id = holter_getSessionTimestamp();
+    header->first_sample_index = firstIndex;
+    header->adc_coeff_a = calibration.adc_coeff_a;
+    header->adc_coeff_b = calibration.adc_coeff_b;
+    header->ecg_gain = calibration.ecg_gain;
+    header->ecg_offset_mv = calibration.ecg_offset_mv;
+    header->ecg_filter = calibration.ecg_filter;
+    
+    size_t bytes = ecg_codec_encodeFrame((const int16_t*)liveSamples, count,
+                                         liveMessage + sizeof(LiveFrameHeader));
+    if (!mqttClient.publish(TOPIC_LIVE, liveMessage, sizeof(LiveFrameHeader) + bytes)) {
+      HOLTER_LOGI("[LIVE] No se pudo publicar frame");
+      break;
+    }
+    
+    if (++liveFramesSent % 240 == 0) {
+      HOLTER_LOGI("[LIVE] %lu frames enviados (%u bytes el último)",
+                  liveFramesSent, (unsigned)(sizeof(LiveFrameHeader) + bytes));
+    }
+    if (count < LIVE_FRAME_SAMPLES) break;
+  }
+}
+
+// Publica las estadísticas de la captura cada HOLTER_STATS_PERIOD_SEC si
+// la sesión MQTT ya está abierta: no enciende la radio solo para esto
+static void statsStep() {
+  if (STATS_PERIOD_MS == 0 || !holter_isCapturing() || !mqttClient.connected()) return;
+  if (millis() - lastStatsPublish < STATS_PERIOD_MS) return;
+  lastStatsPublish = millis();
+  
+  HolterStats stats;
+  holter_getStats(stats);
+  const CaptureStats& c = stats.capture;
+  
+  JsonDocument& doc = newRequest();
+  doc["device_id"] = DEVICE_ID;
+  doc["session_id"] = holter_getSessionTimestamp();
+  doc["segment_seq"] = holter_getSegmentSeq();
+  doc["elapsed_ms"] = c.elapsed_ms;
+  doc["samples_produced"] = c.samples_produced;
+  doc["samples_expected"] = c.samples_expected;
+  doc["samples_dropped"] = c.samples_dropped;
+  doc["imu_dropped"] = c.imu_dropped;
+  doc["peaks_dropped"] = c.peaks_dropped;
+  doc["interval_max_dev_us"] = c.interval_max_dev_us;
+  JsonArray intervalHist = doc.createNestedArray("interval_hist");
+  JsonArray sdHist = doc.createNestedArray("sd_flush_hist");
+  for (size_t i = 0; i < STATS_HIST_BINS; i++) {
+    intervalHist.add(c.interval_hist[i]);
+    sdHist.add(c.sd_flush_hist[i]);
+  }
+  doc["sd_flushes"] = c.sd_flushes;
+  doc["sd_flush_total_ms"] = c.sd_flush_total_ms;
+  doc["sd_flush_max_us"] = c.sd_flush_max_us;
+  StorageInfo storage;
+  holter_getStorageInfo(storage);
+  doc["sd_clock_khz"] = storage.clock_khz;
+  doc["sd_write_kbps"] = storage.write_kbps;
+  doc["sd_free_mb"] = (uint32_t)(holter_storageFreeBytes() / (1024 * 1024));
+  doc["sd_uploaded_files"] = storage.uploaded_files;
+  doc["block_wait_max_ms"] = c.block_wait_max_ms;
+  doc["imu_ring_max"] = c.imu_ring_max;
+  doc["rpeak_ring_max"] = c.rpeak_ring_max;
+  doc["live_ring_max"] = c.live_ring_max;
+  doc["acquisition_stack_free"] = c.acquisition_stack_free;
+  doc["storage_stack_free"] = c.storage_stack_free;
+  doc["imu_stack_free"] = c.imu_stack_free;
+  doc["upload_bytes"] = stats.upload_bytes;
+  doc["upload_bytes_per_s"] = stats.upload_bytes_per_s;
+  doc["free_heap"] = ESP.getFreeHeap();
+  
+  size_t jsonSize = serializeJson(doc, jsonBuffer);
+  if (!mqttClient.publish(TOPIC_STATS, (uint8_t*)jsonBuffer, jsonSize)) {
+    HOLTER_LOGI("[MQTT] No se pudieron publicar las estadísticas");
+  }
+}
+
+// Tarea de red (core 0): toma archivos de la cola y ejecuta la máquina de
+// estados. El TLS y el PUT bloquean solo a esta tarea, nunca a la captura.
+static void networkTaskFn(void* arg) {
+  char nextFile[MAX_FILENAME_LEN];
+  
+  for (;;) {
+    if (!holter_isUploadActive()) {
+      handleUploadResult();
+      
+      if (nextQueuedFile(nextFile)) {
+        beginUpload(nextFile);
+      } else if ((NET_PERSISTENT || liveEnabled) && holter_isCapturing()) {
+        prefetchNextURL();        // Cola vacía: mantener sesión para el próximo segmento
+      } else if (wifiStarted) {
+        holter_disconnectWiFi();  // Cola vacía y sin grabación: apagar radio
+      }
+      
+      if (!holter_isUploadActive()) {
+        // Sin trabajo: esperar un aviso de holter_startUpload(), el próximo
+        // reintento o el próximo frame en vivo
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(liveEnabled ? LIVE_FRAME_MS : 500));
+      }
+    }
+    
+    liveStreamStep();
+    statsStep();
+    holter_uploadLoop();
+    // Durante el PUT se cede el core solo un tick entre bloques de 4 KB
+    vTaskDelay(transferPhase == TRANSFER_IDLE ? pdMS_TO_TICKS(10) : 1);
+  }
+}
+
+// Borra journals multipart cuyo archivo ya no existe. Los que tienen
+// archivo se retoman solos: el segmento sigue en la cola de la SD
+static void removeStaleJournals() {
+  if (!holter_isSDAvailable()) return;
+  
+  File root = sdCard.open("/");
+  if (!root) return;
+  
+  size_t extLen = strlen(JOURNAL_EXT);
+  File entry = root.openNextFile();
+  while (entry) {
+    char name[JOURNAL_PATH_LEN];
+    bool fits = copyText(name, sizeof(name), entry.path());
+    entry.close();
+    if (fits && endsWith(name, JOURNAL_EXT)) {
+      char dataFile[JOURNAL_PATH_LEN];
+      memcpy(dataFile, name, sizeof(dataFile));
+      dataFile[strlen(name) - extLen] = '\0';
+      if (sdCard.exists(dataFile)) {
+        HOLTER_LOGI("[Upload] Upload interrumpido, se retomará: %s", dataFile);
+      } else {
+        sdCard.remove(name);
+      }
+    }
+    entry = root.openNextFile();
+  }
+  root.close();
+}
+
 // ============================================================================
 // IMPLEMENTACIÓN DE INTERFACE PÚBLICA
 // ============================================================================
 
 void holter_initUpload() {
+  loadAccessPoint();
   wifiClient.setCACert(AWS_CERT_CA);
   wifiClient.setCertificate(AWS_CERT_CRT);
   wifiClient.setPrivateKey(AWS_CERT_PRIVATE);
+  s3Client.setInsecure();
+  WiFi.onEvent(onWiFiEvent);
+  
+  removeStaleJournals();
+  backlogDirty = true;   // Segmentos de grabaciones anteriores
+  holter_setLiveTap(liveEnabled);
   
-  Serial.println("[Upload] Módulo inicializado");
+  xTaskCreatePinnedToCore(networkTaskFn, "net_upload", NETWORK_STACK, nullptr,
+                          NETWORK_PRIORITY, &networkTask, NETWORK_CORE);
+  
+  if (!networkTask) {
+    HOLTER_LOGE("[ERROR] No se pudo crear la tarea de red");
+  }
+  
+  HOLTER_LOGI("[Upload] Módulo inicializado");
 }
 
 bool holter_connectWiFi() {
-  Serial.println("\n[WiFi] Conectando a: " + String(WIFI_SSID));
-  WiFi.mode(WIFI_STA);
-  WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
-  
-  int attempts = 0;
-  while (WiFi.status() != WL_CONNECTED && attempts < 20) {
-    delay(500);
-    Serial.print(".");
-    attempts++;
+  if (!wifiUp) {
+    startWiFi();
+    if (fastConnecting && millis() - wifiStartedAt > FAST_CONNECT_TIMEOUT_MS) {
+      fallbackToScan();
+    }
+    return false;
   }
   
-  bool connected = (WiFi.status() == WL_CONNECTED);
-  if (connected) {
-    Serial.println("\n[WiFi] Conectado");
-    Serial.println("[WiFi] IP: " + WiFi.localIP().toString());
-    Serial.println("[WiFi] RSSI: " + String(WiFi.RSSI()) + " dBm");
-    syncTime();
-  } else {
-    Serial.println("\n[WiFi] ERROR: No se pudo conectar");
-    lastError = "WiFi connection failed";
+  if (!wifiReported) {
+    HOLTER_LOGI("[WiFi] Conectado en %lu ms%s", millis() - wifiStartedAt,
+                fastConnecting ? " (fast connect)" : "");
+    IPAddress ip = WiFi.localIP();
+    HOLTER_LOGI("[WiFi] IP: %u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+    HOLTER_LOGI("[WiFi] RSSI: %d dBm", (int)WiFi.RSSI());
+    fastConnecting = false;
+    saveAccessPoint();
+    wifiReported = true;
   }
-  
-  return connected;
+  syncTime();
+  return true;
 }
 
 void holter_disconnectWiFi() {
+  transferClose(false);
+  mqttClient.disconnect();
+  wifiStarted = false;
+  wifiUp = false;
+  wifiReported = false;
   WiFi.disconnect(true);
   WiFi.mode(WIFI_OFF);
-  Serial.println("[WiFi] Desconectado (ahorro energía)");
+  HOLTER_LOGI("[WiFi] Desconectado (ahorro energía)");
 }
 
-bool holter_startUpload(String filename) {
-  currentFilename = filename;
-  currentState = UPLOAD_CONNECTING_WIFI;
-  uploadStartTime = millis();
-  urlReceived = false;
-  lastError = "";
-  uploadURL = "";
+bool holter_startUpload(const char* filename) {
+  if (!networkTask || strlen(filename) >= MAX_FILENAME_LEN) {
+    return false;
+  }
   
-  Serial.println("[Upload] Iniciando proceso de upload para: " + filename);
+  // El archivo ya está en la SD, que es la cola: basta con releerla
+  backlogDirty = true;
+  xTaskNotifyGive(networkTask);
+  
+  HOLTER_LOGI("[Upload] En cola: %s", filename);
   return true;
 }
 
@@ -333,7 +1472,9 @@ void holter_uploadLoop() {
     case UPLOAD_CONNECTING_WIFI:
       if (holter_connectWiFi()) {
         currentState = UPLOAD_CONNECTING_MQTT;
-      } else {
+      } else if (millis() - uploadStartTime > WIFI_CONNECT_TIMEOUT_MS) {
+        HOLTER_LOGE("\n[WiFi] ERROR: No se pudo conectar");
+        setError("WiFi connection failed");
         currentState = UPLOAD_ERROR;
       }
       break;
@@ -342,7 +1483,9 @@ void holter_uploadLoop() {
       if (connectMQTT()) {
         requestUploadURL();
         // requestUploadURL cambia el estado
-      } else {
+      } else if (!wifiUp || mqttFailures >= MQTT_MAX_ATTEMPTS) {
+        HOLTER_LOGE("[MQTT] Falló después de %d intentos", mqttFailures);
+        setError("MQTT connection failed after %d attempts", mqttFailures);
         currentState = UPLOAD_ERROR;
       }
       break;
@@ -350,29 +1493,59 @@ void holter_uploadLoop() {
     case UPLOAD_REQUESTING_URL:
       mqttClient.loop();
       
-      if (urlReceived) {
+      if (lambdaFailed) {
+        currentState = UPLOAD_ERROR;   // lastError conserva el mensaje de Lambda
+      } else if (multipart ? partURLReady(nextPart) || nextPart > totalParts : urlReceived) {
         currentState = UPLOAD_UPLOADING_S3;
       } else if (millis() - uploadStartTime > UPLOAD_TIMEOUT_MS) {
-        Serial.println("[ERROR] Timeout esperando URL");
-        lastError = "Timeout waiting for upload URL";
+        HOLTER_LOGE("[ERROR] Timeout esperando URL");
+        setError("Timeout waiting for upload URL");
         currentState = UPLOAD_ERROR;
       }
       
       // Log cada 5 segundos
       static unsigned long lastLog = 0;
       if (millis() - lastLog > 5000) {
-        Serial.printf("[WAIT] Esperando URL... (%lus)\n", (millis() - uploadStartTime) / 1000);
+        HOLTER_LOGI("[WAIT] Esperando URL... (%lus)", (millis() - uploadStartTime) / 1000);
         lastLog = millis();
       }
       break;
       
     case UPLOAD_UPLOADING_S3:
-      if (uploadToS3()) {
-        Serial.println("\n========================================");
-        Serial.println("UPLOAD COMPLETADO EXITOSAMENTE");
-        Serial.println("========================================\n");
-        currentState = UPLOAD_COMPLETE;
+      if (transferPhase == TRANSFER_IDLE) {
+        if (multipart) {
+          multipartStep();
+        } else {
+          startSinglePut();
+        }
       } else {
+        int result = transferStep(multipart ? PART_TIMEOUT_MS : UPLOAD_TIMEOUT_MS);
+        if (result == TRANSFER_RUNNING) break;
+        if (multipart) {
+          finishPart(result);
+        } else {
+          finishSinglePut(result);
+        }
+      }
+      break;
+      
+    case UPLOAD_COMPLETING_MULTIPART:
+      mqttClient.loop();
+      
+      if (multipartCompleted) {
+        sdCard.remove(journalPath());
+        if (holter_storageRetire(currentFilename)) {
+          HOLTER_LOGI("[SD] Archivo fuera de la cola (%s)", RETIRED_TEXT);
+        }
+        HOLTER_LOGI("\n========================================");
+        HOLTER_LOGI("UPLOAD MULTIPART COMPLETADO");
+        HOLTER_LOGI("========================================\n");
+        currentState = UPLOAD_COMPLETE;
+      } else if (lastError[0] != '\0' || millis() - uploadStartTime > UPLOAD_TIMEOUT_MS) {
+        if (lastError[0] == '\0') {
+          setError("Timeout completing multipart upload");
+        }
+        HOLTER_LOGE("[ERROR] %s", lastError);
         currentState = UPLOAD_ERROR;
       }
       break;
@@ -389,27 +1562,47 @@ void holter_uploadLoop() {
 }
 
 void holter_cancelUpload() {
+  transferClose(false);
   currentState = UPLOAD_IDLE;
   holter_disconnectWiFi();
-  Serial.println("[Upload] Cancelado");
+  HOLTER_LOGI("[Upload] Cancelado");
 }
 
-bool holter_isUploading() {
+bool holter_isUploadActive() {
   return (currentState != UPLOAD_IDLE && 
           currentState != UPLOAD_COMPLETE && 
           currentState != UPLOAD_ERROR);
 }
 
+bool holter_isUploading() {
+  return holter_isUploadActive() || backlogDirty || pendingCount > 0;
+}
+
+int holter_getPendingUploads() {
+  return pendingCount;
+}
+
 float holter_getUploadProgress() {
+  if (currentState == UPLOAD_COMPLETE) return 1.0;
+  if (currentFileSize == 0) return 0.0;
+  return (float)holter_getUploadedBytes() / (float)currentFileSize;
+}
+
+unsigned long holter_getUploadedBytes() {
   switch(currentState) {
-    case UPLOAD_IDLE: return 0.0;
-    case UPLOAD_CONNECTING_WIFI: return 0.1;
-    case UPLOAD_CONNECTING_MQTT: return 0.3;
-    case UPLOAD_REQUESTING_URL: return 0.5;
-    case UPLOAD_UPLOADING_S3: return 0.8;
-    case UPLOAD_COMPLETE: return 1.0;
-    case UPLOAD_ERROR: return 0.0;
-    default: return 0.0;
+    case UPLOAD_REQUESTING_URL:
+    case UPLOAD_UPLOADING_S3:
+    case UPLOAD_COMPLETING_MULTIPART: {
+      unsigned long bytes = (transferPhase != TRANSFER_IDLE) ? transferSent : 0;
+      if (multipart) {
+        bytes += (unsigned long)(nextPart - 1) * PART_SIZE;
+      }
+      return min(bytes, currentFileSize);
+    }
+    case UPLOAD_COMPLETE:
+      return currentFileSize;
+    default:
+      return 0;
   }
 }
 
@@ -417,19 +1610,36 @@ UploadState holter_getUploadState() {
   return currentState;
 }
 
-String holter_getUploadStateString() {
+const char* holter_getUploadStateString() {
   switch(currentState) {
     case UPLOAD_IDLE: return "Idle";
     case UPLOAD_CONNECTING_WIFI: return "Conectando WiFi...";
     case UPLOAD_CONNECTING_MQTT: return "Conectando AWS...";
     case UPLOAD_REQUESTING_URL: return "Solicitando URL...";
     case UPLOAD_UPLOADING_S3: return "Subiendo a S3...";
+    case UPLOAD_COMPLETING_MULTIPART: return "Completando multipart...";
     case UPLOAD_COMPLETE: return "Completado";
-    case UPLOAD_ERROR: return "Error: " + lastError;
+    case UPLOAD_ERROR:
+      snprintf(stateString, sizeof(stateString), "Error: %s", lastError);
+      return stateString;
     default: return "Unknown";
   }
 }
 
+void holter_setLiveStream(bool enabled) {
+  holter_setLiveTap(enabled);
+  liveEnabled = enabled;
+  HOLTER_LOGI("[LIVE] Streaming en vivo %s (%s, %lu ms por frame)",
+              enabled ? "activado" : "desactivado", TOPIC_LIVE, LIVE_FRAME_MS);
+  if (enabled && networkTask) {
+    xTaskNotifyGive(networkTask);
+  }
+}
+
+bool holter_isLiveStreaming() {
+  return liveEnabled;
+}
+
 bool holter_isWiFiConnected() {
   return (WiFi.status() == WL_CONNECTED);
 }
@@ -438,6 +1648,6 @@ bool holter_isMQTTConnected() {
   return mqttClient.connected();
 }
 
-String holter_getLastError() {
+const char* holter_getLastError() {
   return lastError;
 }
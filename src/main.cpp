@@ -1,85 +1,150 @@
 #include <Arduino.h>
 #include <XSpaceBioV10.h>
-#include <XSpaceV21.h>
 #include "holter_capture.h"
+#include "holter_clock.h"
 #include "holter_upload.h"
+#include "holter_config.h"
+#include "holter_log.h"
+#include "display_ui.h"
 
 // ============================================================================
 // OBJETOS PRINCIPALES
 // ============================================================================
 XSpaceBioV10Board MyBioBoard;
-XSpaceV21Board XSBoard; // Mantener por compatibilidad, pero no se usa
 
 // ============================================================================
 // ESTADOS DEL SISTEMA
 // ============================================================================
 enum SystemState {
   STATE_INIT,              // Inicialización
-  STATE_CAPTURING,         // Capturando datos ECG
-  STATE_UPLOADING,         // Subiendo a AWS S3
-  STATE_COMPLETE,          // Completado exitosamente
+  STATE_CAPTURING,         // Grabando segmentos (el upload corre en paralelo)
+  STATE_COMPLETE,          // Grabación terminada, subiendo segmentos restantes
   STATE_ERROR              // Error en el sistema
 };
 
 SystemState currentState = STATE_INIT;
-String currentFilename = "";
+char currentFilename[HOLTER_MAX_FILENAME_LEN] = "";
 unsigned long stateStartTime = 0;
+UploadState lastUploadState = UPLOAD_IDLE;
+
+// ============================================================================
+// FUNCIONES AUXILIARES
+// ============================================================================
+
+// Encola para upload todos los segmentos que la captura ya cerró
+static void queueCompletedSegments() {
+  char segment[HOLTER_MAX_FILENAME_LEN];
+  while (holter_getCompletedSegment(segment)) {
+    HOLTER_LOGI("[UPLOAD] Encolando segmento: %s", segment);
+    if (!holter_startUpload(segment)) {
+      HOLTER_LOGW("[WARNING] No se pudo encolar upload, el archivo queda en SD");
+    }
+  }
+}
+
+// Reporta las transiciones del upload que corre en la tarea de red
+static void monitorUpload() {
+  UploadState uploadState = holter_getUploadState();
+  
+  if (uploadState != lastUploadState) {
+    if (uploadState == UPLOAD_COMPLETE) {
+      HOLTER_LOGI("\n[UPLOAD] ¡Upload completado exitosamente!");
+    } else if (uploadState == UPLOAD_ERROR) {
+      HOLTER_LOGI("\n[UPLOAD] Error en upload");
+      const char* error = holter_getLastError();
+      if (error[0] != '\0') {
+        HOLTER_LOGE("[ERROR] %s", error);
+      }
+    }
+    lastUploadState = uploadState;
+  }
+  
+  // Mostrar estado periódicamente
+  static unsigned long lastStatusLog = 0;
+  if (holter_isUploading() && millis() - lastStatusLog > 5000) {
+    const char* status = holter_getUploadStateString();
+    float progress = holter_getUploadProgress();
+    HOLTER_LOGI("[STATUS] %s (%.0f%%, %lu KB) | En cola: %d", 
+                status, progress * 100, holter_getUploadedBytes() / 1024,
+                holter_getPendingUploads());
+    lastStatusLog = millis();
+  }
+}
 
 // ============================================================================
 // SETUP
 // ============================================================================
 void setup() {
   Serial.begin(115200);
+#if !HOLTER_FAST_BOOT
   delay(2000); // Delay más largo para estabilizar Serial
+#endif
+  holter_logInit();
  
-  Serial.println("\n\n========================================");
-  Serial.println("HOLTER ECG SYSTEM v2.0");
-  Serial.println("========================================");
-  Serial.println("[INFO] ESP32 Holter Monitoring System");
-  Serial.println("[INFO] ECG 3-lead @ 250Hz");
-  Serial.println("[INFO] Auto-capture y auto-upload a AWS");
-  Serial.println("========================================\n");
+  HOLTER_LOGI("\n\n========================================");
+  HOLTER_LOGI("HOLTER ECG SYSTEM v2.0");
+  HOLTER_LOGI("========================================");
+  HOLTER_LOGI("[INFO] ESP32 Holter Monitoring System");
+  HOLTER_LOGI("[INFO] ECG 3-lead @ %dHz", HOLTER_ECG_SAMPLE_RATE_HZ);
+  HOLTER_LOGI("[INFO] Auto-capture y auto-upload a AWS");
+  HOLTER_LOGI("[INFO] Captura en core 1, SD y red en core 0");
+  HOLTER_LOGI("========================================\n");
   
   // Inicializar módulos
-  Serial.println("[SETUP] Inicializando módulos...");
+  HOLTER_LOGI("[SETUP] Inicializando módulos...");
+  
+  // Reloj (RTC/NVS) antes que la captura, que lo usa para el ID de sesión
+  holter_clockInit();
   
   // Primero inicializar captura (SD Card)
-  holter_init(&MyBioBoard, nullptr); // nullptr porque IMU no se usa
+  holter_init(&MyBioBoard);
   
   // Luego inicializar upload (WiFi/MQTT)
   holter_initUpload();
   
-  Serial.println("[SETUP] Sistema inicializado\n");
+  // OLED y botón: el display corre en su propia tarea de baja prioridad
+  // (comparte el bus I2C con el IMU, que todavía no muestrea)
+  display_init(&MyBioBoard);
+  
+  HOLTER_LOGI("[SETUP] Sistema inicializado\n");
   
   // Verificar si SD está disponible
   if (!holter_isSDAvailable()) {
-    Serial.println("[ERROR] SD Card no disponible");
-    Serial.println("[ERROR] El sistema requiere SD Card para funcionar");
-    Serial.println("[INFO] Por favor:");
-    Serial.println("  1. Verifica que la tarjeta SD esté insertada");
-    Serial.println("  2. Verifica que esté formateada en FAT32");
-    Serial.println("  3. Verifica las conexiones SPI");
-    Serial.println("  4. Presiona RESET para reintentar");
+    HOLTER_LOGE("[ERROR] SD Card no disponible");
+    HOLTER_LOGE("[ERROR] El sistema requiere SD Card para funcionar");
+    HOLTER_LOGI("[INFO] Por favor:");
+    HOLTER_LOGI("  1. Verifica que la tarjeta SD esté insertada");
+    HOLTER_LOGI("  2. Verifica que esté formateada en FAT32");
+    HOLTER_LOGI("  3. Verifica las conexiones SPI");
+    HOLTER_LOGI("  4. Presiona RESET para reintentar");
     currentState = STATE_ERROR;
     stateStartTime = millis();
     return;
   }
   
+#if !HOLTER_FAST_BOOT
   // Pequeño delay antes de iniciar captura
-  Serial.println("[INFO] Iniciando captura en 3 segundos...");
+  HOLTER_LOGI("[INFO] Iniciando captura en 3 segundos...");
   delay(3000);
+#endif
   
   // Iniciar captura automáticamente
-  Serial.println("[SYSTEM] Iniciando captura automática...\n");
+  HOLTER_LOGI("[SYSTEM] Iniciando captura automática...\n");
   
   if (holter_startCapture()) {
-    currentFilename = holter_getCurrentFile();
-    Serial.println("[OK] Captura iniciada exitosamente");
-    Serial.println("[INFO] Archivo: " + currentFilename + "\n");
+    holter_getCurrentFile(currentFilename);
+    HOLTER_LOGI("[OK] Grabación iniciada exitosamente (%lu ms desde el arranque)", millis());
+#if HOLTER_EVENT_MODE
+    HOLTER_LOGI("[INFO] Modo eventos: se graba en SD solo al dispararse un evento\n");
+    display_setText("Modo eventos");
+#else
+    HOLTER_LOGI("[INFO] Archivo: %s\n", currentFilename);
+    display_setText("Grabando");
+#endif
     currentState = STATE_CAPTURING;
   } else {
-    Serial.println("[ERROR] No se pudo iniciar captura");
-    Serial.println("[ERROR] Revisa los mensajes anteriores para más detalles");
+    HOLTER_LOGE("[ERROR] No se pudo iniciar captura");
+    HOLTER_LOGE("[ERROR] Revisa los mensajes anteriores para más detalles");
     currentState = STATE_ERROR;
   }
   
@@ -96,98 +161,44 @@ void loop() {
     // ESTADO: CAPTURING
     // ========================================================================
     case STATE_CAPTURING: {
-      // Ejecutar loop de captura
-      holter_captureLoop();
+      // La captura rota los segmentos en sus propias tareas; aquí solo se
+      // entregan los segmentos cerrados a la tarea de red
+      queueCompletedSegments();
       
-      // Verificar si terminó
-      if (!holter_isCapturing()) {
-        Serial.println("\n[CAPTURE] ¡Captura completada!");
-        
-        // Asegurar cierre
-        holter_stopCapture();
-        
-        // Verificar que el archivo existe y tiene datos
-        if (currentFilename.length() == 0) {
-          Serial.println("[ERROR] No hay archivo para subir");
-          currentState = STATE_ERROR;
-          break;
-        }
-        
-        Serial.println("[SYSTEM] Preparando para upload...\n");
-        delay(1000);
-        
-        // Iniciar upload
-        Serial.println("[UPLOAD] Iniciando proceso de upload...");
-        if (holter_startUpload(currentFilename)) {
-          Serial.println("[OK] Upload iniciado");
-          currentState = STATE_UPLOADING;
-        } else {
-          Serial.println("[ERROR] No se pudo iniciar upload");
-          currentState = STATE_ERROR;
-        }
-        
-        stateStartTime = millis();
-      }
-      break;
-    }
-   
-    // ========================================================================
-    // ESTADO: UPLOADING
-    // ========================================================================
-    case STATE_UPLOADING: {
-      // Ejecutar loop de upload
-      holter_uploadLoop();
-      
-      // Mostrar estado periódicamente
-      static unsigned long lastStatusLog = 0;
-      if (millis() - lastStatusLog > 5000) {
-        String status = holter_getUploadStateString();
-        float progress = holter_getUploadProgress();
-        Serial.printf("[STATUS] %s (%.0f%%)\n", status.c_str(), progress * 100);
-        lastStatusLog = millis();
+#if HOLTER_EVENT_MODE
+      if (display_checkButton()) {
+        HOLTER_LOGI("[EVENT] Botón presionado");
+        holter_triggerEvent(EVENT_BUTTON);
       }
+#endif
       
-      // Verificar si terminó
-      if (!holter_isUploading()) {
-        UploadState uploadState = holter_getUploadState();
-        
-        if (uploadState == UPLOAD_COMPLETE) {
-          Serial.println("\n[UPLOAD] ¡Upload completado exitosamente!");
-          currentState = STATE_COMPLETE;
-        } else if (uploadState == UPLOAD_ERROR) {
-          Serial.println("\n[UPLOAD] Error en upload");
-          String error = holter_getLastError();
-          if (error.length() > 0) {
-            Serial.println("[ERROR] " + error);
-          }
-          currentState = STATE_ERROR;
-        }
-        
+      if (!holter_isCapturing()) {
+        queueCompletedSegments();
+        HOLTER_LOGI("\n[CAPTURE] ¡Grabación completada!");
+        HOLTER_LOGI("[INFO] %lu muestras ECG en %u segmentos",
+                    holter_getECGSampleCount(), (unsigned)holter_getSegmentSeq());
+        display_setText("Completo");
+        currentState = STATE_COMPLETE;
         stateStartTime = millis();
       }
+      
+      monitorUpload();
       break;
     }
-   
+    
     // ========================================================================
     // ESTADO: COMPLETE
     // ========================================================================
     case STATE_COMPLETE: {
-      // Desconectar WiFi para ahorrar energía
-      holter_disconnectWiFi();
-      
-      Serial.println("\n========================================");
-      Serial.println("✓ SESIÓN COMPLETADA EXITOSAMENTE");
-      Serial.println("========================================");
-      Serial.println("[INFO] Archivo capturado y subido a AWS S3");
-      Serial.println("[INFO] El sistema se reiniciará en 10 segundos");
-      Serial.println("[INFO] para iniciar una nueva sesión...");
-      Serial.println("========================================\n");
+      // Sin reinicio: se espera a que la tarea de red vacíe la cola y luego
+      // el equipo queda en reposo con los datos en SD
+      monitorUpload();
       
-      delay(10000);
-      
-      Serial.println("[SYSTEM] Reiniciando ESP32...\n");
-      delay(1000);
-      ESP.restart();
+      static bool idleReported = false;
+      if (!holter_isUploading() && !idleReported) {
+        HOLTER_LOGI("[SYSTEM] Todos los segmentos procesados, en reposo");
+        idleReported = true;
+      }
       break;
     }
    
@@ -200,23 +211,23 @@ void loop() {
         holter_disconnectWiFi();
       }
       
-      Serial.println("\n========================================");
-      Serial.println("✗ ERROR EN EL SISTEMA");
-      Serial.println("========================================");
+      HOLTER_LOGI("\n========================================");
+      HOLTER_LOGE("✗ ERROR EN EL SISTEMA");
+      HOLTER_LOGI("========================================");
       
-      String error = holter_getLastError();
-      if (error.length() > 0) {
-        Serial.println("[ERROR] " + error);
+      const char* error = holter_getLastError();
+      if (error[0] != '\0') {
+        HOLTER_LOGE("[ERROR] %s", error);
       }
       
-      Serial.println("\n[INFO] El sistema se reiniciará en 30 segundos");
-      Serial.println("[INFO] para intentar recuperarse...");
-      Serial.println("========================================\n");
+      HOLTER_LOGI("\n[INFO] El sistema se reiniciará en 30 segundos");
+      HOLTER_LOGI("[INFO] para intentar recuperarse...");
+      HOLTER_LOGI("========================================\n");
       
       delay(30000);
       
-      Serial.println("[SYSTEM] Reiniciando ESP32...\n");
-      delay(1000);
+      HOLTER_LOGI("[SYSTEM] Reiniciando ESP32...\n");
+      holter_logFlush();
       ESP.restart();
       break;
     }
@@ -226,13 +237,13 @@ void loop() {
     // ========================================================================
     case STATE_INIT:
     default: {
-      Serial.println("[WARNING] Estado inválido, reiniciando...");
-      delay(1000);
+      HOLTER_LOGW("[WARNING] Estado inválido, reiniciando...");
+      holter_logFlush();
       ESP.restart();
       break;
     }
   }
   
-  // Yield para el watchdog
-  yield();
-}
\ No newline at end of file
+  // La captura y el upload no dependen de loop(); ceder CPU al resto de tareas
+  delay(10);
+}
@@ -0,0 +1,136 @@
+#include <unity.h>
+#include <string.h>
+#include "ecg_blocks.h"
+
+// ============================================================================
+// BLOQUES ECG: índices alineados con descartes
+//
+// Cada muestra lleva su propio índice (I = bits bajos, II = bits altos):
+// después de forzar desbordes, la muestra i de un bloque entregado debe
+// ser la de índice firstIndex + i, que es el que usan IMU y picos R.
+// ============================================================================
+
+static ECGBlocks blocks;
+
+static ECGSample sampleFor(uint32_t index) {
+  ECGSample sample;
+  sample.derivation_I = (int16_t)(index & 0xFFFF);
+  sample.derivation_II = (int16_t)(index >> 16);
+  sample.derivation_III = 0;
+  return sample;
+}
+
+static uint32_t indexOf(const ECGSample& sample) {
+  return (uint16_t)sample.derivation_I | ((uint32_t)(uint16_t)sample.derivation_II << 16);
+}
+
+// Consumidor: verifica el bloque contra la línea de tiempo y lo libera
+struct Timeline {
+  uint32_t next;          // Índice siguiente a lo ya escrito
+  unsigned long written;
+  unsigned long gaps;
+};
+
+static void consume(Timeline& timeline, int block) {
+  size_t count = blocks.length[block].load();
+  TEST_ASSERT_TRUE(count > 0);
+  TEST_ASSERT_TRUE(blocks.firstIndex[block] >= timeline.next);
+
+  timeline.gaps += blocks.firstIndex[block] - timeline.next;
+  for (size_t i = 0; i < count; i++) {
+    TEST_ASSERT_EQUAL_UINT32(blocks.firstIndex[block] + i, indexOf(blocks.samples[block][i]));
+  }
+  timeline.next = blocks.firstIndex[block] + count;
+  timeline.written += count;
+  ecg_blocks_release(blocks, block);
+}
+
+void setUp() {
+  ecg_blocks_reset(blocks);
+}
+
+void tearDown() {}
+
+static void test_sin_descartes() {
+  Timeline timeline = {0, 0, 0};
+  const uint32_t TOTAL = 5 * ECG_BLOCK_SAMPLES + 17;
+
+  for (uint32_t i = 0; i < TOTAL; i++) {
+    int ready = ecg_blocks_append(blocks, sampleFor(i), i);
+    if (ready >= 0) consume(timeline, ready);
+  }
+  int partial = ecg_blocks_flush(blocks);
+  TEST_ASSERT_TRUE(partial >= 0);
+  consume(timeline, partial);
+
+  TEST_ASSERT_EQUAL_UINT32(TOTAL, timeline.written);
+  TEST_ASSERT_EQUAL_UINT32(0, timeline.gaps);
+  TEST_ASSERT_EQUAL_UINT32(0, blocks.dropped.load());
+}
+
+// El consumidor se atrasa: cada bloque se escribe recién varios bloques
+// después. Los descartes deben quedar como huecos del mismo tamaño
+static void test_desborde_deja_huecos_alineados() {
+  Timeline timeline = {0, 0, 0};
+  const uint32_t TOTAL = 20 * ECG_BLOCK_SAMPLES;
+  const uint32_t STALL = ECG_BLOCK_SAMPLES + 300;   // Muestras que tarda la "SD"
+  int pending = -1;
+  uint32_t pendingSince = 0;
+
+  for (uint32_t i = 0; i < TOTAL; i++) {
+    if (pending >= 0 && i - pendingSince >= STALL) {
+      consume(timeline, pending);
+      pending = -1;
+    }
+    int ready = ecg_blocks_append(blocks, sampleFor(i), i);
+    if (ready >= 0) {
+      TEST_ASSERT_EQUAL_INT(-1, pending);   // Como máximo un bloque pendiente
+      pending = ready;
+      pendingSince = i;
+    }
+  }
+  if (pending >= 0) consume(timeline, pending);
+  int partial = ecg_blocks_flush(blocks);
+  if (partial >= 0) consume(timeline, partial);
+
+  TEST_ASSERT_TRUE(blocks.dropped.load() > 0);
+  TEST_ASSERT_EQUAL_UINT32(blocks.dropped.load(), timeline.gaps);
+  TEST_ASSERT_EQUAL_UINT32(TOTAL, timeline.written + timeline.gaps);
+  TEST_ASSERT_EQUAL_UINT32(TOTAL, timeline.next);
+}
+
+// Con los dos bloques llenos todo se descarta; al liberar uno, el bloque
+// nuevo empieza en el índice de la primera muestra que entró
+static void test_bloque_tras_descarte_empieza_en_su_indice() {
+  uint32_t i = 0;
+  int first = -1;
+  for (; first < 0; i++) first = ecg_blocks_append(blocks, sampleFor(i), i);
+  // El segundo bloque se llena y no puede entregarse
+  for (; i < 2 * ECG_BLOCK_SAMPLES + 50; i++) {
+    TEST_ASSERT_EQUAL_INT(-1, ecg_blocks_append(blocks, sampleFor(i), i));
+  }
+  TEST_ASSERT_EQUAL_UINT32(50, blocks.dropped.load());
+
+  ecg_blocks_release(blocks, first);
+  int second = ecg_blocks_append(blocks, sampleFor(i), i);
+  TEST_ASSERT_EQUAL_INT(first ^ 1, second);
+  TEST_ASSERT_EQUAL_UINT32(ECG_BLOCK_SAMPLES, blocks.firstIndex[second]);
+
+  int partial = ecg_blocks_flush(blocks);
+  TEST_ASSERT_EQUAL_INT(first, partial);
+  TEST_ASSERT_EQUAL_UINT32(i, blocks.firstIndex[partial]);
+  TEST_ASSERT_EQUAL_UINT32(i, indexOf(blocks.samples[partial][0]));
+}
+
+static void test_flush_vacio() {
+  TEST_ASSERT_EQUAL_INT(-1, ecg_blocks_flush(blocks));
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_sin_descartes);
+  RUN_TEST(test_desborde_deja_huecos_alineados);
+  RUN_TEST(test_bloque_tras_descarte_empieza_en_su_indice);
+  RUN_TEST(test_flush_vacio);
+  return UNITY_END();
+}
@@ -0,0 +1,201 @@
+#include <unity.h>
+#include <string.h>
+#include "holter_recovery.h"
+#include "holter_crc.h"
+
+// ============================================================================
+// RECUPERACIÓN DE SEGMENTOS PREASIGNADOS
+//
+// Imagen en memoria de un segmento creado con su tamaño reservado: lo que
+// no se llegó a escribir conserva datos viejos de la tarjeta (basura o
+// bloques válidos de otro segmento).
+// ============================================================================
+
+static const char* NAME = "/session_1700000000_0003.bin";
+static const uint32_t SESSION = 1700000000;
+static const uint16_t SEQ = 3;
+static const uint32_t RESERVED_BLOCKS = 64;
+
+static uint8_t image[FILE_HEADER_BLOCK_SIZE + RESERVED_BLOCKS * DATA_BLOCK_SIZE];
+static size_t imageSize;
+static uint8_t block[DATA_BLOCK_SIZE];
+
+static bool readImage(void* ctx, uint32_t index, uint8_t* out) {
+  size_t offset = FILE_HEADER_BLOCK_SIZE + (size_t)index * DATA_BLOCK_SIZE;
+  if (offset + DATA_BLOCK_SIZE > imageSize) return false;
+  memcpy(out, image + offset, DATA_BLOCK_SIZE);
+  return true;
+}
+
+// Datos viejos de la tarjeta: pseudoaleatorios
+static void fillStale(size_t from, size_t to) {
+  uint32_t x = 0x12345678u;
+  for (size_t i = from; i < to; i++) {
+    x = x * 1664525u + 1013904223u;
+    image[i] = (uint8_t)(x >> 24);
+  }
+}
+
+static void writeHeader(uint32_t session, uint16_t seq, uint16_t version) {
+  FileHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = FILE_MAGIC;
+  header.version = version;
+  header.session_id = session;
+  header.segment_seq = seq;
+  memset(image, 0, FILE_HEADER_BLOCK_SIZE);
+  memcpy(image, &header, sizeof(header));
+}
+
+static void writeBlock(uint32_t index, uint16_t tag) {
+  uint8_t* out = image + FILE_HEADER_BLOCK_SIZE + (size_t)index * DATA_BLOCK_SIZE;
+  memset(out, 0, DATA_BLOCK_SIZE);
+  DataBlockHeader header;
+  memset(&header, 0, sizeof(header));
+  header.sync = DATA_BLOCK_SYNC;
+  header.type = DATA_BLOCK_ECG;
+  header.num_samples = 50;
+  header.first_ecg_index = index * 50;
+  header.segment_tag = tag;
+  header.payload_bytes = 10;
+  memcpy(out, &header, sizeof(header));
+  for (size_t i = sizeof(header); i < DATA_BLOCK_SIZE; i++) out[i] = (uint8_t)(index + i);
+  uint32_t crc = holter_crc32(0, out, DATA_BLOCK_SIZE);
+  memcpy(out + offsetof(DataBlockHeader, crc32), &crc, sizeof(crc));
+}
+
+static uint16_t segmentTag() {
+  return data_block_tag(SESSION, SEQ);
+}
+
+// Segmento reservado, con header y written bloques; el resto es basura
+static void preallocated(uint32_t written) {
+  imageSize = sizeof(image);
+  fillStale(0, imageSize);
+  writeHeader(SESSION, SEQ, FILE_FORMAT_VERSION);
+  for (uint32_t i = 0; i < written; i++) writeBlock(i, segmentTag());
+}
+
+static SegmentRecovery check(uint32_t* keep) {
+  FileHeader header;
+  const FileHeader* read = nullptr;
+  if (imageSize >= FILE_HEADER_BLOCK_SIZE) {
+    memcpy(&header, image, sizeof(header));
+    read = &header;
+  }
+  return recovery_check(NAME, read, imageSize, readImage, nullptr, block, keep);
+}
+
+void setUp() {
+  memset(image, 0, sizeof(image));
+  imageSize = 0;
+}
+
+void tearDown() {}
+
+static void test_cerrado_queda_intacto() {
+  preallocated(10);
+  imageSize = FILE_HEADER_BLOCK_SIZE + 10 * DATA_BLOCK_SIZE;   // Recortado al cerrar
+  uint32_t keep;
+  TEST_ASSERT_EQUAL_INT(SEGMENT_INTACT, check(&keep));
+  TEST_ASSERT_EQUAL_UINT32(10, keep);
+}
+
+static void test_parcial_se_recorta_tras_el_ultimo_bloque() {
+  uint32_t keep;
+  for (uint32_t written = 1; written < RESERVED_BLOCKS; written += 7) {
+    preallocated(written);
+    TEST_ASSERT_EQUAL_INT(SEGMENT_TRIM, check(&keep));
+    TEST_ASSERT_EQUAL_UINT32(written, keep);
+  }
+}
+
+// La reserva cae sobre un segmento viejo: sus bloques tienen CRC válido
+// pero otra etiqueta y no se confunden con datos de este
+static void test_bloques_viejos_con_crc_valido_no_cuentan() {
+  preallocated(5);
+  uint16_t otherTag = data_block_tag(SESSION - 86400, 1);
+  for (uint32_t i = 5; i < RESERVED_BLOCKS; i++) writeBlock(i, otherTag);
+  uint32_t keep;
+  TEST_ASSERT_EQUAL_INT(SEGMENT_TRIM, check(&keep));
+  TEST_ASSERT_EQUAL_UINT32(5, keep);
+}
+
+// Corte después del header y antes del primer bloque de datos
+static void test_reset_antes_del_primer_bloque_borra() {
+  preallocated(0);
+  uint32_t keep;
+  TEST_ASSERT_EQUAL_INT(SEGMENT_REMOVE, check(&keep));
+
+  // Solo el header (sin reserva)
+  imageSize = FILE_HEADER_BLOCK_SIZE;
+  TEST_ASSERT_EQUAL_INT(SEGMENT_REMOVE, check(&keep));
+}
+
+// Corte con el archivo ya reservado pero antes de escribir el header
+static void test_reset_antes_del_header_borra() {
+  uint32_t keep;
+  imageSize = sizeof(image);
+  fillStale(0, imageSize);
+  TEST_ASSERT_EQUAL_INT(SEGMENT_REMOVE, check(&keep));
+
+  // El sector 0 tiene el header de otro segmento
+  writeHeader(SESSION - 86400, 1, FILE_FORMAT_VERSION);
+  TEST_ASSERT_EQUAL_INT(SEGMENT_REMOVE, check(&keep));
+
+  // Archivo creado sin tamaño todavía en el directorio
+  imageSize = 0;
+  TEST_ASSERT_EQUAL_INT(SEGMENT_REMOVE, check(&keep));
+}
+
+static void test_ultimo_bloque_cortado() {
+  preallocated(8);
+  image[FILE_HEADER_BLOCK_SIZE + 7 * DATA_BLOCK_SIZE + 300] ^= 0xFF;
+  uint32_t keep;
+  TEST_ASSERT_EQUAL_INT(SEGMENT_TRIM, check(&keep));
+  TEST_ASSERT_EQUAL_UINT32(7, keep);
+}
+
+static void test_cola_menor_a_un_bloque() {
+  preallocated(4);
+  imageSize = FILE_HEADER_BLOCK_SIZE + 4 * DATA_BLOCK_SIZE + 100;
+  uint32_t keep;
+  TEST_ASSERT_EQUAL_INT(SEGMENT_TRIM, check(&keep));
+  TEST_ASSERT_EQUAL_UINT32(4, keep);
+}
+
+static void test_version_anterior_no_se_toca() {
+  preallocated(0);
+  writeHeader(SESSION, SEQ, 8);
+  uint32_t keep;
+  TEST_ASSERT_EQUAL_INT(SEGMENT_INTACT, check(&keep));
+}
+
+// Nombre sin ceros (firmware anterior, reloj sin hora)
+static void test_nombre_sin_ceros() {
+  imageSize = FILE_HEADER_BLOCK_SIZE + 2 * DATA_BLOCK_SIZE;
+  writeHeader(42, 1, FILE_FORMAT_VERSION);
+  writeBlock(0, data_block_tag(42, 1));
+  writeBlock(1, data_block_tag(42, 1));
+  FileHeader header;
+  memcpy(&header, image, sizeof(header));
+  uint32_t keep;
+  TEST_ASSERT_EQUAL_INT(SEGMENT_INTACT, recovery_check("/session_42_0001.bin", &header, imageSize,
+                                                       readImage, nullptr, block, &keep));
+  TEST_ASSERT_EQUAL_INT(SEGMENT_INTACT, recovery_check("/session_0000000042_0001.bin", &header,
+                                                       imageSize, readImage, nullptr, block, &keep));
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_cerrado_queda_intacto);
+  RUN_TEST(test_parcial_se_recorta_tras_el_ultimo_bloque);
+  RUN_TEST(test_bloques_viejos_con_crc_valido_no_cuentan);
+  RUN_TEST(test_reset_antes_del_primer_bloque_borra);
+  RUN_TEST(test_reset_antes_del_header_borra);
+  RUN_TEST(test_ultimo_bloque_cortado);
+  RUN_TEST(test_cola_menor_a_un_bloque);
+  RUN_TEST(test_version_anterior_no_se_toca);
+  RUN_TEST(test_nombre_sin_ceros);
+  return UNITY_END();
+}